@@ -0,0 +1,15 @@
+find_path(LZ4_INCLUDE_DIR
+  NAMES lz4frame.h
+)
+
+find_library(LZ4_LIBRARY
+  NAMES lz4
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4
+  FOUND_VAR LZ4_FOUND
+  REQUIRED_VARS
+    LZ4_LIBRARY
+    LZ4_INCLUDE_DIR
+)
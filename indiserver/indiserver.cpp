@@ -49,6 +49,7 @@
 #endif
 
 #include "config.h"
+#include <algorithm>
 #include <set>
 #include <string>
 #include <list>
@@ -57,6 +58,7 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 #include <assert.h>
 
@@ -65,6 +67,7 @@
 #include "sharedblob.h"
 #include "lilxml.h"
 #include "base64.h"
+#include "routingindex.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -87,6 +90,7 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/un.h>
@@ -100,7 +104,8 @@
 #define INDIUNIXSOCK "/tmp/indiserver" /* default unix socket path (local connections) */
 #define MAXSBUF       512
 #define MAXRBUF       49152 /* max read buffering here */
-#define MAXWSIZ       49152 /* max bytes/write */
+#define DEFMAXWSIZ    1024  /* default max bytes/write, KB */
+#define MAXIOV        64    /* max chunks gathered per write */
 #define SHORTMSGSIZ   2048  /* buf size for most messages */
 #define DEFMAXQSIZ    128   /* default max q behind, MB */
 #define DEFMAXSSIZ    5     /* default max stream behind, MB */
@@ -251,6 +256,12 @@ class Collectable
         {
             return HeartBeat(id, current);
         }
+
+        /* id in the current ConcurrentSet, 0 if none */
+        unsigned long getId() const
+        {
+            return id;
+        }
 };
 
 /**
@@ -278,6 +289,53 @@ class Msg;
 class MsgQueue;
 class MsgChunckIterator;
 
+/* A thread parsing the data read from connections (-j option), so a large
+ * message does not stall the event loop.
+ * A connection is bound to one ParserThread and has at most one chunk being
+ * parsed at a time, so its messages are still processed in order.
+ */
+class ParserThread
+{
+    public:
+        /* A chunk of data read from a connection and the result of its parsing */
+        struct Job
+        {
+            MsgQueue * owner;       /* nullptr once the connection is gone */
+            LilXML * lp;            /* parsing context of the connection */
+            std::vector<char> data;
+            XMLEle ** nodes = nullptr;
+            char err[1024];
+        };
+
+    private:
+        std::mutex lock;
+        std::condition_variable pendingCond;
+        std::list<Job *> pending;   /* Jobs to parse */
+        std::list<Job *> done;      /* Jobs parsed, to give back to their owner */
+        ev::async doneEv;
+
+        /* Parse the pending jobs, forever */
+        void run();
+
+        /* Called within main loop when some jobs were parsed */
+        void onDone();
+
+        static std::vector<ParserThread *> threads;
+        static unsigned long assigned;
+
+    public:
+        ParserThread();
+
+        /* Queue data for parsing with lp. owner->onParsed will receive the Job in the main loop */
+        Job * push(MsgQueue * owner, LilXML * lp, const char * data, size_t len);
+
+        /* Start count parser threads */
+        static void start(int count);
+
+        /* Return the parser thread of a new connection, or nullptr to parse in the main loop */
+        static ParserThread * assign();
+};
+
 class SerializationRequirement
 {
         friend class Msg;
@@ -524,6 +582,9 @@ class MsgQueue: public Collectable
 
         std::set<SerializedMsg*> readBlocker;     /* The message that block this queue */
 
+        ParserThread * parser;                   /* Where to parse, or nullptr for inline */
+        ParserThread::Job * parsing = nullptr;   /* The chunk being parsed by parser */
+
         std::list<SerializedMsg*> msgq;           /* To send msg queue */
         std::list<int> incomingSharedBuffers; /* During reception, fds accumulate here */
 
@@ -534,6 +595,9 @@ class MsgQueue: public Collectable
         size_t doRead(char * buff, size_t len);
         void readFromFd();
 
+        /* Handle the messages parsed from a chunk, then free the nodes array */
+        void processNodes(XMLEle ** nodes);
+
         /* write the next chunk of the current message in the queue to the given
          * client. pop message from queue when complete and free the message if we are
          * the last one to use it. shut down this client if trouble.
@@ -587,6 +651,9 @@ class MsgQueue: public Collectable
 
         void setFds(int rFd, int wFd);
 
+        /* Result of the parsing of a chunk by parser */
+        void onParsed(ParserThread::Job * job);
+
         virtual bool acceptSharedBuffers() const
         {
             return useSharedBuffer;
@@ -651,6 +718,9 @@ class ClInfo: public MsgQueue
         /* close down the given client */
         virtual void close();
 
+        /* Update allprops, keeping allPropsClients in sync */
+        void setAllProps(int allprops);
+
     public:
         std::list<Property*> props;     /* props we want */
         int allprops = 0;               /* saw getProperties w/o device */
@@ -680,6 +750,12 @@ class ClInfo: public MsgQueue
 
         /* Reference to all active clients */
         static ConcurrentSet<ClInfo> clients;
+
+        /* props of all clients, by device and name */
+        static RoutingIndex<Property> propsIndex;
+
+        /* ids of the clients with allprops set */
+        static std::set<unsigned long> allPropsClients;
 };
 
 /* info for each connected driver */
@@ -703,6 +779,8 @@ class DvrInfo: public MsgQueue
         /* override to kill driver that are not reachable anymore */
         virtual void closeWritePart();
 
+        /* add dev to the devices served by this driver */
+        void addDevice(const std::string &dev);
 
         /* Construct an instance that will start the same driver */
         DvrInfo(const DvrInfo &model);
@@ -748,6 +826,12 @@ class DvrInfo: public MsgQueue
         /* Reference to all active drivers */
         static ConcurrentSet<DvrInfo> drivers;
 
+        /* sprops of all drivers, by device and name */
+        static RoutingIndex<Property> snoopIndex;
+
+        /* ids of the drivers serving each device */
+        static std::unordered_map<std::string, std::set<unsigned long>> devIndex;
+
         // decoding of attached blobs from driver is not supported ATM. Be conservative here
         virtual bool acceptSharedBuffers() const
         {
@@ -880,6 +964,8 @@ static char *ldir;                                     /* where to log driver me
 static unsigned int maxqsiz  = (DEFMAXQSIZ * 1024 * 1024); /* kill if these bytes behind */
 static unsigned int maxstreamsiz  = (DEFMAXSSIZ * 1024 * 1024); /* drop blobs if these bytes behind while streaming*/
 static int maxrestarts   = DEFMAXRESTART;
+static unsigned int maxwsiz  = (DEFMAXWSIZ * 1024);   /* max bytes sent per write */
+static int parserThreads = 0;                          /* threads parsing incoming xml, 0 for main loop */
 
 static std::vector<XMLEle *> findBlobElements(XMLEle * root);
 
@@ -952,6 +1038,17 @@ int main(int ac, char *av[])
                     port = atoi(*++av);
                     ac--;
                     break;
+                case 'w':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-w requires max KB per write\n");
+                        usage();
+                    }
+                    maxwsiz = 1024 * atoi(*++av);
+                    if (maxwsiz == 0)
+                        maxwsiz = 1024;
+                    ac--;
+                    break;
                 case 'd':
                     if (ac < 2)
                     {
@@ -992,6 +1089,17 @@ int main(int ac, char *av[])
                         maxrestarts = 0;
                     ac--;
                     break;
+                case 'j':
+                    if (ac < 2)
+                    {
+                        fprintf(stderr, "-j requires number of parser threads\n");
+                        usage();
+                    }
+                    parserThreads = atoi(*++av);
+                    if (parserThreads < 0)
+                        parserThreads = 0;
+                    ac--;
+                    break;
                 case 'v':
                     verbose++;
                     break;
@@ -1008,6 +1116,9 @@ int main(int ac, char *av[])
     /* take care of some unixisms */
     noSIGPIPE();
 
+    /* start parser threads, if any */
+    ParserThread::start(parserThreads);
+
     /* start each driver */
     while (ac-- > 0)
     {
@@ -1081,8 +1192,10 @@ static void usage(void)
     fprintf(stderr, " -u path  : Path for the local connection socket (abstract), default %s\n", INDIUNIXSOCK);
 #endif
     fprintf(stderr, " -p p     : alternate IP port, default %d\n", INDIPORT);
+    fprintf(stderr, " -w k     : max KB sent to a connection per write, default %d\n", DEFMAXWSIZ);
     fprintf(stderr, " -r r     : maximum driver restarts on error, default %d\n", DEFMAXRESTART);
     fprintf(stderr, " -f path  : Path to fifo for dynamic startup and shutdown of drivers.\n");
+    fprintf(stderr, " -j n     : parse incoming messages in n threads, default 0 (in the main loop)\n");
     fprintf(stderr, " -v       : show key events, no traffic\n");
     fprintf(stderr, " -vv      : -v + key message content\n");
     fprintf(stderr, " -vvv     : -vv + complete xml\n");
@@ -1316,7 +1429,7 @@ void RemoteDvrInfo::start()
      * dev.
      */
     if (!dev.empty())
-        this->dev.insert(dev);
+        this->addDevice(dev);
 
     /* Sending getProperties with device lets remote server limit its
      * outbound (and our inbound) traffic on this socket to this device.
@@ -1862,10 +1975,11 @@ void Fifo::ioCb(ev::io &, int revents)
 void ClInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
 {
     char *roottag    = tagXMLEle(root);
+    XMLSymbol rootid = tagIdXMLEle(root);
 
-    const char *dev  = findXMLAttValu(root, "device");
-    const char *name = findXMLAttValu(root, "name");
-    int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
+    const char *dev  = findXMLAttValuById(root, XMLSYM_device);
+    const char *name = findXMLAttValuById(root, XMLSYM_name);
+    int isblob       = rootid == XMLSYM_setBLOBVector;
 
     /* snag interested properties.
      * N.B. don't open to alldevs if seen specific dev already, else
@@ -1876,18 +1990,18 @@ void ClInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
         // Signature for CHAINED SERVER
         // Not a regular client.
         if (dev[0] == '*' && !this->props.size())
-            this->allprops = 2;
+            setAllProps(2);
         else
             addDevice(dev, name, isblob);
     }
-    else if (!strcmp(roottag, "getProperties") && !this->props.size() && this->allprops != 2)
-        this->allprops = 1;
+    else if (rootid == XMLSYM_getProperties && !this->props.size() && this->allprops != 2)
+        setAllProps(1);
 
     /* snag enableBLOB -- send to remote drivers too */
-    if (!strcmp(roottag, "enableBLOB"))
+    if (rootid == XMLSYM_enableBLOB)
         crackBLOBHandling(dev, name, pcdataXMLEle(root));
 
-    if (!strcmp(roottag, "pingRequest"))
+    if (rootid == XMLSYM_pingRequest)
     {
         setXMLEleTag(root, "pingReply");
 
@@ -1927,10 +2041,10 @@ void ClInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
 
 void DvrInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
 {
-    char *roottag    = tagXMLEle(root);
-    const char *dev  = findXMLAttValu(root, "device");
-    const char *name = findXMLAttValu(root, "name");
-    int isblob       = !strcmp(tagXMLEle(root), "setBLOBVector");
+    XMLSymbol rootid = tagIdXMLEle(root);
+    const char *dev  = findXMLAttValuById(root, XMLSYM_device);
+    const char *name = findXMLAttValuById(root, XMLSYM_name);
+    int isblob       = rootid == XMLSYM_setBLOBVector;
 
     if (verbose > 2)
         traceMsg("read ", root);
@@ -1942,7 +2056,7 @@ void DvrInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
 
     /* that's all if driver is just registering a snoop */
     /* JM 2016-05-18: Send getProperties to upstream chained servers as well.*/
-    if (!strcmp(roottag, "getProperties"))
+    if (rootid == XMLSYM_getProperties)
     {
         this->addSDevice(dev, name);
         Msg *mp = new Msg(this, root);
@@ -1959,7 +2073,7 @@ void DvrInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
     }
 
     /* that's all if driver desires to snoop BLOBs from other drivers */
-    if (!strcmp(roottag, "enableBLOB"))
+    if (rootid == XMLSYM_enableBLOB)
     {
         Property *sp = findSDevice(dev, name);
         if (sp)
@@ -1976,14 +2090,14 @@ void DvrInfo::onMessage(XMLEle * root, std::list<int> &sharedBuffers)
             fprintf(stderr, "STARTED \"%s\"\n", dp->name.c_str());
         fflush(stderr);
 #endif
-        this->dev.insert(dev);
+        addDevice(dev);
     }
 
     /* log messages if any and wanted */
     if (ldir)
         logDMsg(root, dev);
 
-    if (!strcmp(roottag, "pingRequest"))
+    if (rootid == XMLSYM_pingRequest)
     {
         setXMLEleTag(root, "pingReply");
 
@@ -2089,14 +2203,25 @@ void DvrInfo::close()
 
 void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
 {
-    char *roottag = tagXMLEle(root);
+    XMLSymbol rootid = tagIdXMLEle(root);
 
     /* queue message to each interested driver.
      * N.B. don't send generic getProps to more than one remote driver,
      *   otherwise they all fan out and we get multiple responses back.
      */
     std::set<std::string> remoteAdvertised;
-    for (auto dpId : drivers.ids())
+    std::vector<unsigned long> dpIds;
+    if (dev.empty() || dev[0] == '*')
+        dpIds = drivers.ids();
+    else
+    {
+        /* only drivers known to support this dev */
+        auto handlers = devIndex.find(dev);
+        if (handlers != devIndex.end())
+            dpIds.assign(handlers->second.begin(), handlers->second.end());
+    }
+
+    for (auto dpId : dpIds)
     {
         auto dp = drivers[dpId];
         if (dp == nullptr) continue;
@@ -2104,10 +2229,6 @@ void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
         std::string remoteUid = dp->remoteServerUid();
         bool isRemote = !remoteUid.empty();
 
-        /* driver known to not support this dev */
-        if ((!dev.empty()) && dev[0] != '*' && !dp->isHandlingDevice(dev))
-            continue;
-
         /* Only send message to each *unique* remote driver at a particular host:port
          * Since it will be propagated to all other devices there */
         if (dev.empty() && isRemote)
@@ -2121,7 +2242,7 @@ void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
         }
 
         /* JM 2016-10-30: Only send enableBLOB to remote drivers */
-        if (isRemote == 0 && !strcmp(roottag, "enableBLOB"))
+        if (isRemote == 0 && rootid == XMLSYM_enableBLOB)
             continue;
 
         /* ok: queue message to this driver */
@@ -2139,16 +2260,19 @@ void DvrInfo::q2RDrivers(const std::string &dev, Msg *mp, XMLEle *root)
 void DvrInfo::q2SDrivers(DvrInfo *me, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root)
 {
     std::string meRemoteServerUid = me ? me->remoteServerUid() : "";
-    for (auto dpId : drivers.ids())
+
+    /* only drivers snooping for dev/name */
+    RoutingIndex<Property>::Entries snoopers;
+    snoopIndex.match(dev, name, snoopers);
+
+    for (auto entry : snoopers)
     {
-        auto dp = drivers[dpId];
+        auto dp = drivers[entry.first];
         if (dp == nullptr) continue;
 
-        Property *sp = dp->findSDevice(dev, name);
+        Property *sp = entry.second;
 
-        /* nothing for dp if not snooping for dev/name or wrong BLOB mode */
-        if (!sp)
-            continue;
+        /* nothing for dp if wrong BLOB mode */
         if ((isblob && sp->blob == B_NEVER) || (!isblob && sp->blob == B_ONLY))
             continue;
 
@@ -2182,6 +2306,7 @@ void DvrInfo::addSDevice(const std::string &dev, const std::string &name)
     sp = new Property(dev, name);
     sp->blob = B_NEVER;
     sprops.push_back(sp);
+    snoopIndex.add(dev, name, getId(), sp);
 
     if (verbose)
         log(fmt("snooping on %s.%s\n", dev.c_str(), name.c_str()));
@@ -2189,28 +2314,53 @@ void DvrInfo::addSDevice(const std::string &dev, const std::string &name)
 
 Property * DvrInfo::findSDevice(const std::string &dev, const std::string &name) const
 {
-    for(auto sp : sprops)
-    {
-        if ((sp->dev == dev) && (sp->name.empty() || sp->name == name))
-            return (sp);
-    }
+    /* a snoop on the whole device is only recorded if no snoop on one of its
+     * properties was seen before, so the index precedence matches sprops order
+     */
+    return snoopIndex.find(dev, name, getId());
+}
 
-    return nullptr;
+void DvrInfo::addDevice(const std::string &dev)
+{
+    if (this->dev.insert(dev).second)
+        devIndex[dev].insert(getId());
 }
 
 void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const std::string &name, Msg *mp, XMLEle *root)
 {
+    /* clients that want this dev/name: all of them for an empty dev, else the
+     * ones with allprops and the ones with a matching prop
+     */
+    std::set<unsigned long> cpIds;
+    if (dev.empty())
+    {
+        auto ids = clients.ids();
+        cpIds.insert(ids.begin(), ids.end());
+    }
+    else
+    {
+        cpIds = allPropsClients;
+        for (auto entries : { propsIndex.find(dev, name), propsIndex.find(dev, std::string()) })
+        {
+            if (entries == nullptr)
+                continue;
+            for (auto entry : *entries)
+                cpIds.insert(entry.first);
+        }
+    }
+
+    /* props registered for this exact dev/name, holding their BLOB policy */
+    auto blobProps = isblob ? propsIndex.find(dev, name) : nullptr;
+
     /* queue message to each interested client */
-    for (auto cpId : clients.ids())
+    for (auto cpId : cpIds)
     {
         auto cp = clients[cpId];
         if (cp == nullptr) continue;
 
-        /* cp in use? notme? want this dev/name? blob? */
+        /* cp in use? notme? blob? */
         if (cp == notme)
             continue;
-        if (cp->findDevice(dev, name) < 0)
-            continue;
 
         //if ((isblob && cp->blob==B_NEVER) || (!isblob && cp->blob==B_ONLY))
         if (!isblob && cp->blob == B_ONLY)
@@ -2221,13 +2371,11 @@ void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const
             if (cp->props.size() > 0)
             {
                 Property *blobp = nullptr;
-                for (auto pp : cp->props)
+                if (blobProps)
                 {
-                    if (pp->dev == dev && pp->name == name)
-                    {
-                        blobp = pp;
-                        break;
-                    }
+                    auto e = blobProps->find(cpId);
+                    if (e != blobProps->end())
+                        blobp = e->second;
                 }
 
                 if ((blobp && blobp->blob == B_NEVER) || (!blobp && cp->blob == B_NEVER))
@@ -2247,9 +2395,9 @@ void ClInfo::q2Clients(ClInfo *notme, int isblob, const std::string &dev, const
             int streamFound = 0;
             for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
             {
-                if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
+                if (tagIdXMLEle(ep) == XMLSYM_oneBLOB)
                 {
-                    XMLAtt *fa = findXMLAtt(ep, "format");
+                    XMLAtt *fa = findXMLAttById(ep, XMLSYM_format);
 
                     if (fa && strstr(valuXMLAtt(fa), "stream"))
                     {
@@ -2378,22 +2526,68 @@ void MsgQueue::writeToFd()
     }
     while(nsend == 0);
 
-    /* send next chunk, never more than MAXWSIZ to reduce blocking */
-    if (nsend > MAXWSIZ)
-        nsend = MAXWSIZ;
+    /* gather the chunks ready to be sent, from this message and the following
+     * ones, never more than maxwsiz to reduce blocking.
+     * Chunks with buffers to attach always start a write, so the fds are
+     * attached to the same data as before.
+     */
+    struct iovec iov[MAXIOV];
+    int iovcnt = 0;
+    ssize_t total = 0;
+    std::vector<int> fds = sharedBuffers;
+    std::vector<int> chunkFds;
+
+    MsgChunckIterator pos = nsent;
+    for (auto it = msgq.begin(); it != msgq.end(); ++it)
+    {
+        if (it != msgq.begin())
+        {
+            // Start producing the next message, if not done yet
+            pos.reset();
+            if (!(*it)->requestContent(pos))
+                break;
+        }
+
+        bool more = true;
+        while (iovcnt < MAXIOV && total < (ssize_t)maxwsiz)
+        {
+            if (!(*it)->getContent(pos, data, nsend, chunkFds) || (iovcnt > 0 && !chunkFds.empty()))
+            {
+                // Not ready yet, or buffers to attach
+                more = false;
+                break;
+            }
+            if (nsend == 0)
+            {
+                // End of message, continue with next one
+                break;
+            }
+
+            if (nsend > (ssize_t)maxwsiz - total)
+                nsend = maxwsiz - total;
+
+            iov[iovcnt].iov_base = data;
+            iov[iovcnt].iov_len = nsend;
+            iovcnt++;
+            total += nsend;
+
+            (*it)->advance(pos, nsend);
+        }
+        if (!more || iovcnt == MAXIOV || total >= (ssize_t)maxwsiz)
+            break;
+    }
 
     if (!useSharedBuffer)
     {
-        nw = write(wFd, data, nsend);
+        nw = writev(wFd, iov, iovcnt);
     }
     else
     {
         struct msghdr msgh;
-        struct iovec iov[1];
         int cmsghdrlength;
         struct cmsghdr * cmsgh;
 
-        int fdCount = sharedBuffers.size();
+        int fdCount = fds.size();
         if (fdCount > 0)
         {
             if (fdCount > MAXFD_PER_MESSAGE)
@@ -2416,7 +2610,7 @@ void MsgQueue::writeToFd()
             msgh.msg_controllen = cmsghdrlength;
             for(int i = 0; i < fdCount; ++i)
             {
-                ((int *) CMSG_DATA(CMSG_FIRSTHDR(&msgh)))[i] = sharedBuffers[i];
+                ((int *) CMSG_DATA(CMSG_FIRSTHDR(&msgh)))[i] = fds[i];
             }
         }
         else
@@ -2427,14 +2621,11 @@ void MsgQueue::writeToFd()
             msgh.msg_controllen = cmsghdrlength;
         }
 
-        iov[0].iov_base = data;
-        iov[0].iov_len = nsend;
-
         msgh.msg_flags = 0;
         msgh.msg_name = NULL;
         msgh.msg_namelen = 0;
         msgh.msg_iov = iov;
-        msgh.msg_iovlen = 1;
+        msgh.msg_iovlen = iovcnt;
 
         nw = sendmsg(wFd, &msgh,  MSG_NOSIGNAL);
 
@@ -2455,22 +2646,40 @@ void MsgQueue::writeToFd()
     }
 
     /* trace */
-    if (verbose > 2)
+    if (verbose > 1)
     {
-        log(fmt("sending msg nq %ld:\n%.*s\n",
-                msgq.size(), (int)nw, data));
-    }
-    else if (verbose > 1)
-    {
-        log(fmt("sending %.*s\n", (int)nw, data));
+        ssize_t left = nw;
+        for (int i = 0; i < iovcnt && left > 0; ++i)
+        {
+            int len = std::min((ssize_t)iov[i].iov_len, left);
+            if (verbose > 2)
+                log(fmt("sending msg nq %ld:\n%.*s\n", msgq.size(), len, (char*)iov[i].iov_base));
+            else
+                log(fmt("sending %.*s\n", len, (char*)iov[i].iov_base));
+            left -= len;
+        }
     }
 
     /* update amount sent. when complete: free message if we are the last
      * to use it and pop from our queue.
      */
-    mp->advance(nsent, nw);
-    if (nsent.done())
-        consumeHeadMsg();
+    while (nw > 0)
+    {
+        mp = headMsg();
+        mp->getContent(nsent, data, nsend, chunkFds);
+        if (nsend == 0)
+        {
+            consumeHeadMsg();
+            continue;
+        }
+        if (nsend > nw)
+            nsend = nw;
+
+        mp->advance(nsent, nsend);
+        nw -= nsend;
+        if (nsent.done())
+            consumeHeadMsg();
+    }
 }
 
 void MsgQueue::log(const std::string &str) const
@@ -2511,6 +2720,16 @@ void ClInfo::addDevice(const std::string &dev, const std::string &name, int isbl
     /* add */
     Property *pp = new Property(dev, name);
     props.push_back(pp);
+    propsIndex.add(dev, name, getId(), pp);
+}
+
+void ClInfo::setAllProps(int allprops)
+{
+    this->allprops = allprops;
+    if (allprops >= 1)
+        allPropsClients.insert(getId());
+    else
+        allPropsClients.erase(getId());
 }
 
 void MsgQueue::crackBLOB(const char *enableBLOB, BLOBHandling *bp)
@@ -2654,11 +2873,22 @@ DvrInfo::DvrInfo(const DvrInfo &model):
 
 DvrInfo::~DvrInfo()
 {
-    drivers.erase(this);
+    for (auto &d : dev)
+    {
+        auto handlers = devIndex.find(d);
+        if (handlers == devIndex.end())
+            continue;
+        handlers->second.erase(getId());
+        if (handlers->second.empty())
+            devIndex.erase(handlers);
+    }
+
     for(auto prop : sprops)
     {
+        snoopIndex.remove(prop->dev, prop->name, getId());
         delete prop;
     }
+    drivers.erase(this);
 }
 
 bool DvrInfo::isHandlingDevice(const std::string &dev) const
@@ -2676,6 +2906,8 @@ void DvrInfo::log(const std::string &str) const
 }
 
 ConcurrentSet<DvrInfo> DvrInfo::drivers;
+RoutingIndex<Property> DvrInfo::snoopIndex;
+std::unordered_map<std::string, std::set<unsigned long>> DvrInfo::devIndex;
 
 LocalDvrInfo::LocalDvrInfo(): DvrInfo(true)
 {
@@ -2815,8 +3047,10 @@ ClInfo::~ClInfo()
 {
     for(auto prop : props)
     {
+        propsIndex.remove(prop->dev, prop->name, getId());
         delete prop;
     }
+    allPropsClients.erase(getId());
 
     clients.erase(this);
 }
@@ -2829,6 +3063,8 @@ void ClInfo::log(const std::string &str) const
 }
 
 ConcurrentSet<ClInfo> ClInfo::clients;
+RoutingIndex<Property> ClInfo::propsIndex;
+std::set<unsigned long> ClInfo::allPropsClients;
 
 SerializedMsg::SerializedMsg(Msg * parent) : asyncProgress(), owner(parent), awaiters(), chuncks(), ownBuffers()
 {
@@ -3093,7 +3329,7 @@ Msg::Msg(MsgQueue * from, XMLEle * ele): sharedBuffers()
     queueSize = sprlXMLEle(xmlContent, 0);
     for(auto blobContent : findBlobElements(xmlContent))
     {
-        std::string attached = findXMLAttValu(blobContent, "attached");
+        std::string attached = findXMLAttValuById(blobContent, XMLSYM_attached);
         if (attached == "true")
         {
             hasSharedBufferBlobs = true;
@@ -3185,7 +3421,7 @@ void Msg::prune()
 
 bool parseBlobSize(XMLEle * blobWithAttachedBuffer, ssize_t &size)
 {
-    std::string sizeStr = findXMLAttValu(blobWithAttachedBuffer, "size");
+    std::string sizeStr = findXMLAttValuById(blobWithAttachedBuffer, XMLSYM_size);
     if (sizeStr == "")
     {
         return false;
@@ -3213,7 +3449,7 @@ bool Msg::fetchBlobs(std::list<int> &incomingSharedBuffers)
             return false;
         }
 
-        std::string attached = findXMLAttValu(blobContent, "attached");
+        std::string attached = findXMLAttValuById(blobContent, XMLSYM_attached);
         if (attached == "true")
         {
             if (incomingSharedBuffers.empty())
@@ -3303,7 +3539,7 @@ bool SerializedMsgWithSharedBuffer::detectInlineBlobs()
     for(auto blobContent : findBlobElements(owner->xmlContent))
     {
         // C'est pas trivial, dans ce cas, car il faut les réattacher
-        std::string attached = findXMLAttValu(blobContent, "attached");
+        std::string attached = findXMLAttValuById(blobContent, XMLSYM_attached);
         if (attached != "true")
         {
             return true;
@@ -3353,7 +3589,7 @@ void SerializedMsgWithoutSharedBuffer::generateContent()
     // Identify base64 blob to avoid copying them (we'll copy the cdata)
     for(auto blobContent : findBlobElements(xmlContent))
     {
-        std::string attached = findXMLAttValu(blobContent, "attached");
+        std::string attached = findXMLAttValuById(blobContent, XMLSYM_attached);
 
         if (attached != "true" && pcdatalenXMLEle(blobContent) == 0)
         {
@@ -3539,7 +3775,7 @@ void SerializedMsgWithSharedBuffer::generateContent()
         {
             continue;
         }
-        std::string attached = findXMLAttValu(blobContent, "attached");
+        std::string attached = findXMLAttValuById(blobContent, XMLSYM_attached);
         if (attached != "true")
         {
             // We need to replace.
@@ -3613,6 +3849,8 @@ void SerializedMsgWithSharedBuffer::generateContent()
 MsgQueue::MsgQueue(bool useSharedBuffer): useSharedBuffer(useSharedBuffer)
 {
     lp = newLilXML();
+    lilxmlArena(lp, 1);
+    parser = ParserThread::assign();
     rio.set<MsgQueue, &MsgQueue::ioCb>(this);
     wio.set<MsgQueue, &MsgQueue::ioCb>(this);
     rFd = -1;
@@ -3625,7 +3863,16 @@ MsgQueue::~MsgQueue()
     wio.stop();
 
     clearMsgQueue();
-    delLilXML(lp);
+    if (parsing)
+    {
+        // The parser thread may still use lp. It will release it with the job.
+        parsing->owner = nullptr;
+        parsing = nullptr;
+    }
+    else
+    {
+        delLilXML(lp);
+    }
     lp = nullptr;
 
     setFds(-1, -1);
@@ -3756,7 +4003,7 @@ void MsgQueue::updateIos()
             wio.start();
         }
     }
-    if (rFd != -1)
+    if (rFd != -1 && !parsing)
     {
         rio.start();
     }
@@ -3829,7 +4076,7 @@ size_t MsgQueue::doRead(char * buf, size_t nr)
     if (!useSharedBuffer)
     {
         /* read client - works for all kinds of fds incl pipe*/
-        return read(rFd, buf, sizeof(buf));
+        return read(rFd, buf, nr);
     }
     else
     {
@@ -3914,6 +4161,14 @@ void MsgQueue::readFromFd()
         return;
     }
 
+    if (parser)
+    {
+        /* process XML chunk in the parser thread. Stop reading until done */
+        parsing = parser->push(this, lp, buf, nr);
+        rio.stop();
+        return;
+    }
+
     /* process XML chunk */
     char err[1024];
     XMLEle **nodes = parseXMLChunk(lp, buf, nr, err);
@@ -3925,6 +4180,32 @@ void MsgQueue::readFromFd()
         return;
     }
 
+    processNodes(nodes);
+}
+
+void MsgQueue::onParsed(ParserThread::Job * job)
+{
+    parsing = nullptr;
+
+    if (!job->nodes)
+    {
+        log(fmt("XML error: %s\n", job->err));
+        log(fmt("XML read: %.*s\n", (int)job->data.size(), job->data.data()));
+        close();
+        return;
+    }
+
+    auto hb = heartBeat();
+    processNodes(job->nodes);
+    job->nodes = nullptr;
+
+    // Resume reading
+    if (hb.alive())
+        updateIos();
+}
+
+void MsgQueue::processNodes(XMLEle ** nodes)
+{
     int inode = 0;
 
     XMLEle *root = nodes[inode];
@@ -3956,12 +4237,108 @@ void MsgQueue::readFromFd()
     free(nodes);
 }
 
+std::vector<ParserThread *> ParserThread::threads;
+unsigned long ParserThread::assigned = 0;
+
+ParserThread::ParserThread()
+{
+    doneEv.set<ParserThread, &ParserThread::onDone>(this);
+    doneEv.start();
+
+    std::thread t([this]()
+    {
+        run();
+    });
+    t.detach();
+}
+
+void ParserThread::start(int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        threads.push_back(new ParserThread());
+    }
+}
+
+ParserThread * ParserThread::assign()
+{
+    if (threads.empty())
+    {
+        return nullptr;
+    }
+    return threads[(assigned++) % threads.size()];
+}
+
+ParserThread::Job * ParserThread::push(MsgQueue * owner, LilXML * lp, const char * data, size_t len)
+{
+    Job * job = new Job();
+    job->owner = owner;
+    job->lp = lp;
+    job->data.assign(data, data + len);
+
+    std::lock_guard<std::mutex> guard(lock);
+    pending.push_back(job);
+    pendingCond.notify_one();
+    return job;
+}
+
+void ParserThread::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        pendingCond.wait(guard, [this] { return !pending.empty(); });
+
+        Job * job = pending.front();
+        pending.pop_front();
+
+        guard.unlock();
+        job->nodes = parseXMLChunk(job->lp, job->data.data(), job->data.size(), job->err);
+        guard.lock();
+
+        done.push_back(job);
+        doneEv.send();
+    }
+}
+
+void ParserThread::onDone()
+{
+    std::list<Job *> jobs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.swap(done);
+    }
+
+    for (auto job : jobs)
+    {
+        if (job->owner)
+        {
+            job->owner->onParsed(job);
+        }
+        else
+        {
+            // Connection was closed while parsing
+            delLilXML(job->lp);
+        }
+
+        if (job->nodes)
+        {
+            for (int i = 0; job->nodes[i]; ++i)
+            {
+                delXMLEle(job->nodes[i]);
+            }
+            free(job->nodes);
+        }
+        delete job;
+    }
+}
+
 static std::vector<XMLEle *> findBlobElements(XMLEle * root)
 {
     std::vector<XMLEle *> result;
     for (auto ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
     {
-        if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
+        if (tagIdXMLEle(ep) == XMLSYM_oneBLOB)
         {
             result.push_back(ep);
         }
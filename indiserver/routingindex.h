@@ -0,0 +1,116 @@
+/*
+    INDI Server routing index
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Index of the device/property interests of the server connections.
+ *
+ * Connections are identified by their id in their ConcurrentSet. Each one
+ * registers records for a device and a property name, an empty name standing
+ * for the whole device. Records are owned by the connections and only
+ * referenced here, so changes to them (BLOB policy...) need no reindexing.
+ */
+template<class V>
+class RoutingIndex
+{
+    public:
+        /* connection id -> record, ordered by id like ConcurrentSet::ids() */
+        typedef std::map<unsigned long, V*> Entries;
+
+        void add(const std::string &dev, const std::string &name, unsigned long id, V * record)
+        {
+            index[dev][name][id] = record;
+        }
+
+        void remove(const std::string &dev, const std::string &name, unsigned long id)
+        {
+            auto devIt = index.find(dev);
+            if (devIt == index.end())
+                return;
+
+            auto nameIt = devIt->second.find(name);
+            if (nameIt == devIt->second.end())
+                return;
+
+            nameIt->second.erase(id);
+            if (nameIt->second.empty())
+            {
+                devIt->second.erase(nameIt);
+                if (devIt->second.empty())
+                    index.erase(devIt);
+            }
+        }
+
+        /* return the records registered for exactly dev/name, or nullptr */
+        const Entries * find(const std::string &dev, const std::string &name) const
+        {
+            auto devIt = index.find(dev);
+            if (devIt == index.end())
+                return nullptr;
+
+            auto nameIt = devIt->second.find(name);
+            if (nameIt == devIt->second.end())
+                return nullptr;
+
+            return &nameIt->second;
+        }
+
+        /* return the record of connection id applying to dev/name: the one for
+         * that property if any, else the one for the whole device, else nullptr.
+         */
+        V * find(const std::string &dev, const std::string &name, unsigned long id) const
+        {
+            for (auto entries : { find(dev, name), find(dev, std::string()) })
+            {
+                if (entries == nullptr)
+                    continue;
+
+                auto e = entries->find(id);
+                if (e != entries->end())
+                    return e->second;
+            }
+            return nullptr;
+        }
+
+        /* fill result with the record applying to dev/name for every connection
+         * having one, with the same precedence as find(dev, name, id).
+         */
+        void match(const std::string &dev, const std::string &name, Entries &result) const
+        {
+            result.clear();
+
+            auto exact = find(dev, name);
+            if (exact)
+                result = *exact;
+
+            if (name.empty())
+                return;
+
+            auto whole = find(dev, std::string());
+            if (whole)
+                result.insert(whole->begin(), whole->end());
+        }
+
+    private:
+        std::unordered_map<std::string, std::unordered_map<std::string, Entries>> index;
+};
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdio.h>
 
 #include "ProcessController.h"
 
@@ -61,6 +62,31 @@ void ProcessController::checkOpenFdCount(int expected, const std::string & msg)
 #endif
 }
 
+long ProcessController::getWriteSyscallCount() {
+    if (pid == -1) {
+        throw std::runtime_error(cmd + " is done - cannot check syscall count");
+    }
+#ifdef __linux__
+    std::string path = "/proc/" + std::to_string(pid) + "/io";
+    FILE * f = fopen(path.c_str(), "r");
+    if (f == nullptr) {
+        return -1;
+    }
+
+    long count = -1;
+    char line[128];
+    while(fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "syscw: %ld", &count) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return count;
+#else
+    return -1;
+#endif
+}
+
 void ProcessController::start(const std::string & path, const std::vector<std::string>  & args)
 {
     if (pid != -1) {
@@ -51,6 +51,9 @@ public:
     int getOpenFdCount();
 
     void checkOpenFdCount(int expected, const std::string & msg);
+
+    // Returns the count of write system calls of the process, or -1 on systems without /proc/<pid>/io
+    long getWriteSyscallCount();
 };
 
 
@@ -0,0 +1,167 @@
+/*******************************************************************************
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "utils.h"
+
+#include "DriverMock.h"
+#include "IndiServerController.h"
+
+static void writeAll(int fd, const std::string &str)
+{
+    size_t done = 0;
+    while (done < str.size())
+    {
+        ssize_t wr = write(fd, str.data() + done, str.size() - done);
+        if (wr == -1)
+            throw std::system_error(errno, std::generic_category(), "write");
+        done += wr;
+    }
+}
+
+static void readUntil(int fd, const std::string &marker)
+{
+    std::string received;
+    char buffer[4096];
+    while (received.find(marker) == std::string::npos)
+    {
+        ssize_t rd = read(fd, buffer, sizeof(buffer));
+        if (rd <= 0)
+            throw std::runtime_error("Connection closed while waiting for " + marker);
+        received.append(buffer, rd);
+    }
+}
+
+// Read from fd until count end tags were received, return the byte count
+static size_t drain(int fd, int count)
+{
+    const std::string endTag = "</setBLOBVector>";
+    std::vector<char> buffer(1024 * 1024);
+    std::string tail;
+    size_t total = 0;
+
+    while (count > 0)
+    {
+        ssize_t rd = read(fd, buffer.data(), buffer.size());
+        if (rd <= 0)
+            throw std::runtime_error("Connection closed while draining");
+        total += rd;
+
+        // Keep the end of the previous read, the tag may span two reads
+        std::string window = tail;
+        window.append(buffer.data(), rd);
+        for (size_t p = window.find(endTag); p != std::string::npos; p = window.find(endTag, p + endTag.size()))
+            count--;
+
+        size_t keep = std::min(window.size(), endTag.size() - 1);
+        tail = window.substr(window.size() - keep);
+    }
+    return total;
+}
+
+/* Throughput of BLOB fan out from one driver to many TCP clients.
+ * Reports MB/s and write system calls per MB sent by indiserver.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(IndiserverThroughput, DISABLED_BlobFanOut)
+{
+    const int blobCount = 32;
+    const int blobSize = 4 * 1024 * 1024;
+
+    setupSigPipe();
+
+    std::string base64((blobSize + 2) / 3 * 4, 'A');
+    std::string blob = "<setBLOBVector device='fakedev1' name='testblob' state='Ok'>\n"
+                       "<oneBLOB name='content' size='" + std::to_string(blobSize) + "' format='.fits' len='" + std::to_string(base64.size()) + "'>\n"
+                       + base64 + "\n</oneBLOB>\n</setBLOBVector>\n";
+
+    for (int clientCount : { 1, 4, 16 })
+    {
+        DriverMock fakeDriver;
+        IndiServerController indiServer;
+
+        fakeDriver.setup();
+
+        // Not verbose: tracing would dominate the measure
+        std::vector<std::string> args = { "-p", std::to_string(indiServer.getTcpPort()), "-r", "0" };
+#ifdef ENABLE_INDI_SHARED_MEMORY
+        args.push_back("-u");
+        args.push_back(indiServer.getUnixSocketPath());
+#endif
+        args.push_back(getTestExePath("fakedriver"));
+        indiServer.start(args);
+
+        fakeDriver.waitEstablish();
+        fakeDriver.cnx.expectXml("<getProperties version='1.7'/>");
+
+        std::vector<int> clients;
+        for (int i = 0; i < clientCount; ++i)
+        {
+            int fd = tcpSocketConnect("localhost", indiServer.getTcpPort());
+            writeAll(fd, "<getProperties version='1.7'/>\n"
+                     "<enableBLOB device='fakedev1' name='testblob'>Also</enableBLOB>\n"
+                     "<pingRequest uid='ready'/>\n");
+            readUntil(fd, "pingReply");
+            clients.push_back(fd);
+        }
+
+        long writesBefore = indiServer.getWriteSyscallCount();
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<size_t> received(clientCount);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < clientCount; ++i)
+        {
+            readers.emplace_back([&received, &clients, i, blobCount]()
+            {
+                received[i] = drain(clients[i], blobCount);
+            });
+        }
+
+        for (int i = 0; i < blobCount; ++i)
+            fakeDriver.cnx.send(blob);
+
+        for (auto &reader : readers)
+            reader.join();
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long writes = indiServer.getWriteSyscallCount() - writesBefore;
+
+        size_t total = 0;
+        for (auto r : received)
+            total += r;
+        double mb = total / (1024.0 * 1024.0);
+
+        printf("%3d clients: %8.1f MB/s", clientCount, mb / elapsed);
+        if (writesBefore >= 0)
+            printf(", %6.1f writes/MB", writes / mb);
+        printf("\n");
+
+        for (auto fd : clients)
+            close(fd);
+    }
+}
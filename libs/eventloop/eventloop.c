@@ -32,7 +32,9 @@
  #define MAIN_TEST for a stand-alone test program.
  */
 
+#include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,6 +47,15 @@
 #include <sys/select.h>
 #endif
 
+/* on Linux, wait with epoll and wake up for timers with a timerfd.
+ * select() is kept for other systems and if epoll can not be set up.
+ */
+#if defined(__linux__)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 #include "eventloop.h"
 
 /* info about one registered callback.
@@ -53,33 +64,38 @@
  */
 typedef struct
 {
-    int in_use; /* flag to mark this record is active */
-    int fd;     /* fd descriptor to watch for read */
-    void *ud;   /* user's data handle */
-    CBF *fp;    /* callback function */
+    int in_use;        /* flag to mark this record is active */
+    int fd;            /* fd descriptor to watch for read */
+    void *ud;          /* user's data handle */
+    CBF *fp;           /* callback function */
+    unsigned long gen; /* registration order, to skip callbacks added while dispatching */
+    int always;        /* fd can not be polled (regular file), always ready */
 } CB;
 static CB *cback;    /* malloced list of callbacks */
 static int ncback;   /* n entries in cback[] */
 static int ncbinuse; /* n entries in cback[] marked in_use */
-static int lastcb;   /* cback index of last cb called */
+static int ncbalways; /* n entries in cback[] marked in_use and always */
+static unsigned long cbgen; /* source of callback registration order */
 
 /* info about one registered timer function.
- * the entries are kept sorted by increasing time from epoch, ie,
- *   the next entry to fire is at the begin of the list.
+ * the entries are kept in a binary min heap on trigger time, ie,
+ *   the next entry to fire is timers[0].
+ * trigger times are on the monotonic clock so wall clock steps do not move them.
  */
 typedef struct TF
 {
-    double tgo;       /* trigger time, ms from epoch */
-    int interval;     /* repeat timer if interval > 0, ms */
-    void *ud;         /* user's data handle */
-    TCF *fp;          /* timer function */
-    int tid;          /* unique id for this timer */
-    struct TF *next;  /* pointer to next item */
+    double tgo;         /* trigger time, ms on the monotonic clock */
+    int interval;       /* repeat timer if interval > 0, ms */
+    void *ud;           /* user's data handle */
+    TCF *fp;            /* timer function */
+    int tid;            /* unique id for this timer */
+    unsigned long seq;  /* insertion order, timers due at the same time run first in first out */
 } TF;
-static TF  timefunc_null = {0, 0, NULL, NULL, 0, NULL};
-static TF *timefunc = &timefunc_null;  /* list of timer functions */
-static int tid = 0;    /* source of unique timer ids */
-#define EPOCHDT(tp) /* ms from epoch to timeval *tp */ (((tp)->tv_usec) / 1000.0 + ((tp)->tv_sec) * 1000.0)
+static TF **timers;          /* malloced min heap of timer functions */
+static int ntimers;          /* n entries in timers[] */
+static int mtimers;          /* n entries allocated in timers[] */
+static int tid = 0;          /* source of unique timer ids */
+static unsigned long tseq;   /* source of timer insertion order */
 
 /* info about one registered work procedure.
  * the malloced array wproc is never shrunk, entries are reused. new id's are
@@ -96,13 +112,115 @@ static int nwproc;   /* n entries in wproc[] */
 static int nwpinuse; /* n entries in wproc[] marked in-use */
 static int lastwp;   /* wproc index of last workproc called*/
 
+#ifdef USE_EPOLL
+#define MAXEVENTS 64
+static int epfd = -1;        /* epoll instance watching callbacks and tfd */
+static int tfd = -1;         /* timerfd armed for timers[0] */
+static double armedtgo = -1; /* trigger time tfd is armed for, -1 if disarmed */
+static int backendinit;      /* set once epoll setup was attempted */
+#endif
+
 static void runWorkProc(void);
-static void callCallback(fd_set *rfdp);
 static void checkTimer();
 static void oneLoop(void);
 static void deferTO(void *p);
 static void runImmediates();
 
+/* ms on the monotonic clock */
+static double nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+#ifdef USE_EPOLL
+/* create the epoll instance and the timerfd, once.
+ * return 1 if epoll may be used, else 0 to fall back to select().
+ */
+static int initBackend()
+{
+    struct epoll_event ev;
+    CB *cp;
+
+    if (backendinit)
+        return epfd >= 0;
+    backendinit = 1;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        perror("epoll_create1");
+        return 0;
+    }
+
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = tfd;
+    if (tfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) < 0)
+    {
+        perror("timerfd");
+        if (tfd >= 0)
+            close(tfd);
+        close(epfd);
+        tfd = epfd = -1;
+        return 0;
+    }
+
+    /* callbacks registered so far */
+    for (cp = cback; cp < &cback[ncback]; cp++)
+    {
+        if (cp->in_use)
+        {
+            ev.data.fd = cp->fd;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, cp->fd, &ev) < 0 && errno == EPERM)
+            {
+                cp->always = 1;
+                ncbalways++;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* start watching the fd of cp, several callbacks may share one fd */
+static void watchCallback(CB *cp)
+{
+    struct epoll_event ev;
+
+    if (!backendinit || epfd < 0)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN;
+    ev.data.fd = cp->fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, cp->fd, &ev) < 0 && errno == EPERM)
+    {
+        /* regular files can not be polled, select() reports them always ready */
+        cp->always = 1;
+        ncbalways++;
+    }
+}
+
+/* stop watching the fd of cp unless another callback still uses it */
+static void unwatchCallback(CB *cp)
+{
+    CB *op;
+
+    if (!backendinit || epfd < 0)
+        return;
+
+    for (op = cback; op < &cback[ncback]; op++)
+        if (op->in_use && op->fd == cp->fd)
+            return;
+
+    /* fd may be closed already, epoll then dropped it by itself */
+    epoll_ctl(epfd, EPOLL_CTL_DEL, cp->fd, NULL);
+}
+#endif
+
 /* inf loop to dispatch callbacks, work procs and timers as necessary.
  * never returns.
  */
@@ -181,7 +299,12 @@ int addCallback(int fd, CBF *fp, void *ud)
     cp->fp     = fp;
     cp->ud     = ud;
     cp->fd     = fd;
+    cp->gen    = ++cbgen;
+    cp->always = 0;
     ncbinuse++;
+#ifdef USE_EPOLL
+    watchCallback(cp);
+#endif
 
     /* id is index into array */
     return (cp - cback);
@@ -204,44 +327,96 @@ void rmCallback(int cid)
     /* mark for reuse */
     cp->in_use = 0;
     ncbinuse--;
+    if (cp->always)
+        ncbalways--;
+#ifdef USE_EPOLL
+    unwatchCallback(cp);
+#endif
 }
 
-/* insert maintaining sort */
-static void insertTimer(TF *node)
+/* heap order: soonest first, then first inserted */
+static int timerBefore(const TF *a, const TF *b)
 {
-    TF *it = timefunc;
+    return a->tgo < b->tgo || (a->tgo == b->tgo && a->seq < b->seq);
+}
 
-    for(; ; it = it->next)
+/* move timers[i] up to its place in the heap */
+static void siftUp(int i)
+{
+    TF *node = timers[i];
+
+    while (i > 0)
     {
-        if (it->next == NULL || node->tgo < it->next->tgo)
-        {
-            node->next = it->next;
-            it->next = node;
+        int parent = (i - 1) / 2;
+        if (!timerBefore(node, timers[parent]))
             break;
-        }
+        timers[i] = timers[parent];
+        i         = parent;
     }
+    timers[i] = node;
+}
+
+/* move timers[i] down to its place in the heap */
+static void siftDown(int i)
+{
+    TF *node = timers[i];
+
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= ntimers)
+            break;
+        if (child + 1 < ntimers && timerBefore(timers[child + 1], timers[child]))
+            child++;
+        if (!timerBefore(timers[child], node))
+            break;
+        timers[i] = timers[child];
+        i         = child;
+    }
+    timers[i] = node;
+}
+
+/* insert maintaining heap order */
+static void insertTimer(TF *node)
+{
+    if (ntimers == mtimers)
+    {
+        mtimers = mtimers ? 2 * mtimers : 16;
+        timers  = (TF **)realloc(timers, mtimers * sizeof(TF *));
+    }
+
+    node->seq         = ++tseq;
+    timers[ntimers++] = node;
+    siftUp(ntimers - 1);
+}
+
+/* remove timers[i] from the heap, caller owns the node */
+static TF *dettachTimer(int i)
+{
+    TF *node = timers[i];
+
+    timers[i] = timers[--ntimers];
+    if (i < ntimers)
+    {
+        siftDown(i);
+        siftUp(i);
+    }
+    return node;
 }
 
 /* register a new timer function, fp, to be called with ud as arg after ms
- * milliseconds. add to list in order of increasing time from epoch, ie,
- * first entry runs soonest. return id for use with rmTimer().
+ * milliseconds. return id for use with rmTimer().
  */
 static int addTimerImpl(int delay, int interval, TCF *fp, void *ud)
 {
-    struct timeval t;
-    TF *node;
-
-    /* get time now */
-    gettimeofday(&t, NULL);
-
     /* create entry */
-    node = (TF*)malloc(sizeof(TF));
+    TF *node = (TF*)malloc(sizeof(TF));
 
     /* init new entry */
     node->ud  = ud;
     node->fp  = fp;
     node->tid = ++tid; /* store new unique id */
-    node->tgo = EPOCHDT(&t) + delay;
+    node->tgo = nowMs() + delay;
     node->interval = interval;
 
     insertTimer(node);
@@ -259,29 +434,14 @@ int addPeriodicTimer(int ms, TCF *fp, void *ud)
     return addTimerImpl(ms, ms, fp, ud);
 }
 
-/* find the timer and remove from list */
-static TF *dettachTimer(TF *node)
-{
-    TF *it = timefunc;
-    for(; it->next != NULL; it = it->next)
-    {
-        if (it->next == node)
-        {
-            it->next = node->next;
-            return node;
-        }
-    }
-    return NULL;
-}
-
-/* find the timer by id */
-static TF *findTimer(int timer_id)
+/* find the heap index of a timer by id, -1 if not found */
+static int findTimer(int timer_id)
 {
-    TF *it = timefunc->next;
-    for(; it != NULL; it = it->next)
-        if (it->tid == timer_id)
-            return it;
-    return NULL;
+    int i;
+    for (i = 0; i < ntimers; i++)
+        if (timers[i]->tid == timer_id)
+            return i;
+    return -1;
 }
 
 /* remove the timer with the given id, as returned from addTimer().
@@ -289,24 +449,15 @@ static TF *findTimer(int timer_id)
  */
 void rmTimer(int timer_id)
 {
-    TF *node, *it = timefunc;
-    for(; (node = it->next) != NULL; it = it->next)
-    {
-        if (node->tid == timer_id)
-        {
-            it->next = node->next;
-            free(node);
-            break;
-        }
-    }
+    int i = findTimer(timer_id);
+    if (i >= 0)
+        free(dettachTimer(i));
 }
 
 /* Returns the timer's remaining value in milliseconds left until the timeout. */
 static double remainingTimerNode(TF *node)
 {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    return (node->tgo - EPOCHDT(&now));
+    return (node->tgo - nowMs());
 }
 
 /* Returns the timer's remaining value in milliseconds left until the timeout.
@@ -314,8 +465,8 @@ static double remainingTimerNode(TF *node)
  */
 int remainingTimer(int timer_id)
 {
-    TF *it = findTimer(timer_id);
-    return it == NULL ? -1 : remainingTimerNode(it);
+    int i = findTimer(timer_id);
+    return i < 0 ? -1 : remainingTimerNode(timers[i]);
 }
 
 /* Returns the timer's remaining value in nanoseconds left until the timeout.
@@ -323,8 +474,8 @@ int remainingTimer(int timer_id)
  */
 int64_t nsecsRemainingTimer(int timer_id)
 {
-    TF *it = findTimer(timer_id);
-    return it == NULL ? -1 : remainingTimerNode(it) * 1000000;
+    int i = findTimer(timer_id);
+    return i < 0 ? -1 : remainingTimerNode(timers[i]) * 1000000;
 }
 
 /* add a new work procedure, fp, to be called with ud when nothing else to do.
@@ -393,57 +544,71 @@ static void runWorkProc()
     (*wp->fp)(wp->ud);
 }
 
-/* run next callback whose fd is listed as ready to go in rfdp */
-static void callCallback(fd_set *rfdp)
+/* run the timer callbacks whose time has come, if any. all we have to do
+ * is check the head of the heap, it is always the soonest to run.
+ * every timer due when we start is run, including several periods of one
+ * periodic timer that fell behind only once.
+ */
+static void checkTimer()
 {
-    CB *cp;
-
-    /* skip if list is empty */
-    if (!ncbinuse)
-        return;
+    double now = nowMs();
 
-    /* find next */
-    do
+    while (ntimers > 0 && timers[0]->tgo <= now)
     {
-        lastcb = (lastcb + 1) % ncback;
-        cp     = &cback[lastcb];
-    } while (!cp->in_use || !FD_ISSET(cp->fd, rfdp));
+        TF *node = timers[0];
 
-    /* run */
-    (*cp->fp)(cp->fd, cp->ud);
+        if (node->interval > 0)
+        {
+            /* reschedule before running, so the callback may remove it.
+             * skip the periods we missed, keep the phase.
+             */
+            node->tgo += node->interval;
+            if (node->tgo <= now)
+                node->tgo += (floor((now - node->tgo) / node->interval) + 1) * node->interval;
+            node->seq = ++tseq;
+            siftDown(0);
+
+            (*node->fp)(node->ud);
+        }
+        else
+        {
+            dettachTimer(0);
+            (*node->fp)(node->ud);
+            free(node);
+        }
+    }
 }
 
-/* run the next timer callback whose time has come, if any. all we have to do
- * is is check the first entry in timefunc because it is sorted in increasing
- * order of time from epoch to run, ie, first entry runs soonest.
+/* run the callbacks whose fd is ready, as told by isReady.
+ * callbacks registered while dispatching wait for the next loop.
+ * return the number of callbacks run.
  */
-static void checkTimer()
+static int callCallbacks(int (*isReady)(int fd, void *ctx), void *ctx)
 {
-    TF *node = timefunc->next;
+    unsigned long gen = cbgen;
+    int i, ncalled = 0;
 
-    if (node == NULL || remainingTimerNode(node) > 0)
-        return;
-
-    (*node->fp)(node->ud);
-
-    node = dettachTimer(node);
-
-    if (node == NULL)
-        return;
-
-    if (node->interval > 0)
+    /* cback may move as callbacks add callbacks, always index it */
+    for (i = 0; i < ncback; i++)
     {
-        node->tgo += node->interval;
-        insertTimer(node);
-    } else {
-        free(node);
+        if (cback[i].in_use && cback[i].gen <= gen && (cback[i].always || isReady(cback[i].fd, ctx)))
+        {
+            (*cback[i].fp)(cback[i].fd, cback[i].ud);
+            ncalled++;
+        }
     }
+    return ncalled;
+}
+
+static int isSetFd(int fd, void *ctx)
+{
+    return FD_ISSET(fd, (fd_set *)ctx);
 }
 
-/* check fd's from each active callback.
- * if any ready, call their callbacks else call each registered work procedure.
+/* wait with select() until a callback fd is ready or the next timer is due,
+ * then dispatch. return the number of callbacks run.
  */
-static void oneLoop()
+static int selectLoop()
 {
     struct timeval tv, *tvp;
     fd_set rfd;
@@ -464,27 +629,27 @@ static void oneLoop()
     }
 
     /* determine timeout:
-	 * if there are work procs
-	 *   set delay = 0
-	 * else if there is at least one timer func
-	 *   set delay = time until soonest timer func expires
-	 * else
-	 *   set delay = forever
-	 */
+     * if there are work procs
+     *   set delay = 0
+     * else if there is at least one timer func
+     *   set delay = time until soonest timer func expires
+     * else
+     *   set delay = forever
+     */
     if (nwpinuse > 0)
     {
         tvp         = &tv;
         tvp->tv_sec = tvp->tv_usec = 0;
     }
-    else if (timefunc->next != NULL)
+    else if (ntimers > 0)
     {
-        double late = remainingTimerNode(timefunc->next); /* ms late */
+        double late = remainingTimerNode(timers[0]); /* ms late */
         if (late < 0)
             late = 0;
         late /= 1000.0; /* secs late */
         tvp          = &tv;
         tvp->tv_sec  = (long)floor(late);
-        tvp->tv_usec = (long)floor((late - tvp->tv_sec) * 1000000.0);
+        tvp->tv_usec = (long)ceil((late - tvp->tv_sec) * 1000000.0);
     }
     else
         tvp = NULL;
@@ -493,16 +658,115 @@ static void oneLoop()
     ns = select(maxfd + 1, &rfd, NULL, NULL, tvp);
     if (ns < 0)
     {
-        perror("select");
+        if (errno != EINTR)
+            perror("select");
+        return -1;
+    }
+
+    /* dispatch */
+    checkTimer();
+    return ns > 0 ? callCallbacks(isSetFd, &rfd) : 0;
+}
+
+#ifdef USE_EPOLL
+typedef struct
+{
+    struct epoll_event *events;
+    int nevents;
+} ReadyEvents;
+
+static int isEventFd(int fd, void *ctx)
+{
+    ReadyEvents *ready = (ReadyEvents *)ctx;
+    int i;
+
+    for (i = 0; i < ready->nevents; i++)
+        if (ready->events[i].data.fd == fd)
+            return 1;
+    return 0;
+}
+
+/* arm tfd for the soonest timer, only when it changed */
+static void armTimerFd()
+{
+    struct itimerspec its;
+    double tgo = ntimers > 0 ? timers[0]->tgo : -1;
+
+    if (tgo == armedtgo)
         return;
+
+    memset(&its, 0, sizeof(its));
+    if (tgo >= 0)
+    {
+        /* a zero it_value disarms, trigger times are far from 0 anyway */
+        its.it_value.tv_sec  = (time_t)(tgo / 1000.0);
+        its.it_value.tv_nsec = (long)((tgo - its.it_value.tv_sec * 1000.0) * 1000000.0);
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+    armedtgo = tgo;
+}
+
+/* wait with epoll until a callback fd is ready or tfd tells the next timer is due,
+ * then dispatch. return the number of callbacks run.
+ */
+static int epollLoop()
+{
+    struct epoll_event events[MAXEVENTS];
+    ReadyEvents ready;
+    int i, ns;
+
+    /* do not block when there is work to do */
+    armTimerFd();
+    ns = epoll_wait(epfd, events, MAXEVENTS, (nwpinuse > 0 || ncbalways > 0) ? 0 : -1);
+    if (ns < 0)
+    {
+        if (errno != EINTR)
+            perror("epoll_wait");
+        return -1;
+    }
+
+    /* clear the timer expiration, tfd gets rearmed for the next timer */
+    for (i = 0; i < ns; i++)
+    {
+        if (events[i].data.fd == tfd)
+        {
+            uint64_t expirations;
+            if (read(tfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                perror("read timerfd");
+            armedtgo = -1;
+            events[i--] = events[--ns];
+        }
     }
 
     /* dispatch */
     checkTimer();
-    if (ns == 0)
-        runWorkProc();
+    if (ns == 0 && ncbalways == 0)
+        return 0;
+
+    ready.events  = events;
+    ready.nevents = ns;
+    return callCallbacks(isEventFd, &ready);
+}
+#endif
+
+/* wait for callback fds and timers.
+ * if any ready, call their callbacks else call the next registered work procedure.
+ */
+static void oneLoop()
+{
+    int ncalled;
+
+#ifdef USE_EPOLL
+    if (initBackend())
+        ncalled = epollLoop();
     else
-        callCallback(&rfd);
+#endif
+        ncalled = selectLoop();
+
+    if (ncalled == 0)
+        runWorkProc();
 
     runImmediates();
 }
@@ -174,6 +174,12 @@ int fp_pack_data_to_data (const char *inputBuffer, size_t inputBufferSize, unsig
                           size_t *outputBufferSize,
                           fpstate fpvar,
                           int *islossless);
+/* Same, output buffer allocated by mem_realloc (realloc semantics), for example IDSharedBlobRealloc */
+int fp_pack_data_to_data_realloc (const char *inputBuffer, size_t inputBufferSize, unsigned char **outputBuffer,
+                                  size_t *outputBufferSize,
+                                  fpstate fpvar,
+                                  int *islossless,
+                                  void *(*mem_realloc)(void *p, size_t newsize));
 /* Pack input fits file to in-memory fits file */
 int fp_pack_fits_to_fits (fitsfile *infptr, fitsfile **outfits, fpstate fpvar, int *islossless);
 
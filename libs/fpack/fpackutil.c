@@ -1030,6 +1030,14 @@ int fp_pack_data_to_fits (const char *inputBuffer, size_t inputBufferSize, fitsf
  */
 int fp_pack_data_to_data (const char *inputBuffer, size_t inputBufferSize, unsigned char **outputBuffer, size_t *outputBufferSize,
                           fpstate fpvar, int *islossless)
+{
+    return fp_pack_data_to_data_realloc(inputBuffer, inputBufferSize, outputBuffer, outputBufferSize, fpvar, islossless, realloc);
+}
+
+/*--------------------------------------------------------------------------*/
+int fp_pack_data_to_data_realloc (const char *inputBuffer, size_t inputBufferSize, unsigned char **outputBuffer,
+                                  size_t *outputBufferSize, fpstate fpvar, int *islossless,
+                                  void *(*mem_realloc)(void *p, size_t newsize))
 {
     fitsfile *infptr, *outfptr;
     int	stat=0;
@@ -1043,7 +1051,7 @@ int fp_pack_data_to_data (const char *inputBuffer, size_t inputBufferSize, unsig
     }
 
     void *outbuffer = (void *)(outputBuffer);
-    fits_create_memfile(&outfptr, outbuffer, outputBufferSize, 2880, realloc, &stat);
+    fits_create_memfile(&outfptr, outbuffer, outputBufferSize, 2880, mem_realloc, &stat);
     if (stat)
     {
         fp_abort_output(infptr, outfptr, stat);
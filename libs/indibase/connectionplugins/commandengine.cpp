@@ -0,0 +1,276 @@
+/*******************************************************************************
+ Command Engine
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "commandengine.h"
+
+#include "connectionserial.h"
+#include "connectiontcp.h"
+#include "indicom.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+namespace Connection
+{
+
+CommandEngine::CommandEngine(Interface *connection) : m_Connection(connection)
+{
+}
+
+CommandEngine::CommandEngine(int fd) : m_FD(fd)
+{
+}
+
+void CommandEngine::queue(const Command &command)
+{
+    m_Queue.push_back(command);
+}
+
+void CommandEngine::setMaxInFlight(size_t maxInFlight)
+{
+    m_MaxInFlight = std::max<size_t>(1, maxInFlight);
+}
+
+void CommandEngine::setTimeout(int timeoutMs)
+{
+    m_TimeoutMs = timeoutMs;
+}
+
+int CommandEngine::portFD() const
+{
+    if (m_Connection == nullptr)
+        return m_FD;
+
+    if (auto serial = dynamic_cast<Serial *>(m_Connection))
+        return serial->getPortFD();
+    if (auto tcp = dynamic_cast<TCP *>(m_Connection))
+        return tcp->getPortFD();
+    return -1;
+}
+
+CommandEngine::Reply CommandEngine::send(const Command &command)
+{
+    queue(command);
+    return run().back();
+}
+
+std::vector<CommandEngine::Reply> CommandEngine::run()
+{
+    std::vector<Command> commands(m_Queue.begin(), m_Queue.end());
+    std::vector<Reply> replies(commands.size());
+    m_Queue.clear();
+
+    int fd = portFD();
+    if (fd < 0)
+    {
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            replies[i].status = TTY_ERRNO;
+            complete(commands[i], replies[i]);
+        }
+        return replies;
+    }
+
+    // Replies left from earlier commands would be taken for ours
+    flushInput(fd);
+
+    std::deque<InFlight> inFlight;
+    size_t next = 0;
+    Clock::time_point lastReply = Clock::now();
+
+    while (next < commands.size() || !inFlight.empty())
+    {
+        // Send as far as the window allows. A command that is not pipelined
+        // goes alone: after every previous reply, and before any later command.
+        while (next < commands.size() && inFlight.size() < m_MaxInFlight &&
+                (inFlight.empty() || (commands[next].pipelined && commands[inFlight.back().index].pipelined)))
+        {
+            size_t index = next++;
+            auto sent    = Clock::now();
+            int err      = writeCommand(fd, commands[index]);
+
+            if (err != TTY_OK || !commands[index].expectReply)
+            {
+                replies[index].status = err;
+                complete(commands[index], replies[index]);
+                continue;
+            }
+
+            inFlight.push_back({index, sent});
+        }
+
+        if (inFlight.empty())
+            continue;
+
+        InFlight current = inFlight.front();
+        inFlight.pop_front();
+
+        const Command &command = commands[current.index];
+        Reply &reply           = replies[current.index];
+
+        // A reply can not arrive before the one ahead of it, wait from whichever came last
+        int timeoutMs = command.timeoutMs > 0 ? command.timeoutMs : m_TimeoutMs;
+        auto deadline = std::max(current.sent, lastReply) + std::chrono::milliseconds(timeoutMs);
+
+        reply.status = readReply(fd, command, deadline, reply.data);
+        if (reply.status != TTY_OK)
+        {
+            complete(command, reply);
+
+            // The replies still expected can no longer be told apart
+            for (const auto &other : inFlight)
+            {
+                replies[other.index].status = reply.status;
+                complete(commands[other.index], replies[other.index]);
+            }
+            inFlight.clear();
+            flushInput(fd);
+            continue;
+        }
+
+        lastReply       = Clock::now();
+        reply.latencyMs = std::chrono::duration<double, std::milli>(lastReply - current.sent).count();
+        complete(command, reply);
+    }
+
+    return replies;
+}
+
+int CommandEngine::writeCommand(int fd, const Command &command)
+{
+    int timeoutMs = command.timeoutMs > 0 ? command.timeoutMs : m_TimeoutMs;
+    size_t done   = 0;
+
+    while (done < command.request.size())
+    {
+        ssize_t written = write(fd, command.request.data() + done, command.request.size() - done);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                struct pollfd pfd = { fd, POLLOUT, 0 };
+                if (poll(&pfd, 1, timeoutMs) > 0)
+                    continue;
+            }
+            return TTY_WRITE_ERROR;
+        }
+        done += written;
+    }
+
+    return TTY_OK;
+}
+
+int CommandEngine::readReply(int fd, const Command &command, Clock::time_point deadline, std::string &data)
+{
+    for (;;)
+    {
+        // A complete reply may be buffered already, read along with the previous one
+        size_t length = command.expectedLength;
+        if (length == 0)
+        {
+            size_t stop = m_Input.find(command.terminator);
+            if (stop != std::string::npos)
+                length = stop + 1;
+        }
+        else if (m_Input.size() < length)
+            length = 0;
+
+        if (length > 0)
+        {
+            data.assign(m_Input, 0, length);
+            m_Input.erase(0, length);
+            return TTY_OK;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (remaining <= 0)
+            return TTY_TIME_OUT;
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, static_cast<int>(remaining) + 1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return TTY_SELECT_ERROR;
+        }
+        if (ready == 0)
+            return TTY_TIME_OUT;
+
+        char buffer[512];
+        ssize_t bytesRead = read(fd, buffer, sizeof(buffer));
+        if (bytesRead < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        if (bytesRead <= 0)
+            return TTY_READ_ERROR;
+
+        m_Input.append(buffer, bytesRead);
+    }
+}
+
+void CommandEngine::flushInput(int fd)
+{
+    m_Input.clear();
+
+    if (isatty(fd))
+    {
+        tty_flush_input(fd);
+        return;
+    }
+
+    // tcflush() does nothing on sockets: read what already arrived until there is nothing left
+    for (;;)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+            return;
+
+        char buffer[512];
+        ssize_t bytesRead = read(fd, buffer, sizeof(buffer));
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return;
+    }
+}
+
+void CommandEngine::complete(const Command &command, const Reply &reply)
+{
+    if (command.expectReply)
+    {
+        LatencyStats &stats = m_Stats[command.name.empty() ? command.request : command.name];
+        if (reply.status != TTY_OK)
+            stats.failures++;
+        else
+        {
+            stats.minMs = stats.count ? std::min(stats.minMs, reply.latencyMs) : reply.latencyMs;
+            stats.maxMs = std::max(stats.maxMs, reply.latencyMs);
+            stats.totalMs += reply.latencyMs;
+            stats.lastMs = reply.latencyMs;
+            stats.count++;
+        }
+    }
+
+    if (command.onReply)
+        command.onReply(reply);
+}
+}
@@ -0,0 +1,194 @@
+/*******************************************************************************
+ Command Engine
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Connection
+{
+class Interface;
+
+/**
+ * @brief The CommandEngine class sends queued commands to a device and collects their replies.
+ *
+ * Serial and TCP mount protocols answer commands in the order they were received. Instead of a
+ * full round trip per command, the engine writes several commands back to back and then reads
+ * the replies in order, splitting them by terminator or by expected length. Over a network bridge
+ * a status poll of N queries then costs about one round trip instead of N.
+ *
+ * Commands that change the device state, that the device can not buffer, or that it may leave
+ * unanswered can be marked as not pipelined: they are sent alone, once every previous reply was
+ * read, and the next commands wait for their reply.
+ *
+ * If a reply does not arrive in time, the replies of the commands in flight can no longer be told
+ * apart. They all fail with TTY_TIME_OUT and the input is flushed before the next command is sent.
+ *
+ * \code{.cpp}
+ * Connection::CommandEngine engine(serialConnection);
+ * engine.queue({":GR#"});
+ * engine.queue({":GD#"});
+ * auto replies = engine.run();
+ * if (replies[0].status == TTY_OK)
+ *     parseRA(replies[0].data);
+ * \endcode
+ */
+class CommandEngine
+{
+    public:
+        struct Reply;
+
+        /**
+         * @brief The Command struct describes one command and the reply it expects.
+         */
+        struct Command
+        {
+            /** Bytes to write to the device. */
+            std::string request;
+            /** The reply ends with this char, when expectedLength is 0. */
+            char terminator { '#' };
+            /** Length of a fixed size reply, 0 to split replies by terminator. */
+            size_t expectedLength { 0 };
+            /** Set to false for commands the device does not answer. */
+            bool expectReply { true };
+            /** Set to false to wait for every previous reply before sending this command. */
+            bool pipelined { true };
+            /** Reply timeout in milliseconds, 0 for the engine default. */
+            int timeoutMs { 0 };
+            /** Key of the latency statistics, the request if empty. */
+            std::string name;
+            /** Called with the reply once it is read, or failed. */
+            std::function<void(const Reply &)> onReply;
+        };
+
+        /**
+         * @brief The Reply struct holds the outcome of one command.
+         */
+        struct Reply
+        {
+            /** TTY_OK, or the TTY_ERROR code of the failure. */
+            int status { 0 };
+            /** Reply bytes, including the terminator. */
+            std::string data;
+            /** Time from writing the command to reading the end of its reply, in milliseconds. */
+            double latencyMs { 0 };
+        };
+
+        /**
+         * @brief The LatencyStats struct accumulates reply latencies of one command.
+         */
+        struct LatencyStats
+        {
+            unsigned count { 0 };
+            unsigned failures { 0 };
+            double minMs { 0 };
+            double maxMs { 0 };
+            double totalMs { 0 };
+            double lastMs { 0 };
+
+            double meanMs() const
+            {
+                return count ? totalMs / count : 0;
+            }
+        };
+
+    public:
+        /**
+         * @brief CommandEngine Use the port of a serial or TCP connection plugin.
+         * The port is looked up on each run, so the engine survives reconnections.
+         */
+        explicit CommandEngine(Interface *connection);
+
+        /**
+         * @brief CommandEngine Use a file descriptor, e.g. a pseudo terminal.
+         */
+        explicit CommandEngine(int fd);
+
+        /**
+         * @brief queue Add a command to the queue, it is sent by the next run().
+         */
+        void queue(const Command &command);
+
+        /**
+         * @brief run Send the queued commands and read their replies.
+         * @return The replies, in the order the commands were queued.
+         */
+        std::vector<Reply> run();
+
+        /**
+         * @brief send Queue a single command and run it, along with the commands queued before.
+         * @return The reply of this command.
+         */
+        Reply send(const Command &command);
+
+        /**
+         * @brief setMaxInFlight Limit the number of commands sent and not yet answered.
+         * Some controllers drop commands when their input buffer is full. The default is 8.
+         */
+        void setMaxInFlight(size_t maxInFlight);
+
+        /**
+         * @brief setTimeout Default reply timeout, in milliseconds. The default is 3000.
+         */
+        void setTimeout(int timeoutMs);
+
+        /**
+         * @return Latency statistics by command name.
+         */
+        const std::map<std::string, LatencyStats> &latencyStats() const
+        {
+            return m_Stats;
+        }
+
+        void resetLatencyStats()
+        {
+            m_Stats.clear();
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct InFlight
+        {
+            size_t index;
+            Clock::time_point sent;
+        };
+
+        int portFD() const;
+        int writeCommand(int fd, const Command &command);
+        int readReply(int fd, const Command &command, Clock::time_point deadline, std::string &data);
+        void flushInput(int fd);
+        void complete(const Command &command, const Reply &reply);
+
+    private:
+        Interface *m_Connection { nullptr };
+        int m_FD { -1 };
+        size_t m_MaxInFlight { 8 };
+        int m_TimeoutMs { 3000 };
+
+        std::deque<Command> m_Queue;
+        std::string m_Input;
+        std::map<std::string, LatencyStats> m_Stats;
+};
+}
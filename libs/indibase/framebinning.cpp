@@ -0,0 +1,397 @@
+/*******************************************************************************
+ Frame Binning
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "framebinning.h"
+#include "frameparallel_p.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMEBINNING_SIMD_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define FRAMEBINNING_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace INDI
+{
+
+// Sum binY rows, width pixels apart, column by column into acc
+template <typename T, typename A>
+static void sumRowsScalar(const T *src, size_t width, uint32_t binY, uint32_t columns, A *acc)
+{
+    for (uint32_t j = 0; j < columns; j++)
+        acc[j] = src[j];
+    for (uint32_t k = 1; k < binY; k++)
+    {
+        const T *row = src + k * width;
+        for (uint32_t j = 0; j < columns; j++)
+            acc[j] += row[j];
+    }
+}
+
+#if defined(FRAMEBINNING_SIMD_X86)
+
+__attribute__((target("avx2")))
+static uint32_t sumRows8AVX2(const uint8_t *src, size_t width, uint32_t binY, uint32_t columns, uint32_t *acc)
+{
+    uint32_t j = 0;
+    for (; j + 16 <= columns; j += 16)
+    {
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        for (uint32_t k = 0; k < binY; k++)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + k * width + j));
+            a0 = _mm256_add_epi32(a0, _mm256_cvtepu8_epi32(v));
+            a1 = _mm256_add_epi32(a1, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + j), a0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + j + 8), a1);
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+static uint32_t sumRows16AVX2(const uint16_t *src, size_t width, uint32_t binY, uint32_t columns, uint32_t *acc)
+{
+    uint32_t j = 0;
+    for (; j + 16 <= columns; j += 16)
+    {
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        for (uint32_t k = 0; k < binY; k++)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + k * width + j));
+            a0 = _mm256_add_epi32(a0, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+            a1 = _mm256_add_epi32(a1, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + j), a0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + j + 8), a1);
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+static uint32_t sumRows32AVX2(const uint32_t *src, size_t width, uint32_t binY, uint32_t columns, uint64_t *acc)
+{
+    uint32_t j = 0;
+    for (; j + 8 <= columns; j += 8)
+    {
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        for (uint32_t k = 0; k < binY; k++)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + k * width + j));
+            a0 = _mm256_add_epi64(a0, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+            a1 = _mm256_add_epi64(a1, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + j), a0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + j + 4), a1);
+    }
+    return j;
+}
+
+// Sums of adjacent pairs, the horizontal pass of 2xN bins
+__attribute__((target("avx2")))
+static uint32_t sumPairsAVX2(const uint32_t *acc, uint32_t outputs, uint32_t *sums)
+{
+    uint32_t o = 0;
+    for (; o + 8 <= outputs; o += 8)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + 2 * o));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + 2 * o + 8));
+        // hadd works within 128 bit lanes, restore the order of the pairs
+        __m256i s = _mm256_permute4x64_epi64(_mm256_hadd_epi32(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums + o), s);
+    }
+    return o;
+}
+
+// Saturate sums to 16 bits, the last pass of 16 bit bins
+__attribute__((target("avx2")))
+static uint32_t saturate16AVX2(const uint32_t *sums, uint32_t outputs, uint16_t *out)
+{
+    const __m256i top = _mm256_set1_epi32(UINT16_MAX);
+    uint32_t o = 0;
+    for (; o + 16 <= outputs; o += 16)
+    {
+        __m256i a = _mm256_min_epu32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(sums + o)), top);
+        __m256i b = _mm256_min_epu32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(sums + o + 8)), top);
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + o), p);
+    }
+    return o;
+}
+
+#elif defined(FRAMEBINNING_SIMD_NEON)
+
+static uint32_t sumRows8NEON(const uint8_t *src, size_t width, uint32_t binY, uint32_t columns, uint32_t *acc)
+{
+    uint32_t j = 0;
+    for (; j + 8 <= columns; j += 8)
+    {
+        uint32x4_t a0 = vdupq_n_u32(0), a1 = vdupq_n_u32(0);
+        for (uint32_t k = 0; k < binY; k++)
+        {
+            uint16x8_t v = vmovl_u8(vld1_u8(src + k * width + j));
+            a0 = vaddw_u16(a0, vget_low_u16(v));
+            a1 = vaddw_u16(a1, vget_high_u16(v));
+        }
+        vst1q_u32(acc + j, a0);
+        vst1q_u32(acc + j + 4, a1);
+    }
+    return j;
+}
+
+static uint32_t sumRows16NEON(const uint16_t *src, size_t width, uint32_t binY, uint32_t columns, uint32_t *acc)
+{
+    uint32_t j = 0;
+    for (; j + 8 <= columns; j += 8)
+    {
+        uint32x4_t a0 = vdupq_n_u32(0), a1 = vdupq_n_u32(0);
+        for (uint32_t k = 0; k < binY; k++)
+        {
+            uint16x8_t v = vld1q_u16(src + k * width + j);
+            a0 = vaddw_u16(a0, vget_low_u16(v));
+            a1 = vaddw_u16(a1, vget_high_u16(v));
+        }
+        vst1q_u32(acc + j, a0);
+        vst1q_u32(acc + j + 4, a1);
+    }
+    return j;
+}
+
+static uint32_t sumRows32NEON(const uint32_t *src, size_t width, uint32_t binY, uint32_t columns, uint64_t *acc)
+{
+    uint32_t j = 0;
+    for (; j + 4 <= columns; j += 4)
+    {
+        uint64x2_t a0 = vdupq_n_u64(0), a1 = vdupq_n_u64(0);
+        for (uint32_t k = 0; k < binY; k++)
+        {
+            uint32x4_t v = vld1q_u32(src + k * width + j);
+            a0 = vaddw_u32(a0, vget_low_u32(v));
+            a1 = vaddw_u32(a1, vget_high_u32(v));
+        }
+        vst1q_u64(acc + j, a0);
+        vst1q_u64(acc + j + 2, a1);
+    }
+    return j;
+}
+
+static uint32_t saturate16NEON(const uint32_t *sums, uint32_t outputs, uint16_t *out)
+{
+    uint32_t o = 0;
+    for (; o + 8 <= outputs; o += 8)
+        vst1q_u16(out + o, vcombine_u16(vqmovn_u32(vld1q_u32(sums + o)), vqmovn_u32(vld1q_u32(sums + o + 4))));
+    return o;
+}
+
+static uint32_t sumPairsNEON(const uint32_t *acc, uint32_t outputs, uint32_t *sums)
+{
+    uint32_t o = 0;
+    for (; o + 4 <= outputs; o += 4)
+        vst1q_u32(sums + o, vpaddq_u32(vld1q_u32(acc + 2 * o), vld1q_u32(acc + 2 * o + 4)));
+    return o;
+}
+
+#endif
+
+static SimdLevel s_SimdLevel;
+
+int setFrameBinningSimdLevel(int level)
+{
+    return s_SimdLevel.set(level);
+}
+
+// Vectorized vertical pass, returns the number of columns done
+static uint32_t sumRowsSIMD(const uint8_t *src, size_t width, uint32_t binY, uint32_t columns, uint32_t *acc)
+{
+#if defined(FRAMEBINNING_SIMD_X86)
+    return sumRows8AVX2(src, width, binY, columns, acc);
+#elif defined(FRAMEBINNING_SIMD_NEON)
+    return sumRows8NEON(src, width, binY, columns, acc);
+#else
+    (void)src, (void)width, (void)binY, (void)columns, (void)acc;
+    return 0;
+#endif
+}
+
+static uint32_t sumRowsSIMD(const uint16_t *src, size_t width, uint32_t binY, uint32_t columns, uint32_t *acc)
+{
+#if defined(FRAMEBINNING_SIMD_X86)
+    return sumRows16AVX2(src, width, binY, columns, acc);
+#elif defined(FRAMEBINNING_SIMD_NEON)
+    return sumRows16NEON(src, width, binY, columns, acc);
+#else
+    (void)src, (void)width, (void)binY, (void)columns, (void)acc;
+    return 0;
+#endif
+}
+
+static uint32_t sumRowsSIMD(const uint32_t *src, size_t width, uint32_t binY, uint32_t columns, uint64_t *acc)
+{
+#if defined(FRAMEBINNING_SIMD_X86)
+    return sumRows32AVX2(src, width, binY, columns, acc);
+#elif defined(FRAMEBINNING_SIMD_NEON)
+    return sumRows32NEON(src, width, binY, columns, acc);
+#else
+    (void)src, (void)width, (void)binY, (void)columns, (void)acc;
+    return 0;
+#endif
+}
+
+static uint32_t sumPairsSIMD(const uint32_t *acc, uint32_t outputs, uint32_t *sums)
+{
+#if defined(FRAMEBINNING_SIMD_X86)
+    return sumPairsAVX2(acc, outputs, sums);
+#elif defined(FRAMEBINNING_SIMD_NEON)
+    return sumPairsNEON(acc, outputs, sums);
+#else
+    (void)acc, (void)outputs, (void)sums;
+    return 0;
+#endif
+}
+
+static uint32_t sumPairsSIMD(const uint64_t *, uint32_t, uint64_t *)
+{
+    return 0;
+}
+
+static uint32_t saturateSIMD(const uint32_t *sums, uint32_t outputs, uint16_t *out)
+{
+#if defined(FRAMEBINNING_SIMD_X86)
+    return saturate16AVX2(sums, outputs, out);
+#elif defined(FRAMEBINNING_SIMD_NEON)
+    return saturate16NEON(sums, outputs, out);
+#else
+    (void)sums, (void)outputs, (void)out;
+    return 0;
+#endif
+}
+
+template <typename T, typename A>
+static uint32_t saturateSIMD(const A *, uint32_t, T *)
+{
+    return 0;
+}
+
+// Bin output rows [rowBegin, rowEnd). A is wide enough to hold the sum of a whole bin.
+template <typename T, typename A>
+static void binRows(const T *src, T *dst, uint32_t width, uint32_t binX, uint32_t binY, uint32_t rowBegin,
+                    uint32_t rowEnd, A divisor)
+{
+    const uint32_t outputs = width / binX;
+    const uint32_t columns = outputs * binX;
+    const A saturation     = std::numeric_limits<T>::max();
+    const bool simd        = s_SimdLevel.get() > 0;
+
+    std::vector<A> acc(columns), sums(outputs);
+
+    for (uint32_t r = rowBegin; r < rowEnd; r++)
+    {
+        const T *block = src + static_cast<size_t>(r) * binY * width;
+        T *out         = dst + static_cast<size_t>(r) * outputs;
+
+        // Vertical pass, binY rows into one row of sums
+        uint32_t j = simd ? sumRowsSIMD(block, width, binY, columns, acc.data()) : 0;
+        if (j < columns)
+            sumRowsScalar(block + j, width, binY, columns - j, acc.data() + j);
+
+        // Horizontal pass, binX columns into one sum
+        uint32_t o = (simd && binX == 2) ? sumPairsSIMD(acc.data(), outputs, sums.data()) : 0;
+        for (; o < outputs; o++)
+        {
+            const A *bin = acc.data() + o * binX;
+            A sum = bin[0];
+            for (uint32_t l = 1; l < binX; l++)
+                sum += bin[l];
+            sums[o] = sum;
+        }
+
+        if (divisor > 1)
+            for (o = 0; o < outputs; o++)
+                out[o] = static_cast<T>(std::min<A>(sums[o] / divisor, saturation));
+        else
+            for (o = simd ? saturateSIMD(sums.data(), outputs, out) : 0; o < outputs; o++)
+                out[o] = static_cast<T>(std::min<A>(sums[o], saturation));
+    }
+}
+
+template <typename T, typename A>
+static void binThreaded(const void *source, void *destination, uint32_t width, uint32_t height, uint32_t binX,
+                        uint32_t binY, A divisor, int threads)
+{
+    const T *src        = static_cast<const T *>(source);
+    T *dst              = static_cast<T *>(destination);
+    const uint32_t rows = height / binY;
+
+    unsigned count = threadCount(static_cast<size_t>(width) * height, rows, threads);
+    parallelSlices(rows, count, [&](unsigned, size_t begin, size_t end)
+    {
+        binRows<T, A>(src, dst, width, binX, binY, static_cast<uint32_t>(begin), static_cast<uint32_t>(end), divisor);
+    });
+}
+
+bool binFrameBuffer(const void *source, void *destination, uint32_t width, uint32_t height, int bpp,
+                    uint32_t binX, uint32_t binY, BinningMode mode, int threads)
+{
+    if ((bpp != 8 && bpp != 16 && bpp != 32) || binX == 0 || binY == 0)
+        return false;
+
+    const uint32_t outputs = width / binX;
+    const uint32_t rows    = height / binY;
+    if (outputs == 0 || rows == 0)
+        return true;
+
+    if (binX == 1 && binY == 1)
+    {
+        memcpy(destination, source, static_cast<size_t>(width) * height * (bpp / 8));
+        return true;
+    }
+
+    uint64_t pixels  = static_cast<uint64_t>(binX) * binY;
+    uint64_t divisor = 1;
+    if (mode == BINNING_MEAN)
+        divisor = pixels;
+    else if (mode == BINNING_DEFAULT && bpp == 8)
+        divisor = std::max<uint64_t>(1, pixels / 2);
+
+    switch (bpp)
+    {
+        case 8:
+            if (pixels > std::numeric_limits<uint32_t>::max() / UINT8_MAX)
+                return false;
+            binThreaded<uint8_t, uint32_t>(source, destination, width, height, binX, binY, divisor, threads);
+            break;
+        case 16:
+            if (pixels > std::numeric_limits<uint32_t>::max() / UINT16_MAX)
+                return false;
+            binThreaded<uint16_t, uint32_t>(source, destination, width, height, binX, binY, divisor, threads);
+            break;
+        default:
+            binThreaded<uint32_t, uint64_t>(source, destination, width, height, binX, binY, divisor, threads);
+            break;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+ Frame Binning
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+namespace INDI
+{
+
+typedef enum
+{
+    /** Saturated sum for 16 and 32 bits. For 8 bits, the sum divided by half the number of binned pixels. */
+    BINNING_DEFAULT,
+    /** Sum of the binned pixels, saturated to the bit depth. */
+    BINNING_SUM,
+    /** Mean of the binned pixels, rounded down. */
+    BINNING_MEAN
+} BinningMode;
+
+/**
+ * @brief binFrameBuffer Bin an unsigned 8, 16 or 32 bit mono frame in software.
+ * Source rows are summed in blocks of binY with AVX2 or NEON when available, then blocks of binX
+ * columns are reduced. Large frames are split by output rows across threads.
+ * @param source Pixels, native endianness, rows without padding.
+ * @param destination Receives (width / binX) x (height / binY) pixels of the same depth. Must not
+ * overlap source. Rows and columns left over by the bin size are dropped.
+ * @param width Source width in pixels.
+ * @param height Source height in pixels.
+ * @param bpp Bits per pixel, 8, 16 or 32.
+ * @param binX Horizontal bin size.
+ * @param binY Vertical bin size.
+ * @param mode How the binned pixels are combined.
+ * @param threads Number of threads, 0 to pick one from the frame size and the number of cores.
+ * @return False if the bit depth or bin size is not supported.
+ */
+bool binFrameBuffer(const void *source, void *destination, uint32_t width, uint32_t height, int bpp,
+                    uint32_t binX, uint32_t binY, BinningMode mode = BINNING_DEFAULT, int threads = 0);
+
+/**
+ * @brief setFrameBinningSimdLevel Limit the instruction set used by binning, for testing.
+ * @param level 0 for scalar code, -1 for the best available.
+ * @return The level in use.
+ */
+int setFrameBinningSimdLevel(int level);
+
+}
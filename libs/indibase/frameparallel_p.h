@@ -0,0 +1,114 @@
+/*******************************************************************************
+ Frame Parallel
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+// SIMD detection and row threading shared by the frame processing routines, not installed
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace INDI
+{
+
+// Below this many samples, starting threads costs more than it saves
+static constexpr size_t THREADED_SAMPLES = 1 << 22;
+static constexpr unsigned MAX_THREADS    = 8;
+
+// 1 when the CPU runs AVX2 on x86 or NEON on aarch64, 0 otherwise
+inline int simdSupported()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+#elif defined(__GNUC__) && defined(__aarch64__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief SIMD level of one frame routine, detected on first use and capped at what the routine implements.
+ * Threads running the routine at once may detect it together, they store the same value.
+ */
+class SimdLevel
+{
+    public:
+        explicit SimdLevel(int implemented = 1) : m_Implemented(implemented) {}
+
+        int get()
+        {
+            int level = m_Level.load(std::memory_order_relaxed);
+            if (level < 0)
+            {
+                level = supported();
+                m_Level.store(level, std::memory_order_relaxed);
+            }
+            return level;
+        }
+
+        // Out of range levels select the best supported one, which is returned
+        int set(int level)
+        {
+            int best = supported();
+            level = (level < 0 || level > best) ? best : level;
+            m_Level.store(level, std::memory_order_relaxed);
+            return level;
+        }
+
+    private:
+        int supported() const
+        {
+            return std::min(m_Implemented, simdSupported());
+        }
+
+        const int m_Implemented;
+        std::atomic<int> m_Level {-1};
+};
+
+// Threads to split units (rows or pixels) of a frame of samples over, threads > 0 forces the count
+inline unsigned threadCount(size_t samples, size_t units, int threads)
+{
+    size_t count = threads;
+    if (threads <= 0)
+        count = samples < THREADED_SAMPLES ? 1 : std::min(MAX_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    return static_cast<unsigned>(std::max<size_t>(1, std::min(count, units)));
+}
+
+// Split [0, units) in count contiguous slices and run function(slice, begin, end) on each, the first one on the calling thread
+template <typename Function>
+void parallelSlices(size_t units, unsigned count, Function &&function)
+{
+    std::vector<std::thread> workers;
+    for (unsigned slice = 1; slice < count; slice++)
+        workers.emplace_back([&function, units, count, slice]()
+        {
+            function(slice, units * slice / count, units * (slice + 1) / count);
+        });
+
+    function(0u, size_t(0), units / count);
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+}
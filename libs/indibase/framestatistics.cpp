@@ -0,0 +1,425 @@
+/*******************************************************************************
+ Frame Statistics
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "framestatistics.h"
+#include "frameparallel_p.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMESTATS_SIMD_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define FRAMESTATS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace INDI
+{
+
+template <typename T>
+static void minMaxScalar(const T *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    T vmin = std::numeric_limits<T>::max(), vmax = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        vmin = std::min(vmin, p[i]);
+        vmax = std::max(vmax, p[i]);
+    }
+    lmin = vmin;
+    lmax = vmax;
+}
+
+template <typename T, size_t N>
+static void reduceLanes(const T (&vmin)[N], const T (&vmax)[N], uint32_t &lmin, uint32_t &lmax)
+{
+    lmin = *std::min_element(vmin, vmin + N);
+    lmax = *std::max_element(vmax, vmax + N);
+}
+
+#if defined(FRAMESTATS_SIMD_X86)
+
+__attribute__((target("avx2")))
+static void minMax8AVX2(const uint8_t *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    __m256i vmin = _mm256_set1_epi8(-1), vmax = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        vmin = _mm256_min_epu8(vmin, v);
+        vmax = _mm256_max_epu8(vmax, v);
+    }
+
+    alignas(32) uint8_t amin[32], amax[32];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(amin), vmin);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(amax), vmax);
+    reduceLanes(amin, amax, lmin, lmax);
+
+    uint32_t tmin, tmax;
+    minMaxScalar(p + i, n - i, tmin, tmax);
+    lmin = std::min(lmin, tmin);
+    lmax = std::max(lmax, tmax);
+}
+
+__attribute__((target("avx2")))
+static void minMax16AVX2(const uint16_t *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    __m256i vmin = _mm256_set1_epi16(-1), vmax = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        vmin = _mm256_min_epu16(vmin, v);
+        vmax = _mm256_max_epu16(vmax, v);
+    }
+
+    alignas(32) uint16_t amin[16], amax[16];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(amin), vmin);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(amax), vmax);
+    reduceLanes(amin, amax, lmin, lmax);
+
+    uint32_t tmin, tmax;
+    minMaxScalar(p + i, n - i, tmin, tmax);
+    lmin = std::min(lmin, tmin);
+    lmax = std::max(lmax, tmax);
+}
+
+__attribute__((target("avx2")))
+static void minMax32AVX2(const uint32_t *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    __m256i vmin = _mm256_set1_epi32(-1), vmax = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        vmin = _mm256_min_epu32(vmin, v);
+        vmax = _mm256_max_epu32(vmax, v);
+    }
+
+    alignas(32) uint32_t amin[8], amax[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(amin), vmin);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(amax), vmax);
+    reduceLanes(amin, amax, lmin, lmax);
+
+    uint32_t tmin, tmax;
+    minMaxScalar(p + i, n - i, tmin, tmax);
+    lmin = std::min(lmin, tmin);
+    lmax = std::max(lmax, tmax);
+}
+
+#elif defined(FRAMESTATS_SIMD_NEON)
+
+static void minMax8NEON(const uint8_t *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    uint8x16_t vmin = vdupq_n_u8(0xff), vmax = vdupq_n_u8(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(p + i);
+        vmin = vminq_u8(vmin, v);
+        vmax = vmaxq_u8(vmax, v);
+    }
+    lmin = vminvq_u8(vmin);
+    lmax = vmaxvq_u8(vmax);
+
+    uint32_t tmin, tmax;
+    minMaxScalar(p + i, n - i, tmin, tmax);
+    lmin = std::min(lmin, tmin);
+    lmax = std::max(lmax, tmax);
+}
+
+static void minMax16NEON(const uint16_t *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    uint16x8_t vmin = vdupq_n_u16(0xffff), vmax = vdupq_n_u16(0);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint16x8_t v = vld1q_u16(p + i);
+        vmin = vminq_u16(vmin, v);
+        vmax = vmaxq_u16(vmax, v);
+    }
+    lmin = vminvq_u16(vmin);
+    lmax = vmaxvq_u16(vmax);
+
+    uint32_t tmin, tmax;
+    minMaxScalar(p + i, n - i, tmin, tmax);
+    lmin = std::min(lmin, tmin);
+    lmax = std::max(lmax, tmax);
+}
+
+static void minMax32NEON(const uint32_t *p, size_t n, uint32_t &lmin, uint32_t &lmax)
+{
+    uint32x4_t vmin = vdupq_n_u32(0xffffffff), vmax = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32x4_t v = vld1q_u32(p + i);
+        vmin = vminq_u32(vmin, v);
+        vmax = vmaxq_u32(vmax, v);
+    }
+    lmin = vminvq_u32(vmin);
+    lmax = vmaxvq_u32(vmax);
+
+    uint32_t tmin, tmax;
+    minMaxScalar(p + i, n - i, tmin, tmax);
+    lmin = std::min(lmin, tmin);
+    lmax = std::max(lmax, tmax);
+}
+
+#endif
+
+static SimdLevel s_SimdLevel;
+
+int setFrameStatisticsSimdLevel(int level)
+{
+    return s_SimdLevel.set(level);
+}
+
+// Min and max of n pixels, which must not be empty
+static void minMaxRange(const void *buffer, size_t offset, size_t n, int bpp, uint32_t &lmin, uint32_t &lmax)
+{
+    const uint8_t *p8   = static_cast<const uint8_t *>(buffer) + offset;
+    const uint16_t *p16 = static_cast<const uint16_t *>(buffer) + offset;
+    const uint32_t *p32 = static_cast<const uint32_t *>(buffer) + offset;
+
+    if (s_SimdLevel.get() > 0)
+    {
+#if defined(FRAMESTATS_SIMD_X86)
+        switch (bpp)
+        {
+            case 8:
+                return minMax8AVX2(p8, n, lmin, lmax);
+            case 16:
+                return minMax16AVX2(p16, n, lmin, lmax);
+            default:
+                return minMax32AVX2(p32, n, lmin, lmax);
+        }
+#elif defined(FRAMESTATS_SIMD_NEON)
+        switch (bpp)
+        {
+            case 8:
+                return minMax8NEON(p8, n, lmin, lmax);
+            case 16:
+                return minMax16NEON(p16, n, lmin, lmax);
+            default:
+                return minMax32NEON(p32, n, lmin, lmax);
+        }
+#endif
+    }
+
+    switch (bpp)
+    {
+        case 8:
+            return minMaxScalar(p8, n, lmin, lmax);
+        case 16:
+            return minMaxScalar(p16, n, lmin, lmax);
+        default:
+            return minMaxScalar(p32, n, lmin, lmax);
+    }
+}
+
+void frameMinMax(const void *buffer, size_t pixels, int bpp, double *min, double *max)
+{
+    *min = *max = 0;
+    if (buffer == nullptr || pixels == 0 || (bpp != 8 && bpp != 16 && bpp != 32))
+        return;
+
+    unsigned count = threadCount(pixels, pixels, 0);
+    std::vector<uint32_t> mins(count), maxs(count);
+
+    parallelSlices(pixels, count, [&](unsigned slice, size_t begin, size_t end)
+    {
+        minMaxRange(buffer, begin, end - begin, bpp, mins[slice], maxs[slice]);
+    });
+
+    *min = *std::min_element(mins.begin(), mins.end());
+    *max = *std::max_element(maxs.begin(), maxs.end());
+}
+
+// Counts of one slice. 8 and 16 bit pixels are counted at full resolution, 32 bit pixels by their
+// upper 16 bits, along with their sums relative to a reference pixel to keep the variance accurate.
+struct SlicePartial
+{
+    std::vector<uint32_t> histogram;
+    uint32_t min { 0 };
+    uint32_t max { 0 };
+    int64_t sum { 0 };
+    double sumSquares { 0 };
+};
+
+template <typename T>
+static void histogramSlice(const T *p, size_t n, std::vector<uint32_t> &histogram)
+{
+    // Four tables, so that runs of equal pixels do not wait on the same counter
+    const size_t range = histogram.size();
+    std::vector<uint32_t> tables(range * 4, 0);
+    uint32_t *h0 = tables.data(), *h1 = h0 + range, *h2 = h1 + range, *h3 = h2 + range;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        h0[p[i]]++;
+        h1[p[i + 1]]++;
+        h2[p[i + 2]]++;
+        h3[p[i + 3]]++;
+    }
+    for (; i < n; i++)
+        h0[p[i]]++;
+
+    for (size_t v = 0; v < range; v++)
+        histogram[v] = h0[v] + h1[v] + h2[v] + h3[v];
+}
+
+static void statistics32Slice(const uint32_t *p, size_t n, uint32_t reference, SlicePartial &partial)
+{
+    uint32_t *h  = partial.histogram.data();
+    int64_t sum  = 0;
+    double sumSquares = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int64_t d = static_cast<int64_t>(p[i]) - reference;
+        sum += d;
+        sumSquares += static_cast<double>(d * d);
+        h[p[i] >> 16]++;
+    }
+
+    partial.sum        = sum;
+    partial.sumSquares = sumSquares;
+}
+
+// Value of the pixel of the given rank in sorted order
+static uint64_t valueAtRank(const std::vector<uint64_t> &histogram, uint64_t rank)
+{
+    uint64_t seen = 0;
+    for (size_t v = 0; v < histogram.size(); v++)
+    {
+        seen += histogram[v];
+        if (seen > rank)
+            return v;
+    }
+    return histogram.size() - 1;
+}
+
+bool frameStatistics(const void *buffer, uint32_t width, uint32_t height, int bpp, FrameStatistics &stats,
+                     uint32_t bins, int threads)
+{
+    if (bpp != 8 && bpp != 16 && bpp != 32)
+        return false;
+
+    const size_t pixels = static_cast<size_t>(width) * height;
+    const size_t range  = bpp == 8 ? 256 : 65536;
+
+    stats       = FrameStatistics();
+    stats.count = pixels;
+    stats.histogram.assign(std::min<size_t>(std::max<uint32_t>(bins, 1), range), 0);
+
+    if (buffer == nullptr || pixels == 0)
+        return true;
+
+    const uint32_t reference = bpp == 32 ? *static_cast<const uint32_t *>(buffer) : 0;
+    unsigned count = threadCount(pixels, height, threads);
+    std::vector<SlicePartial> partials(count);
+
+    parallelSlices(height, count, [&](unsigned slice, size_t beginRow, size_t endRow)
+    {
+        SlicePartial &partial = partials[slice];
+        size_t offset = beginRow * width;
+        size_t n      = (endRow - beginRow) * width;
+
+        // Every slice holds at least one row, there are never more slices than rows
+        partial.histogram.assign(range, 0);
+
+        switch (bpp)
+        {
+            case 8:
+                histogramSlice(static_cast<const uint8_t *>(buffer) + offset, n, partial.histogram);
+                break;
+            case 16:
+                histogramSlice(static_cast<const uint16_t *>(buffer) + offset, n, partial.histogram);
+                break;
+            default:
+                minMaxRange(buffer, offset, n, bpp, partial.min, partial.max);
+                statistics32Slice(static_cast<const uint32_t *>(buffer) + offset, n, reference, partial);
+                break;
+        }
+    });
+
+    std::vector<uint64_t> histogram(range, 0);
+    for (const auto &partial : partials)
+        for (size_t v = 0; v < range; v++)
+            histogram[v] += partial.histogram[v];
+
+    if (bpp == 32)
+    {
+        int64_t sum = 0;
+        double sumSquares = 0;
+        uint32_t lmin = std::numeric_limits<uint32_t>::max(), lmax = 0;
+        for (const auto &partial : partials)
+        {
+            sum += partial.sum;
+            sumSquares += partial.sumSquares;
+            lmin = std::min(lmin, partial.min);
+            lmax = std::max(lmax, partial.max);
+        }
+
+        double mean   = static_cast<double>(sum) / pixels;
+        stats.min     = lmin;
+        stats.max     = lmax;
+        stats.mean    = reference + mean;
+        stats.stddev  = std::sqrt(std::max(0.0, sumSquares / pixels - mean * mean));
+        stats.median  = static_cast<double>(valueAtRank(histogram, (pixels - 1) / 2) << 16);
+    }
+    else
+    {
+        // Everything else follows from the full resolution histogram
+        double sum = 0;
+        for (size_t v = 0; v < range; v++)
+            sum += static_cast<double>(v) * histogram[v];
+        double mean = sum / pixels;
+
+        double sumSquares = 0;
+        for (size_t v = 0; v < range; v++)
+            if (histogram[v])
+                sumSquares += (v - mean) * (v - mean) * histogram[v];
+
+        size_t lmin = 0, lmax = range - 1;
+        while (histogram[lmin] == 0)
+            lmin++;
+        while (histogram[lmax] == 0)
+            lmax--;
+
+        stats.min    = lmin;
+        stats.max    = lmax;
+        stats.mean   = mean;
+        stats.stddev = std::sqrt(sumSquares / pixels);
+        stats.median = (pixels % 2) ? valueAtRank(histogram, pixels / 2) :
+                       (valueAtRank(histogram, pixels / 2 - 1) + valueAtRank(histogram, pixels / 2)) / 2.0;
+    }
+
+    const size_t outBins = stats.histogram.size();
+    for (size_t v = 0; v < range; v++)
+        stats.histogram[v * outBins / range] += histogram[v];
+
+    return true;
+}
+
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+ Frame Statistics
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief The FrameStatistics struct holds the pixel statistics of a frame.
+ */
+struct FrameStatistics
+{
+    double min { 0 };
+    double max { 0 };
+    double mean { 0 };
+    double stddev { 0 };
+    /** Exact for 8 and 16 bits. For 32 bits, the lower bound of the 65536-wide bin holding the median. */
+    double median { 0 };
+    /** Number of pixels. */
+    size_t count { 0 };
+    /** Pixel counts over the full range of the bit depth, split in equal bins. */
+    std::vector<uint64_t> histogram;
+};
+
+/**
+ * @brief frameMinMax Find the smallest and largest pixel of an unsigned 8, 16 or 32 bit frame.
+ * Uses AVX2 or NEON when available.
+ * @param buffer Pixels, native endianness.
+ * @param pixels Number of pixels in the buffer.
+ * @param bpp Bits per pixel, 8, 16 or 32.
+ * @param min Set to the smallest value, 0 for an empty buffer.
+ * @param max Set to the largest value, 0 for an empty buffer.
+ */
+void frameMinMax(const void *buffer, size_t pixels, int bpp, double *min, double *max);
+
+/**
+ * @brief frameStatistics Compute min, max, mean, standard deviation, median and histogram in one
+ * pass over an unsigned 8, 16 or 32 bit frame. Large frames are split by rows across threads.
+ * @param buffer Pixels, native endianness, rows without padding.
+ * @param width Frame width in pixels, times the number of channels for color frames.
+ * @param height Frame height in pixels.
+ * @param bpp Bits per pixel, 8, 16 or 32.
+ * @param stats Filled with the statistics.
+ * @param bins Number of histogram bins, clamped to 1..2^bpp (2^16 for 32 bits).
+ * @param threads Number of threads, 0 to pick one from the frame size and the number of cores.
+ * @return False if the bit depth is not supported.
+ */
+bool frameStatistics(const void *buffer, uint32_t width, uint32_t height, int bpp, FrameStatistics &stats,
+                     uint32_t bins = 256, int threads = 0);
+
+/**
+ * @brief setFrameStatisticsSimdLevel Limit the instruction set used by the kernels, for testing.
+ * @param level 0 for scalar code, -1 for the best available.
+ * @return The level in use.
+ */
+int setFrameStatisticsSimdLevel(int level);
+
+}
@@ -33,6 +33,8 @@
 #include "indicom.h"
 #include "locale_compat.h"
 #include "indiutility.h"
+#include "sharedblob.h"
+#include "blobcompression.h"
 
 #ifdef HAVE_XISF
 #include <libxisf.h>
@@ -47,16 +49,17 @@
 #include <libnova/ln_types.h>
 #include <libastro.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <cmath>
 #include <regex>
 #include <iterator>
+#include <limits>
 #include <variant>
 
 #include <dirent.h>
 #include <cerrno>
 #include <cstdlib>
-#include <zlib.h>
 #include <sys/stat.h>
 
 const char * IMAGE_SETTINGS_TAB = "Image Settings";
@@ -79,6 +82,52 @@ std::string join(std::vector<std::string> const &strings, std::string delim)
 namespace INDI
 {
 
+// A frame on its way to the disk and the client, with the buffers it owns
+struct CCD::UploadJob
+{
+    CCDChip *chip {nullptr};
+    bool sendImage {false};
+    bool saveImage {false};
+    bool compress {false};
+    int blobCodec {BlobCompression::CODEC_ZLIB};
+    int blobLevel {0};
+    int encodeFormat {FORMAT_FITS};
+    std::string extension;
+    std::string uploadDir;
+    std::string uploadPrefix;
+
+    // Frame, owned when copied for the pipeline
+    uint8_t *frame {nullptr};
+    size_t frameSize {0};
+    bool ownsFrame {false};
+    int bpp {16};
+    int naxis {2};
+    uint32_t width {0};
+    uint32_t height {0};
+    CCDChip::CCD_FRAME frameType {CCDChip::LIGHT_FRAME};
+    std::string bayerPattern;
+    std::vector<FITSRecord> keywords;
+
+    // Encoded file, the frame itself in native format
+    void *file {nullptr};
+    size_t fileSize {0};
+
+    // Sent to the client, the file itself when not compressed
+    void *blob {nullptr};
+    size_t blobSize {0};
+    std::string blobFormat;
+
+    ~UploadJob()
+    {
+        if (blob != file)
+            IDSharedBlobFree(blob);
+        if (file != frame)
+            IDSharedBlobFree(file);
+        if (ownsFrame)
+            IDSharedBlobFree(frame);
+    }
+};
+
 CCD::CCD()
 {
     //ctor
@@ -127,10 +176,16 @@ CCD::CCD()
 
     exposureStartTime[0] = 0;
     exposureDuration = 0.0;
+
+    setupUploadPipeline();
 }
 
 CCD::~CCD()
 {
+    // Already idle when the driver disconnected first, see updateProperties(). Any frame still in flight
+    // completes against CCD only, the derived class is gone by now.
+    m_UploadPipeline->stop();
+
     // Only update if index is different.
     if (m_ConfigFastExposureIndex != IUFindOnSwitchIndex(&FastExposureToggleSP))
         saveConfig(true, FastExposureToggleSP.name);
@@ -357,6 +412,50 @@ bool CCD::initProperties()
     ScopeInfoNP[Aperture].fill("APERTURE", "Aperture (mm)", "%.2f", 10, 3000, 100, 0);
     ScopeInfoNP.fill(getDeviceName(), "SCOPE_INFO", "Scope", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
 
+    BufferPoolNP[POOL_HITS].fill("POOL_HITS", "Hits", "%.f", 0, 1e12, 0, 0);
+    BufferPoolNP[POOL_MISSES].fill("POOL_MISSES", "Misses", "%.f", 0, 1e12, 0, 0);
+    BufferPoolNP.fill(getDeviceName(), "CCD_BUFFER_POOL", "Buffer Pool", OPTIONS_TAB, IP_RO, 60, IPS_IDLE);
+
+    BufferPoolLimitNP[0].fill("MAX_MB", "Limit (MB)", "%.f", 0, 4096, 64, 0);
+    BufferPoolLimitNP.fill(getDeviceName(), "CCD_BUFFER_POOL_LIMIT", "Pool Limit", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+
+    /**********************************************/
+    /************** Frame Statistics **************/
+    /**********************************************/
+    FrameStatisticsSP[INDI_ENABLED].fill("INDI_ENABLED", "Enabled", ISS_OFF);
+    FrameStatisticsSP[INDI_DISABLED].fill("INDI_DISABLED", "Disabled", ISS_ON);
+    FrameStatisticsSP.fill(getDeviceName(), "CCD_STATISTICS_TOGGLE", "Statistics", IMAGE_INFO_TAB, IP_RW, ISR_1OFMANY, 60,
+                           IPS_IDLE);
+
+    FrameStatisticsNP[STATS_MIN].fill("STATS_MIN", "Min", "%.f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATS_MAX].fill("STATS_MAX", "Max", "%.f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATS_MEAN].fill("STATS_MEAN", "Mean", "%.2f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATS_STDDEV].fill("STATS_STDDEV", "Std Dev", "%.2f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP[STATS_MEDIAN].fill("STATS_MEDIAN", "Median", "%.1f", 0, 4294967295., 0, 0);
+    FrameStatisticsNP.fill(getDeviceName(), "CCD_FRAME_STATISTICS", "Frame", IMAGE_INFO_TAB, IP_RO, 60, IPS_IDLE);
+
+    /**********************************************/
+    /*************** Upload Pipeline **************/
+    /**********************************************/
+    UploadPipelineNP[0].fill("DEPTH", "Frames in flight", "%.f", 0, 8, 1, 0);
+    UploadPipelineNP.fill(getDeviceName(), "CCD_UPLOAD_PIPELINE", "Pipeline", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+
+    BlobCodecSP[BlobCompression::CODEC_ZLIB].fill("CODEC_ZLIB", "zlib", ISS_ON);
+    BlobCodecSP[BlobCompression::CODEC_ZSTD].fill("CODEC_ZSTD", "Zstandard", ISS_OFF);
+    BlobCodecSP[BlobCompression::CODEC_LZ4].fill("CODEC_LZ4", "LZ4", ISS_OFF);
+    BlobCodecSP.fill(getDeviceName(), "CCD_BLOB_CODEC", "Codec", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 60, IPS_IDLE);
+
+    BlobCompressionLevelNP[0].fill("LEVEL", "Level", "%.f", -10, 22, 1, 0);
+    BlobCompressionLevelNP.fill(getDeviceName(), "CCD_BLOB_COMPRESSION_LEVEL", "Codec Level", OPTIONS_TAB, IP_RW, 60,
+                                IPS_IDLE);
+
+    UploadTimingNP[UPLOAD_WAIT].fill("UPLOAD_WAIT", "Wait (ms)", "%.1f", 0, 1e9, 0, 0);
+    UploadTimingNP[UPLOAD_ENCODE].fill("UPLOAD_ENCODE", "Encode (ms)", "%.1f", 0, 1e9, 0, 0);
+    UploadTimingNP[UPLOAD_COMPRESS].fill("UPLOAD_COMPRESS", "Compress (ms)", "%.1f", 0, 1e9, 0, 0);
+    UploadTimingNP[UPLOAD_SAVE].fill("UPLOAD_SAVE", "Save (ms)", "%.1f", 0, 1e9, 0, 0);
+    UploadTimingNP[UPLOAD_SEND].fill("UPLOAD_SEND", "Send (ms)", "%.1f", 0, 1e9, 0, 0);
+    UploadTimingNP.fill(getDeviceName(), "CCD_UPLOAD_TIMING", "Upload Timing", OPTIONS_TAB, IP_RO, 60, IPS_IDLE);
+
     /**********************************************/
     /************** Capture Format ***************/
     /**********************************************/
@@ -610,6 +709,15 @@ bool CCD::updateProperties()
         }
 #endif
         defineProperty(ScopeInfoNP);
+        defineProperty(BufferPoolNP);
+        defineProperty(BufferPoolLimitNP);
+        defineProperty(FrameStatisticsSP);
+        defineProperty(UploadPipelineNP);
+        defineProperty(BlobCodecSP);
+        defineProperty(BlobCompressionLevelNP);
+        defineProperty(UploadTimingNP);
+        if (FrameStatisticsSP[INDI_ENABLED].getState() == ISS_ON)
+            defineProperty(FrameStatisticsNP);
 
         defineProperty(&WorldCoordSP);
         defineProperty(&UploadSP);
@@ -694,6 +802,16 @@ bool CCD::updateProperties()
         if (HasBayer())
             deleteProperty(BayerTP.name);
         deleteProperty(ScopeInfoNP);
+        deleteProperty(BufferPoolNP);
+        deleteProperty(BufferPoolLimitNP);
+        deleteProperty(FrameStatisticsSP);
+        // Let the frames in flight reach the client while the derived class can still complete them
+        m_UploadPipeline->stop();
+        deleteProperty(UploadPipelineNP);
+        deleteProperty(BlobCodecSP);
+        deleteProperty(BlobCompressionLevelNP);
+        deleteProperty(UploadTimingNP);
+        deleteProperty(FrameStatisticsNP);
 
         if (WorldCoordS[0].s == ISS_ON)
         {
@@ -1225,6 +1343,43 @@ bool CCD::ISNewNumber(const char * dev, const char * name, double values[], char
             return true;
         }
 
+        // Buffer Pool Limit
+        if (BufferPoolLimitNP.isNameMatch(name))
+        {
+            BufferPoolLimitNP.update(values, names, n);
+            BufferPoolLimitNP.setState(IPS_OK);
+            BufferPoolLimitNP.apply();
+
+            // Bounded by size only
+            size_t limit = static_cast<size_t>(BufferPoolLimitNP[0].getValue()) * 1024 * 1024;
+            IDSharedBlobSetPoolSize(limit > 0 ? std::numeric_limits<unsigned int>::max() : 0, limit);
+            saveConfig(true, BufferPoolLimitNP.getName());
+            return true;
+        }
+
+        // Upload Pipeline
+        if (UploadPipelineNP.isNameMatch(name))
+        {
+            UploadPipelineNP.update(values, names, n);
+            UploadPipelineNP.setState(IPS_OK);
+            UploadPipelineNP.apply();
+
+            if (UploadPipelineNP[0].getValue() > 0)
+                m_UploadPipeline->setDepth(UploadPipelineNP[0].getValue());
+            saveConfig(true, UploadPipelineNP.getName());
+            return true;
+        }
+
+        // BLOB Compression Level
+        if (BlobCompressionLevelNP.isNameMatch(name))
+        {
+            BlobCompressionLevelNP.update(values, names, n);
+            BlobCompressionLevelNP.setState(IPS_OK);
+            BlobCompressionLevelNP.apply();
+            saveConfig(true, BlobCompressionLevelNP.getName());
+            return true;
+        }
+
         // Scope Information
         if (ScopeInfoNP.isNameMatch(name))
         {
@@ -1750,6 +1905,46 @@ bool CCD::ISNewSwitch(const char * dev, const char * name, ISState * states, cha
             return true;
         }
 
+        // Frame Statistics
+        if (FrameStatisticsSP.isNameMatch(name))
+        {
+            FrameStatisticsSP.update(states, names, n);
+            FrameStatisticsSP.setState(IPS_OK);
+            FrameStatisticsSP.apply();
+
+            if (FrameStatisticsSP[INDI_ENABLED].getState() == ISS_ON)
+                defineProperty(FrameStatisticsNP);
+            else
+                deleteProperty(FrameStatisticsNP);
+
+            saveConfig(true, FrameStatisticsSP.getName());
+            return true;
+        }
+
+        // BLOB Codec
+        if (BlobCodecSP.isNameMatch(name))
+        {
+            int previousIndex = BlobCodecSP.findOnSwitchIndex();
+            BlobCodecSP.update(states, names, n);
+
+            auto codec = static_cast<BlobCompression::Codec>(BlobCodecSP.findOnSwitchIndex());
+            if (BlobCompression::isAvailable(codec))
+                BlobCodecSP.setState(IPS_OK);
+            else
+            {
+                LOGF_ERROR("%s compression is not supported by this build.", BlobCodecSP.findOnSwitch()->getLabel());
+                if (previousIndex >= 0)
+                {
+                    BlobCodecSP.reset();
+                    BlobCodecSP[previousIndex].setState(ISS_ON);
+                }
+                BlobCodecSP.setState(IPS_ALERT);
+            }
+            BlobCodecSP.apply();
+            saveConfig(true, BlobCodecSP.getName());
+            return true;
+        }
+
         // Encode Format
         if (EncodeFormatSP.isNameMatch(name))
         {
@@ -2261,6 +2456,10 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
     if (processFastExposure(targetChip) == false)
         return false;
 
+    // Local to this exposure, other chips complete on their own threads
+    FrameStatistics statistics;
+    bool hasStatistics = updateFrameStatistics(targetChip, statistics);
+
     bool sendImage = (UploadS[UPLOAD_CLIENT].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
     bool saveImage = (UploadS[UPLOAD_LOCAL].s == ISS_ON || UploadS[UPLOAD_BOTH].s == ISS_ON);
 
@@ -2270,415 +2469,596 @@ bool CCD::ExposureCompletePrivate(CCDChip * targetChip)
 
     if (sendImage || saveImage)
     {
-        if (EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON)
+        std::unique_ptr<UploadJob> job(new UploadJob);
+        if (prepareUpload(targetChip, *job, sendImage, saveImage, hasStatistics ? &statistics : nullptr) == false)
         {
-            targetChip->setImageExtension("fits");
+            targetChip->setExposureFailed();
+            return false;
+        }
 
-            int img_type  = 0;
-            int byte_type = 0;
-            int status    = 0;
-            long naxis    = targetChip->getNAxis();
-            long naxes[3];
-            int nelements = 0;
-            char error_status[MAXRBUF];
+        if (UploadPipelineNP[0].getValue() > 0)
+        {
+            // Hand a copy of the frame over to the pipeline, the camera can fill the buffer again
+            {
+                std::unique_lock<std::mutex> guard(ccdBufferLock);
+                job->frame = static_cast<uint8_t *>(IDSharedBlobAlloc(job->frameSize));
+                if (job->frame == nullptr)
+                {
+                    LOG_ERROR("Error: Ran out of memory queuing image for upload");
+                    targetChip->setExposureFailed();
+                    return false;
+                }
+                job->ownsFrame = true;
+                memcpy(job->frame, targetChip->getFrameBuffer(), job->frameSize);
+            }
 
-            naxes[0] = targetChip->getSubW() / targetChip->getBinX();
-            naxes[1] = targetChip->getSubH() / targetChip->getBinY();
+            // Blocks while the pipeline is full, it completes the exposure once the frame is out
+            m_UploadWaitMs = m_UploadPipeline->push(std::move(job));
+            return true;
+        }
 
-            switch (targetChip->getBPP())
-            {
-                case 8:
-                    byte_type = TBYTE;
-                    img_type  = BYTE_IMG;
-                    break;
+        // Frames still in the pipeline go out first
+        m_UploadPipeline->waitForIdle();
 
-                case 16:
-                    byte_type = TUSHORT;
-                    img_type  = USHORT_IMG;
-                    break;
+        std::unique_lock<std::mutex> guard(ccdBufferLock);
+        job->frame = targetChip->getFrameBuffer();
 
-                case 32:
-                    byte_type = TULONG;
-                    img_type  = ULONG_IMG;
-                    break;
+        std::vector<double> stageMs;
+        bool rc = true;
+        for (auto stage : {&CCD::encodeUpload, &CCD::compressUpload, &CCD::saveUpload, &CCD::sendUpload})
+        {
+            auto start = std::chrono::steady_clock::now();
+            rc = (this->*stage)(*job);
+            stageMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if (rc == false)
+                break;
+        }
+        job.reset();
+        guard.unlock();
 
-                default:
-                    LOGF_ERROR("Unsupported bits per pixel value %d", targetChip->getBPP());
-                    return false;
-            }
+        if (rc == false)
+        {
+            targetChip->setExposureFailed();
+            return false;
+        }
 
-            nelements = naxes[0] * naxes[1];
-            if (naxis == 3)
-            {
-                nelements *= 3;
-                naxes[2] = 3;
-            }
+        m_UploadWaitMs = 0;
+        updateUploadTiming(stageMs);
+    }
 
-            /*DEBUGF(Logger::DBG_DEBUG, "Exposure complete. Image Depth: %s. Width: %d Height: %d nelements: %d", bit_depth.c_str(), naxes[0],
-                    naxes[1], nelements);*/
+    completeUpload(targetChip);
+    return true;
+}
 
-            std::unique_lock<std::mutex> guard(ccdBufferLock);
+void CCD::completeUpload(CCDChip * targetChip)
+{
+    if (FastExposureToggleS[INDI_ENABLED].s != ISS_ON)
+        targetChip->setExposureComplete();
 
-            // 8640 = 2880 * 3 which is sufficient for most cases.
-            uint32_t size = 8640 + nelements * (targetChip->getBPP() / 8);
-            //  Initialize FITS file.
-            if (targetChip->openFITSFile(size, status) == false)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                return false;
-            }
+    unsigned long hits, misses;
+    IDSharedBlobPoolStats(&hits, &misses);
+    if (hits != BufferPoolNP[POOL_HITS].getValue() || misses != BufferPoolNP[POOL_MISSES].getValue())
+    {
+        BufferPoolNP[POOL_HITS].setValue(hits);
+        BufferPoolNP[POOL_MISSES].setValue(misses);
+        BufferPoolNP.setState(IPS_OK);
+        BufferPoolNP.apply();
+    }
 
-            auto fptr = *targetChip->fitsFilePointer();
+    UploadComplete(targetChip);
+}
 
-            fits_create_img(fptr, img_type, naxis, naxes, &status);
+void CCD::updateUploadTiming(const std::vector<double> &stageMs)
+{
+    UploadTimingNP[UPLOAD_WAIT].setValue(m_UploadWaitMs);
+    for (size_t i = 0; i < stageMs.size() && UPLOAD_ENCODE + i < UploadTimingNP.size(); i++)
+        UploadTimingNP[UPLOAD_ENCODE + i].setValue(stageMs[i]);
+    UploadTimingNP.setState(IPS_OK);
+    UploadTimingNP.apply();
+}
 
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                targetChip->closeFITSFile();
+void CCD::setupUploadPipeline()
+{
+    m_UploadPipeline.reset(new StagedPipeline<std::unique_ptr<UploadJob>>());
+    m_UploadPipeline->addStage("Encode", [this](std::unique_ptr<UploadJob> &job)
+    {
+        return encodeUpload(*job);
+    });
+    m_UploadPipeline->addStage("Compress", [this](std::unique_ptr<UploadJob> &job)
+    {
+        return compressUpload(*job);
+    });
+    m_UploadPipeline->addStage("Save", [this](std::unique_ptr<UploadJob> &job)
+    {
+        return saveUpload(*job);
+    });
+    m_UploadPipeline->addStage("Send", [this](std::unique_ptr<UploadJob> &job)
+    {
+        return sendUpload(*job);
+    });
+    m_UploadPipeline->setDone([this](std::unique_ptr<UploadJob> &job, bool ok, const std::vector<double> &stageMs)
+    {
+        CCDChip *targetChip = job->chip;
+        // Give the frame copy back to the pool before the next frame asks for one
+        job.reset();
+
+        if (ok == false)
+        {
+            targetChip->setExposureFailed();
+            return;
+        }
+
+        updateUploadTiming(stageMs);
+        completeUpload(targetChip);
+    });
+}
+
+bool CCD::prepareUpload(CCDChip * targetChip, UploadJob &job, bool sendImage, bool saveImage,
+                        const FrameStatistics *statistics)
+{
+    job.chip         = targetChip;
+    job.sendImage    = sendImage;
+    job.saveImage    = saveImage;
+    job.encodeFormat = EncodeFormatSP.findOnSwitchIndex();
+    job.bpp          = targetChip->getBPP();
+    job.naxis        = targetChip->getNAxis();
+    job.width        = targetChip->getSubW() / targetChip->getBinX();
+    job.height       = targetChip->getSubH() / targetChip->getBinY();
+    job.frameType    = targetChip->getFrameType();
+    job.frameSize    = targetChip->getFrameBufferSize();
+    job.uploadDir    = UploadSettingsT[UPLOAD_DIR].text ? UploadSettingsT[UPLOAD_DIR].text : "";
+    job.uploadPrefix = UploadSettingsT[UPLOAD_PREFIX].text ? UploadSettingsT[UPLOAD_PREFIX].text : "";
+    if (HasBayer())
+        job.bayerPattern = BayerT[2].text;
+
+    if (job.encodeFormat == FORMAT_FITS)
+    {
+        targetChip->setImageExtension("fits");
+
+        switch (job.bpp)
+        {
+            case 8:
+            case 16:
+            case 32:
+                break;
+
+            default:
+                LOGF_ERROR("Unsupported bits per pixel value %d", job.bpp);
                 return false;
-            }
+        }
 
-            std::vector<FITSRecord> fitsKeywords;
+        size_t nelements = static_cast<size_t>(job.width) * job.height * (job.naxis == 3 ? 3 : 1);
+        if (nelements * (job.bpp / 8) > job.frameSize)
+        {
+            LOGF_ERROR("Frame buffer of %zu bytes is too small for a %ux%u image", job.frameSize, job.width, job.height);
+            return false;
+        }
+        job.frameSize = nelements * (job.bpp / 8);
+    }
+#ifdef HAVE_XISF
+    else if (job.encodeFormat == FORMAT_XISF)
+    {
+        targetChip->setImageExtension("xisf");
+    }
+#endif
+    else
+    {
+        // If image extension was set to fits (default), change if bin if not already set to another format by the driver.
+        if (!strcmp(targetChip->getImageExtension(), "fits"))
+            targetChip->setImageExtension("bin");
+    }
 
-            addFITSKeywords(targetChip, fitsKeywords);
+    job.extension = targetChip->getImageExtension();
+    job.compress  = targetChip->SendCompressed && job.encodeFormat != FORMAT_XISF;
+    job.blobCodec = BlobCodecSP.findOnSwitchIndex();
+    job.blobLevel = BlobCompressionLevelNP[0].getValue();
 
-            // Add all custom keywords next
-            for (auto &record : m_CustomFITSKeywords)
-                fitsKeywords.push_back(record.second);
+    // Keywords reflect the state of the device when the exposure completed
+    if (job.encodeFormat != FORMAT_NATIVE)
+    {
+        addFITSKeywords(targetChip, job.keywords);
 
-            for (auto &keyword : fitsKeywords)
+        // Statistics of this frame replace any min/max of the chip buffer
+        if (statistics)
+        {
+            job.keywords.erase(std::remove_if(job.keywords.begin(), job.keywords.end(), [](const FITSRecord & record)
             {
-                int key_status = 0;
-                switch(keyword.type())
-                {
-                    case INDI::FITSRecord::VOID:
-                        break;
-                    case INDI::FITSRecord::COMMENT:
-                        fits_write_comment(fptr, keyword.comment().c_str(), &key_status);
-                        break;
-                    case INDI::FITSRecord::STRING:
-                        fits_update_key_str(fptr, keyword.key().c_str(), keyword.valueString().c_str(), keyword.comment().c_str(), &key_status);
-                        break;
-                    case INDI::FITSRecord::LONGLONG:
-                        fits_update_key_lng(fptr, keyword.key().c_str(), keyword.valueInt(), keyword.comment().c_str(), &key_status);
-                        break;
-                    case INDI::FITSRecord::DOUBLE:
-                        fits_update_key_dbl(fptr, keyword.key().c_str(), keyword.valueDouble(), keyword.decimal(), keyword.comment().c_str(),
-                                            &key_status);
-                        break;
-                }
-                if (key_status)
-                {
-                    fits_get_errstatus(key_status, error_status);
-                    LOGF_ERROR("FITS key %s Error: %s", keyword.key().c_str(), error_status);
-                }
-            }
+                return record.key() == "DATAMIN" || record.key() == "DATAMAX";
+            }), job.keywords.end());
 
-            fits_write_img(fptr, byte_type, 1, nelements, targetChip->getFrameBuffer(), &status);
-            targetChip->finishFITSFile(status);
-            if (status)
-            {
-                fits_report_error(stderr, status); /* print out any error messages */
-                fits_get_errstatus(status, error_status);
-                LOGF_ERROR("FITS Error: %s", error_status);
-                targetChip->closeFITSFile();
-                return false;
-            }
+            job.keywords.push_back({"DATAMIN", statistics->min, 6, "Minimum value"});
+            job.keywords.push_back({"DATAMAX", statistics->max, 6, "Maximum value"});
+            job.keywords.push_back({"DATAMEAN", statistics->mean, 6, "Mean value"});
+            job.keywords.push_back({"DATASTD", statistics->stddev, 6, "Standard deviation"});
+            job.keywords.push_back({"DATAMED", statistics->median, 6, "Median value"});
+        }
+
+        // Add all custom keywords next
+        for (auto &record : m_CustomFITSKeywords)
+            job.keywords.push_back(record.second);
+    }
+
+    return true;
+}
+
+bool CCD::encodeUpload(UploadJob &job)
+{
+    if (job.encodeFormat == FORMAT_FITS)
+    {
+        int byte_type = 0;
+        int img_type  = 0;
+        int status    = 0;
+        long naxes[3] = { static_cast<long>(job.width), static_cast<long>(job.height), 3 };
+        char error_status[MAXRBUF];
 
+        switch (job.bpp)
+        {
+            case 8:
+                byte_type = TBYTE;
+                img_type  = BYTE_IMG;
+                break;
 
-            bool rc = uploadFile(targetChip, *(targetChip->fitsMemoryBlockPointer()), *(targetChip->fitsMemorySizePointer()), sendImage,
-                                 saveImage);
+            case 16:
+                byte_type = TUSHORT;
+                img_type  = USHORT_IMG;
+                break;
 
-            targetChip->closeFITSFile();
+            default:
+                byte_type = TULONG;
+                img_type  = ULONG_IMG;
+                break;
+        }
 
-            guard.unlock();
+        size_t memorySize = 2880;
+        void *memory      = IDSharedBlobAlloc(CCDChip::FITS_HEADER_RESERVE + job.frameSize);
+        fitsfile *fptr    = nullptr;
 
-            if (rc == false)
+        if (memory == nullptr)
+        {
+            LOG_ERROR("Failed to allocate memory for FITS file.");
+            return false;
+        }
+
+        //  Initialize FITS file.
+        fits_create_memfile(&fptr, &memory, &memorySize, 2880, IDSharedBlobRealloc, &status);
+        if (status == 0)
+            fits_create_img(fptr, img_type, job.naxis, naxes, &status);
+
+        if (status)
+        {
+            fits_report_error(stderr, status); /* print out any error messages */
+            fits_get_errstatus(status, error_status);
+            LOGF_ERROR("FITS Error: %s", error_status);
+            if (fptr)
             {
-                targetChip->setExposureFailed();
-                return false;
+                int close_status = 0;
+                fits_close_file(fptr, &close_status);
             }
+            IDSharedBlobFree(memory);
+            return false;
+        }
+
+        for (auto &keyword : job.keywords)
+        {
+            int key_status = 0;
+            switch(keyword.type())
+            {
+                case INDI::FITSRecord::VOID:
+                    break;
+                case INDI::FITSRecord::COMMENT:
+                    fits_write_comment(fptr, keyword.comment().c_str(), &key_status);
+                    break;
+                case INDI::FITSRecord::STRING:
+                    fits_update_key_str(fptr, keyword.key().c_str(), keyword.valueString().c_str(), keyword.comment().c_str(), &key_status);
+                    break;
+                case INDI::FITSRecord::LONGLONG:
+                    fits_update_key_lng(fptr, keyword.key().c_str(), keyword.valueInt(), keyword.comment().c_str(), &key_status);
+                    break;
+                case INDI::FITSRecord::DOUBLE:
+                    fits_update_key_dbl(fptr, keyword.key().c_str(), keyword.valueDouble(), keyword.decimal(), keyword.comment().c_str(),
+                                        &key_status);
+                    break;
+            }
+            if (key_status)
+            {
+                fits_get_errstatus(key_status, error_status);
+                LOGF_ERROR("FITS key %s Error: %s", keyword.key().c_str(), error_status);
+            }
+        }
+
+        fits_write_img(fptr, byte_type, 1, job.frameSize / (job.bpp / 8), job.frame, &status);
+        fits_flush_file(fptr, &status);
+        int close_status = 0;
+        fits_close_file(fptr, &close_status);
+        if (status == 0)
+            status = close_status;
+        if (status)
+        {
+            fits_report_error(stderr, status); /* print out any error messages */
+            fits_get_errstatus(status, error_status);
+            LOGF_ERROR("FITS Error: %s", error_status);
+            IDSharedBlobFree(memory);
+            return false;
         }
+
+        job.file     = memory;
+        job.fileSize = memorySize;
+        return true;
+    }
 #ifdef HAVE_XISF
-        else if (EncodeFormatSP[FORMAT_XISF].getState() == ISS_ON)
+    else if (job.encodeFormat == FORMAT_XISF)
+    {
+        try
         {
-            std::vector<FITSRecord> fitsKeywords;
-            addFITSKeywords(targetChip, fitsKeywords);
-            targetChip->setImageExtension("xisf");
+            AutoCNumeric locale;
+            LibXISF::Image image;
+            LibXISF::XISFWriter xisfWriter;
 
-            try
+            for (auto &keyword : job.keywords)
             {
-                AutoCNumeric locale;
-                LibXISF::Image image;
-                LibXISF::XISFWriter xisfWriter;
+                image.addFITSKeyword({keyword.key().c_str(), keyword.valueString().c_str(), keyword.comment().c_str()});
+                image.addFITSKeywordAsProperty(keyword.key().c_str(), keyword.valueString());
+            }
 
-                for (auto &keyword : fitsKeywords)
-                {
-                    image.addFITSKeyword({keyword.key().c_str(), keyword.valueString().c_str(), keyword.comment().c_str()});
-                    image.addFITSKeywordAsProperty(keyword.key().c_str(), keyword.valueString());
-                }
+            image.setGeometry(job.width, job.height, job.naxis == 2 ? 1 : 3);
+            switch(job.bpp)
+            {
+                case 8:
+                    image.setSampleFormat(LibXISF::Image::UInt8);
+                    break;
+                case 16:
+                    image.setSampleFormat(LibXISF::Image::UInt16);
+                    break;
+                case 32:
+                    image.setSampleFormat(LibXISF::Image::UInt32);
+                    break;
+                default:
+                    LOGF_ERROR("Unsupported bits per pixel value %d", job.bpp);
+                    return false;
+            }
 
-                image.setGeometry(targetChip->getSubW() / targetChip->getBinX(),
-                                  targetChip->getSubH() / targetChip->getBinY(),
-                                  targetChip->getNAxis() == 2 ? 1 : 3);
-                switch(targetChip->getBPP())
-                {
-                    case 8:
-                        image.setSampleFormat(LibXISF::Image::UInt8);
-                        break;
-                    case 16:
-                        image.setSampleFormat(LibXISF::Image::UInt16);
-                        break;
-                    case 32:
-                        image.setSampleFormat(LibXISF::Image::UInt32);
-                        break;
-                    default:
-                        LOGF_ERROR("Unsupported bits per pixel value %d", targetChip->getBPP());
-                        return false;
-                }
+            switch(job.frameType)
+            {
+                case CCDChip::LIGHT_FRAME:
+                    image.setImageType(LibXISF::Image::Light);
+                    break;
+                case CCDChip::BIAS_FRAME:
+                    image.setImageType(LibXISF::Image::Bias);
+                    break;
+                case CCDChip::DARK_FRAME:
+                    image.setImageType(LibXISF::Image::Dark);
+                    break;
+                case CCDChip::FLAT_FRAME:
+                    image.setImageType(LibXISF::Image::Flat);
+                    break;
+            }
 
-                switch(targetChip->getFrameType())
-                {
-                    case CCDChip::LIGHT_FRAME:
-                        image.setImageType(LibXISF::Image::Light);
-                        break;
-                    case CCDChip::BIAS_FRAME:
-                        image.setImageType(LibXISF::Image::Bias);
-                        break;
-                    case CCDChip::DARK_FRAME:
-                        image.setImageType(LibXISF::Image::Dark);
-                        break;
-                    case CCDChip::FLAT_FRAME:
-                        image.setImageType(LibXISF::Image::Flat);
-                        break;
-                }
+            if (job.chip->SendCompressed)
+            {
+                if(LibXISF::DataBlock::CompressionCodecSupported(LibXISF::DataBlock::ZSTD))
+                    image.setCompression(LibXISF::DataBlock::ZSTD);
+                else
+                    image.setCompression(LibXISF::DataBlock::LZ4);
+                image.setByteshuffling(job.bpp / 8);
+            }
 
-                if (targetChip->SendCompressed)
-                {
-                    if(LibXISF::DataBlock::CompressionCodecSupported(LibXISF::DataBlock::ZSTD))
-                        image.setCompression(LibXISF::DataBlock::ZSTD);
-                    else
-                        image.setCompression(LibXISF::DataBlock::LZ4);
-                    image.setByteshuffling(targetChip->getBPP() / 8);
-                }
+            if (!job.bayerPattern.empty())
+                image.setColorFilterArray({2, 2, job.bayerPattern});
 
-                if (HasBayer())
-                    image.setColorFilterArray({2, 2, BayerT[2].text});
+            if (job.naxis == 3)
+            {
+                image.setColorSpace(LibXISF::Image::RGB);
+            }
 
-                if (targetChip->getNAxis() == 3)
-                {
-                    image.setColorSpace(LibXISF::Image::RGB);
-                }
+            std::memcpy(image.imageData(), job.frame, image.imageDataSize());
+            xisfWriter.writeImage(image);
 
-                std::unique_lock<std::mutex> guard(ccdBufferLock);
-                std::memcpy(image.imageData(), targetChip->getFrameBuffer(), image.imageDataSize());
-                xisfWriter.writeImage(image);
+            LibXISF::ByteArray xisfFile;
+            xisfWriter.save(xisfFile);
 
-                LibXISF::ByteArray xisfFile;
-                xisfWriter.save(xisfFile);
-                bool rc = uploadFile(targetChip, xisfFile.data(), xisfFile.size(), sendImage, saveImage);
-                if (rc == false)
-                {
-                    targetChip->setExposureFailed();
-                    return false;
-                }
-            }
-            catch (LibXISF::Error &error)
+            job.file = IDSharedBlobAlloc(xisfFile.size());
+            if (job.file == nullptr)
             {
-                LOGF_ERROR("XISF Error: %s", error.what());
+                LOG_ERROR("Error: Ran out of memory encoding image");
                 return false;
             }
+            std::memcpy(job.file, xisfFile.data(), xisfFile.size());
+            job.fileSize = xisfFile.size();
         }
-#endif
-        else
+        catch (LibXISF::Error &error)
         {
-            // If image extension was set to fits (default), change if bin if not already set to another format by the driver.
-            if (!strcmp(targetChip->getImageExtension(), "fits"))
-                targetChip->setImageExtension("bin");
-            std::unique_lock<std::mutex> guard(ccdBufferLock);
-            bool rc = uploadFile(targetChip, targetChip->getFrameBuffer(), targetChip->getFrameBufferSize(), sendImage,
-                                 saveImage);
-            guard.unlock();
-
-            if (rc == false)
-            {
-                targetChip->setExposureFailed();
-                return false;
-            }
+            LOGF_ERROR("XISF Error: %s", error.what());
+            return false;
         }
+        return true;
     }
+#endif
 
-    if (FastExposureToggleS[INDI_ENABLED].s != ISS_ON)
-        targetChip->setExposureComplete();
-
-    UploadComplete(targetChip);
+    job.file     = job.frame;
+    job.fileSize = job.frameSize;
     return true;
 }
 
-bool CCD::uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage,
-                     bool saveImage)
+bool CCD::compressUpload(UploadJob &job)
 {
-    uint8_t * compressedData = nullptr;
+    if (job.sendImage == false || job.compress == false)
+    {
+        job.blob       = job.file;
+        job.blobSize   = job.fileSize;
+        job.blobFormat = "." + job.extension;
+        return true;
+    }
 
-    DEBUGF(Logger::DBG_DEBUG, "Uploading file. Ext: %s, Size: %d, sendImage? %s, saveImage? %s",
-           targetChip->getImageExtension(), totalBytes, sendImage ? "Yes" : "No", saveImage ? "Yes" : "No");
+    uint8_t * compressedData = nullptr;
 
-    if (saveImage)
+    if (job.encodeFormat == FORMAT_FITS && job.extension == "fits")
     {
-        targetChip->FitsB.blob    = const_cast<void *>(fitsData);
-        targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
-
-        FILE * fp = nullptr;
-        char imageFileName[MAXRBUF];
+        fpstate	fpvar;
+        fp_init (&fpvar);
+        size_t compressedBytes = 0;
+        int islossless = 0;
+        // Compress straight into a shared buffer, so that it is sent without copy
+        if (fp_pack_data_to_data_realloc(reinterpret_cast<const char *>(job.file), job.fileSize, &compressedData, &compressedBytes,
+                                         fpvar, &islossless, IDSharedBlobRealloc) < 0)
+        {
+            IDSharedBlobFree(compressedData);
+            LOG_ERROR("Error: Ran out of memory compressing image");
+            return false;
+        }
 
-        std::string prefix = UploadSettingsT[UPLOAD_PREFIX].text;
-        int maxIndex       = getFileIndex(UploadSettingsT[UPLOAD_DIR].text, UploadSettingsT[UPLOAD_PREFIX].text,
-                                          targetChip->FitsB.format);
+        job.blob       = compressedData;
+        job.blobSize   = compressedBytes;
+        job.blobFormat = "." + job.extension + ".fz";
+    }
+    else
+    {
+        auto codec = static_cast<BlobCompression::Codec>(job.blobCodec);
+        // Shuffle the bytes of native pixels, so that their high bytes compress together
+        size_t elementSize = job.encodeFormat == FORMAT_NATIVE ? std::max(1, job.bpp / 8) : 1;
+        size_t compressedBytes = BlobCompression::bound(codec, job.fileSize);
+        compressedData  = static_cast<uint8_t *>(IDSharedBlobAlloc(compressedBytes));
 
-        if (maxIndex < 0)
+        if (job.file == nullptr || compressedData == nullptr)
         {
-            LOGF_ERROR("Error iterating directory %s. %s", UploadSettingsT[0].text,
-                       strerror(errno));
+            if (compressedData)
+                IDSharedBlobFree(compressedData);
+            LOG_ERROR("Error: Ran out of memory compressing image");
             return false;
         }
 
-        if (maxIndex > 0)
+        compressedBytes = BlobCompression::compress(codec, job.blobLevel, elementSize, job.file, job.fileSize,
+                          compressedData, compressedBytes);
+        if (compressedBytes == 0)
         {
-            auto now = std::chrono::system_clock::now();
-            std::time_t time = std::chrono::system_clock::to_time_t(now);
-            std::tm* now_tm = std::localtime(&time);
-            long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+            /* this should NEVER happen */
+            LOG_ERROR("Error: Failed to compress image");
+            IDSharedBlobFree(compressedData);
+            return false;
+        }
 
-            std::stringstream stream;
-            // JM 2023.08.31 Make timestamps OS friendly (Windows)
-            stream    << std::setfill('0')
-                      << std::put_time(now_tm, "%FT%H-%M-")
-                      << std::setw(2) << (timestamp / 1000) % 60 << '.'
-                      << std::setw(3) << timestamp % 1000;
+        job.blob       = compressedData;
+        job.blobSize   = compressedBytes;
+        job.blobFormat = BlobCompression::format("." + job.extension, codec, elementSize);
+    }
 
-            prefix = std::regex_replace(prefix, std::regex("ISO8601"), stream.str());
+    return true;
+}
 
-            char indexString[8];
-            snprintf(indexString, 8, "%03d", maxIndex);
-            std::string prefixIndex = indexString;
-            //prefix.replace(prefix.find("XXX"), std::string::npos, prefixIndex);
-            prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
-        }
+bool CCD::saveUpload(UploadJob &job)
+{
+    if (job.saveImage == false)
+        return true;
 
-        snprintf(imageFileName, MAXRBUF, "%s/%s%s", UploadSettingsT[0].text, prefix.c_str(), targetChip->FitsB.format);
+    char imageFileName[MAXRBUF];
+    std::string format = "." + job.extension;
+    std::string prefix = job.uploadPrefix;
+    int maxIndex       = getFileIndex(job.uploadDir.c_str(), job.uploadPrefix.c_str(), format.c_str());
 
-        fp = fopen(imageFileName, "w");
-        if (fp == nullptr)
-        {
-            LOGF_ERROR("Unable to save image file (%s). %s", imageFileName, strerror(errno));
-            return false;
-        }
-
-        int n = 0;
-        for (int nr = 0; nr < targetChip->FitsB.bloblen; nr += n)
-            n = fwrite((static_cast<char *>(targetChip->FitsB.blob) + nr), 1, targetChip->FitsB.bloblen - nr, fp);
+    if (maxIndex < 0)
+    {
+        LOGF_ERROR("Error iterating directory %s. %s", job.uploadDir.c_str(),
+                   strerror(errno));
+        return false;
+    }
 
-        fclose(fp);
+    if (maxIndex > 0)
+    {
+        auto now = std::chrono::system_clock::now();
+        std::time_t time = std::chrono::system_clock::to_time_t(now);
+        std::tm* now_tm = std::localtime(&time);
+        long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+
+        std::stringstream stream;
+        // JM 2023.08.31 Make timestamps OS friendly (Windows)
+        stream    << std::setfill('0')
+                  << std::put_time(now_tm, "%FT%H-%M-")
+                  << std::setw(2) << (timestamp / 1000) % 60 << '.'
+                  << std::setw(3) << timestamp % 1000;
+
+        prefix = std::regex_replace(prefix, std::regex("ISO8601"), stream.str());
+
+        char indexString[8];
+        snprintf(indexString, 8, "%03d", maxIndex);
+        std::string prefixIndex = indexString;
+        //prefix.replace(prefix.find("XXX"), std::string::npos, prefixIndex);
+        prefix = std::regex_replace(prefix, std::regex("XXX"), prefixIndex);
+    }
 
-        // Save image file path
-        IUSaveText(&FileNameT[0], imageFileName);
+    snprintf(imageFileName, MAXRBUF, "%s/%s%s", job.uploadDir.c_str(), prefix.c_str(), format.c_str());
 
-        DEBUGF(Logger::DBG_SESSION, "Image saved to %s", imageFileName);
-        FileNameTP.s = IPS_OK;
-        IDSetText(&FileNameTP, nullptr);
+    FILE * fp = fopen(imageFileName, "w");
+    if (fp == nullptr)
+    {
+        LOGF_ERROR("Unable to save image file (%s). %s", imageFileName, strerror(errno));
+        return false;
     }
 
-    if (targetChip->SendCompressed && EncodeFormatSP[FORMAT_XISF].getState() != ISS_ON)
+    size_t n = 0;
+    for (size_t nr = 0; nr < job.fileSize; nr += n)
     {
-        if (EncodeFormatSP[FORMAT_FITS].getState() == ISS_ON && !strcmp(targetChip->getImageExtension(), "fits"))
+        n = fwrite((static_cast<char *>(job.file) + nr), 1, job.fileSize - nr, fp);
+        if (n == 0)
         {
-            fpstate	fpvar;
-            fp_init (&fpvar);
-            size_t compressedBytes = 0;
-            int islossless = 0;
-            if (fp_pack_data_to_data(reinterpret_cast<const char *>(fitsData), totalBytes, &compressedData, &compressedBytes, fpvar,
-                                     &islossless) < 0)
-            {
-                free(compressedData);
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
-            }
-
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.fz", targetChip->getImageExtension());
+            LOGF_ERROR("Unable to save image file (%s). %s", imageFileName, strerror(errno));
+            fclose(fp);
+            return false;
         }
-        else
-        {
-            uLong compressedBytes = sizeof(char) * totalBytes + totalBytes / 64 + 16 + 3;
-            compressedData  = new uint8_t[compressedBytes];
+    }
 
-            if (fitsData == nullptr || compressedData == nullptr)
-            {
-                if (compressedData)
-                    delete [] compressedData;
-                LOG_ERROR("Error: Ran out of memory compressing image");
-                return false;
-            }
+    fclose(fp);
 
-            int r = compress2(compressedData, &compressedBytes, (const Bytef *)fitsData, totalBytes, 9);
-            if (r != Z_OK)
-            {
-                /* this should NEVER happen */
-                LOG_ERROR("Error: Failed to compress image");
-                delete [] compressedData;
-                return false;
-            }
+    // Save image file path
+    IUSaveText(&FileNameT[0], imageFileName);
 
-            targetChip->FitsB.blob    = compressedData;
-            targetChip->FitsB.bloblen = compressedBytes;
-            snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s.z", targetChip->getImageExtension());
-        }
-    }
-    else
-    {
-        targetChip->FitsB.blob    = const_cast<void *>(fitsData);
-        targetChip->FitsB.bloblen = totalBytes;
-        snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, ".%s", targetChip->getImageExtension());
-    }
+    DEBUGF(Logger::DBG_SESSION, "Image saved to %s", imageFileName);
+    FileNameTP.s = IPS_OK;
+    IDSetText(&FileNameTP, nullptr);
+
+    return true;
+}
+
+bool CCD::sendUpload(UploadJob &job)
+{
+    if (job.sendImage == false)
+        return true;
+
+    CCDChip *targetChip = job.chip;
+
+    DEBUGF(Logger::DBG_DEBUG, "Uploading file. Ext: %s, Size: %zu, Sent: %zu bytes",
+           job.extension.c_str(), job.fileSize, job.blobSize);
 
-    targetChip->FitsB.size = totalBytes;
+    targetChip->FitsB.blob    = job.blob;
+    targetChip->FitsB.bloblen = job.blobSize;
+    targetChip->FitsB.size    = job.fileSize;
+    snprintf(targetChip->FitsB.format, MAXINDIBLOBFMT, "%s", job.blobFormat.c_str());
     targetChip->FitsBP.s   = IPS_OK;
 
-    if (sendImage)
-    {
 #ifdef HAVE_WEBSOCKET
-        if (HasWebSocket() && WebSocketS[WEBSOCKET_ENABLED].s == ISS_ON)
-        {
-            auto start = std::chrono::high_resolution_clock::now();
+    if (HasWebSocket() && WebSocketS[WEBSOCKET_ENABLED].s == ISS_ON)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
 
-            // Send format/size/..etc first later
-            wsServer.send_text(std::string(targetChip->FitsB.format));
-            wsServer.send_binary(targetChip->FitsB.blob, targetChip->FitsB.bloblen);
+        // Send format/size/..etc first later
+        wsServer.send_text(std::string(targetChip->FitsB.format));
+        wsServer.send_binary(targetChip->FitsB.blob, targetChip->FitsB.bloblen);
 
-            auto end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> diff = end - start;
-            LOGF_DEBUG("Websocket transfer took %g seconds", diff.count());
-        }
-        else
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diff = end - start;
+        LOGF_DEBUG("Websocket transfer took %g seconds", diff.count());
+    }
+    else
 #endif
-        {
-            auto start = std::chrono::high_resolution_clock::now();
-            IDSetBLOB(&targetChip->FitsBP, nullptr);
-            auto end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> diff = end - start;
-            LOGF_DEBUG("BLOB transfer took %g seconds", diff.count());
-        }
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        IDSetBLOB(&targetChip->FitsBP, nullptr);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diff = end - start;
+        LOGF_DEBUG("BLOB transfer took %g seconds", diff.count());
     }
 
-    if (compressedData)
-        delete [] compressedData;
+    // The buffers are released along with the job
+    targetChip->FitsB.blob    = nullptr;
+    targetChip->FitsB.bloblen = 0;
 
     DEBUG(Logger::DBG_DEBUG, "Upload complete");
 
@@ -2814,6 +3194,11 @@ bool CCD::saveConfigItems(FILE * fp)
         DSP->saveConfigItems(fp);
 
     ScopeInfoNP.save(fp);
+    FrameStatisticsSP.save(fp);
+    BufferPoolLimitNP.save(fp);
+    UploadPipelineNP.save(fp);
+    BlobCodecSP.save(fp);
+    BlobCompressionLevelNP.save(fp);
 
     return true;
 }
@@ -2848,66 +3233,40 @@ IPState CCD::GuideWest(uint32_t ms)
 
 void CCD::getMinMax(double * min, double * max, CCDChip * targetChip)
 {
-    int ind         = 0, i, j;
-    int imageHeight = targetChip->getSubH() / targetChip->getBinY();
-    int imageWidth  = targetChip->getSubW() / targetChip->getBinX();
-    double lmin = 0, lmax = 0;
+    size_t pixels = static_cast<size_t>(targetChip->getSubW() / targetChip->getBinX()) *
+                    (targetChip->getSubH() / targetChip->getBinY());
 
-    switch (targetChip->getBPP())
-    {
-        case 8:
-        {
-            uint8_t * imageBuffer = targetChip->getFrameBuffer();
-            lmin = lmax = imageBuffer[0];
+    frameMinMax(targetChip->getFrameBuffer(), pixels, targetChip->getBPP(), min, max);
+}
 
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
+bool CCD::updateFrameStatistics(CCDChip * targetChip, FrameStatistics &statistics)
+{
+    if (FrameStatisticsSP[INDI_ENABLED].getState() != ISS_ON || targetChip->getFrameBufferSize() == 0)
+        return false;
 
-        case 16:
-        {
-            uint16_t * imageBuffer = reinterpret_cast<uint16_t*>(targetChip->getFrameBuffer());
-            lmin = lmax = imageBuffer[0];
+    // Color frames are counted as a whole, over all channels
+    uint32_t width  = (targetChip->getSubW() / targetChip->getBinX()) * (targetChip->getNAxis() == 3 ? 3 : 1);
+    uint32_t height = targetChip->getSubH() / targetChip->getBinY();
+    if (static_cast<size_t>(width) * height * (targetChip->getBPP() / 8) > static_cast<size_t>(targetChip->getFrameBufferSize()))
+        return false;
 
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
+    {
+        std::unique_lock<std::mutex> guard(ccdBufferLock);
+        if (!frameStatistics(targetChip->getFrameBuffer(), width, height, targetChip->getBPP(), statistics))
+            return false;
+    }
 
-        case 32:
-        {
-            uint32_t * imageBuffer = reinterpret_cast<uint32_t*>(targetChip->getFrameBuffer());
-            lmin = lmax = imageBuffer[0];
+    if (targetChip != &PrimaryCCD)
+        return true;
 
-            for (i = 0; i < imageHeight; i++)
-                for (j = 0; j < imageWidth; j++)
-                {
-                    ind = (i * imageWidth) + j;
-                    if (imageBuffer[ind] < lmin)
-                        lmin = imageBuffer[ind];
-                    else if (imageBuffer[ind] > lmax)
-                        lmax = imageBuffer[ind];
-                }
-        }
-        break;
-    }
-    *min = lmin;
-    *max = lmax;
+    FrameStatisticsNP[STATS_MIN].setValue(statistics.min);
+    FrameStatisticsNP[STATS_MAX].setValue(statistics.max);
+    FrameStatisticsNP[STATS_MEAN].setValue(statistics.mean);
+    FrameStatisticsNP[STATS_STDDEV].setValue(statistics.stddev);
+    FrameStatisticsNP[STATS_MEDIAN].setValue(statistics.median);
+    FrameStatisticsNP.setState(IPS_OK);
+    FrameStatisticsNP.apply();
+    return true;
 }
 
 std::string regex_replace_compat(const std::string &input, const std::string &pattern, const std::string &replace)
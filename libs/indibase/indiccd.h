@@ -34,6 +34,8 @@
 #include "inditimer.h"
 #include "indielapsedtimer.h"
 #include "fitskeyword.h"
+#include "framestatistics.h"
+#include "indistagedpipeline.h"
 #include "dsp/manager.h"
 #include "stream/streammanager.h"
 
@@ -47,6 +49,7 @@
 #include <cstring>
 #include <chrono>
 #include <stdint.h>
+#include <atomic>
 #include <mutex>
 #include <thread>
 
@@ -106,6 +109,11 @@ class XISFWrapper;
  * Similarly, before calling Streamer->newFrame, the buffer needs to be protected in a similar fashion using
  * the same ccdBufferLock mutex.
  *
+ * ExposureComplete() returns at once and uploads the image on another thread. With an upload pipeline
+ * depth (CCD_UPLOAD_PIPELINE) above 0, the chip is marked complete and UploadComplete() is called later
+ * from the pipeline thread that sends the image, possibly while the next exposure already runs.
+ * Disconnecting waits for the images in flight, so drivers must disconnect before they are destroyed.
+ *
  * \example CCD Simulator
  * \version 1.1
  * \author Jasem Mutlaq
@@ -535,6 +543,8 @@ class CCD : public DefaultDevice, GuiderInterface
          * @brief UploadComplete Signal that capture is completed and image was uploaded and/or saved successfully.
          * @param targetChip Active exposure chip
          * @note Child camera should override this function to receive notification on exposure upload completion.
+         * @note It is not called from the main thread. With an upload pipeline depth above 0, it is called from the
+         * pipeline send thread, in the order the exposures completed.
          */
         virtual void UploadComplete(CCDChip *) {}
 
@@ -732,6 +742,47 @@ class CCD : public DefaultDevice, GuiderInterface
             Aperture
         };
 
+        // Shared buffers served by the pool of recycled buffers, or allocated
+        INDI::PropertyNumber BufferPoolNP {2};
+        enum
+        {
+            POOL_HITS,
+            POOL_MISSES
+        };
+
+        // Memory kept by the pool of recycled buffers in MB, 0 to disable it. The pool is shared by the whole driver.
+        INDI::PropertyNumber BufferPoolLimitNP {1};
+
+        // Frame statistics, computed on every exposure when enabled
+        INDI::PropertySwitch FrameStatisticsSP {2};
+        INDI::PropertyNumber FrameStatisticsNP {5};
+        enum
+        {
+            STATS_MIN,
+            STATS_MAX,
+            STATS_MEAN,
+            STATS_STDDEV,
+            STATS_MEDIAN
+        };
+
+        // Frames in flight between the camera and the client, 0 to upload before completing the exposure
+        INDI::PropertyNumber UploadPipelineNP {1};
+
+        // Codec and level of compressed frames that are not FITS, in the order of BlobCompression::Codec
+        INDI::PropertySwitch BlobCodecSP {3};
+        INDI::PropertyNumber BlobCompressionLevelNP {1};
+
+        // Time the last frame spent waiting for room in the pipeline, and in each upload stage
+        INDI::PropertyNumber UploadTimingNP {5};
+        enum
+        {
+            UPLOAD_WAIT,
+            UPLOAD_ENCODE,
+            UPLOAD_COMPRESS,
+            UPLOAD_SAVE,
+            UPLOAD_SEND
+        };
+
         // Websocket Support
         ISwitch WebSocketS[2];
         ISwitchVectorProperty WebSocketSP;
@@ -786,11 +837,25 @@ class CCD : public DefaultDevice, GuiderInterface
 
         std::map<std::string, FITSRecord> m_CustomFITSKeywords;
 
+        // A frame on its way to the disk and the client
+        struct UploadJob;
+        std::unique_ptr<StagedPipeline<std::unique_ptr<UploadJob>>> m_UploadPipeline;
+        std::atomic<double> m_UploadWaitMs {0};
+
         ///////////////////////////////////////////////////////////////////////////////
         /// Utility Functions
         ///////////////////////////////////////////////////////////////////////////////
-        bool uploadFile(CCDChip * targetChip, const void * fitsData, size_t totalBytes, bool sendImage, bool saveImage);
+        void setupUploadPipeline();
+        bool prepareUpload(CCDChip * targetChip, UploadJob &job, bool sendImage, bool saveImage,
+                           const FrameStatistics *statistics);
+        bool encodeUpload(UploadJob &job);
+        bool compressUpload(UploadJob &job);
+        bool saveUpload(UploadJob &job);
+        bool sendUpload(UploadJob &job);
+        void completeUpload(CCDChip * targetChip);
+        void updateUploadTiming(const std::vector<double> &stageMs);
         void getMinMax(double * min, double * max, CCDChip * targetChip);
+        bool updateFrameStatistics(CCDChip * targetChip, FrameStatistics &statistics);
         int getFileIndex(const char * dir, const char * prefix, const char * ext);
         bool ExposureCompletePrivate(CCDChip * targetChip);
 
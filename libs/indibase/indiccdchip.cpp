@@ -41,7 +41,7 @@ CCDChip::~CCDChip()
 bool CCDChip::openFITSFile(uint32_t size, int &status)
 {
     m_FITSMemorySize = size > 2880 ? 2880 : size;
-    m_FITSMemoryBlock = IDSharedBlobAlloc(size);
+    m_FITSMemoryBlock = IDSharedBlobAllocReserve(size, FITS_HEADER_RESERVE + fullFrameReserve());
     if (m_FITSMemoryBlock == nullptr)
     {
         IDLog("Failed to allocate memory for FITS file.");
@@ -199,16 +199,24 @@ void CCDChip::setFrameBufferSize(uint32_t nbuf, bool allocMem)
 
     RawFrame = static_cast<uint8_t*>(IDSharedBlobRealloc(RawFrame, RawFrameSize));
     if (RawFrame == nullptr)
-        RawFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
+        RawFrame = static_cast<uint8_t*>(IDSharedBlobAllocReserve(RawFrameSize, fullFrameReserve()));
 
     if (BinFrame)
     {
         BinFrame = static_cast<uint8_t*>(IDSharedBlobRealloc(BinFrame, RawFrameSize));
         if (BinFrame == nullptr)
-            BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
+            BinFrame = static_cast<uint8_t*>(IDSharedBlobAllocReserve(RawFrameSize, fullFrameReserve()));
     }
 }
 
+size_t CCDChip::fullFrameReserve() const
+{
+    // Address space is too scarce on 32 bits systems to reserve ahead
+    if (sizeof(void *) < 8)
+        return 0;
+    return static_cast<size_t>(XRes) * YRes * 3 * (BitsPerPixel / 8);
+}
+
 void CCDChip::setExposureLeft(double duration)
 {
     ImageExposureNP.s = IPS_BUSY;
@@ -284,85 +292,36 @@ void CCDChip::setImageExtension(const char *ext)
 
 void CCDChip::binFrame()
 {
-    if (BinX == 1)
+    binFrame(BINNING_DEFAULT);
+}
+
+void CCDChip::binFrame(BinningMode mode)
+{
+    if (BinX == 1 && BinY == 1)
         return;
 
     // Jasem: Keep full frame shadow in memory to enhance performance and just swap frame pointers after operation is complete
     if (BinFrame == nullptr)
-        BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
+        BinFrame = static_cast<uint8_t*>(IDSharedBlobAllocReserve(RawFrameSize, fullFrameReserve()));
     else
     {
         BinFrame = static_cast<uint8_t*>(IDSharedBlobRealloc(BinFrame, RawFrameSize));
         if (BinFrame == nullptr)
-            BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
+            BinFrame = static_cast<uint8_t*>(IDSharedBlobAllocReserve(RawFrameSize, fullFrameReserve()));
     }
 
-    memset(BinFrame, 0, RawFrameSize);
-
-    switch (getBPP())
-    {
-        case 8:
-        {
-            uint8_t *bin_buf = BinFrame;
-            // Try to average pixels since in 8bit they get saturated pretty quickly
-            double factor      = (BinX * BinX) / 2;
-            double accumulator;
-
-            for (uint32_t i = 0; i < SubH; i += BinX)
-                for (uint32_t j = 0; j < SubW; j += BinX)
-                {
-                    accumulator = 0;
-                    for (int k = 0; k < BinX; k++)
-                    {
-                        for (int l = 0; l < BinX; l++)
-                        {
-                            accumulator += *(RawFrame + j + (i + k) * SubW + l);
-                        }
-                    }
-
-                    accumulator /= factor;
-                    if (accumulator > UINT8_MAX)
-                        *bin_buf = UINT8_MAX;
-                    else
-                        *bin_buf += static_cast<uint8_t>(accumulator);
-                    bin_buf++;
-                }
-        }
-        break;
-
-        case 16:
-        {
-            uint16_t *bin_buf    = reinterpret_cast<uint16_t *>(BinFrame);
-            uint16_t *RawFrame16 = reinterpret_cast<uint16_t *>(RawFrame);
-            uint16_t val;
-
-            for (uint32_t i = 0; i < SubH; i += BinX)
-                for (uint32_t j = 0; j < SubW; j += BinX)
-                {
-                    for (int k = 0; k < BinX; k++)
-                    {
-                        for (int l = 0; l < BinX; l++)
-                        {
-                            val = *(RawFrame16 + j + (i + k) * SubW + l);
-                            if (val + *bin_buf > UINT16_MAX)
-                                *bin_buf = UINT16_MAX;
-                            else
-                                *bin_buf += val;
-                        }
-                    }
-                    bin_buf++;
-                }
-        }
-        break;
+    // Every binned pixel is written, no need to clear the frame first
+    if (!binFrameBuffer(RawFrame, BinFrame, SubW, SubH, getBPP(), BinX, BinY, mode))
+        return;
 
-        default:
-            return;
-    }
+    // The rest of the buffer is sent along with native frames, and may hold an older frame: clear it
+    size_t binnedSize = static_cast<size_t>(SubW / BinX) * (SubH / BinY) * (getBPP() / 8);
+    if (binnedSize < static_cast<size_t>(RawFrameSize))
+        memset(BinFrame + binnedSize, 0, RawFrameSize - binnedSize);
 
     // Swap frame pointers
     uint8_t *rawFramePointer = RawFrame;
     RawFrame                 = BinFrame;
-    // We just memset it next time we use it
     BinFrame = rawFramePointer;
 }
 
@@ -382,12 +341,12 @@ void CCDChip::binBayerFrame()
 
     // Jasem: Keep full frame shadow in memory to enhance performance and just swap frame pointers after operation is complete
     if (BinFrame == nullptr)
-        BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
+        BinFrame = static_cast<uint8_t*>(IDSharedBlobAllocReserve(RawFrameSize, fullFrameReserve()));
     else
     {
         BinFrame = static_cast<uint8_t*>(IDSharedBlobRealloc(BinFrame, RawFrameSize));
         if (BinFrame == nullptr)
-            BinFrame = static_cast<uint8_t*>(IDSharedBlobAlloc(RawFrameSize));
+            BinFrame = static_cast<uint8_t*>(IDSharedBlobAllocReserve(RawFrameSize, fullFrameReserve()));
     }
 
     memset(BinFrame, 0, RawFrameSize);
@@ -20,6 +20,7 @@
 
 #include "indiapi.h"
 #include "indidriver.h"
+#include "framebinning.h"
 
 #include <sys/time.h>
 #include <stdint.h>
@@ -50,6 +51,9 @@ class CCDChip
             CCD_BITSPERPIXEL
         } CCD_INFO_INDEX;
 
+        /// Room for the FITS header in front of the image data: 3 blocks of 2880 bytes, sufficient for most cases.
+        static constexpr size_t FITS_HEADER_RESERVE = 2880 * 3;
+
         /**
          * @brief openFITSFile Allocate memory buffer for internal FITS file structure and open
          * @param FITS error code in case an error happens.
@@ -403,10 +407,18 @@ class CCDChip
 
         /**
          * @brief binFrame Perform software binning on the CCD frame. Only use this function if hardware
-         * binning is not supported.
+         * binning is not supported. 8, 16 and 32 bit frames are supported, with BinX and BinY possibly different.
+         * 16 and 32 bit pixels are summed, 8 bit pixels are summed and divided by half the number of binned
+         * pixels. Both saturate.
          */
         void binFrame();
 
+        /**
+         * @brief binFrame Perform software binning on the CCD frame, combining pixels as mode says.
+         * @param mode See BinningMode.
+         */
+        void binFrame(BinningMode mode);
+
         /**
          * @brief binBayerFrame Perform software binning on a 2x2 Bayer matrix CCD frame. Only use this function if hardware
          * binning is not supported.
@@ -429,6 +441,9 @@ class CCDChip
         }
 
     private:
+        /// Address space reserved for the frame buffers, so that they grow in place up to a full color frame.
+        size_t fullFrameReserve() const;
+
         /////////////////////////////////////////////////////////////////////////////////////////
         /// Chip Variables
         /////////////////////////////////////////////////////////////////////////////////////////
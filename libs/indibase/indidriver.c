@@ -180,19 +180,20 @@ void IDSnoopBLOBs(const char *snooped_device, const char *snooped_property, BLOB
 int dispatch(XMLEle *root, char msg[])
 {
     char *rtag = tagXMLEle(root);
+    XMLSymbol rid = tagIdXMLEle(root);
     XMLEle *ep;
     int n;
 
     if (verbose)
         prXMLEle(stderr, root, 0);
 
-    if (!strcmp(rtag, "getProperties"))
+    if (rid == XMLSYM_getProperties)
     {
         XMLAtt *ap, *name, *dev;
         double v;
 
         /* check version */
-        ap = findXMLAtt(root, "version");
+        ap = findXMLAttById(root, XMLSYM_version);
         if (!ap)
         {
             fprintf(stderr, "%s: getProperties missing version\n", me);
@@ -206,10 +207,10 @@ int dispatch(XMLEle *root, char msg[])
         }
 
         // Get device
-        dev = findXMLAtt(root, "device");
+        dev = findXMLAttById(root, XMLSYM_device);
 
         // Get property name
-        name = findXMLAtt(root, "name");
+        name = findXMLAttById(root, XMLSYM_name);
 
         if (name && dev)
         {
@@ -256,10 +257,10 @@ int dispatch(XMLEle *root, char msg[])
          * we don't know here which devices are being snooped so we send
          * all remaining valid messages
          */
-    if (!strcmp(rtag, "setNumberVector") || !strcmp(rtag, "setTextVector") || !strcmp(rtag, "setLightVector") ||
-            !strcmp(rtag, "setSwitchVector") || !strcmp(rtag, "setBLOBVector") || !strcmp(rtag, "defNumberVector") ||
-            !strcmp(rtag, "defTextVector") || !strcmp(rtag, "defLightVector") || !strcmp(rtag, "defSwitchVector") ||
-            !strcmp(rtag, "defBLOBVector") || !strcmp(rtag, "message") || !strcmp(rtag, "delProperty"))
+    if (rid == XMLSYM_setNumberVector || rid == XMLSYM_setTextVector || rid == XMLSYM_setLightVector ||
+            rid == XMLSYM_setSwitchVector || rid == XMLSYM_setBLOBVector || rid == XMLSYM_defNumberVector ||
+            rid == XMLSYM_defTextVector || rid == XMLSYM_defLightVector || rid == XMLSYM_defSwitchVector ||
+            rid == XMLSYM_defBLOBVector || rid == XMLSYM_message || rid == XMLSYM_delProperty)
     {
         ISSnoopDevice(root);
         return (0);
@@ -296,7 +297,7 @@ int dispatch(XMLEle *root, char msg[])
 
     /* check tag in surmised decreasing order of likelihood */
 
-    if (!strcmp(rtag, "newNumberVector"))
+    if (rid == XMLSYM_newNumberVector)
     {
         static double *doubles = NULL;
         static char **names = NULL;
@@ -308,9 +309,9 @@ int dispatch(XMLEle *root, char msg[])
         /* pull out each name/value pair */
         for (n = 0, ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
         {
-            if (strcmp(tagXMLEle(ep), "oneNumber") == 0)
+            if (tagIdXMLEle(ep) == XMLSYM_oneNumber)
             {
-                XMLAtt *na = findXMLAtt(ep, "name");
+                XMLAtt *na = findXMLAttById(ep, XMLSYM_name);
                 if (na)
                 {
                     if (n >= maxn)
@@ -339,7 +340,7 @@ int dispatch(XMLEle *root, char msg[])
         return (0);
     }
 
-    if (!strcmp(rtag, "newSwitchVector"))
+    if (rid == XMLSYM_newSwitchVector)
     {
         static ISState *states = NULL;
         static char **names = NULL;
@@ -349,9 +350,9 @@ int dispatch(XMLEle *root, char msg[])
         /* pull out each name/state pair */
         for (n = 0, ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
         {
-            if (strcmp(tagXMLEle(ep), "oneSwitch") == 0)
+            if (tagIdXMLEle(ep) == XMLSYM_oneSwitch)
             {
-                XMLAtt *na = findXMLAtt(ep, "name");
+                XMLAtt *na = findXMLAttById(ep, XMLSYM_name);
                 if (na)
                 {
                     if (n >= maxn)
@@ -386,7 +387,7 @@ int dispatch(XMLEle *root, char msg[])
         return (0);
     }
 
-    if (!strcmp(rtag, "newTextVector"))
+    if (rid == XMLSYM_newTextVector)
     {
         static char **texts = NULL;
         static char **names = NULL;
@@ -395,9 +396,9 @@ int dispatch(XMLEle *root, char msg[])
         /* pull out each name/text pair */
         for (n = 0, ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
         {
-            if (strcmp(tagXMLEle(ep), "oneText") == 0)
+            if (tagIdXMLEle(ep) == XMLSYM_oneText)
             {
-                XMLAtt *na = findXMLAtt(ep, "name");
+                XMLAtt *na = findXMLAttById(ep, XMLSYM_name);
                 if (na)
                 {
                     if (n >= maxn)
@@ -421,7 +422,7 @@ int dispatch(XMLEle *root, char msg[])
         return (0);
     }
 
-    if (!strcmp(rtag, "newBLOBVector"))
+    if (rid == XMLSYM_newBLOBVector)
     {
         static char **blobs = NULL;
         static char **names = NULL;
@@ -434,12 +435,12 @@ int dispatch(XMLEle *root, char msg[])
         /* pull out each name/BLOB pair, decode */
         for (n = 0, ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
         {
-            if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
+            if (tagIdXMLEle(ep) == XMLSYM_oneBLOB)
             {
-                XMLAtt *na = findXMLAtt(ep, "name");
-                XMLAtt *fa = findXMLAtt(ep, "format");
-                XMLAtt *sa = findXMLAtt(ep, "size");
-                XMLAtt *el = findXMLAtt(ep, "enclen");
+                XMLAtt *na = findXMLAttById(ep, XMLSYM_name);
+                XMLAtt *fa = findXMLAttById(ep, XMLSYM_format);
+                XMLAtt *sa = findXMLAttById(ep, XMLSYM_size);
+                XMLAtt *el = findXMLAttById(ep, XMLSYM_enclen);
                 if (na && fa && sa)
                 {
                     if (n >= maxn)
@@ -334,6 +334,7 @@ int main(int ac, char *av[])
 
     /* init */
     clixml = newLilXML();
+    lilxmlArena(clixml, 1);
     addCallback(0, clientMsgCB, clixml);
 
     /* service client */
@@ -27,6 +27,7 @@
 #include "stream/streammanager.h"
 #include "locale_compat.h"
 #include "indiutility.h"
+#include "framestatistics.h"
 
 #include <fitsio.h>
 
@@ -1058,59 +1059,14 @@ void SensorInterface::getMinMax(double *min, double *max, uint8_t *buf, int len,
     int integrationWidth  = len;
     double lmin = 0, lmax = 0;
 
-    switch (bpp)
+    if (bpp == 8 || bpp == 16 || bpp == 32)
     {
-        case 8:
-        {
-            uint8_t *integrationBuffer = static_cast<uint8_t *>(buf);
-            lmin = lmax = integrationBuffer[0];
-
-            for (i = 0; i < integrationHeight; i++)
-                for (j = 0; j < integrationWidth; j++)
-                {
-                    ind = (i * integrationWidth) + j;
-                    if (integrationBuffer[ind] < lmin)
-                        lmin = integrationBuffer[ind];
-                    else if (integrationBuffer[ind] > lmax)
-                        lmax = integrationBuffer[ind];
-                }
-        }
-        break;
-
-        case 16:
-        {
-            uint16_t *integrationBuffer = reinterpret_cast<uint16_t *>(buf);
-            lmin = lmax = integrationBuffer[0];
-
-            for (i = 0; i < integrationHeight; i++)
-                for (j = 0; j < integrationWidth; j++)
-                {
-                    ind = (i * integrationWidth) + j;
-                    if (integrationBuffer[ind] < lmin)
-                        lmin = integrationBuffer[ind];
-                    else if (integrationBuffer[ind] > lmax)
-                        lmax = integrationBuffer[ind];
-                }
-        }
-        break;
-
-        case 32:
-        {
-            uint32_t *integrationBuffer = reinterpret_cast<uint32_t *>(buf);
-            lmin = lmax = integrationBuffer[0];
-
-            for (i = 0; i < integrationHeight; i++)
-                for (j = 0; j < integrationWidth; j++)
-                {
-                    ind = (i * integrationWidth) + j;
-                    if (integrationBuffer[ind] < lmin)
-                        lmin = integrationBuffer[ind];
-                    else if (integrationBuffer[ind] > lmax)
-                        lmax = integrationBuffer[ind];
-                }
-        }
-        break;
+        frameMinMax(buf, len, bpp, min, max);
+        return;
+    }
 
+    switch (bpp)
+    {
         case 64:
         {
             unsigned long *integrationBuffer = reinterpret_cast<unsigned long *>(buf);
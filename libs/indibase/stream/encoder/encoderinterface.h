@@ -55,10 +55,21 @@ class EncoderInterface
 
         virtual bool upload(INDI::WidgetViewBlob *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed = false) = 0;
 
+        /**
+         * @brief frameSent Called once the frame encoded by upload() is sent to the clients.
+         * @param nbytes size of the encoded frame.
+         * @param seconds time it took to send it, it grows when the clients fall behind.
+         */
+        virtual void frameSent(uint32_t nbytes, double seconds)
+        {
+            INDI_UNUSED(nbytes);
+            INDI_UNUSED(seconds);
+        }
+
         const char *getName();
 
     protected:
-        INDI::DefaultDevice *currentDevice;
+        INDI::DefaultDevice *currentDevice = nullptr;
         const char *name;
         INDI_PIXEL_FORMAT pixelFormat;            // INDI Pixel Format
         uint8_t pixelDepth = 8;                   // Bits per Pixels
@@ -20,48 +20,131 @@
 */
 
 #include "mjpegencoder.h"
-#include "stream/streammanager.h"
-#include "indiccd.h"
-#include <cmath>
-#include <zlib.h>
+#include "indilogger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <csetjmp>
 #include <jpeglib.h>
 #include <jerror.h>
 
+// libjpeg-turbo does not implement the DCT scaling of libjpeg 7 when compressing
+#if JPEG_LIB_VERSION >= 70 && !defined(LIBJPEG_TURBO_VERSION)
+#define HAVE_JPEG_DCT_SCALING
+#endif
+
+namespace INDI
+{
+
+struct JpegErrorManager
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
+
+struct JpegDestination
+{
+    struct jpeg_destination_mgr pub;
+    std::vector<uint8_t> *buffer = nullptr;
+    size_t size = 0;
+};
+
+struct MJPEGEncoder::Compressor
+{
+    struct jpeg_compress_struct cinfo;
+    JpegErrorManager error;
+    JpegDestination destination;
+
+    // Settings of the previous frame, left in cinfo
+    int components = 0;
+    int quality = 0;
+};
+
+static void error_exit(j_common_ptr cinfo)
+{
+    auto error = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(error->setjmp_buffer, 1);
+}
+
 static void init_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    auto destination = reinterpret_cast<JpegDestination *>(cinfo->dest);
+    if (destination->buffer->empty())
+        destination->buffer->resize(64 * 1024);
+    cinfo->dest->next_output_byte = destination->buffer->data();
+    cinfo->dest->free_in_buffer = destination->buffer->size();
 }
 
+// The buffer is full, grow it and go on where it ended
 static boolean empty_output_buffer(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* No work necessary here */
+    auto destination = reinterpret_cast<JpegDestination *>(cinfo->dest);
+    size_t used = destination->buffer->size();
+    bool grown = true;
+    try
+    {
+        destination->buffer->resize(used * 2);
+    }
+    catch (const std::bad_alloc &)
+    {
+        grown = false;
+    }
+    if (!grown)
+        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+
+    cinfo->dest->next_output_byte = destination->buffer->data() + used;
+    cinfo->dest->free_in_buffer = destination->buffer->size() - used;
     return TRUE;
 }
 
 static void term_destination(j_compress_ptr cinfo)
 {
-    INDI_UNUSED(cinfo);
-    /* no work necessary here */
+    auto destination = reinterpret_cast<JpegDestination *>(cinfo->dest);
+    destination->size = destination->buffer->size() - cinfo->dest->free_in_buffer;
 }
 
-namespace INDI
-{
-
 MJPEGEncoder::MJPEGEncoder()
+    : compressor(new Compressor)
 {
     name = "MJPEG";
+
+    // Created once, jpeg_finish_compress() leaves it ready for the next frame
+    compressor->cinfo.err = jpeg_std_error(&compressor->error.pub);
+    compressor->error.pub.error_exit = error_exit;
+    jpeg_create_compress(&compressor->cinfo);
+
+    compressor->destination.pub.init_destination    = init_destination;
+    compressor->destination.pub.empty_output_buffer = empty_output_buffer;
+    compressor->destination.pub.term_destination    = term_destination;
+    compressor->destination.buffer = &jpegBuffer;
+    compressor->cinfo.dest = &compressor->destination.pub;
 }
 
 MJPEGEncoder::~MJPEGEncoder()
 {
-    delete [] jpegBuffer;
+    jpeg_destroy_compress(&compressor->cinfo);
 }
 
 const char *MJPEGEncoder::getDeviceName()
 {
-    return currentDevice->getDeviceName();
+    // Used standalone before init()
+    return currentDevice ? currentDevice->getDeviceName() : getName();
+}
+
+void MJPEGEncoder::setQuality(int quality)
+{
+    this->quality = std::max(1, std::min(100, quality));
+}
+
+void MJPEGEncoder::setScaleWidth(uint16_t width)
+{
+    scaleWidth = width;
+}
+
+void MJPEGEncoder::setTargetBandwidth(uint32_t bytesPerSecond)
+{
+    targetBandwidth = bytesPerSecond;
 }
 
 bool MJPEGEncoder::upload(INDI::WidgetViewBlob *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed)
@@ -73,134 +156,184 @@ bool MJPEGEncoder::upload(INDI::WidgetViewBlob *bp, const uint8_t *buffer, uint3
         return false;
     }
 
-    INDI_UNUSED(nbytes);
-    int bufsize = rawWidth * rawHeight * ((pixelFormat == INDI_RGB) ? 3 : 1);
-    if (bufsize != jpegBufferSize)
+    int components = (pixelFormat == INDI_RGB) ? 3 : 1;
+    if (nbytes < static_cast<uint32_t>(rawWidth * rawHeight * components))
     {
-        delete [] jpegBuffer;
-        jpegBuffer = new uint8_t[bufsize];
-        jpegBufferSize = bufsize;
+        LOGF_ERROR("Frame of %u bytes is too small for %dx%d.", nbytes, rawWidth, rawHeight);
+        return false;
     }
 
-    // Scale image DOWN by this factor
-    // 640 is now selected arbitrary to test mpeg streaming performance
-    int scale = std::max(1, static_cast<int>(std::floor(rawWidth / SCALE_WIDTH)));
-    if (pixelFormat == INDI_RGB)
-        jpeg_compress_8u_rgb(buffer, rawWidth, rawHeight, rawWidth * 3, scale, jpegBuffer, &bufsize, 85);
+    auto start = std::chrono::steady_clock::now();
+
+    // Scale image DOWN by this factor, to the scale width
+    int maxQuality = quality;
+    int baseScale = scaleWidth > 0 ? std::max(1, rawWidth / scaleWidth) : 1;
+    if (targetBandwidth == 0)
+    {
+        activeQuality = maxQuality;
+        activeScale   = baseScale;
+    }
     else
-        jpeg_compress_8u_gray(buffer, rawWidth, rawHeight, rawWidth, scale, jpegBuffer, &bufsize, 85);
+    {
+        activeQuality = std::max(std::min(activeQuality, maxQuality), std::min(maxQuality, static_cast<int>(MIN_QUALITY)));
+        activeScale   = std::max(activeScale, baseScale);
+    }
+    activeScale = std::max(1, std::min({activeScale, static_cast<int>(MAX_SCALE), static_cast<int>(rawWidth), static_cast<int>(rawHeight)}));
+
+    if (!compress(buffer, rawWidth, rawHeight, components, activeScale, activeQuality))
+    {
+        LOG_ERROR("JPEG compression failed.");
+        return false;
+    }
 
-    bp->setBlob(jpegBuffer);
-    bp->setBlobLen(bufsize);
-    bp->setSize(bufsize);
+    if (targetBandwidth != 0)
+        adapt(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), start);
+    else
+        lastFrame = start;
+
+    bp->setBlob(jpegBuffer.data());
+    bp->setBlobLen(compressor->destination.size);
+    bp->setSize(compressor->destination.size);
     bp->setFormat(".stream_jpg");
 
     return true;
 }
 
-/*
-FROM: https://svn.csail.mit.edu/rrg_pods/jpeg-utils/
+void MJPEGEncoder::frameSent(uint32_t nbytes, double seconds)
+{
+    INDI_UNUSED(nbytes);
+    sendSeconds = seconds;
+}
 
-Name:         jpeg-utils
-Maintainers:  Albert Huang <albert@csail.mit.edu>
-Summary:      Wrapper functions around libjpeg to simplify JPEG compression and
-              decompression with in-memory buffers.
-Description:
-  note: This is a simple enough library that you could just copy the .c
-  and .h files in to your own programs.
+// Once per frame, from the size of the frame, the time it took to encode it, and the time the
+// previous frame took to reach the clients: it grows when they do not keep up with the stream.
+void MJPEGEncoder::adapt(double encodeSeconds, std::chrono::steady_clock::time_point start)
+{
+    bool first = lastFrame == std::chrono::steady_clock::time_point();
+    double interval = std::chrono::duration<double>(start - lastFrame).count();
+    lastFrame = start;
+    if (first || interval <= 0)
+        return;
 
-  To use the library, link against -ljpeg-utils, or use
-  pkg-config --cflags --libs jpeg-utils
+    // Frames are encoded and sent one after the other, a frame takes at least that long
+    double period = std::max(interval, encodeSeconds + sendSeconds);
+    double rate = compressor->destination.size / period;
+    double target = targetBandwidth;
 
-Requirements:
-  libjpeg62
+    int maxQuality = quality;
+    int baseScale = scaleWidth > 0 ? std::max(1, rawWidth / scaleWidth) : 1;
 
-  For faster performance, install libjpeg-turbo, an SSE-accelerated
-  library that is ABI compatible with libjpeg62.
-*/
+    // Scaling down cuts the encode time as well, do it first when encoding takes much of the frame time
+    bool encodeBound = encodeSeconds > interval / 2;
+
+    if (rate > target || sendSeconds > interval / 2)
+    {
+        if (activeQuality > MIN_QUALITY && !encodeBound)
+            activeQuality = std::max(static_cast<int>(MIN_QUALITY), activeQuality - 5);
+        else if (activeScale < MAX_SCALE)
+            ++activeScale;
+        else
+            activeQuality = std::max(1, activeQuality - 5);
+    }
+    else if (rate < target * 3 / 4 && sendSeconds < interval / 4)
+    {
+        double scaledUp = static_cast<double>(activeScale * activeScale) / ((activeScale - 1) * (activeScale - 1));
+        if (activeQuality < maxQuality)
+            activeQuality = std::min(maxQuality, activeQuality + 5);
+        else if (activeScale > baseScale && rate * scaledUp < target && encodeSeconds * scaledUp < interval / 2)
+            --activeScale;
+    }
+}
 
-int MJPEGEncoder::jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale,
-        uint8_t * dest,
-        int * destsize, int quality)
+bool MJPEGEncoder::compress(const uint8_t *src, uint16_t width, uint16_t height, int components, int scale, int quality)
 {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-#if JPEG_LIB_VERSION >= 70
-    cinfo.scale_denom = scale;
-#else
-    INDI_UNUSED(scale);
-#endif
-    cinfo.input_components = 1;
-    cinfo.in_color_space = JCS_GRAYSCALE;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
+    struct jpeg_compress_struct *cinfo = &compressor->cinfo;
 
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    if (setjmp(compressor->error.setjmp_buffer))
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        jpeg_abort_compress(cinfo);
+        compressor->components = 0;
+        return false;
     }
 
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
-}
+    if (compressor->components != components)
+    {
+        cinfo->input_components = components;
+        cinfo->in_color_space = components == 3 ? JCS_RGB : JCS_GRAYSCALE;
+        jpeg_set_defaults(cinfo);
+        compressor->components = components;
+        compressor->quality = 0;
+    }
+    if (compressor->quality != quality)
+    {
+        jpeg_set_quality(cinfo, quality, TRUE);
+        compressor->quality = quality;
+    }
 
-int MJPEGEncoder::jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale,
-                                        uint8_t * dest, int * destsize, int quality)
-{
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    struct jpeg_destination_mgr jdest;
-    int out_size = *destsize;
-
-    cinfo.err = jpeg_std_error (&jerr);
-    jpeg_create_compress (&cinfo);
-    jdest.next_output_byte = dest;
-    jdest.free_in_buffer = out_size;
-    jdest.init_destination = init_destination;
-    jdest.empty_output_buffer = empty_output_buffer;
-    jdest.term_destination = term_destination;
-    cinfo.dest = &jdest;
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-#if JPEG_LIB_VERSION >= 70
-    cinfo.scale_denom = scale;
+    int stride = width * components;
+
+#ifdef HAVE_JPEG_DCT_SCALING
+    cinfo->image_width = width;
+    cinfo->image_height = height;
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = scale;
+
+    jpeg_start_compress(cinfo, TRUE);
+    while (cinfo->next_scanline < cinfo->image_height)
+    {
+        JSAMPROW row = const_cast<JSAMPROW>(src + cinfo->next_scanline * stride);
+        jpeg_write_scanlines(cinfo, &row, 1);
+    }
 #else
-    INDI_UNUSED(scale);
-#endif
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-    jpeg_set_defaults (&cinfo);
-    jpeg_set_quality (&cinfo, quality, TRUE);
+    cinfo->image_width = width / scale;
+    cinfo->image_height = height / scale;
 
-    jpeg_start_compress (&cinfo, TRUE);
-    while (cinfo.next_scanline < height)
+    jpeg_start_compress(cinfo, TRUE);
+    if (scale == 1)
+    {
+        while (cinfo->next_scanline < cinfo->image_height)
+        {
+            JSAMPROW row = const_cast<JSAMPROW>(src + cinfo->next_scanline * stride);
+            jpeg_write_scanlines(cinfo, &row, 1);
+        }
+    }
+    else
     {
-        JSAMPROW row = (JSAMPROW)(src + cinfo.next_scanline * stride);
-        jpeg_write_scanlines (&cinfo, &row, 1);
+        // Average blocks of scale x scale pixels: add up the rows of a block, then the columns
+        const int scaledStride = cinfo->image_width * components;
+        const int area = scale * scale;
+        scaledSums.resize(stride);
+        scaledRow.resize(scaledStride);
+
+        while (cinfo->next_scanline < cinfo->image_height)
+        {
+            const uint8_t *row = src + cinfo->next_scanline * scale * stride;
+            std::copy(row, row + stride, scaledSums.begin());
+            for (int y = 1; y < scale; y++)
+            {
+                row += stride;
+                for (int i = 0; i < stride; i++)
+                    scaledSums[i] += row[i];
+            }
+
+            const uint16_t *sums = scaledSums.data();
+            for (int x = 0; x < scaledStride; x += components, sums += scale * components)
+                for (int c = 0; c < components; c++)
+                {
+                    unsigned int sum = area / 2;
+                    for (int dx = 0; dx < scale; dx++)
+                        sum += sums[dx * components + c];
+                    scaledRow[x + c] = static_cast<uint8_t>(sum / area);
+                }
+
+            JSAMPROW scaled = scaledRow.data();
+            jpeg_write_scanlines(cinfo, &scaled, 1);
+        }
     }
-    jpeg_finish_compress (&cinfo);
-    *destsize = out_size - jdest.free_in_buffer;
-    jpeg_destroy_compress (&cinfo);
-    return 0;
+#endif
+
+    jpeg_finish_compress(cinfo);
+    return true;
 }
 
 }
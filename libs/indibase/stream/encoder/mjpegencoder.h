@@ -23,13 +23,23 @@
 
 #include "encoderinterface.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
 namespace INDI
 {
 
 /**
  * @brief The MJPEGEncoder class encodes frames in JPEG format before transmitting them to the client.
  *
- * The quality is now hard-coded at 70 when encoding the JPEG image. Further compression is not supported.
+ * The compressor is created once and reused for every frame, writing into a buffer that only grows.
+ * Frames wider than the scale width are scaled down by an integer factor, in the DCT domain when the
+ * JPEG library supports it, otherwise by averaging blocks of pixels as the rows are fed to it.
+ *
+ * With a target bandwidth, the quality, then the scale, are lowered while the frames sent per second
+ * exceed it or the clients fall behind, and raised back while there is room.
  */
 class MJPEGEncoder : public EncoderInterface
 {
@@ -38,18 +48,53 @@ class MJPEGEncoder : public EncoderInterface
         ~MJPEGEncoder();
 
         virtual bool upload(INDI::WidgetViewBlob *bp, const uint8_t *buffer, uint32_t nbytes, bool isCompressed = false) override;
+        virtual void frameSent(uint32_t nbytes, double seconds) override;
+
+        /** @brief setQuality JPEG quality, 1 to 100, the highest used in bandwidth mode. */
+        void setQuality(int quality);
+
+        /** @brief setScaleWidth Frames are scaled down to about this width, 0 to keep the full resolution. */
+        void setScaleWidth(uint16_t width);
+
+        /** @brief setTargetBandwidth Adapt quality and scale to send at most this many bytes per second, 0 to disable. */
+        void setTargetBandwidth(uint32_t bytesPerSecond);
+
+        /** @return Quality used for the last frame. */
+        int currentQuality() const
+        {
+            return activeQuality;
+        }
+
+        /** @return Scale factor used for the last frame. */
+        int currentScale() const
+        {
+            return activeScale;
+        }
 
     private:
+        struct Compressor;
+
         const char *getDeviceName();
-        int jpeg_compress_8u_gray (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale, uint8_t * dest,
-                                   int * destsize, int quality);
-        int jpeg_compress_8u_rgb (const uint8_t * src, uint16_t width, uint16_t height, int stride, int scale, uint8_t * dest,
-                                  int * destsize, int quality);
-        uint8_t *jpegBuffer = nullptr;
-        uint16_t jpegBufferSize = 1;
+        bool compress(const uint8_t *src, uint16_t width, uint16_t height, int components, int scale, int quality);
+        void adapt(double encodeSeconds, std::chrono::steady_clock::time_point start);
+
+        std::unique_ptr<Compressor> compressor;
+        std::vector<uint8_t> jpegBuffer;
+        std::vector<uint16_t> scaledSums;
+        std::vector<uint8_t> scaledRow;
+
+        std::atomic<int> quality {85};
+        std::atomic<int> scaleWidth {0};
+        std::atomic<uint32_t> targetBandwidth {0};
 
-        static const int SCALE_WIDTH = 640;
+        // Bandwidth mode, on the upload thread
+        int activeQuality = 85;
+        int activeScale = 1;
+        double sendSeconds = 0;
+        std::chrono::steady_clock::time_point lastFrame;
 
+        static const int MIN_QUALITY = 30;
+        static const int MAX_SCALE = 16;
 };
 
 }
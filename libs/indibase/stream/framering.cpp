@@ -0,0 +1,170 @@
+/*
+    Frame Ring
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#include "framering.h"
+#include "sharedblob.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace INDI
+{
+
+class FrameRingPrivate : public std::enable_shared_from_this<FrameRingPrivate>
+{
+    public:
+        ~FrameRingPrivate()
+        {
+            for (auto slot : idle)
+                destroy(slot);
+        }
+
+        void destroy(FrameRing::Slot *slot)
+        {
+            allocated -= slot->mCapacity;
+            --slots;
+            IDSharedBlobFree(slot->mData);
+            delete slot;
+        }
+
+        void release(FrameRing::Slot *slot)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy;
+
+            // Sent attached to a BLOB, the receivers map it readonly
+            if (IDSharedBlobIsSealed(slot->mData) || allocated > limit)
+                destroy(slot);
+            else
+                idle.push_back(slot);
+        }
+
+    public:
+        mutable std::mutex mutex;
+        std::vector<FrameRing::Slot *> idle;
+        size_t slots {0};
+        size_t busy {0};
+        size_t allocated {0};
+        size_t limit {SIZE_MAX};
+};
+
+FrameRing::FrameRing()
+    : d_ptr(new FrameRingPrivate)
+{ }
+
+FrameRing::~FrameRing()
+{ }
+
+FrameRing::Frame FrameRing::acquire(size_t size)
+{
+    D_PTR(FrameRing);
+    std::unique_lock<std::mutex> lock(d->mutex);
+
+    Slot *slot = nullptr;
+
+    // The most recently released slot is the likeliest to be in cache
+    if (!d->idle.empty())
+    {
+        slot = d->idle.back();
+        d->idle.pop_back();
+    }
+    else
+    {
+        if (d->allocated + size > d->limit)
+            return nullptr;
+
+        slot = new Slot;
+        ++d->slots;
+    }
+
+    if (slot->mCapacity < size)
+    {
+        if (d->allocated - slot->mCapacity + size > d->limit)
+        {
+            d->idle.push_back(slot);
+            return nullptr;
+        }
+
+        void *data = slot->mData == nullptr ? IDSharedBlobAlloc(size) : IDSharedBlobRealloc(slot->mData, size);
+        if (data == nullptr)
+        {
+            if (slot->mData == nullptr)
+            {
+                --d->slots;
+                delete slot;
+            }
+            else
+                d->idle.push_back(slot);
+            return nullptr;
+        }
+
+        d->allocated += size - slot->mCapacity;
+        slot->mData     = static_cast<uint8_t *>(data);
+        slot->mCapacity = size;
+    }
+
+    slot->mSize = size;
+    ++d->busy;
+    lock.unlock();
+
+    std::shared_ptr<FrameRingPrivate> ring = d->shared_from_this();
+    return Frame(slot, [ring](Slot * slot)
+    {
+        ring->release(slot);
+    });
+}
+
+void FrameRing::setLimit(size_t bytes)
+{
+    D_PTR(FrameRing);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->limit = bytes;
+}
+
+void FrameRing::clear()
+{
+    D_PTR(FrameRing);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    for (auto slot : d->idle)
+        d->destroy(slot);
+    d->idle.clear();
+}
+
+size_t FrameRing::slotCount() const
+{
+    D_PTR(const FrameRing);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->slots;
+}
+
+size_t FrameRing::busyCount() const
+{
+    D_PTR(const FrameRing);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->busy;
+}
+
+size_t FrameRing::allocatedSize() const
+{
+    D_PTR(const FrameRing);
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->allocated;
+}
+
+}
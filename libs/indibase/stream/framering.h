@@ -0,0 +1,119 @@
+/*
+    Frame Ring
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#pragma once
+
+#include "indimacros.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace INDI
+{
+
+class FrameRingPrivate;
+
+/**
+ * \class FrameRing
+ * \brief Recycled frame buffers for video streams.
+ *
+ * A slot is acquired, filled, then passed around as a reference counted Frame: the queue, the recorder
+ * and the preview hold the same buffer, no stage copies it. The slot returns to the ring when its last
+ * reference is dropped, and is reused by the next acquire without allocating.
+ *
+ * Slots are shared blobs, so a Frame can be sent as an attached BLOB without copy. Sending seals the
+ * buffer readonly: such a slot is freed on release, and replaced by a new one when needed.
+ */
+class FrameRing
+{
+        DECLARE_PRIVATE(FrameRing)
+
+    public:
+        class Slot
+        {
+                friend class FrameRing;
+                friend class FrameRingPrivate;
+
+            public:
+                uint8_t *data()
+                {
+                    return mData;
+                }
+                const uint8_t *data() const
+                {
+                    return mData;
+                }
+
+                /** @brief Bytes used by the frame, as requested from acquire(). */
+                size_t size() const
+                {
+                    return mSize;
+                }
+
+                /** @brief Bytes allocated for the slot, at least size(). */
+                size_t capacity() const
+                {
+                    return mCapacity;
+                }
+
+            private:
+                uint8_t *mData {nullptr};
+                size_t mSize {0};
+                size_t mCapacity {0};
+        };
+
+        typedef std::shared_ptr<Slot> Frame;
+
+    public:
+        FrameRing();
+        ~FrameRing();
+
+    public:
+        /**
+         * @brief acquire Get a free slot of size bytes.
+         * An idle slot is reused, grown if needed. A new slot is allocated only if all are in use.
+         * @return The frame to fill, nullptr if the ring reached its limit or memory is exhausted.
+         */
+        Frame acquire(size_t size);
+
+        /**
+         * @brief setLimit Memory the slots may take, in bytes. Default is unlimited.
+         * Above the limit, acquire fails instead of allocating, and released slots are freed.
+         */
+        void setLimit(size_t bytes);
+
+        /** @brief Free the idle slots. Frames in use are still valid and freed on release. */
+        void clear();
+
+    public:
+        /** @brief Count of allocated slots, idle or in use. */
+        size_t slotCount() const;
+
+        /** @brief Count of slots held by a Frame. */
+        size_t busyCount() const;
+
+        /** @brief Bytes taken by all slots. */
+        size_t allocatedSize() const;
+
+    protected:
+        // Frames keep it alive, they may outlive the ring
+        std::shared_ptr<FrameRingPrivate> d_ptr;
+};
+
+}
@@ -21,35 +21,142 @@
 
 */
 #include "gammalut16.h"
+#include "frameparallel_p.h"
+
+#include <algorithm>
 #include <cmath>
 
-GammaLut16::GammaLut16(double gamma, double a, double b, double Ii)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GAMMALUT16_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// In the compact table, samples below are looked up one by one, above by groups of 16
+static constexpr uint32_t EXACT_SAMPLES = 4096;
+static constexpr uint32_t GROUP_SHIFT   = 4;
+static constexpr uint32_t TABLE_SIZE    = EXACT_SAMPLES + (65536 >> GROUP_SHIFT) - (EXACT_SAMPLES >> GROUP_SHIFT);
+
+// The same as value < EXACT_SAMPLES ? value : (value >> GROUP_SHIFT) + EXACT_SAMPLES - (EXACT_SAMPLES >> GROUP_SHIFT)
+static inline uint32_t tableIndex(uint32_t value)
 {
-    mLookUpTable.resize(65536);
+    return std::min(value, (value >> GROUP_SHIFT) + EXACT_SAMPLES - (EXACT_SAMPLES >> GROUP_SHIFT));
+}
 
-    unsigned int i = 0;
-    for (auto &value : mLookUpTable)
+GammaLut16::GammaLut16(double gamma, double a, double b, double Ii)
+{
+    auto curve = [&](uint32_t i) -> uint8_t
     {
-        double I = static_cast<double>(i++) / 65535.0;
+        double I = static_cast<double>(i) / 65535.0;
         double p;
         if (I <= Ii)
             p = a * I;
         else
             p = (1 + b) * powf(I, 1.0 / gamma) - b;
-        value = round(255.0 * p);
+        return round(255.0 * p);
+    };
+
+    mLookUpTable.resize(65536);
+    for (uint32_t i = 0; i < 65536; ++i)
+        mLookUpTable[i] = curve(i);
+
+#if defined(GAMMALUT16_SIMD_X86)
+    // 3 more bytes, gathers read 4 bytes at the last index
+    mCompactTable.resize(TABLE_SIZE + 3);
+
+    std::copy(mLookUpTable.begin(), mLookUpTable.begin() + EXACT_SAMPLES, mCompactTable.begin());
+
+    // A group takes the value of its middle
+    for (uint32_t i = EXACT_SAMPLES; i < 65536; i += 1 << GROUP_SHIFT)
+        mCompactTable[tableIndex(i)] = curve(i + (1 << (GROUP_SHIFT - 1)));
+#endif
+}
+
+#if defined(GAMMALUT16_SIMD_X86)
+
+__attribute__((target("avx2")))
+static size_t applyAVX2(const uint8_t *lookUpTable, const uint16_t *source, size_t count, uint8_t *destination)
+{
+    const __m256i offset = _mm256_set1_epi32(EXACT_SAMPLES - (EXACT_SAMPLES >> GROUP_SHIFT));
+    const __m256i byte   = _mm256_set1_epi32(0xff);
+    const int *table     = reinterpret_cast<const int *>(lookUpTable);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i v  = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+        __m256i v0 = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i v1 = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+
+        v0 = _mm256_min_epu32(v0, _mm256_add_epi32(_mm256_srli_epi32(v0, GROUP_SHIFT), offset));
+        v1 = _mm256_min_epu32(v1, _mm256_add_epi32(_mm256_srli_epi32(v1, GROUP_SHIFT), offset));
+
+        __m256i g0 = _mm256_and_si256(_mm256_i32gather_epi32(table, v0, 1), byte);
+        __m256i g1 = _mm256_and_si256(_mm256_i32gather_epi32(table, v1, 1), byte);
+
+        // 16 x 16 bit in order, then 16 bytes
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(g0, g1), 0xD8);
+        __m128i b = _mm_packus_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), b);
     }
+    return i;
+}
+
+// Only x86 has a vectorized lookup
+static INDI::SimdLevel s_SimdLevel {1};
+
+#else
+
+static INDI::SimdLevel s_SimdLevel {0};
+
+#endif
+
+int GammaLut16::setSimdLevel(int level)
+{
+    return s_SimdLevel.set(level);
 }
 
 void GammaLut16::apply(const uint16_t *source, size_t count, uint8_t *destination) const
 {
-    apply(source, source + count, destination);
+    const uint8_t *lookUpTable = mLookUpTable.data();
+    for (size_t i = 0; i < count; ++i)
+        destination[i] = lookUpTable[source[i]];
 }
 
 
 void GammaLut16::apply(const uint16_t *first, const uint16_t *last, uint8_t *destination) const
+{
+    apply(first, last - first, destination);
+}
+
+void GammaLut16::applyRows(const uint16_t *source, size_t stride, size_t samples, size_t rowBegin, size_t rowEnd,
+                           uint8_t *destination) const
 {
     const uint8_t *lookUpTable = mLookUpTable.data();
+    const bool simd = s_SimdLevel.get() > 0;
+
+    for (size_t row = rowBegin; row < rowEnd; ++row)
+    {
+        const uint16_t *first = source + row * stride;
+        uint8_t *out          = destination + row * samples;
 
-    while (first != last)
-        *destination++ = lookUpTable[*first++];
+        size_t i = 0;
+#if defined(GAMMALUT16_SIMD_X86)
+        if (simd)
+            i = applyAVX2(mCompactTable.data(), first, samples, out);
+#else
+        (void)simd;
+#endif
+        for (; i < samples; ++i)
+            out[i] = lookUpTable[first[i]];
+    }
+}
+
+void GammaLut16::applyRegion(const uint16_t *source, size_t stride, size_t samples, size_t rows,
+                             uint8_t *destination, int threads) const
+{
+    unsigned count = INDI::threadCount(samples * rows, rows, threads);
+    INDI::parallelSlices(rows, count, [&](unsigned, size_t begin, size_t end)
+    {
+        applyRows(source, stride, samples, begin, end, destination);
+    });
 }
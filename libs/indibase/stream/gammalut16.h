@@ -26,15 +26,51 @@
 #include <cstdint>
 #include <cstddef>
 
+/**
+ * \class GammaLut16
+ * \brief Gamma correction of 16 bit samples to 8 bit, for the preview of streams.
+ *
+ * apply() and the scalar code look every sample up in a 64K table, and are exact.
+ *
+ * With AVX2, applyRegion() converts 16 samples at once with gathers into a compact table: samples below
+ * 4096 are looked up one by one, above they are looked up by groups of 16, where the curve is flat enough.
+ * That table is 8 KB and stays in L1 cache, and the result is within one level of the exact curve.
+ */
 class GammaLut16
 {
     public:
         GammaLut16(double gamma = 2.4, double a = 12.92, double b = 0.055, double Ii = 0.00304);
 
     public:
+        /** @brief apply Convert count samples with the exact curve. */
         void apply(const uint16_t *source, size_t count, uint8_t *destination) const;
         void apply(const uint16_t *first, const uint16_t *last, uint8_t *destination) const;
 
+        /**
+         * @brief applyRegion Convert a region of a frame in one pass, instead of a subframe copy then apply().
+         * With AVX2, the result is within one level of the exact curve.
+         * @param source First sample of the region.
+         * @param stride Samples from a row of the source to the next, the frame width times the color components.
+         * @param samples Samples per row of the region, its width times the color components.
+         * @param rows Rows of the region.
+         * @param destination Receives rows x samples bytes, rows without padding.
+         * @param threads Number of threads, 0 to pick one from the region size and the number of cores.
+         */
+        void applyRegion(const uint16_t *source, size_t stride, size_t samples, size_t rows, uint8_t *destination,
+                         int threads = 0) const;
+
+        /**
+         * @brief setSimdLevel Limit the instruction set used, for testing.
+         * @param level 0 for scalar code, -1 for the best available.
+         * @return The level in use.
+         */
+        static int setSimdLevel(int level);
+
+    protected:
+        void applyRows(const uint16_t *source, size_t stride, size_t samples, size_t rowBegin, size_t rowEnd,
+                       uint8_t *destination) const;
+
     protected:
         std::vector<uint8_t> mLookUpTable;
+        std::vector<uint8_t> mCompactTable;
 };
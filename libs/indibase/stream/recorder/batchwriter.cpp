@@ -0,0 +1,339 @@
+/*
+    Batch Writer
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#include "batchwriter.h"
+#include "stream/ringqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace INDI
+{
+
+class BatchWriterPrivate
+{
+    public:
+        // Direct writes must start, end and be stored on block boundaries
+        static const size_t ALIGNMENT = 4096;
+
+
+        struct Batch
+        {
+            uint8_t *data = nullptr;
+            size_t size = 0;
+        };
+
+    public:
+        BatchWriterPrivate()
+            : freeBatches(new SPSCQueue<Batch>(1))
+            , fullBatches(new SPSCQueue<Batch>(1))
+        { }
+
+        void run();
+        bool write(Batch &batch);
+        void preallocate(off_t end);
+
+    public:
+        int fd = -1;
+        bool direct = false;
+        size_t batchSize = 0;
+        std::vector<uint8_t *> buffers;
+
+        // Producer side
+        Batch current;
+        uint64_t appended = 0;
+
+        // Writer side
+        std::thread thread;
+        off_t offset = 0;
+        off_t preallocated = 0;
+        // Space reserved on disk ahead of the writes, what the batches hold
+        off_t preallocateAhead = 0;
+
+        std::unique_ptr<SPSCQueue<Batch>> freeBatches;
+        std::unique_ptr<SPSCQueue<Batch>> fullBatches;
+
+        std::atomic<uint64_t> written {0};
+        std::atomic<int> error {0};
+        std::chrono::steady_clock::time_point start, stop;
+};
+
+void BatchWriterPrivate::run()
+{
+    Batch batch;
+    while (fullBatches->pop(batch))
+    {
+        // Closing
+        if (batch.data == nullptr)
+            break;
+
+        if (error == 0 && !write(batch))
+            error = errno != 0 ? errno : EIO;
+
+        batch.size = 0;
+        freeBatches->push(std::move(batch));
+    }
+}
+
+bool BatchWriterPrivate::write(Batch &batch)
+{
+    size_t size = batch.size;
+
+    // The last batch is padded, the file is truncated to its size on close
+    if (direct && size % ALIGNMENT != 0)
+    {
+        size_t padded = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        memset(batch.data + size, 0, padded - size);
+        size = padded;
+    }
+
+    preallocate(offset + size);
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = pwrite(fd, batch.data + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+
+#ifdef O_DIRECT
+        // Some filesystems accept O_DIRECT on open and refuse the writes
+        if (n < 0 && errno == EINVAL && direct)
+        {
+            direct = false;
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            size = batch.size;
+            continue;
+        }
+#endif
+        if (n <= 0)
+            return false;
+
+        done += n;
+    }
+
+    offset += std::min(size, batch.size);
+    written += batch.size;
+    return true;
+}
+
+void BatchWriterPrivate::preallocate(off_t end)
+{
+#ifdef __linux__
+    if (end <= preallocated)
+        return;
+
+    // Not supported by every filesystem, the writes allocate then
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, preallocated, end - preallocated + preallocateAhead) == 0)
+        preallocated = end + preallocateAhead;
+    else
+        preallocated = end;
+#else
+    INDI_UNUSED(end);
+#endif
+}
+
+BatchWriter::BatchWriter()
+    : d_ptr(new BatchWriterPrivate)
+{ }
+
+BatchWriter::~BatchWriter()
+{
+    close();
+}
+
+bool BatchWriter::open(const char *filename, size_t batchSize, size_t batchCount, bool direct)
+{
+    D_PTR(BatchWriter);
+    if (d->fd >= 0)
+        close();
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    d->direct = false;
+#ifdef O_DIRECT
+    if (direct)
+    {
+        d->fd = ::open(filename, flags | O_DIRECT, 0644);
+        d->direct = d->fd >= 0;
+    }
+#else
+    INDI_UNUSED(direct);
+#endif
+    if (d->fd < 0)
+        d->fd = ::open(filename, flags, 0644);
+    if (d->fd < 0)
+        return false;
+
+    batchCount = std::max<size_t>(2, batchCount);
+    d->batchSize = (std::max<size_t>(1, batchSize) + BatchWriterPrivate::ALIGNMENT - 1) / BatchWriterPrivate::ALIGNMENT *
+                   BatchWriterPrivate::ALIGNMENT;
+
+    d->freeBatches.reset(new SPSCQueue<BatchWriterPrivate::Batch>(batchCount));
+    d->fullBatches.reset(new SPSCQueue<BatchWriterPrivate::Batch>(batchCount + 1));
+    for (size_t i = 0; i < batchCount; i++)
+    {
+        void *data = nullptr;
+        if (posix_memalign(&data, BatchWriterPrivate::ALIGNMENT, d->batchSize) != 0)
+        {
+            int error = errno;
+            close();
+            errno = error;
+            return false;
+        }
+        d->buffers.push_back(static_cast<uint8_t *>(data));
+
+        BatchWriterPrivate::Batch batch;
+        batch.data = static_cast<uint8_t *>(data);
+        d->freeBatches->push(std::move(batch));
+    }
+
+    d->current = BatchWriterPrivate::Batch();
+    d->appended = 0;
+    d->offset = 0;
+    d->preallocated = 0;
+    d->preallocateAhead = static_cast<off_t>(d->batchSize * batchCount);
+    d->written = 0;
+    d->error = 0;
+    d->start = std::chrono::steady_clock::now();
+    d->stop = std::chrono::steady_clock::time_point();
+    d->thread = std::thread([d]()
+    {
+        d->run();
+    });
+    return true;
+}
+
+bool BatchWriter::close()
+{
+    D_PTR(BatchWriter);
+    if (d->fd < 0)
+        return true;
+
+    if (d->thread.joinable())
+    {
+        if (d->current.data != nullptr && d->current.size != 0)
+            d->fullBatches->push(std::move(d->current));
+        d->fullBatches->push(BatchWriterPrivate::Batch());
+        d->thread.join();
+    }
+    d->stop = std::chrono::steady_clock::now();
+    d->current = BatchWriterPrivate::Batch();
+
+    // Drop the padding of the last batch, and the preallocated space
+    if (d->error == 0 && ftruncate(d->fd, d->offset) != 0)
+        d->error = errno;
+    if (::close(d->fd) != 0 && d->error == 0)
+        d->error = errno;
+    d->fd = -1;
+
+    for (auto data : d->buffers)
+        free(data);
+    d->buffers.clear();
+    d->freeBatches.reset(new SPSCQueue<BatchWriterPrivate::Batch>(1));
+    d->fullBatches.reset(new SPSCQueue<BatchWriterPrivate::Batch>(1));
+
+    return d->error == 0;
+}
+
+bool BatchWriter::isOpen() const
+{
+    D_PTR(const BatchWriter);
+    return d->fd >= 0;
+}
+
+size_t BatchWriter::available() const
+{
+    D_PTR(const BatchWriter);
+    if (d->fd < 0 || d->error != 0)
+        return 0;
+
+    size_t current = d->current.data != nullptr ? d->batchSize - d->current.size : 0;
+    return current + d->freeBatches->size() * d->batchSize;
+}
+
+bool BatchWriter::append(const void *data, size_t size)
+{
+    D_PTR(BatchWriter);
+    if (size > available())
+        return false;
+
+    const uint8_t *source = static_cast<const uint8_t *>(data);
+    d->appended += size;
+
+    while (size > 0)
+    {
+        if (d->current.data == nullptr)
+            d->freeBatches->pop(d->current, 0);
+
+        size_t n = std::min(size, d->batchSize - d->current.size);
+        memcpy(d->current.data + d->current.size, source, n);
+        d->current.size += n;
+        source += n;
+        size -= n;
+
+        if (d->current.size == d->batchSize)
+        {
+            d->fullBatches->push(std::move(d->current));
+            d->current = BatchWriterPrivate::Batch();
+        }
+    }
+    return true;
+}
+
+uint64_t BatchWriter::size() const
+{
+    D_PTR(const BatchWriter);
+    return d->appended;
+}
+
+uint64_t BatchWriter::writtenSize() const
+{
+    D_PTR(const BatchWriter);
+    return d->written;
+}
+
+double BatchWriter::writeRate() const
+{
+    D_PTR(const BatchWriter);
+    auto end = d->fd >= 0 ? std::chrono::steady_clock::now() : d->stop;
+    double seconds = std::chrono::duration<double>(end - d->start).count();
+    return seconds > 0 ? d->written / seconds : 0;
+}
+
+int BatchWriter::error() const
+{
+    D_PTR(const BatchWriter);
+    return d->error;
+}
+
+bool BatchWriter::isDirect() const
+{
+    D_PTR(const BatchWriter);
+    return d->direct;
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+    Batch Writer
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+#pragma once
+
+#include "indimacros.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace INDI
+{
+
+class BatchWriterPrivate;
+
+/**
+ * \class BatchWriter
+ * \brief Appends to a file from a dedicated thread, in large aligned batches.
+ *
+ * append() copies the data into the current batch and returns: full batches are written by the writer
+ * thread while the next ones fill up. It never waits for the disk, when every batch is still waiting to
+ * be written it fails, and the caller drops the frame instead of stalling the stream.
+ *
+ * On Linux, the file is opened with O_DIRECT when the filesystem supports it, so that recordings do not
+ * evict the page cache, and space is preallocated ahead of the writes with fallocate(), as much as the
+ * batches hold.
+ */
+class BatchWriter
+{
+        DECLARE_PRIVATE(BatchWriter)
+    public:
+        BatchWriter();
+        ~BatchWriter();
+
+    public:
+        /**
+         * @brief open Create or truncate the file and start the writer thread.
+         * @param filename Path of the file.
+         * @param batchSize Size of a batch, rounded up to the alignment of direct writes.
+         * @param batchCount Number of batches, what can be held in memory while the disk stalls.
+         * @param direct Try to bypass the page cache.
+         * @return False with errno set if the file could not be created.
+         */
+        bool open(const char *filename, size_t batchSize = 8 * 1024 * 1024, size_t batchCount = 8, bool direct = true);
+
+        /**
+         * @brief close Write what is left and close the file.
+         * @return False if any write failed.
+         */
+        bool close();
+
+        bool isOpen() const;
+
+        /**
+         * @brief append Queue data at the end of the file.
+         * @return False if it does not fit in the free batches, or a write failed. Nothing is queued then.
+         */
+        bool append(const void *data, size_t size);
+
+        /** @return Bytes that append() can take now. */
+        size_t available() const;
+
+    public:
+        /** @return Bytes appended since open. */
+        uint64_t size() const;
+
+        /** @return Bytes written to the file by the writer thread. */
+        uint64_t writtenSize() const;
+
+        /** @return Average bytes written per second, from open to now or to close. */
+        double writeRate() const;
+
+        /** @return errno of the first failed write, 0 if none. */
+        int error() const;
+
+        /** @return True if the file bypasses the page cache. */
+        bool isDirect() const;
+
+    protected:
+        std::unique_ptr<BatchWriterPrivate> d_ptr;
+};
+
+}
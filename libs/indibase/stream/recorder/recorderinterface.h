@@ -80,6 +80,18 @@ class RecorderInterface
         // This is to reduce process time and save memory for a dedicated subframe buffer
         virtual void setStreamEnabled(bool enable) = 0;
 
+        // Bytes written per second by the current or last recording, for the recorders that measure it
+        virtual double getWriteRate()
+        {
+            return 0;
+        }
+
+        // Frames dropped by the current or last recording, because the disk did not keep up
+        virtual uint64_t getDroppedFrames()
+        {
+            return 0;
+        }
+
     protected:
         const char *name;
         float m_FPS = 1;
@@ -28,6 +28,7 @@
 #include "serrecorder.h"
 #include "jpegutils.h"
 
+#include <algorithm>
 #include <ctime>
 #include <cerrno>
 #include <cstring>
@@ -36,6 +37,14 @@
 
 #define ERRMSGSIZ 1024
 
+// Frames are written by batches of a quarter second of frames, from 1 to 8 MB, and up to 2 seconds of
+// frames wait for the disk, from 4 batches to 512 MB
+static const size_t FRAME_BATCH_MIN      = 1024 * 1024;
+static const size_t FRAME_BATCH_MAX      = 8 * 1024 * 1024;
+static const size_t FRAME_BUFFER_MAX     = 512 * 1024 * 1024;
+static const double FRAME_BUFFER_SECONDS = 2;
+static const size_t STAMP_BATCH_SIZE     = 64 * 1024;
+
 namespace INDI
 {
 
@@ -70,49 +79,36 @@ bool SER_Recorder::is_little_endian()
     return black_magic == 0x01;
 }
 
-void SER_Recorder::write_int_le(uint32_t *i)
+void SER_Recorder::write_header(ser_header *s)
 {
-    if (is_little_endian())
-        fwrite((i), sizeof(uint32_t), 1, f);
-    else
-    {
-        unsigned char *c = (unsigned char *)i;
-        fwrite((c + 3), sizeof(char), 1, f);
-        fwrite((c + 2), sizeof(char), 1, f);
-        fwrite((c + 1), sizeof(char), 1, f);
-        fwrite((c), sizeof(char), 1, f);
-    }
+    uint8_t data[HEADER_SIZE];
+    serialize_header(s, data);
+    fwrite(data, sizeof(char), HEADER_SIZE, f);
 }
 
-void SER_Recorder::write_long_int_le(uint64_t *i)
+void SER_Recorder::serialize_header(const ser_header *s, uint8_t *data)
 {
-    if (is_little_endian())
+    auto put_int_le = [&data](uint64_t value, int bytes)
     {
-        fwrite(((uint32_t *)i), sizeof(int), 1, f);
-        fwrite(((uint32_t *)(i) + 1), sizeof(int), 1, f);
-    }
-    else
-    {
-        write_int_le((uint32_t *)(i) + 1);
-        write_int_le((uint32_t *)(i));
-    }
-}
-
-void SER_Recorder::write_header(ser_header *s)
-{
-    fwrite((s->FileID), sizeof(char), 14, f);
-    write_int_le(&(s->LuID));
-    write_int_le(&(s->ColorID));
-    write_int_le(&(s->LittleEndian));
-    write_int_le(&(s->ImageWidth));
-    write_int_le(&(s->ImageHeight));
-    write_int_le(&(s->PixelDepth));
-    write_int_le(&(s->FrameCount));
-    fwrite((s->Observer), sizeof(char), 40, f);
-    fwrite((s->Instrume), sizeof(char), 40, f);
-    fwrite((s->Telescope), sizeof(char), 40, f);
-    write_long_int_le(&(s->DateTime));
-    write_long_int_le(&(s->DateTime_UTC));
+        for (int i = 0; i < bytes; i++)
+            *data++ = static_cast<uint8_t>(value >> (8 * i));
+    };
+
+    memcpy(data, s->FileID, 14);
+    data += 14;
+    put_int_le(s->LuID, 4);
+    put_int_le(s->ColorID, 4);
+    put_int_le(s->LittleEndian, 4);
+    put_int_le(s->ImageWidth, 4);
+    put_int_le(s->ImageHeight, 4);
+    put_int_le(s->PixelDepth, 4);
+    put_int_le(s->FrameCount, 4);
+    memcpy(data, s->Observer, 40);
+    memcpy(data + 40, s->Instrume, 40);
+    memcpy(data + 80, s->Telescope, 40);
+    data += 120;
+    put_int_le(s->DateTime, 8);
+    put_int_le(s->DateTime_UTC, 8);
 }
 
 bool SER_Recorder::setPixelFormat(INDI_PIXEL_FORMAT pixelFormat, uint8_t pixelDepth)
@@ -175,41 +171,86 @@ bool SER_Recorder::open(const char *filename, char *errmsg)
     if (isRecordingActive)
         return false;
     serh.FrameCount = 0;
-    if ((f = fopen(filename, "w")) == nullptr)
+    droppedFrames   = 0;
+    frame_size      = serh.ImageWidth * serh.ImageHeight * (serh.PixelDepth <= 8 ? 1 : 2) * number_of_planes;
+
+    // Timestamps are streamed to a side file, then appended to the frames on close
+    fileName      = filename;
+    stampFileName = fileName + ".stamps";
+
+    // Sized from the stream rate, set by setFPS() before open
+    double bytesPerSecond = static_cast<double>(frame_size) * std::max(1.0f, m_FPS);
+    size_t batchSize  = std::max<size_t>(frame_size,
+                                         std::min<double>(FRAME_BATCH_MAX, std::max<double>(FRAME_BATCH_MIN, bytesPerSecond / 4)));
+    size_t bufferSize = std::min<double>(FRAME_BUFFER_MAX, bytesPerSecond * FRAME_BUFFER_SECONDS);
+    if (!frameWriter.open(filename, batchSize, std::max<size_t>(4, bufferSize / batchSize)) ||
+            !stampWriter.open(stampFileName.c_str(), STAMP_BATCH_SIZE, 4, false))
     {
         snprintf(errmsg, ERRMSGSIZ, "recorder open error %d, %s\n", errno, strerror(errno));
+        frameWriter.close();
+        remove(filename);
         return false;
     }
 
     serh.DateTime     = getLocalTimeStamp();
     serh.DateTime_UTC = getUTCTimeStamp();
-    write_header(&serh);
-    frame_size        = serh.ImageWidth * serh.ImageHeight * (serh.PixelDepth <= 8 ? 1 : 2) * number_of_planes;
-    isRecordingActive = true;
 
-    frameStamps.clear();
+    uint8_t header[HEADER_SIZE];
+    serialize_header(&serh, header);
+    frameWriter.append(header, HEADER_SIZE);
+    isRecordingActive = true;
 
     return true;
 }
 
 bool SER_Recorder::close()
 {
-    if (f)
+    bool result = true;
+
+    if (frameWriter.isOpen())
     {
-        // Write all timestamps
-        for (auto value : frameStamps)
-            write_long_int_le(&value);
+        result = frameWriter.close();
+        result = stampWriter.close() && result;
 
-        frameStamps.clear();
+        // Header with the frame count, and timestamps after the frames
+        if ((f = fopen(fileName.c_str(), "r+b")) != nullptr)
+        {
+            write_header(&serh);
+            fseek(f, 0L, SEEK_END);
+
+            FILE *stamps = fopen(stampFileName.c_str(), "rb");
+            if (stamps != nullptr)
+            {
+                char buffer[STAMP_BATCH_SIZE];
+                size_t n;
+                while ((n = fread(buffer, 1, sizeof(buffer), stamps)) > 0)
+                    result = fwrite(buffer, 1, n, f) == n && result;
+                fclose(stamps);
+            }
+            else
+                result = false;
+
+            result = fclose(f) == 0 && result;
+            f = nullptr;
+        }
+        else
+            result = false;
 
-        fseek(f, 0L, SEEK_SET);
-        write_header(&serh);
-        fclose(f);
-        f = nullptr;
+        remove(stampFileName.c_str());
     }
 
     isRecordingActive = false;
-    return true;
+    return result;
+}
+
+double SER_Recorder::getWriteRate()
+{
+    return frameWriter.writeRate();
+}
+
+uint64_t SER_Recorder::getDroppedFrames()
+{
+    return droppedFrames;
 }
 
 bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes, uint64_t timestamp)
@@ -253,10 +294,10 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes, uint64_t ti
     }
 #endif
 
-    if(timestamp)
-        frameStamps.push_back(timestamp * m_sepaseconds_per_microsecond);
-    else
-        frameStamps.push_back(getUTCTimeStamp());
+    uint64_t stamp = timestamp ? timestamp * m_sepaseconds_per_microsecond : getUTCTimeStamp();
+
+    const uint8_t *data = frame;
+    size_t size = nbytes;
 
     // Not technically pixel format, but let's use this for now.
     if (m_PixelFormat == INDI_JPG)
@@ -269,10 +310,27 @@ bool SER_Recorder::writeFrame(const uint8_t *frame, uint32_t nbytes, uint64_t ti
         serh.ImageWidth = w;
         serh.ImageHeight = h;
         serh.ColorID = (naxis == 3) ? SER_RGB : SER_MONO;
-        fwrite(jpegBuffer, 1, memsize, f);
+        data = jpegBuffer;
+        size = memsize;
     }
-    else
-        fwrite(frame, 1, nbytes, f);
+
+    // A write failed, the disk is likely full
+    if (frameWriter.error() != 0 || stampWriter.error() != 0)
+        return false;
+
+    // The disk does not keep up, drop the frame rather than stall the stream
+    uint8_t stampData[sizeof(stamp)];
+    if (frameWriter.available() < size || stampWriter.available() < sizeof(stampData))
+    {
+        ++droppedFrames;
+        return true;
+    }
+
+    for (size_t i = 0; i < sizeof(stampData); i++)
+        stampData[i] = static_cast<uint8_t>(stamp >> (8 * i));
+
+    frameWriter.append(data, size);
+    stampWriter.append(stampData, sizeof(stampData));
     serh.FrameCount += 1;
     return true;
 }
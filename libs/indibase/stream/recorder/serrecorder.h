@@ -22,9 +22,12 @@
 #pragma once
 
 #include "recorderinterface.h"
+#include "batchwriter.h"
 
+#include <atomic>
 #include <cstdint>
 #include <stdio.h>
+#include <string>
 
 typedef struct ser_header
 {
@@ -66,6 +69,11 @@ namespace INDI
 
 /**
  * @brief The SER_Recorder class implements recording of video streams in SER format.
+ *
+ * Frames are queued to a BatchWriter and written by its thread, the stream thread does not wait for the
+ * disk. The batches hold about two seconds of frames at the rate given to setFPS() before open(). When the
+ * disk falls behind and the batches are full, frames are dropped and counted. Timestamps
+ * are streamed to a side file, appended to the SER file as its trailer on close.
  */
 class SER_Recorder : public RecorderInterface
 {
@@ -87,6 +95,8 @@ class SER_Recorder : public RecorderInterface
         {
             isStreamingActive = enable;
         }
+        virtual double getWriteRate();
+        virtual uint64_t getDroppedFrames();
 
         // Public constants
         static const uint64_t C_SEPASECONDS_PER_SECOND = 10000000;
@@ -94,16 +104,22 @@ class SER_Recorder : public RecorderInterface
     protected:
         uint64_t utcTo64BitTS();
         bool is_little_endian();
-        void write_int_le(uint32_t *i);
-        void write_long_int_le(uint64_t *i);
         void write_header(ser_header *s);
+        static void serialize_header(const ser_header *s, uint8_t *data);
         ser_header serh;
         bool isRecordingActive = false, isStreamingActive = false;
         FILE *f;
         uint32_t frame_size;
         uint32_t number_of_planes;
         uint16_t rawWidth = 0, rawHeight = 0;
-        std::vector<uint64_t> frameStamps;
+
+        BatchWriter frameWriter;
+        BatchWriter stampWriter;
+        std::string fileName, stampFileName;
+        std::atomic<uint64_t> droppedFrames {0};
+
+        // Size of the SER header in the file
+        static const size_t HEADER_SIZE = 178;
 
     private:
         // From pipp_timestamp.h
@@ -0,0 +1,536 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * \class SPSCRing template
+ * \brief Bounded lock-free ring for one producer thread and one consumer thread.
+ *
+ * Each side caches the index of the other one and only reads it again when the ring looks full or empty.
+ */
+template <typename T>
+class SPSCRing
+{
+    public:
+        explicit SPSCRing(size_t capacity);
+
+        /**
+         * @brief Move data to the ring, from the producer thread only
+         * @return false if the ring is full, data is left untouched
+         */
+        bool tryPush(T &&data);
+
+        /**
+         * @brief Move the oldest data out of the ring, from the consumer thread only
+         * @return false if the ring is empty
+         */
+        bool tryPop(T &dest);
+
+        size_t size() const;
+        size_t capacity() const;
+
+        /** @brief Largest backlog found by the consumer when it caught up with the producer. */
+        size_t peakSize() const;
+
+    protected:
+        static constexpr size_t CacheLine = 64;
+
+        std::unique_ptr<T[]> buffer;
+        size_t mask;
+
+        alignas(CacheLine) std::atomic<size_t> head {0}; // next to pop
+        size_t tailCache {0};                            // consumer copy of tail
+        std::atomic<size_t> peak {0};                    // written by the consumer
+
+        alignas(CacheLine) std::atomic<size_t> tail {0}; // next to push
+        size_t headCache {0};                            // producer copy of head
+};
+
+/**
+ * \class MPMCRing template
+ * \brief Bounded lock-free ring for any number of producer and consumer threads.
+ *
+ * Each cell carries a sequence number telling whether it is free for the push of a given round or holds
+ * data for its pop. Threads claim a position with a compare-and-swap and never wait for each other.
+ */
+template <typename T>
+class MPMCRing
+{
+    public:
+        explicit MPMCRing(size_t capacity);
+
+        /**
+         * @brief Move data to the ring
+         * @return false if the ring is full, data is left untouched
+         */
+        bool tryPush(T &&data);
+
+        /**
+         * @brief Move the oldest data out of the ring
+         * @return false if the ring is empty
+         */
+        bool tryPop(T &dest);
+
+        size_t size() const;
+        size_t capacity() const;
+
+        /** @brief Largest occupancy seen by a push. */
+        size_t peakSize() const;
+
+    protected:
+        static constexpr size_t CacheLine = 64;
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<Cell[]> buffer;
+        size_t mask;
+
+        alignas(CacheLine) std::atomic<size_t> enqueuePos {0};
+        alignas(CacheLine) std::atomic<size_t> dequeuePos {0};
+        alignas(CacheLine) std::atomic<size_t> peak {0};
+};
+
+/**
+ * \class RingQueue template
+ * \brief The RingQueue class is a bounded FIFO with the interface of UniqueQueue, without a lock to push and pop.
+ *
+ * Threads only sleep when waiting: pop on an empty queue and waitForEmpty take a mutex, push and pop only
+ * wake them if some are sleeping. A consumer draining a busy queue is thus never woken, and never wakes
+ * anyone, the wakeups come in batches of at most one per empty period.
+ *
+ * Unlike UniqueQueue, push fails when the queue is full: the data is not moved and the drop is counted.
+ * The queue also counts its deepest occupancy, to size it.
+ *
+ * Use SPSCQueue between two threads, like a camera thread and a processing thread, and MPMCQueue otherwise.
+ */
+template <typename T, typename Ring>
+class RingQueue
+{
+    public:
+        /**
+         * @param capacity maximum count of elements, rounded up to a power of 2
+         */
+        explicit RingQueue(size_t capacity = 1024);
+
+        /**
+         * @brief Move data to queue
+         * @param data the data will be moved using std::move, only if it fits
+         * @return returns false if the queue is full
+         */
+        bool push(T &&data);
+
+        /**
+         * @brief Pop data from queue
+         * @param dest the data will be moved from the queue
+         * @return returns false if the abort function was called while waiting for data
+         */
+        bool pop(T &dest);
+
+        /**
+         * @brief Pop data from queue
+         * @param dest the data will be moved from the queue
+         * @param msecs timeout in milliseconds
+         * @return returns false if timeout or the abort function was called while waiting for data
+         */
+        bool pop(T &dest, uint32_t msecs);
+
+        /**
+         * @brief Wait for an empty queue
+         */
+        void waitForEmpty() const;
+
+        /**
+         * @brief Wait for an empty queue
+         * @param msecs timeout in milliseconds
+         * @return returns false if timeout
+         */
+        bool waitForEmpty(uint32_t msecs) const;
+
+        /**
+         * @brief Clear queue. It pops, so only a consumer thread may call it.
+         */
+        void clear();
+
+        /**
+         * @brief Exit pop and waitForEmpty methods with false return. The data is kept.
+         */
+        void abort();
+
+        /**
+         * @brief Return the number of items in the queue
+         * @return count of elements
+         */
+        size_t size() const;
+
+        /**
+         * @brief Return the maximum number of items in the queue
+         */
+        size_t capacity() const;
+
+        /**
+         * @brief Return the count of elements rejected by push because the queue was full
+         */
+        uint64_t dropped() const;
+
+        /**
+         * @brief Return the largest number of items seen in the queue, sampled without extra synchronization
+         */
+        size_t peakSize() const;
+
+    protected:
+        template <typename Predicate>
+        bool wait(Predicate predicate, const std::chrono::milliseconds *timeout) const;
+        void wakeSleepers() const;
+
+    protected:
+        Ring ring;
+
+        std::atomic<uint64_t> dropCount {0};
+
+        // Slow path, only for sleeping threads
+        mutable std::atomic<int>        sleepers {0};
+        mutable std::atomic<bool>       signalled {false}; // sleepers notified, not sleeping again yet
+        std::atomic<uint64_t>           aborts {0};
+        mutable std::mutex              mutex;
+        mutable std::condition_variable changed;
+};
+
+template <typename T>
+using SPSCQueue = RingQueue<T, SPSCRing<T>>;
+
+template <typename T>
+using MPMCQueue = RingQueue<T, MPMCRing<T>>;
+
+// implementation
+inline size_t ringQueueCapacity(size_t capacity)
+{
+    size_t rounded = 2;
+    while (rounded < capacity)
+        rounded <<= 1;
+    return rounded;
+}
+
+template <typename T>
+inline SPSCRing<T>::SPSCRing(size_t capacity)
+    : buffer(new T[ringQueueCapacity(capacity)])
+    , mask(ringQueueCapacity(capacity) - 1)
+{ }
+
+template <typename T>
+inline bool SPSCRing<T>::tryPush(T &&data)
+{
+    size_t position = tail.load(std::memory_order_relaxed);
+    if (position - headCache > mask)
+    {
+        headCache = head.load(std::memory_order_acquire);
+        if (position - headCache > mask)
+            return false;
+    }
+
+    buffer[position & mask] = std::move(data);
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline bool SPSCRing<T>::tryPop(T &dest)
+{
+    size_t position = head.load(std::memory_order_relaxed);
+    if (position == tailCache)
+    {
+        tailCache = tail.load(std::memory_order_acquire);
+        if (position == tailCache)
+            return false;
+
+        if (tailCache - position > peak.load(std::memory_order_relaxed))
+            peak.store(tailCache - position, std::memory_order_relaxed);
+    }
+
+    // Leave an empty element, so that nothing is held until the cell is reused
+    dest = std::move(buffer[position & mask]);
+    buffer[position & mask] = T();
+    head.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline size_t SPSCRing<T>::size() const
+{
+    size_t position = head.load(std::memory_order_acquire);
+    return tail.load(std::memory_order_acquire) - position;
+}
+
+template <typename T>
+inline size_t SPSCRing<T>::capacity() const
+{
+    return mask + 1;
+}
+
+template <typename T>
+inline size_t SPSCRing<T>::peakSize() const
+{
+    return peak.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+inline MPMCRing<T>::MPMCRing(size_t capacity)
+    : buffer(new Cell[ringQueueCapacity(capacity)])
+    , mask(ringQueueCapacity(capacity) - 1)
+{
+    for (size_t i = 0; i <= mask; ++i)
+        buffer[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+inline bool MPMCRing<T>::tryPush(T &&data)
+{
+    Cell *cell;
+    size_t position = enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        cell = &buffer[position & mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+            return false; // full
+        else
+            position = enqueuePos.load(std::memory_order_relaxed);
+    }
+
+    cell->data = std::move(data);
+    cell->sequence.store(position + 1, std::memory_order_release);
+
+    size_t depth = position + 1 - dequeuePos.load(std::memory_order_relaxed);
+    size_t deepest = peak.load(std::memory_order_relaxed);
+    while (depth > deepest && depth <= mask + 1 && !peak.compare_exchange_weak(deepest, depth, std::memory_order_relaxed))
+    { }
+    return true;
+}
+
+template <typename T>
+inline bool MPMCRing<T>::tryPop(T &dest)
+{
+    Cell *cell;
+    size_t position = dequeuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        cell = &buffer[position & mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+        if (difference == 0)
+        {
+            if (dequeuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+            return false; // empty
+        else
+            position = dequeuePos.load(std::memory_order_relaxed);
+    }
+
+    dest = std::move(cell->data);
+    cell->data = T();
+    cell->sequence.store(position + mask + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline size_t MPMCRing<T>::size() const
+{
+    size_t position = dequeuePos.load(std::memory_order_acquire);
+    size_t end = enqueuePos.load(std::memory_order_acquire);
+    // Claimed positions may be counted before their data is in
+    return end > position ? end - position : 0;
+}
+
+template <typename T>
+inline size_t MPMCRing<T>::capacity() const
+{
+    return mask + 1;
+}
+
+template <typename T>
+inline size_t MPMCRing<T>::peakSize() const
+{
+    return peak.load(std::memory_order_relaxed);
+}
+
+template <typename T, typename Ring>
+inline RingQueue<T, Ring>::RingQueue(size_t capacity)
+    : ring(capacity)
+{ }
+
+template <typename T, typename Ring>
+inline void RingQueue<T, Ring>::wakeSleepers() const
+{
+    // Pairs with the fence of wait(): either the sleeper sees the change, or this sees the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) == 0)
+        return;
+
+    // One wakeup until a thread goes back to sleep, however many changes
+    if (signalled.exchange(true))
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    changed.notify_all();
+}
+
+template <typename T, typename Ring>
+template <typename Predicate>
+inline bool RingQueue<T, Ring>::wait(Predicate predicate, const std::chrono::milliseconds *timeout) const
+{
+    if (predicate())
+        return true;
+
+    uint64_t abortsBefore = aborts.load(std::memory_order_acquire);
+    auto done = [&]()
+    {
+        // Checked before each sleep: ask for the next wakeup, then look at the queue
+        signalled.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return predicate() || aborts.load(std::memory_order_acquire) != abortsBefore;
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    sleepers.fetch_add(1, std::memory_order_relaxed);
+
+    bool result;
+    if (timeout)
+        result = changed.wait_for(lock, *timeout, done);
+    else
+    {
+        changed.wait(lock, done);
+        result = true;
+    }
+    sleepers.fetch_sub(1, std::memory_order_relaxed);
+
+    return result && predicate();
+}
+
+template <typename T, typename Ring>
+inline bool RingQueue<T, Ring>::push(T &&data)
+{
+    if (!ring.tryPush(std::move(data)))
+    {
+        dropCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    wakeSleepers();
+    return true;
+}
+
+template <typename T, typename Ring>
+inline bool RingQueue<T, Ring>::pop(T &dest)
+{
+    // Only sleep when empty
+    while (!ring.tryPop(dest))
+    {
+        if (!wait([this]() { return ring.size() != 0; }, nullptr))
+            return false; // abort
+    }
+
+    wakeSleepers();
+    return true;
+}
+
+template <typename T, typename Ring>
+inline bool RingQueue<T, Ring>::pop(T &dest, uint32_t msecs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(msecs);
+    while (!ring.tryPop(dest))
+    {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() < 0 || !wait([this]() { return ring.size() != 0; }, &left))
+            return false; // timeout or abort
+    }
+
+    wakeSleepers();
+    return true;
+}
+
+template <typename T, typename Ring>
+inline void RingQueue<T, Ring>::waitForEmpty() const
+{
+    wait([this]() { return ring.size() == 0; }, nullptr);
+}
+
+template <typename T, typename Ring>
+inline bool RingQueue<T, Ring>::waitForEmpty(uint32_t msecs) const
+{
+    std::chrono::milliseconds timeout(msecs);
+    return wait([this]() { return ring.size() == 0; }, &timeout);
+}
+
+template <typename T, typename Ring>
+inline void RingQueue<T, Ring>::clear()
+{
+    T dest;
+    while (ring.tryPop(dest))
+        dest = T();
+    wakeSleepers();
+}
+
+template <typename T, typename Ring>
+inline void RingQueue<T, Ring>::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborts.fetch_add(1, std::memory_order_release);
+    }
+    changed.notify_all();
+}
+
+template <typename T, typename Ring>
+inline size_t RingQueue<T, Ring>::size() const
+{
+    return ring.size();
+}
+
+template <typename T, typename Ring>
+inline size_t RingQueue<T, Ring>::capacity() const
+{
+    return ring.capacity();
+}
+
+template <typename T, typename Ring>
+inline uint64_t RingQueue<T, Ring>::dropped() const
+{
+    return dropCount.load(std::memory_order_relaxed);
+}
+
+template <typename T, typename Ring>
+inline size_t RingQueue<T, Ring>::peakSize() const
+{
+    return ring.peakSize();
+}
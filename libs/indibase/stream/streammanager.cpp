@@ -30,6 +30,7 @@
 #include "indiutility.h"
 #include "indisinglethreadpool.h"
 #include "indielapsedtimer.h"
+#include "encoder/mjpegencoder.h"
 
 #include <cerrno>
 #include <sys/stat.h>
@@ -130,6 +131,11 @@ bool StreamManagerPrivate::initProperties()
     RecordOptionsNP.fill(getDeviceName(), "RECORD_OPTIONS",
                          "Record Options", STREAM_TAB, IP_RW, 60, IPS_IDLE);
 
+    /* Record Statistics */
+    RecordStatsNP[RECORD_RATE   ].fill("RECORD_RATE",    "Write Rate (MB/s)", "%.1f", 0, 100000, 0, 0);
+    RecordStatsNP[RECORD_DROPPED].fill("RECORD_DROPPED", "Dropped Frames",    "%.f",  0, 1e12,   0, 0);
+    RecordStatsNP.fill(getDeviceName(), "RECORD_STATS", "Record Stats", STREAM_TAB, IP_RO, 0, IPS_IDLE);
+
     /* Record Switch */
     RecordStreamSP[RECORD_ON   ].fill("RECORD_ON",          "Record On",         ISS_OFF);
     RecordStreamSP[RECORD_TIME ].fill("RECORD_DURATION_ON", "Record (Duration)", ISS_OFF);
@@ -173,6 +179,18 @@ bool StreamManagerPrivate::initProperties()
     LimitsNP[LIMITS_BUFFER_MAX ].fill("LIMITS_BUFFER_MAX",  "Maximum Buffer Size (MB)", "%.0f", 1, 1024 * 64, 1, 512);
     LimitsNP[LIMITS_PREVIEW_FPS].fill("LIMITS_PREVIEW_FPS", "Maximum Preview FPS",      "%.0f", 1, 120,     1,  10);
     LimitsNP.fill(getDeviceName(), "LIMITS", "Limits", STREAM_TAB, IP_RW, 0, IPS_IDLE);
+    framesRing.setLimit(static_cast<size_t>(LimitsNP[LIMITS_BUFFER_MAX].getValue()) * 1024 * 1024);
+
+    // MJPEG Encoder
+    MJPEGOptionsNP[MJPEG_QUALITY    ].fill("MJPEG_QUALITY",     "Quality",                 "%.0f", 1, 100,         5,  85);
+    MJPEGOptionsNP[MJPEG_SCALE_WIDTH].fill("MJPEG_SCALE_WIDTH", "Scale Width (0 = full)",  "%.0f", 0, 65535,       64, 0);
+    MJPEGOptionsNP[MJPEG_BANDWIDTH  ].fill("MJPEG_BANDWIDTH",   "Bandwidth (KB/s, 0 = off)", "%.0f", 0, 1024 * 1024, 64, 0);
+    MJPEGOptionsNP.fill(getDeviceName(), "STREAM_MJPEG", "MJPEG", STREAM_TAB, IP_RW, 0, IPS_IDLE);
+    setMJPEGOptions();
+
+    EncoderStatsNP[ENCODER_TIME ].fill("ENCODER_TIME",  "Encode Time (ms)", "%.2f", 0, 60000,      0, 0);
+    EncoderStatsNP[ENCODER_BYTES].fill("ENCODER_BYTES", "Frame Size (bytes)", "%.0f", 0, 4294967295., 0, 0);
+    EncoderStatsNP.fill(getDeviceName(), "STREAM_ENCODER_STATS", "Encoder", STREAM_TAB, IP_RO, 0, IPS_IDLE);
     return true;
 }
 
@@ -196,10 +214,13 @@ void StreamManagerPrivate::ISGetProperties(const char *dev)
         currentDevice->defineProperty(RecordStreamSP);
         currentDevice->defineProperty(RecordFileTP);
         currentDevice->defineProperty(RecordOptionsNP);
+        currentDevice->defineProperty(RecordStatsNP);
         currentDevice->defineProperty(StreamFrameNP);
         currentDevice->defineProperty(EncoderSP);
         currentDevice->defineProperty(RecorderSP);
         currentDevice->defineProperty(LimitsNP);
+        currentDevice->defineProperty(MJPEGOptionsNP);
+        currentDevice->defineProperty(EncoderStatsNP);
     }
 }
 
@@ -230,10 +251,13 @@ bool StreamManagerPrivate::updateProperties()
         currentDevice->defineProperty(RecordStreamSP);
         currentDevice->defineProperty(RecordFileTP);
         currentDevice->defineProperty(RecordOptionsNP);
+        currentDevice->defineProperty(RecordStatsNP);
         currentDevice->defineProperty(StreamFrameNP);
         currentDevice->defineProperty(EncoderSP);
         currentDevice->defineProperty(RecorderSP);
         currentDevice->defineProperty(LimitsNP);
+        currentDevice->defineProperty(MJPEGOptionsNP);
+        currentDevice->defineProperty(EncoderStatsNP);
     }
     else
     {
@@ -245,10 +269,13 @@ bool StreamManagerPrivate::updateProperties()
         currentDevice->deleteProperty(RecordFileTP.getName());
         currentDevice->deleteProperty(RecordStreamSP.getName());
         currentDevice->deleteProperty(RecordOptionsNP.getName());
+        currentDevice->deleteProperty(RecordStatsNP.getName());
         currentDevice->deleteProperty(StreamFrameNP.getName());
         currentDevice->deleteProperty(EncoderSP.getName());
         currentDevice->deleteProperty(RecorderSP.getName());
         currentDevice->deleteProperty(LimitsNP.getName());
+        currentDevice->deleteProperty(MJPEGOptionsNP.getName());
+        currentDevice->deleteProperty(EncoderStatsNP.getName());
     }
 
     return true;
@@ -266,13 +293,49 @@ bool StreamManager::updateProperties()
  * Therefore nbytes is expected to be SubW/BinX * SubH/BinY * Bytes_Per_Pixels * Number_Color_Components
  * Binned frame must be sent from the camera driver for this to work consistentaly for all drivers.*/
 void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes, uint64_t timestamp)
+{
+    if (!acceptFrame())
+        return;
+
+    FrameRing::Frame frame = acquireFrame(nbytes);
+    if (frame)
+        memcpy(frame->data(), buffer, nbytes); // copy the frame
+
+    queueFrame(std::move(frame), timestamp);
+}
+
+FrameRing::Frame StreamManagerPrivate::acquireFrame(uint32_t nbytes)
+{
+    if (!isStreaming && !(isRecording && !isRecordingAboutToClose))
+        return nullptr;
+
+    FrameRing::Frame frame = framesRing.acquire(nbytes);
+    if (frame == nullptr)
+    {
+        ++framesRingFull;
+        LOGF_WARN("Frame buffer is full, skipping frame (%llu skipped)...",
+                  static_cast<unsigned long long>(framesRingFull + framesIncoming.dropped()));
+    }
+
+    return frame;
+}
+
+void StreamManagerPrivate::commitFrame(FrameRing::Frame frame, uint64_t timestamp)
+{
+    if (!acceptFrame())
+        return;
+
+    queueFrame(std::move(frame), timestamp);
+}
+
+bool StreamManagerPrivate::acceptFrame()
 {
     // close the data stream on the same thread as the data stream
     // manually triggered to stop recording.
     if (isRecordingAboutToClose)
     {
         stopRecording();
-        return;
+        return false;
     }
 
     // Discard every N frame.
@@ -284,7 +347,7 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes, uin
         (frameCountDivider % static_cast<int>(StreamExposureNP[STREAM_DIVISOR].getValue())) == 0
     )
     {
-        return;
+        return false;
     }
 
     if (FPSAverage.newFrame())
@@ -303,18 +366,24 @@ void StreamManagerPrivate::newFrame(const uint8_t * buffer, uint32_t nbytes, uin
         }).detach();
     }
 
+    return true;
+}
+
+void StreamManagerPrivate::queueFrame(FrameRing::Frame frame, uint64_t timestamp)
+{
+    // no slot for it, acquireFrame() counted it
+    if (frame == nullptr)
+        return;
+
     if (isStreaming || (isRecording && !isRecordingAboutToClose))
     {
-        size_t allocatedSize = nbytes * framesIncoming.size() / 1024 / 1024; // allocated size in MB
-        if (allocatedSize > LimitsNP[LIMITS_BUFFER_MAX].getValue())
+        // push it into the queue
+        if (!framesIncoming.push(TimeFrame{FPSFast.deltaTime(), timestamp, std::move(frame)}))
         {
-            LOG_WARN("Frame buffer is full, skipping frame...");
+            LOGF_WARN("Frame queue is full, skipping frame (%llu skipped)...",
+                      static_cast<unsigned long long>(framesRingFull + framesIncoming.dropped()));
             return;
         }
-
-        std::vector<uint8_t> copyBuffer(buffer, buffer + nbytes); // copy the frame
-
-        framesIncoming.push(TimeFrame{FPSFast.deltaTime(), timestamp, std::move(copyBuffer)}); // push it into the queue
     }
 
     if (isRecording && !isRecordingAboutToClose)
@@ -353,6 +422,18 @@ void StreamManager::newFrame(const uint8_t * buffer, uint32_t nbytes, uint64_t t
     d->newFrame(buffer, nbytes, timestamp);
 }
 
+FrameRing::Frame StreamManager::acquireFrame(uint32_t nbytes)
+{
+    D_PTR(StreamManager);
+    return d->acquireFrame(nbytes);
+}
+
+void StreamManager::commitFrame(FrameRing::Frame frame, uint64_t timestamp)
+{
+    D_PTR(StreamManager);
+    d->commitFrame(std::move(frame), timestamp);
+}
+
 
 StreamManagerPrivate::FrameInfo StreamManagerPrivate::updateSourceFrameInfo()
 {
@@ -419,9 +500,6 @@ void StreamManagerPrivate::asyncStreamThread()
     TimeFrame sourceTimeFrame;
     sourceTimeFrame.time = 0;
 
-    std::vector<uint8_t> subframeBuffer;  // Subframe buffer for recording/streaming
-    std::vector<uint8_t> downscaleBuffer; // Downscale buffer for streaming
-
     INDI::SingleThreadPool previewThreadPool;
     INDI::ElapsedTimer previewElapsed;
 
@@ -432,33 +510,49 @@ void StreamManagerPrivate::asyncStreamThread()
 
         FrameInfo srcFrameInfo = updateSourceFrameInfo();
 
-        std::vector<uint8_t> *sourceBuffer = &sourceTimeFrame.frame;
+        // Stages share the slot, it returns to its ring with the last reference
+        FrameRing::Frame frame = std::move(sourceTimeFrame.frame);
 
-        if (PixelFormat != INDI_JPG && sourceBuffer->size() != srcFrameInfo.totalSize())
+        if (PixelFormat != INDI_JPG && frame->size() != srcFrameInfo.totalSize())
         {
             LOG_ERROR("Invalid source buffer size, skipping frame...");
             continue;
         }
 
         // Check if we need to subframe
-        if (
-            PixelFormat != INDI_JPG &&
-            dstFrameInfo.pixels() != 0 &&
-            dstFrameInfo != srcFrameInfo
-        )
+        bool isSubframe = (
+                              PixelFormat != INDI_JPG &&
+                              dstFrameInfo.pixels() != 0 &&
+                              dstFrameInfo != srcFrameInfo
+                          );
+
+        // For streaming, downscale to 8bit if higher than 8bit to reduce bandwidth
+        // You can reduce the number of frames by setting a frame limit.
+        bool isPreview   = isStreaming && FPSPreview.newFrame();
+        bool isDownscale = isPreview && PixelFormat != INDI_JPG && PixelDepth > 8;
+
+        // Copy the subframe, unless only the downscale needs it: it reads the subframe in place
+        if (isSubframe && (isRecording || !isDownscale))
         {
-            subframeBuffer.resize(dstFrameInfo.totalSize());
-            subframe(sourceBuffer->data(), srcFrameInfo, subframeBuffer.data(), dstFrameInfo);
+            FrameRing::Frame subframeBuffer = processedRing.acquire(dstFrameInfo.totalSize());
+            if (subframeBuffer == nullptr)
+            {
+                LOG_ERROR("Failed to allocate subframe buffer, skipping frame...");
+                continue;
+            }
+
+            subframe(frame->data(), srcFrameInfo, subframeBuffer->data(), dstFrameInfo);
 
-            sourceBuffer = &subframeBuffer;
+            frame = std::move(subframeBuffer);
+            isSubframe = false;
         }
 
         // For recording, save immediately.
         {
             std::lock_guard<std::mutex> lock(recordMutex);
             if (
-                isRecording && !isRecordingAboutToClose &&
-                recordStream(sourceBuffer->data(), sourceBuffer->size(), sourceTimeFrame.time, sourceTimeFrame.timestamp) == false
+                isRecording && !isRecordingAboutToClose && !isSubframe &&
+                recordStream(frame->data(), frame->size(), sourceTimeFrame.time, sourceTimeFrame.timestamp) == false
             )
             {
                 LOG_ERROR("Recording failed.");
@@ -466,37 +560,46 @@ void StreamManagerPrivate::asyncStreamThread()
             }
         }
 
-        // For streaming, downscale to 8bit if higher than 8bit to reduce bandwidth
-        // You can reduce the number of frames by setting a frame limit.
-        if (isStreaming && FPSPreview.newFrame())
+        if (isPreview)
         {
             // Downscale to 8bit always for streaming to reduce bandwidth
-            if (PixelFormat != INDI_JPG && PixelDepth > 8)
+            if (isDownscale)
             {
-                // Allocale new buffer if size changes
-                downscaleBuffer.resize(dstFrameInfo.pixels());
-
-                // Apply gamma
-                gammaLut16.apply(
-                    reinterpret_cast<const uint16_t*>(sourceBuffer->data()),
-                    downscaleBuffer.size(),
-                    downscaleBuffer.data()
+                size_t components = dstFrameInfo.bytesPerColor / 2;
+                FrameRing::Frame downscaleBuffer = processedRing.acquire(dstFrameInfo.pixels() * components);
+                if (downscaleBuffer == nullptr)
+                {
+                    LOG_ERROR("Failed to allocate downscale buffer, skipping preview...");
+                    continue;
+                }
+
+                // Apply gamma, reading the subframe from the full frame if not copied
+                const uint16_t *source = reinterpret_cast<const uint16_t*>(frame->data());
+                size_t stride = dstFrameInfo.w * components;
+                if (isSubframe)
+                {
+                    source += (dstFrameInfo.y * srcFrameInfo.w + dstFrameInfo.x) * components;
+                    stride  = srcFrameInfo.w * components;
+                }
+
+                gammaLut16.applyRegion(
+                    source, stride,
+                    dstFrameInfo.w * components, dstFrameInfo.h,
+                    downscaleBuffer->data()
                 );
 
-                sourceBuffer = &downscaleBuffer;
+                frame = std::move(downscaleBuffer);
             }
 
-            //uploadStream(sourceBuffer->data(), sourceBuffer->size());
-            previewThreadPool.start(std::bind([this, &previewElapsed](const std::atomic_bool & isAboutToQuit,
-                                              std::vector<uint8_t> frame)
+            // The preview holds the frame until uploaded, sent attached it is not copied at all
+            previewThreadPool.start([this, &previewElapsed, frame](const std::atomic_bool & isAboutToQuit)
             {
                 INDI_UNUSED(isAboutToQuit);
                 previewElapsed.start();
-                uploadStream(frame.data(), frame.size());
+                uploadStream(frame->data(), frame->size());
                 StreamTimeNP[0].setValue(previewElapsed.nsecsElapsed() / 1000000000.0);
                 StreamTimeNP.apply();
-
-            }, std::placeholders::_1, std::move(*sourceBuffer)));
+            });
         }
     }
 }
@@ -594,7 +697,21 @@ bool StreamManagerPrivate::recordStream(const uint8_t * buffer, uint32_t nbytes,
     if (!isRecording)
         return false;
 
-    return recorder->writeFrame(buffer, nbytes, timestamp);
+    if (!recorder->writeFrame(buffer, nbytes, timestamp))
+        return false;
+
+    if (recordStatsElapsed.hasExpired(1000))
+        updateRecordStats();
+    return true;
+}
+
+void StreamManagerPrivate::updateRecordStats()
+{
+    recordStatsElapsed.start();
+    RecordStatsNP[RECORD_RATE   ].setValue(recorder->getWriteRate() / (1024 * 1024));
+    RecordStatsNP[RECORD_DROPPED].setValue(recorder->getDroppedFrames());
+    RecordStatsNP.setState(recorder->getDroppedFrames() > 0 ? IPS_BUSY : IPS_OK);
+    RecordStatsNP.apply();
 }
 
 std::string StreamManagerPrivate::expand(const std::string &fname, const std::map<std::string, std::string> &patterns)
@@ -747,9 +864,20 @@ bool StreamManagerPrivate::stopRecording(bool force)
     isRecording = false;
     isRecordingAboutToClose = false;
 
+    bool closed;
     {
         std::lock_guard<std::mutex> lock(recordMutex);
-        recorder->close();
+        closed = recorder->close();
+        updateRecordStats();
+    }
+
+    if (!closed)
+        LOG_ERROR("Failed to write the end of the record file.");
+
+    if (!isStreaming)
+    {
+        framesRing.clear();
+        processedRing.clear();
     }
 
     if (force)
@@ -761,6 +889,10 @@ bool StreamManagerPrivate::stopRecording(bool force)
         FPSRecorder.totalFrames()
     );
 
+    if (recorder->getDroppedFrames() > 0)
+        LOGF_WARN("%llu frames were dropped, the disk did not keep up.",
+                  static_cast<unsigned long long>(recorder->getDroppedFrames()));
+
     return true;
 }
 
@@ -954,6 +1086,7 @@ bool StreamManagerPrivate::ISNewNumber(const char * dev, const char * name, doub
     {
         LimitsNP.update(values, names, n);
 
+        framesRing.setLimit(static_cast<size_t>(LimitsNP[LIMITS_BUFFER_MAX].getValue()) * 1024 * 1024);
         FPSPreview.setTimeWindow(1000.0 / LimitsNP[LIMITS_PREVIEW_FPS].getValue());
         FPSPreview.reset();
 
@@ -962,6 +1095,16 @@ bool StreamManagerPrivate::ISNewNumber(const char * dev, const char * name, doub
         return true;
     }
 
+    /* MJPEG Encoder */
+    if (MJPEGOptionsNP.isNameMatch(name))
+    {
+        MJPEGOptionsNP.update(values, names, n);
+        setMJPEGOptions();
+        MJPEGOptionsNP.setState(IPS_OK);
+        MJPEGOptionsNP.apply();
+        return true;
+    }
+
     /* Record Options */
     if (RecordOptionsNP.isNameMatch(name))
     {
@@ -1119,6 +1262,12 @@ bool StreamManagerPrivate::setStream(bool enable)
             FpsNP[FPS_AVERAGE].setValue(0);
 
             recorder->setStreamEnabled(false);
+
+            if (!isRecording)
+            {
+                framesRing.clear();
+                processedRing.clear();
+            }
         }
     }
 
@@ -1140,6 +1289,7 @@ bool StreamManager::saveConfigItems(FILE * fp)
     d->RecordOptionsNP.save(fp);
     d->RecorderSP.save(fp);
     d->LimitsNP.save(fp);
+    d->MJPEGOptionsNP.save(fp);
     return true;
 }
 
@@ -1209,10 +1359,14 @@ bool StreamManagerPrivate::uploadStream(const uint8_t * buffer, uint32_t nbytes)
     }
 #endif
 
+    INDI::ElapsedTimer elapsed;
+
     if(currentDevice->getDriverInterface() & INDI::DefaultDevice::CCD_INTERFACE)
     {
         if (encoder->upload(&imageBP[0], buffer, nbytes, dynamic_cast<INDI::CCD*>(currentDevice)->PrimaryCCD.isCompressed()))
         {
+            double encodeSeconds = elapsed.nsecsElapsed() / 1000000000.0;
+            elapsed.start();
 #ifdef HAVE_WEBSOCKET
             if (dynamic_cast<INDI::CCD*>(currentDevice)->HasWebSocket()
                     && dynamic_cast<INDI::CCD*>(currentDevice)->WebSocketS[CCD::WEBSOCKET_ENABLED].s == ISS_ON)
@@ -1224,12 +1378,14 @@ bool StreamManagerPrivate::uploadStream(const uint8_t * buffer, uint32_t nbytes)
                 }
 
                 dynamic_cast<INDI::CCD*>(currentDevice)->wsServer.send_binary(buffer, nbytes);
+                frameSent(encodeSeconds, elapsed.nsecsElapsed() / 1000000000.0);
                 return true;
             }
 #endif
             // Upload to client now
             imageBP.setState(IPS_OK);
             imageBP.apply();
+            frameSent(encodeSeconds, elapsed.nsecsElapsed() / 1000000000.0);
             return true;
         }
     }
@@ -1238,9 +1394,12 @@ bool StreamManagerPrivate::uploadStream(const uint8_t * buffer, uint32_t nbytes)
         if (encoder->upload(&imageBP[0], buffer, nbytes,
                             false))//dynamic_cast<INDI::SensorInterface*>(currentDevice)->isCompressed()))
         {
+            double encodeSeconds = elapsed.nsecsElapsed() / 1000000000.0;
+            elapsed.start();
             // Upload to client now
             imageBP.setState(IPS_OK);
             imageBP.apply();
+            frameSent(encodeSeconds, elapsed.nsecsElapsed() / 1000000000.0);
             return true;
         }
     }
@@ -1248,6 +1407,36 @@ bool StreamManagerPrivate::uploadStream(const uint8_t * buffer, uint32_t nbytes)
     return false;
 }
 
+void StreamManagerPrivate::frameSent(double encodeSeconds, double sendSeconds)
+{
+    uint32_t nbytes = imageBP[0].getBlobLen();
+    encoder->frameSent(nbytes, sendSeconds);
+
+    // Once per second, not to double the messages of the stream
+    if (encoderStatsElapsed.hasExpired(1000))
+    {
+        encoderStatsElapsed.start();
+        EncoderStatsNP[ENCODER_TIME ].setValue(encodeSeconds * 1000);
+        EncoderStatsNP[ENCODER_BYTES].setValue(nbytes);
+        EncoderStatsNP.setState(IPS_OK);
+        EncoderStatsNP.apply();
+    }
+}
+
+void StreamManagerPrivate::setMJPEGOptions()
+{
+    for (EncoderInterface * oneEncoder : encoderManager.getEncoderList())
+    {
+        MJPEGEncoder *mjpeg = dynamic_cast<MJPEGEncoder *>(oneEncoder);
+        if (mjpeg == nullptr)
+            continue;
+
+        mjpeg->setQuality(MJPEGOptionsNP[MJPEG_QUALITY].getValue());
+        mjpeg->setScaleWidth(MJPEGOptionsNP[MJPEG_SCALE_WIDTH].getValue());
+        mjpeg->setTargetBandwidth(MJPEGOptionsNP[MJPEG_BANDWIDTH].getValue() * 1024);
+    }
+}
+
 RecorderInterface *StreamManager::getRecorder() const
 {
     D_PTR(const StreamManager);
@@ -26,6 +26,7 @@
 #include "indidevapi.h"
 #include "indibasetypes.h"
 #include "indimacros.h"
+#include "framering.h"
 #include <memory>
 
 /**
@@ -44,7 +45,8 @@
    16bit frames, but they will be downscaled to 8bit when necessary for streaming and recording purposes. Base classes must implement
    startStreaming() and stopStreaming() functions. When a frame is ready, use uploadStream() to send the data to active encoders and recorders.
 
-   It is highly recommended to implement the streaming functionality in a dedicated thread.
+   It is highly recommended to implement the streaming functionality in a dedicated thread. Drivers that can make the camera SDK write
+   to a given buffer should use acquireFrame() and commitFrame() instead of newFrame(), to save a copy of every frame.
 
    \section Encoders
 
@@ -117,6 +119,21 @@ class StreamManager
          */
         void newFrame(const uint8_t *buffer, uint32_t nbytes, uint64_t timestamp = 0);
 
+        /**
+         * @brief acquireFrame Get a buffer for the next frame, to be filled by the camera SDK and passed to commitFrame().
+         * Unlike newFrame(), the frame is not copied: the recorder and the preview use this buffer, which is reused once done.
+         * @param nbytes size of the frame, as given to newFrame().
+         * @return The frame to fill, nullptr if neither streaming nor recording, or if the frame buffer is full.
+         */
+        FrameRing::Frame acquireFrame(uint32_t nbytes);
+
+        /**
+         * @brief commitFrame Stream and record a frame filled after acquireFrame(). The driver must not modify it anymore.
+         * A nullptr frame is ignored. When acquireFrame() returned it because the frame buffer was full, the frame was
+         * already counted there as skipped.
+         */
+        void commitFrame(FrameRing::Frame frame, uint64_t timestamp = 0);
+
         bool close();
 
     public:
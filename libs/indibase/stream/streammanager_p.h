@@ -27,8 +27,10 @@
 #include "recorder/recordermanager.h"
 #include "encoder/encodermanager.h"
 #include "fpsmeter.h"
-#include "uniquequeue.h"
+#include "ringqueue.h"
 #include "gammalut16.h"
+#include "framering.h"
+#include "indielapsedtimer.h"
 
 #include <atomic>
 #include <string>
@@ -111,6 +113,19 @@ class StreamManagerPrivate
         bool ISNewNumber(const char * dev, const char * name, double values[], char * names[], int n);
 
         void newFrame(const uint8_t * buffer, uint32_t nbytes, uint64_t timestamp);
+        FrameRing::Frame acquireFrame(uint32_t nbytes);
+        void commitFrame(FrameRing::Frame frame, uint64_t timestamp);
+
+        /**
+         * @brief acceptFrame Count the frame in the FPS meters and apply the rate divisor.
+         * @return False if the frame is discarded.
+         */
+        bool acceptFrame();
+
+        /**
+         * @brief queueFrame Queue the frame for recording and preview, and stop recording when complete.
+         */
+        void queueFrame(FrameRing::Frame frame, uint64_t timestamp);
 
         bool updateProperties();
         bool setStream(bool enable);
@@ -142,12 +157,25 @@ class StreamManagerPrivate
          */
         bool uploadStream(const uint8_t *buffer, uint32_t nbytes);
 
+        /**
+         * @brief frameSent Tell the encoder how long the frame took to send, and update the encoder statistics.
+         * @param encodeSeconds time spent encoding the frame.
+         * @param sendSeconds time spent sending it to the clients.
+         */
+        void frameSent(double encodeSeconds, double sendSeconds);
+
+        /** @brief setMJPEGOptions Pass MJPEGOptionsNP to the MJPEG encoder. */
+        void setMJPEGOptions();
+
         /**
          * @brief recordStream Calls the backend recorder to record a single frame.
          * @param deltams time in milliseconds since last frame
          */
         bool recordStream(const uint8_t *buffer, uint32_t nbytes, double deltams, uint64_t timestamp);
 
+        /** @brief updateRecordStats Show the write rate and dropped frames of the recorder. */
+        void updateRecordStats();
+
         void getStreamFrame(uint16_t * x, uint16_t * y, uint16_t * w, uint16_t * h) const;
         void setStreamFrame(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
         void setStreamFrame(const FrameInfo &frameInfo);
@@ -198,6 +226,11 @@ class StreamManagerPrivate
         /* Record Options */
         INDI::PropertyNumber RecordOptionsNP {2};
 
+        /* Record Statistics, updated once per second */
+        INDI::PropertyNumber RecordStatsNP {2};
+        enum { RECORD_RATE, RECORD_DROPPED };
+        INDI::ElapsedTimer recordStatsElapsed;
+
         // Stream Frame
         INDI::PropertyNumber StreamFrameNP {4};
 
@@ -216,6 +249,15 @@ class StreamManagerPrivate
         INDI::PropertyNumber LimitsNP {2};
         enum { LIMITS_BUFFER_MAX, LIMITS_PREVIEW_FPS };
 
+        // MJPEG encoder. Quality, scale width, and target bandwidth that adapts both to it
+        INDI::PropertyNumber MJPEGOptionsNP {3};
+        enum { MJPEG_QUALITY, MJPEG_SCALE_WIDTH, MJPEG_BANDWIDTH };
+
+        // Time to encode preview frames, and their size. Updated once per second.
+        INDI::PropertyNumber EncoderStatsNP {2};
+        enum { ENCODER_TIME, ENCODER_BYTES };
+        INDI::ElapsedTimer encoderStatsElapsed;
+
         std::atomic<bool> isStreaming { false };
         std::atomic<bool> isRecording { false };
         std::atomic<bool> isRecordingAboutToClose { false };
@@ -249,12 +291,16 @@ class StreamManagerPrivate
         {
             double time;
             uint64_t timestamp;
-            std::vector<uint8_t> frame;
+            FrameRing::Frame frame;
         } TimeFrame;
 
+        FrameRing                framesRing;     // incoming frames, limited by LIMITS_BUFFER_MAX
+        uint64_t                 framesRingFull = 0; // frames skipped without a slot in framesRing
+        FrameRing                processedRing;  // subframed and downscaled frames
+
         std::thread              framesThread;   // async incoming frames processing
         std::atomic<bool>        framesThreadTerminate {false};
-        UniqueQueue<TimeFrame>   framesIncoming;
+        SPSCQueue<TimeFrame>     framesIncoming; // pushed by the driver thread only
 
         std::mutex               fastFPSUpdate;
         std::mutex               recordMutex;
@@ -0,0 +1,247 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace INDI
+{
+
+/**
+ * @brief The StagedPipeline class runs items through a fixed sequence of stages, one thread per stage.
+ *
+ * While a stage works on an item, the previous stages already work on the next ones. The number of
+ * items in flight is bounded: push() blocks until the oldest item left the last stage, so a slow
+ * stage holds back the producer instead of piling up buffers.
+ *
+ * A stage returns false to skip the remaining stages of an item. Every item, whether it went through
+ * all stages or not, is then handed to the done callback on the thread of the last stage, in the
+ * order the items were pushed.
+ */
+template <typename T>
+class StagedPipeline
+{
+    public:
+        /** Process an item, return false to skip the remaining stages. */
+        using Stage = std::function<bool(T &item)>;
+        /** Called once the item left the pipeline, with the time it spent in each stage in milliseconds. */
+        using Done = std::function<void(T &item, bool ok, const std::vector<double> &stageMs)>;
+
+    public:
+        StagedPipeline() = default;
+        StagedPipeline(const StagedPipeline &) = delete;
+        StagedPipeline &operator=(const StagedPipeline &) = delete;
+
+        ~StagedPipeline()
+        {
+            stop();
+        }
+
+    public:
+        /** @brief Append a stage. Stages can only be added before the first push. */
+        void addStage(const std::string &name, const Stage &stage)
+        {
+            auto worker  = std::unique_ptr<Worker>(new Worker);
+            worker->name = name;
+            worker->run  = stage;
+            m_Workers.push_back(std::move(worker));
+        }
+
+        void setDone(const Done &done)
+        {
+            m_Done = done;
+        }
+
+        /** @brief Limit the number of items in flight. The default is 2. */
+        void setDepth(size_t depth)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Depth = std::max<size_t>(1, depth);
+            m_Space.notify_all();
+        }
+
+        size_t depth() const
+        {
+            return m_Depth;
+        }
+
+        size_t inFlight() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_InFlight;
+        }
+
+        const std::string &stageName(size_t index) const
+        {
+            return m_Workers.at(index)->name;
+        }
+
+        size_t stageCount() const
+        {
+            return m_Workers.size();
+        }
+
+        /**
+         * @brief push Queue an item for the first stage, waiting while the pipeline is full.
+         * @return The time spent waiting for room, in milliseconds.
+         */
+        double push(T item)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            startLocked();
+            m_Space.wait(lock, [this]()
+            {
+                return m_InFlight < m_Depth;
+            });
+            m_InFlight++;
+
+            Slot slot;
+            slot.item = std::move(item);
+            slot.stageMs.assign(m_Workers.size(), 0);
+            m_Workers.front()->queue.push_back(std::move(slot));
+            m_Workers.front()->ready.notify_one();
+            lock.unlock();
+
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        /** @brief Wait until every item pushed so far left the pipeline. */
+        void waitForIdle()
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Space.wait(lock, [this]()
+            {
+                return m_InFlight == 0;
+            });
+        }
+
+        /** @brief Finish the items in flight and stop the threads. The next push starts them again. */
+        void stop()
+        {
+            waitForIdle();
+
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if (!m_Started)
+                return;
+            m_Stopping = true;
+            for (auto &worker : m_Workers)
+                worker->ready.notify_all();
+            lock.unlock();
+
+            for (auto &worker : m_Workers)
+                worker->thread.join();
+
+            lock.lock();
+            m_Stopping = false;
+            m_Started  = false;
+        }
+
+    private:
+        struct Slot
+        {
+            T item;
+            bool ok { true };
+            std::vector<double> stageMs;
+        };
+
+        struct Worker
+        {
+            std::string name;
+            Stage run;
+            std::deque<Slot> queue;
+            std::condition_variable ready;
+            std::thread thread;
+        };
+
+        void startLocked()
+        {
+            if (m_Started)
+                return;
+            m_Started = true;
+            for (size_t i = 0; i < m_Workers.size(); i++)
+                m_Workers[i]->thread = std::thread(&StagedPipeline::work, this, i);
+        }
+
+        void work(size_t index)
+        {
+            Worker &worker = *m_Workers[index];
+
+            for (;;)
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                worker.ready.wait(lock, [&]()
+                {
+                    return !worker.queue.empty() || m_Stopping;
+                });
+                // Only stopped once idle, nothing can be left behind
+                if (worker.queue.empty())
+                    return;
+
+                Slot slot = std::move(worker.queue.front());
+                worker.queue.pop_front();
+                lock.unlock();
+
+                if (slot.ok)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    slot.ok = worker.run(slot.item);
+                    slot.stageMs[index] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                }
+
+                if (index + 1 < m_Workers.size())
+                {
+                    lock.lock();
+                    m_Workers[index + 1]->queue.push_back(std::move(slot));
+                    m_Workers[index + 1]->ready.notify_one();
+                    continue;
+                }
+
+                if (m_Done)
+                    m_Done(slot.item, slot.ok, slot.stageMs);
+
+                // Release the item before making room for the next one
+                slot = Slot();
+
+                lock.lock();
+                m_InFlight--;
+                m_Space.notify_all();
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<Worker>> m_Workers;
+        Done m_Done;
+
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_Space;
+        size_t m_Depth { 2 };
+        size_t m_InFlight { 0 };
+        bool m_Started { false };
+        bool m_Stopping { false };
+};
+
+}
@@ -219,6 +219,9 @@ void TcpSocketSharedBlobs::readyRead()
 BaseClientPrivate::BaseClientPrivate(BaseClient *parent)
     : AbstractBaseClientPrivate(parent)
 {
+    // Messages are dispatched then dropped right away
+    xmlParser.setArena(true);
+
     clientSocket.onData([this](const char *data, size_t size)
     {
         char msg[MAXRBUF];
@@ -30,7 +30,10 @@ namespace INDI
 
 BaseClientQtPrivate::BaseClientQtPrivate(BaseClientQt *parent)
     : AbstractBaseClientPrivate(parent)
-{ }
+{
+    // Messages are dispatched then dropped right away
+    xmlParser.setArena(true);
+}
 
 ssize_t BaseClientQtPrivate::sendData(const void *data, size_t size)
 {
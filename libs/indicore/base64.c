@@ -36,6 +36,7 @@
 
 #include <ctype.h>
 #include <stdint.h>
+#include <string.h>
 #include "base64.h"
 #include "base64_luts.h"
 #include <stdio.h>
@@ -56,6 +57,409 @@
 
 #define  IS_LITTLE_ENDIAN  (!IS_BIG_ENDIAN)
 
+/* SIMD implementations, selected at runtime by base64_set_simd_level().
+ *
+ * Encoders convert as many 3 bytes groups as they can without reading past
+ * in + inlen, and return the count of bytes consumed.
+ * Decoders convert 4 chars groups until a block holds a char out of the
+ * base64 alphabet (padding, new line...), left to the scalar code, and return
+ * the count of groups converted. groups is the count of groups before the
+ * last one; stores never go beyond what the scalar code would write.
+ */
+typedef size_t (*base64_encoder)(unsigned char *out, const unsigned char *in, size_t inlen);
+typedef int (*base64_decoder)(char *out, const char *in, int groups);
+
+typedef struct
+{
+    base64_encoder encode;
+    base64_decoder decode;
+} base64_simd;
+
+static const base64_simd simd_none = { NULL, NULL };
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_SIMD_X86
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+#define BASE64_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(BASE64_SIMD_X86) || defined(BASE64_SIMD_NEON)
+/* Selected once on first use, or by base64_set_simd_level(), from any thread */
+static const base64_simd *simd_selected = NULL;
+
+/* base64 char -> 6 bits value, 0x80 when not in the alphabet */
+static const uint8_t base64rev[128] =
+{
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x3e, 0x80, 0x80, 0x80, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+#endif
+
+#ifdef BASE64_SIMD_X86
+
+/* SSSE3 and AVX2 kernels follow W. Mula and D. Lemire, "Faster Base64
+ * Encoding and Decoding Using AVX2 Instructions" (2018).
+ */
+
+/* split the 3 bytes of each 32 bits lane (shuffled as b1 b0 b2 b1) in 4 x 6 bits */
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle_ssse3(__m128i in)
+{
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate_ssse3(__m128i indices)
+{
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, result), indices);
+}
+
+__attribute__((target("ssse3")))
+static size_t enc_ssse3(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t done = 0;
+
+    /* 16 bytes loaded for 12 used */
+    for (; done + 16 <= inlen; done += 12, out += 16)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + done)), shuf);
+        _mm_storeu_si128((__m128i *)out, enc_translate_ssse3(enc_reshuffle_ssse3(v)));
+    }
+    return done;
+}
+
+__attribute__((target("ssse3")))
+static int dec_ssse3(char *out, const char *in, int groups)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    int done = 0;
+
+    /* 16 bytes stored for 12 decoded */
+    for (; done + 5 <= groups; done += 4, in += 16, out += 12)
+    {
+        __m128i str = _mm_loadu_si128((const __m128i *)in);
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(str, mask_2f));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xffff)
+            break;
+
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi_nibbles));
+        str = _mm_add_epi8(str, roll);
+        str = _mm_madd_epi16(_mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(str, pack));
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_reshuffle_avx2(__m256i in)
+{
+    __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t0, t1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_translate_avx2(__m256i indices)
+{
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    return _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), indices);
+}
+
+__attribute__((target("avx2")))
+static size_t enc_avx2(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                         10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t done = 0;
+
+    /* 2 x 16 bytes loaded at +0 and +12 for 24 used */
+    for (; done + 28 <= inlen; done += 24, out += 32)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + done));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + done + 12));
+        __m256i v = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), shuf);
+        _mm256_storeu_si256((__m256i *)out, enc_translate_avx2(enc_reshuffle_avx2(v)));
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+static int dec_avx2(char *out, const char *in, int groups)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+    int done = 0;
+
+    /* 32 bytes stored for 24 decoded */
+    for (; done + 11 <= groups; done += 8, in += 32, out += 24)
+    {
+        __m256i str = _mm256_loadu_si256((const __m256i *)in);
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(str, mask_2f));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != -1)
+            break;
+
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask_2f), hi_nibbles));
+        str = _mm256_add_epi8(str, roll);
+        str = _mm256_madd_epi16(_mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+        str = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(str, pack), lanes);
+        _mm256_storeu_si256((__m256i *)out, str);
+    }
+    return done;
+}
+
+/* AVX-512 VBMI kernels: vpermb does the whole 64 entries alphabet lookup */
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t enc_avx512vbmi(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    const __m512i lookup = _mm512_loadu_si512((const void *)base64digits);
+    const __m512i shuf = _mm512_setr_epi32(0x01020001, 0x04050304, 0x07080607, 0x0a0b090a,
+                                           0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516,
+                                           0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122,
+                                           0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+    const __m512i shifts = _mm512_set1_epi64(0x3036242a1016040aLL);
+    size_t done = 0;
+
+    /* 64 bytes loaded for 48 used */
+    for (; done + 64 <= inlen; done += 48, out += 64)
+    {
+        __m512i v = _mm512_permutexvar_epi8(shuf, _mm512_loadu_si512((const void *)(in + done)));
+        v = _mm512_multishift_epi64_epi8(shifts, v);
+        _mm512_storeu_si512((void *)out, _mm512_permutexvar_epi8(v, lookup));
+    }
+    return done;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static int dec_avx512vbmi(char *out, const char *in, int groups)
+{
+    static const uint8_t pack[64] =
+    {
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, 18, 17, 16, 22, 21, 20, 26, 25, 24, 30, 29, 28,
+        34, 33, 32, 38, 37, 36, 42, 41, 40, 46, 45, 44, 50, 49, 48, 54, 53, 52, 58, 57, 56, 62, 61, 60,
+    };
+    const __m512i lut_lo = _mm512_loadu_si512((const void *)base64rev);
+    const __m512i lut_hi = _mm512_loadu_si512((const void *)(base64rev + 64));
+    const __m512i perm = _mm512_loadu_si512((const void *)pack);
+    int done = 0;
+
+    /* 64 bytes stored for 48 decoded */
+    for (; done + 22 <= groups; done += 16, in += 64, out += 48)
+    {
+        __m512i str = _mm512_loadu_si512((const void *)in);
+        __m512i v = _mm512_permutex2var_epi8(lut_lo, str, lut_hi);
+        if (_mm512_movepi8_mask(_mm512_or_si512(v, str)) != 0)
+            break;
+
+        v = _mm512_madd_epi16(_mm512_maddubs_epi16(v, _mm512_set1_epi32(0x01400140)), _mm512_set1_epi32(0x00011000));
+        _mm512_storeu_si512((void *)out, _mm512_permutexvar_epi8(perm, v));
+    }
+    return done;
+}
+
+static int simd_supported(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw"))
+        return 3;
+    if (__builtin_cpu_supports("avx2"))
+        return 2;
+    if (__builtin_cpu_supports("ssse3"))
+        return 1;
+    return 0;
+}
+
+#elif defined(BASE64_SIMD_NEON)
+
+static size_t enc_neon(unsigned char *out, const unsigned char *in, size_t inlen)
+{
+    uint8x16x4_t lookup;
+    size_t done = 0;
+
+    lookup.val[0] = vld1q_u8((const uint8_t *)base64digits);
+    lookup.val[1] = vld1q_u8((const uint8_t *)base64digits + 16);
+    lookup.val[2] = vld1q_u8((const uint8_t *)base64digits + 32);
+    lookup.val[3] = vld1q_u8((const uint8_t *)base64digits + 48);
+
+    for (; done + 48 <= inlen; done += 48, out += 64)
+    {
+        uint8x16x3_t v = vld3q_u8(in + done);
+        uint8x16x4_t r;
+
+        r.val[0] = vshrq_n_u8(v.val[0], 2);
+        r.val[1] = vorrq_u8(vshrq_n_u8(v.val[1], 4), vandq_u8(vshlq_n_u8(v.val[0], 4), vdupq_n_u8(0x30)));
+        r.val[2] = vorrq_u8(vshrq_n_u8(v.val[2], 6), vandq_u8(vshlq_n_u8(v.val[1], 2), vdupq_n_u8(0x3c)));
+        r.val[3] = vandq_u8(v.val[2], vdupq_n_u8(0x3f));
+
+        r.val[0] = vqtbl4q_u8(lookup, r.val[0]);
+        r.val[1] = vqtbl4q_u8(lookup, r.val[1]);
+        r.val[2] = vqtbl4q_u8(lookup, r.val[2]);
+        r.val[3] = vqtbl4q_u8(lookup, r.val[3]);
+        vst4q_u8(out, r);
+    }
+    return done;
+}
+
+static int dec_neon(char *out, const char *in, int groups)
+{
+    uint8x16x4_t lut_lo, lut_hi;
+    int done = 0;
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        lut_lo.val[i] = vld1q_u8(base64rev + 16 * i);
+        lut_hi.val[i] = vld1q_u8(base64rev + 64 + 16 * i);
+    }
+
+    for (; done + 16 <= groups; done += 16, in += 64, out += 48)
+    {
+        uint8x16x4_t v = vld4q_u8((const uint8_t *)in);
+        uint8x16_t err = vdupq_n_u8(0);
+        uint8x16x3_t r;
+
+        for (i = 0; i < 4; i++)
+        {
+            /* out of range indices give 0: each char is found in one table at most */
+            uint8x16_t c = v.val[i];
+            v.val[i] = vorrq_u8(vqtbl4q_u8(lut_lo, c), vqtbl4q_u8(lut_hi, vsubq_u8(c, vdupq_n_u8(64))));
+            err = vorrq_u8(err, vorrq_u8(v.val[i], c));
+        }
+        if (vmaxvq_u8(err) & 0x80)
+            break;
+
+        r.val[0] = vorrq_u8(vshlq_n_u8(v.val[0], 2), vshrq_n_u8(v.val[1], 4));
+        r.val[1] = vorrq_u8(vshlq_n_u8(v.val[1], 4), vshrq_n_u8(v.val[2], 2));
+        r.val[2] = vorrq_u8(vshlq_n_u8(v.val[2], 6), v.val[3]);
+        vst3q_u8((uint8_t *)out, r);
+    }
+    return done;
+}
+
+static int simd_supported(void)
+{
+    return 1;
+}
+
+#else
+
+static int simd_supported(void)
+{
+    return 0;
+}
+
+#endif
+
+int base64_set_simd_level(int level)
+{
+    int supported = simd_supported();
+    const base64_simd *selected = &simd_none;
+
+    if (level < 0 || level > supported)
+        level = supported;
+
+    switch (level)
+    {
+#if defined(BASE64_SIMD_X86)
+        case 3:
+        {
+            static const base64_simd avx512vbmi = { enc_avx512vbmi, dec_avx512vbmi };
+            selected = &avx512vbmi;
+            break;
+        }
+        case 2:
+        {
+            static const base64_simd avx2 = { enc_avx2, dec_avx2 };
+            selected = &avx2;
+            break;
+        }
+        case 1:
+        {
+            static const base64_simd ssse3 = { enc_ssse3, dec_ssse3 };
+            selected = &ssse3;
+            break;
+        }
+#elif defined(BASE64_SIMD_NEON)
+        case 1:
+        {
+            static const base64_simd neon = { enc_neon, dec_neon };
+            selected = &neon;
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+#if defined(BASE64_SIMD_X86) || defined(BASE64_SIMD_NEON)
+    __atomic_store_n(&simd_selected, selected, __ATOMIC_RELEASE);
+#else
+    (void)selected;
+#endif
+    return level;
+}
+
+static const base64_simd *simd_get(void)
+{
+#if defined(BASE64_SIMD_X86) || defined(BASE64_SIMD_NEON)
+    const base64_simd *selected = __atomic_load_n(&simd_selected, __ATOMIC_ACQUIRE);
+
+    /* Threads racing here all select the same one */
+    if (selected == NULL)
+    {
+        base64_set_simd_level(-1);
+        selected = __atomic_load_n(&simd_selected, __ATOMIC_ACQUIRE);
+    }
+    return selected;
+#else
+    return &simd_none;
+#endif
+}
+
 /* convert inlen raw bytes at in to base64 string (NUL-terminated) at out. 
  * out size should be at least 4*inlen/3 + 4.
  * return length of out (sans trailing NUL).
@@ -78,8 +482,18 @@ int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
 {
     uint16_t *b64lut = (uint16_t *)base64lut;
     int dlen         = ((inlen + 2) / 3) * 4; /* 4/3, rounded up */
-    uint16_t *wbuf   = (uint16_t *)out;
+    uint16_t *wbuf;
+    base64_encoder simd_encode = simd_get()->encode;
 
+    if (simd_encode != NULL && inlen > 0)
+    {
+        size_t done = simd_encode(out, in, inlen);
+        in += done;
+        inlen -= done;
+        out += done / 3 * 4;
+    }
+
+    wbuf = (uint16_t *)out;
     for (; inlen > 2; inlen -= 3)
     {
         uint32_t n = in[0] << 16 | in[1] << 8 | in[2];
@@ -107,6 +521,32 @@ int to64frombits(unsigned char *out, const unsigned char *in, int inlen)
     return dlen;
 }
 
+/* convert inlen raw bytes at in to base64 lines of linelen chars, each ended
+ * by a new line, at out (NUL-terminated). The base64 is produced in place then
+ * spread over the lines from the last one.
+ */
+size_t to64frombits_lines(unsigned char *out, const unsigned char *in, size_t inlen, size_t linelen)
+{
+    size_t enclen = ((inlen + 2) / 3) * 4;
+    size_t lines, line;
+
+    to64frombits_s(out, in, inlen, enclen + 1);
+    if (linelen == 0)
+        return enclen;
+
+    lines = (enclen + linelen - 1) / linelen;
+    for (line = lines; line-- > 0;)
+    {
+        size_t start = line * linelen;
+        size_t len   = (enclen - start > linelen) ? linelen : enclen - start;
+
+        memmove(out + start + line, out + start, len);
+        out[start + line + len] = '\n';
+    }
+    out[enclen + lines] = 0;
+    return enclen + lines;
+}
+
 /* convert base64 at in to raw bytes out, returning count or <0 on error.
  * base64 should not contain whitespaces.
  * out should be at least 3/4 the length of in.
@@ -128,9 +568,22 @@ int from64tobits_fast(char *out, const char *in, int inlen)
     int j;
     int n         = (inlen / 4) - 1;
     uint16_t *inp = (uint16_t *)in;
+    base64_decoder simd_decode = simd_get()->decode;
 
     for (j = 0; j < n; j++)
     {
+        if (simd_decode != NULL)
+        {
+            int done = simd_decode(out, in, n - j);
+            if (done > 0)
+            {
+                in += 4 * done;
+                out += 3 * done;
+                j += done - 1;
+                continue;
+            }
+        }
+
         if (in[0] == '\n')
             in++;
         inp = (uint16_t *)in;
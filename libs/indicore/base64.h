@@ -48,6 +48,16 @@ __attribute__((deprecated("unsafe function, use to64frombits_s instead")))
 #endif
 extern int to64frombits(unsigned char *out, const unsigned char *in, int inlen);
 
+/** \brief Convert bytes array to base64 lines, each ended by a new line.
+    Large buffers can be converted by chunks of a multiple of (3 * linelen / 4) bytes, giving the same lines as a single call.
+    \param out output buffer in base64. The buffer size must be at least (4 * inlen / 3 + 4) * (linelen + 1) / linelen + 1 bytes long.
+    \param in input binary buffer
+    \param inlen number of bytes to convert
+    \param linelen number of base64 chars per line, a multiple of 4. 0 for no new lines.
+    \return length of out (sans trailing NUL).
+ */
+extern size_t to64frombits_lines(unsigned char *out, const unsigned char *in, size_t inlen, size_t linelen);
+
 /** \brief Convert base64 to bytes array.
     \param out output buffer in bytes. The buffer size must be at least (3 * size_of_in_buffer / 4) bytes long.
     \param in input base64 buffer
@@ -59,6 +69,13 @@ extern int from64tobits(char *out, const char *in);
 extern int from64tobits_fast(char *out, const char *in, int inlen);
 extern int from64tobits_fast_with_bug(char *out, const char *in, int inlen);
 
+/** \brief Select the instruction set used to convert from and to base64.
+    The best one supported by the CPU is selected on first use, this is mostly for tests and benchmarks.
+    \param level 0 for the portable code, 1 for SSSE3 (x86) or NEON (ARM64), 2 for AVX2, 3 for AVX-512 VBMI, -1 for the best supported.
+    \return the level in use, lower than requested if the CPU lacks support.
+ */
+extern int base64_set_simd_level(int level);
+
 /*@}*/
 
 #ifdef __cplusplus
@@ -42,6 +42,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -81,6 +82,7 @@
 #endif
 
 #ifndef _WIN32
+#include <pthread.h>
 #include <unistd.h>
 #include <termios.h>
 #include <sys/param.h>
@@ -106,6 +108,27 @@ static int tty_gemini_udp_format = 0;
 static int tty_generic_udp_format = 0;
 static int tty_sequence_number = 1;
 static int tty_clear_trailing_lf = 0;
+static int tty_buffered_read = 0;
+
+#ifndef _WIN32
+#define TTY_BUFFER_SIZE 512
+
+/* bytes read from a device but not returned to the driver yet.
+ * a section is read with as few read() calls as the device allows, what
+ * follows the stop char is kept here for the next read from the same fd.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;       /* held by reads of the fd, and to drop kept bytes */
+    int start;                  /* first byte not returned yet */
+    int end;                    /* end of bytes read */
+    char data[TTY_BUFFER_SIZE];
+} TTYBuffer;
+
+static pthread_mutex_t tty_buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TTYBuffer **tty_buffers; /* indexed by fd, entries never move */
+static int tty_nbuffers;        /* n entries in tty_buffers[] */
+#endif
 
 #if defined(HAVE_LIBNOVA)
 int extractISOTime(const char *timestr, struct ln_date *iso_date)
@@ -377,6 +400,107 @@ void tty_clr_trailing_read_lf(int enabled)
     tty_clear_trailing_lf = enabled;
 }
 
+void tty_set_buffered_read(int enabled)
+{
+    tty_buffered_read = enabled;
+}
+
+#ifndef _WIN32
+/* buffer of fd, created on demand if create is set, else NULL if there is none */
+static TTYBuffer *tty_buffer(int fd, int create)
+{
+    TTYBuffer *tb = NULL;
+
+    if (fd < 0)
+        return NULL;
+
+    pthread_mutex_lock(&tty_buffers_mutex);
+    if (fd >= tty_nbuffers && create)
+    {
+        int n = fd + 16;
+        tty_buffers = (TTYBuffer **)realloc(tty_buffers, n * sizeof(TTYBuffer *));
+        memset(tty_buffers + tty_nbuffers, 0, (n - tty_nbuffers) * sizeof(TTYBuffer *));
+        tty_nbuffers = n;
+    }
+    if (fd < tty_nbuffers)
+    {
+        tb = tty_buffers[fd];
+        if (tb == NULL && create)
+        {
+            tb = tty_buffers[fd] = (TTYBuffer *)calloc(1, sizeof(TTYBuffer));
+            pthread_mutex_init(&tb->lock, NULL);
+        }
+    }
+    pthread_mutex_unlock(&tty_buffers_mutex);
+
+    return tb;
+}
+
+/* forget the bytes kept for fd, as tcflush() would for the kernel queue */
+static void tty_drop_buffered(int fd)
+{
+    TTYBuffer *tb = tty_buffer(fd, 0);
+    if (tb)
+    {
+        pthread_mutex_lock(&tb->lock);
+        tb->start = tb->end = 0;
+        pthread_mutex_unlock(&tb->lock);
+    }
+}
+
+/* wait for the device then read what it sent into the empty buffer.
+ * a single byte is read when buffered reads are disabled.
+ */
+static int tty_fill_buffer(int fd, TTYBuffer *tb, long timeout_seconds, long timeout_microseconds)
+{
+    int err, bytesRead;
+
+    if ((err = tty_timeout_microseconds(fd, timeout_seconds, timeout_microseconds)))
+        return err;
+
+    bytesRead = read(fd, tb->data, tty_buffered_read ? TTY_BUFFER_SIZE : 1);
+    if (bytesRead < 0)
+        return TTY_READ_ERROR;
+
+    tb->start = 0;
+    tb->end   = bytesRead;
+    return TTY_OK;
+}
+
+/* move buffered bytes to buf + *nbytes_read, up to and including *stop_char
+ * if not NULL, without making *nbytes_read larger than nsize.
+ * return 1 if the stop char was moved, else 0.
+ */
+static int tty_take_section(TTYBuffer *tb, char *buf, int nsize, const char *stop_char, int *nbytes_read)
+{
+    const char *stop = NULL;
+    int i, n;
+
+    while (tb->start < tb->end && *nbytes_read == 0 && tty_clear_trailing_lf && tb->data[tb->start] == 0x0A)
+    {
+        if (tty_debug)
+            IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
+        tb->start++;
+    }
+
+    n    = MIN(tb->end - tb->start, nsize - *nbytes_read);
+    if (stop_char)
+        stop = (const char *)memchr(tb->data + tb->start, *stop_char, n);
+    if (stop)
+        n = stop - (tb->data + tb->start) + 1;
+
+    memcpy(buf + *nbytes_read, tb->data + tb->start, n);
+
+    if (tty_debug)
+        for (i = *nbytes_read; i < *nbytes_read + n; i++)
+            IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, i, (unsigned char)buf[i], buf[i]);
+
+    tb->start += n;
+    *nbytes_read += n;
+    return stop != NULL;
+}
+#endif
+
 int tty_timeout(int fd, int timeout)
 {
     return tty_timeout_microseconds(fd, timeout, 0);
@@ -512,6 +636,21 @@ int tty_read_expanded(int fd, char *buf, int nbytes, long timeout_seconds, long
         numBytesToRead = nbytes + 8;
         buffer = geminiBuffer;
     }
+    else
+    {
+        // Bytes kept by a previous section read come first
+        TTYBuffer *tb = tty_buffer(fd, 0);
+        if (tb)
+        {
+            pthread_mutex_lock(&tb->lock);
+            if (tb->start < tb->end)
+            {
+                tty_take_section(tb, buffer, nbytes, NULL, nbytes_read);
+                numBytesToRead -= *nbytes_read;
+            }
+            pthread_mutex_unlock(&tb->lock);
+        }
+    }
 
     while (numBytesToRead > 0)
     {
@@ -583,8 +722,6 @@ int tty_read_section_expanded(int fd, char *buf, char stop_char, long timeout_se
     int err       = TTY_OK;
     *nbytes_read  = 0;
 
-    uint8_t *read_char = 0;
-
     if (tty_debug)
         IDLog("%s: Request to read until stop char '%#02X' with %ld s %ld us timeout for fd %d\n", __FUNCTION__, stop_char, timeout_seconds, timeout_microseconds, fd);
 
@@ -631,31 +768,16 @@ int tty_read_section_expanded(int fd, char *buf, char stop_char, long timeout_se
     }
     else
     {
-        for (;;)
-        {
-            if ((err = tty_timeout_microseconds(fd, timeout_seconds, timeout_microseconds)))
-                return err;
+        TTYBuffer *tb = tty_buffer(fd, 1);
 
-            read_char = (uint8_t*)(buf + *nbytes_read);
-            bytesRead = read(fd, read_char, 1);
-
-            if (bytesRead < 0)
-                return TTY_READ_ERROR;
-
-            if (tty_debug)
-                IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
-
-            if (!(tty_clear_trailing_lf && *read_char == 0X0A && *nbytes_read == 0))
-                (*nbytes_read)++;
-            else {
-                if (tty_debug)
-                    IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
-            }
-
-            if (*read_char == stop_char) {
-                return TTY_OK;
-            }
+        pthread_mutex_lock(&tb->lock);
+        while (!tty_take_section(tb, buf, INT_MAX, &stop_char, nbytes_read))
+        {
+            if ((err = tty_fill_buffer(fd, tb, timeout_seconds, timeout_microseconds)))
+                break;
         }
+        pthread_mutex_unlock(&tb->lock);
+        return err;
     }
 
     return TTY_TIME_OUT;
@@ -676,41 +798,31 @@ int tty_nread_section(int fd, char *buf, int nsize, char stop_char, int timeout,
     if (tty_gemini_udp_format || tty_generic_udp_format)
         return tty_read_section(fd, buf, stop_char, timeout, nbytes_read);
 
-    int bytesRead = 0;
     int err       = TTY_OK;
     *nbytes_read  = 0;
-    uint8_t *read_char = 0;
     memset(buf, 0, nsize);
 
     if (tty_debug)
         IDLog("%s: Request to read until stop char '%#02X' with %d timeout for fd %d\n", __FUNCTION__, stop_char, timeout, fd);
 
+    TTYBuffer *tb = tty_buffer(fd, 1);
+
+    pthread_mutex_lock(&tb->lock);
     for (;;)
     {
-        if ((err = tty_timeout(fd, timeout)))
-            return err;
-
-        read_char = (uint8_t*)(buf + *nbytes_read);
-        bytesRead = read(fd, read_char, 1);
-
-        if (bytesRead < 0)
-            return TTY_READ_ERROR;
-
-        if (tty_debug)
-            IDLog("%s: buffer[%d]=%#X (%c)\n", __FUNCTION__, (*nbytes_read), *read_char, *read_char);
-
-        if (!(tty_clear_trailing_lf && *read_char == 0X0A && *nbytes_read == 0))
-            (*nbytes_read)++;
-        else {
-            if (tty_debug)
-                IDLog("%s: Cleared LF char left in buf\n", __FUNCTION__);
+        if (tty_take_section(tb, buf, nsize, &stop_char, nbytes_read))
+            break;
+        else if (*nbytes_read >= nsize)
+        {
+            err = TTY_OVERFLOW;
+            break;
         }
 
-        if (*read_char == stop_char)
-            return TTY_OK;
-        else if (*nbytes_read >= nsize)
-            return TTY_OVERFLOW;
+        if ((err = tty_fill_buffer(fd, tb, timeout, 0)))
+            break;
     }
+    pthread_mutex_unlock(&tb->lock);
+    return err;
 
 #endif
 }
@@ -928,6 +1040,7 @@ int tty_connect(const char *device, int bit_rate, int word_size, int parity, int
     }
 #endif
 
+    tty_drop_buffered(t_fd);
     *fd = t_fd;
     /* return success */
     return TTY_OK;
@@ -1136,6 +1249,7 @@ int tty_connect(const char *device, int bit_rate, int word_size, int parity, int
         return TTY_PORT_FAILURE;
     }
 
+    tty_drop_buffered(t_fd);
     *fd = t_fd;
     /* return success */
     return TTY_OK;
@@ -1145,6 +1259,20 @@ int tty_connect(const char *device, int bit_rate, int word_size, int parity, int
 
 #endif
 
+int tty_flush_input(int fd)
+{
+    if (fd == -1)
+        return TTY_ERRNO;
+
+#ifdef _WIN32
+    return TTY_ERRNO;
+#else
+    tcflush(fd, TCIFLUSH);
+    tty_drop_buffered(fd);
+    return TTY_OK;
+#endif
+}
+
 int tty_disconnect(int fd)
 {
     if (fd == -1)
@@ -1155,6 +1283,7 @@ int tty_disconnect(int fd)
 #else
     int err;
     tcflush(fd, TCIOFLUSH);
+    tty_drop_buffered(fd);
     err = close(fd);
 
     if (err != 0)
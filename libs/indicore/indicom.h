@@ -282,6 +282,21 @@ void tty_set_gemini_udp_format(int enabled);
 void tty_set_generic_udp_format(int enabled);
 void tty_clr_trailing_read_lf(int enabled);
 
+/** \brief tty_set_buffered_read Enable or disable buffered reads, disabled by default.
+ *  Section reads then take all the bytes the device sent in one read() call, and keep
+ *  what follows the stop char for the next read from the same fd. tcflush() cannot drop
+ *  the kept bytes: drivers that enable buffered reads must flush stale replies with
+ *  tty_flush_input(), and must not mix tty reads with their own read() on the fd.
+ *  \param enabled 1 to enable, 0 to read one byte at a time
+ */
+void tty_set_buffered_read(int enabled);
+
+/** \brief tty_flush_input Drop the input not read yet, both received by the system and kept by buffered reads.
+ *  \param fd file descriptor
+ *  \return On success, it returns TTY_OK, otherwise, a TTY_ERROR code.
+ */
+int tty_flush_input(int fd);
+
 int tty_timeout(int fd, int timeout);
 
 int tty_timeout_microseconds(int fd, long timeout_seconds, long timeout_microseconds);
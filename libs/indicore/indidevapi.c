@@ -547,11 +547,12 @@ int IUSnoopNumber(XMLEle *root, INumberVectorProperty *nvp)
     XMLEle *ep;
 
     /* check and crack type, device, name and state */
-    if (strcmp(tagXMLEle(root) + 3, "NumberVector") || crackDN(root, &dev, &name, NULL) < 0)
+    XMLSymbol tag = tagIdXMLEle(root);
+    if ((tag != XMLSYM_defNumberVector && tag != XMLSYM_setNumberVector && tag != XMLSYM_newNumberVector) || crackDN(root, &dev, &name, NULL) < 0)
         return (-1);
     if (strcmp(dev, nvp->device) || strcmp(name, nvp->name))
         return (-1); /* not this property */
-    (void)crackIPState(findXMLAttValu(root, "state"), &nvp->s);
+    (void)crackIPState(findXMLAttValuById(root, XMLSYM_state), &nvp->s);
 
     /* match each INumber with a oneNumber */
     locale_char_t *orig = indi_locale_C_numeric_push();
@@ -559,7 +560,9 @@ int IUSnoopNumber(XMLEle *root, INumberVectorProperty *nvp)
     {
         for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
         {
-            if (!strcmp(tagXMLEle(ep) + 3, "Number") && !strcmp(nvp->np[i].name, findXMLAttValu(ep, "name")))
+            XMLSymbol etag = tagIdXMLEle(ep);
+            if ((etag == XMLSYM_oneNumber || etag == XMLSYM_defNumber) &&
+                    !strcmp(nvp->np[i].name, findXMLAttValuById(ep, XMLSYM_name)))
             {
                 if (f_scansexa(pcdataXMLEle(ep), &nvp->np[i].value) < 0)
                 {
@@ -592,18 +595,21 @@ int IUSnoopText(XMLEle *root, ITextVectorProperty *tvp)
     XMLEle *ep;
 
     /* check and crack type, device, name and state */
-    if (strcmp(tagXMLEle(root) + 3, "TextVector") || crackDN(root, &dev, &name, NULL) < 0)
+    XMLSymbol tag = tagIdXMLEle(root);
+    if ((tag != XMLSYM_defTextVector && tag != XMLSYM_setTextVector && tag != XMLSYM_newTextVector) || crackDN(root, &dev, &name, NULL) < 0)
         return (-1);
     if (strcmp(dev, tvp->device) || strcmp(name, tvp->name))
         return (-1); /* not this property */
-    (void)crackIPState(findXMLAttValu(root, "state"), &tvp->s);
+    (void)crackIPState(findXMLAttValuById(root, XMLSYM_state), &tvp->s);
 
     /* match each IText with a oneText */
     for (int i = 0; i < tvp->ntp; i++)
     {
         for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
         {
-            if (!strcmp(tagXMLEle(ep) + 3, "Text") && !strcmp(tvp->tp[i].name, findXMLAttValu(ep, "name")))
+            XMLSymbol etag = tagIdXMLEle(ep);
+            if ((etag == XMLSYM_oneText || etag == XMLSYM_defText) &&
+                    !strcmp(tvp->tp[i].name, findXMLAttValuById(ep, XMLSYM_name)))
             {
                 IUSaveText(&tvp->tp[i], pcdataXMLEle(ep));
                 break;
@@ -628,19 +634,21 @@ int IUSnoopLight(XMLEle *root, ILightVectorProperty *lvp)
     XMLEle *ep;
 
     /* check and crack type, device, name and state */
-    if (strcmp(tagXMLEle(root) + 3, "LightVector") || crackDN(root, &dev, &name, NULL) < 0)
+    XMLSymbol tag = tagIdXMLEle(root);
+    if ((tag != XMLSYM_defLightVector && tag != XMLSYM_setLightVector) || crackDN(root, &dev, &name, NULL) < 0)
         return (-1);
     if (strcmp(dev, lvp->device) || strcmp(name, lvp->name))
         return (-1); /* not this property */
 
-    (void)crackIPState(findXMLAttValu(root, "state"), &lvp->s);
+    (void)crackIPState(findXMLAttValuById(root, XMLSYM_state), &lvp->s);
 
     /* match each oneLight with one ILight */
     for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
     {
-        if (!strcmp(tagXMLEle(ep) + 3, "Light"))
+        XMLSymbol etag = tagIdXMLEle(ep);
+        if (etag == XMLSYM_oneLight || etag == XMLSYM_defLight)
         {
-            const char *name = findXMLAttValu(ep, "name");
+            const char *name = findXMLAttValuById(ep, XMLSYM_name);
             for (int i = 0; i < lvp->nlp; i++)
             {
                 if (!strcmp(lvp->lp[i].name, name))
@@ -670,18 +678,20 @@ int IUSnoopSwitch(XMLEle *root, ISwitchVectorProperty *svp)
     XMLEle *ep;
 
     /* check and crack type, device, name and state */
-    if (strcmp(tagXMLEle(root) + 3, "SwitchVector") || crackDN(root, &dev, &name, NULL) < 0)
+    XMLSymbol tag = tagIdXMLEle(root);
+    if ((tag != XMLSYM_defSwitchVector && tag != XMLSYM_setSwitchVector && tag != XMLSYM_newSwitchVector) || crackDN(root, &dev, &name, NULL) < 0)
         return (-1);
     if (strcmp(dev, svp->device) || strcmp(name, svp->name))
         return (-1); /* not this property */
-    (void)crackIPState(findXMLAttValu(root, "state"), &svp->s);
+    (void)crackIPState(findXMLAttValuById(root, XMLSYM_state), &svp->s);
 
     /* match each oneSwitch with one ISwitch */
     for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
     {
-        if (!strcmp(tagXMLEle(ep) + 3, "Switch"))
+        XMLSymbol etag = tagIdXMLEle(ep);
+        if (etag == XMLSYM_oneSwitch || etag == XMLSYM_defSwitch)
         {
-            const char *name = findXMLAttValu(ep, "name");
+            const char *name = findXMLAttValuById(ep, XMLSYM_name);
             for (int i = 0; i < svp->nsp; i++)
             {
                 if (!strcmp(svp->sp[i].name, name))
@@ -712,19 +722,19 @@ int IUSnoopBLOB(XMLEle *root, IBLOBVectorProperty *bvp)
     XMLEle *ep;
 
     /* check and crack type, device, name and state */
-    if (strcmp(tagXMLEle(root), "setBLOBVector") || crackDN(root, &dev, &name, NULL) < 0)
+    if (tagIdXMLEle(root) != XMLSYM_setBLOBVector || crackDN(root, &dev, &name, NULL) < 0)
         return (-1);
 
     if (strcmp(dev, bvp->device) || strcmp(name, bvp->name))
         return (-1); /* not this property */
 
-    crackIPState(findXMLAttValu(root, "state"), &bvp->s);
+    crackIPState(findXMLAttValuById(root, XMLSYM_state), &bvp->s);
 
     for (ep = nextXMLEle(root, 1); ep; ep = nextXMLEle(root, 0))
     {
-        if (strcmp(tagXMLEle(ep), "oneBLOB") == 0)
+        if (tagIdXMLEle(ep) == XMLSYM_oneBLOB)
         {
-            XMLAtt *na = findXMLAtt(ep, "name");
+            XMLAtt *na = findXMLAttById(ep, XMLSYM_name);
             if (na == NULL)
                 return (-1);
 
@@ -733,8 +743,8 @@ int IUSnoopBLOB(XMLEle *root, IBLOBVectorProperty *bvp)
             if (bp == NULL)
                 return (-1);
 
-            XMLAtt *fa = findXMLAtt(ep, "format");
-            XMLAtt *sa = findXMLAtt(ep, "size");
+            XMLAtt *fa = findXMLAttById(ep, XMLSYM_format);
+            XMLAtt *sa = findXMLAttById(ep, XMLSYM_size);
             if (fa && sa)
             {
                 int base64datalen = pcdatalenXMLEle(ep);
@@ -760,7 +770,7 @@ int crackDN(XMLEle *root, char **dev, char **name, char msg[])
 {
     XMLAtt *ap;
 
-    ap = findXMLAtt(root, "device");
+    ap = findXMLAttById(root, XMLSYM_device);
     if (!ap)
     {
         sprintf(msg, "%s requires 'device' attribute", tagXMLEle(root));
@@ -768,7 +778,7 @@ int crackDN(XMLEle *root, char **dev, char **name, char msg[])
     }
     *dev = valuXMLAtt(ap);
 
-    ap = findXMLAtt(root, "name");
+    ap = findXMLAttById(root, XMLSYM_name);
     if (!ap)
     {
         sprintf(msg, "%s requires 'name' attribute", tagXMLEle(root));
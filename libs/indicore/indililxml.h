@@ -131,11 +131,13 @@ class LilXmlElement
     public:
         bool isValid() const;
         std::string tagName() const;
+        XMLSymbol tagId() const;
 
     public:
         Elements getElements() const;
         Elements getElementsByTagName(const char *tagName) const;
         LilXmlAttribute getAttribute(const char *name) const;
+        LilXmlAttribute getAttribute(XMLSymbol id) const;
         LilXmlAttribute addAttribute(const char *name, const char *value);
         void removeAttribute(const char *name);
 
@@ -189,6 +191,9 @@ class LilXmlParser
     public:
         std::list<LilXmlDocument> parseChunk(const char *data, size_t size);
 
+    public:
+        void setArena(bool on);
+
     public:
         bool hasErrorMessage() const;
         const char *errorMessage() const;
@@ -374,6 +379,11 @@ inline std::string LilXmlElement::tagName() const
     return tagXMLEle(mHandle);
 }
 
+inline XMLSymbol LilXmlElement::tagId() const
+{
+    return tagIdXMLEle(mHandle);
+}
+
 inline LilXmlElement::Elements LilXmlElement::getElements() const
 {
     Elements result;
@@ -407,6 +417,11 @@ inline LilXmlAttribute LilXmlElement::getAttribute(const char *name) const
     return LilXmlAttribute(findXMLAtt(mHandle, name));
 }
 
+inline LilXmlAttribute LilXmlElement::getAttribute(XMLSymbol id) const
+{
+    return LilXmlAttribute(findXMLAttById(mHandle, id));
+}
+
 inline LilXmlAttribute LilXmlElement::addAttribute(const char *name, const char *value)
 {
     return LilXmlAttribute(addXMLAtt(mHandle, name, value));
@@ -497,6 +512,11 @@ inline std::list<LilXmlDocument> LilXmlParser::parseChunk(const char *data, size
     return result;
 }
 
+inline void LilXmlParser::setArena(bool on)
+{
+    lilxmlArena(mHandle.get(), on);
+}
+
 inline bool LilXmlParser::hasErrorMessage() const
 {
     return mErrorMessage[0] != '\0';
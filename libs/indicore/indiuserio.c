@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define BASE64_LINE_LEN    72   /* base64 chars per line of inline blobs */
+#define BASE64_CHUNK_LINES 1024 /* lines encoded per write */
+
 static void s_userio_xml_message_vprintf(const userio *io, void *user, const char *fmt, va_list ap)
 {
     char message[MAXINDIMESSAGE];
@@ -130,38 +133,30 @@ void IUUserIOBLOBContextOne(
 
             io->joinbuff(user, "    attached='true'>\n", (void*)blob, bloblen);
         } else {
-            size_t sz = 4 * bloblen / 3 + 4;
-            assert_mem(encblob = (unsigned char *)malloc(sz)); // #PS: TODO
-            l = to64frombits_s(encblob, blob, bloblen, sz);
-            if (l == 0) {
-                fprintf(stderr, "%s: Not enough memory for decoding.\n", __func__);
-                exit(1);
-            }
+            /* encode by chunks of whole lines, so memory stays bounded whatever the blob size */
+            size_t chunk = BASE64_CHUNK_LINES * (BASE64_LINE_LEN / 4 * 3);
+            size_t done;
+
+            assert_mem(encblob = (unsigned char *)malloc(BASE64_CHUNK_LINES * (BASE64_LINE_LEN + 1) + 1));
+
+            l = 4 * ((bloblen + 2) / 3);
             userio_printf    (io, user, "    enclen='%d'\n", l); // safe
             userio_prints    (io, user, "    format='");
             userio_xml_escape(io, user, format);
             userio_prints    (io, user, "'>\n");
-            size_t written = 0;
-            // FIXME: this is not efficient. The CR/LF imply one more copy... Do we need them ?
-            while ((int)written < l)
+
+            for (done = 0; done < bloblen; done += chunk)
             {
-                size_t towrite = ((l - written) > 72) ? 72 : l - written;
-                size_t wr      = userio_write(io, user, encblob + written, towrite);
+                size_t len = to64frombits_lines(encblob, (const unsigned char *)blob + done,
+                                                bloblen - done > chunk ? chunk : bloblen - done, BASE64_LINE_LEN);
 
-                if (wr == 0)
+                if (userio_write(io, user, encblob, len) == 0)
                 {
                     free(encblob);
                     return;
                 }
-
-                written += wr;
-                if ((written % 72) == 0)
-                    userio_putc(io, user, '\n');
             }
 
-            if ((written % 72) != 0)
-                userio_putc(io, user, '\n');
-
             free(encblob);
         }
     }
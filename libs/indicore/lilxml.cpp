@@ -34,6 +34,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #if defined(_MSC_VER)
@@ -45,29 +46,40 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301  USA
 
 #include "lilxml.h"
 
+/* bump allocator holding all the memory of one parsed tree, see lilxmlArena() */
+typedef struct Arena_ Arena;
+
 /* used to efficiently manage growing malloced string space */
 typedef struct
 {
-    char *s; /* malloced memory for string */
-    int sl;  /* string length, sans trailing \0 */
-    int sm;  /* total malloced bytes */
+    char *s;      /* malloced memory for string */
+    int sl;       /* string length, sans trailing \0 */
+    int sm;       /* total malloced bytes */
+    Arena *arena; /* where s lives, NULL for the heap */
 } String;
 #define MINMEM 64 /* starting string length */
 
 static int oneXMLchar(LilXML *lp, int c, char ynot[]);
+static int scanXMLrun(LilXML *lp, const char *p, const char *end);
 static void initParser(LilXML *lp);
 static void pushXMLEle(LilXML *lp);
 static void popXMLEle(LilXML *lp);
 static void resetEndTag(LilXML *lp);
 static XMLAtt *growAtt(XMLEle *e);
-static XMLEle *growEle(XMLEle *pe);
+static XMLEle *growEle(XMLEle *pe, Arena *a);
 static void freeAtt(XMLAtt *a);
 static int isTokenChar(int start, int c);
 static void growString(String *sp, int c);
 static void appendString(String *sp, const char *str);
+static void appendBytes(String *sp, const char *str, int n);
 static void freeString(String *sp);
 static void newString(String *sp);
 static void *moremem(void *old, size_t n);
+static Arena *newArena(void);
+static void delArena(Arena *a);
+static void *arenamem(Arena *a, void *old, size_t n);
+static void arenafree(Arena *a, void *p);
+static void *growList(Arena *a, void *list, int n, size_t size);
 static void appXMLEle(XMLEle *ep, XMLEle *newep);
 
 typedef enum
@@ -100,7 +112,7 @@ struct LilXML_
     int delim;     /* attribute value delimiter */
     int lastc;     /* last char (just used with skipping)*/
     int skipping;  /* in comment or declaration */
-    int inblob;    /* in oneBLOB element */
+    int arena;     /* build each tree in its own arena */
 };
 
 /* internal representation of a (possibly nested) XML element */
@@ -116,14 +128,17 @@ struct xml_ele_
     int eit;           /* used to iterate over el[] */
     String pcdata;     /* character data in this element */
     int pcdata_hasent; /* 1 if pcdata contains an entity char*/
+    Arena *arena;      /* where this element lives, NULL for the heap */
+    XMLSymbol tagid;   /* symbol of tag */
 };
 
 /* internal representation of an attribute */
 struct xml_att_
 {
     String name; /* name */
-    String valu; /* value */
-    XMLEle *ce;  /* containing element */
+    String valu;      /* value */
+    XMLEle *ce;       /* containing element */
+    XMLSymbol nameid; /* symbol of name */
 };
 
 /* characters that need escaping as "entities" in attr values and pcdata
@@ -146,6 +161,238 @@ void lilxmlMalloc(void *(*newmalloc)(size_t size), void *(*newrealloc)(void *ptr
     myfree    = newfree;
 }
 
+/* memory of a parsed tree is carved out of a few large blocks, released all at
+ * once with the root. each allocation is preceded by its size so it can still
+ * be grown or freed one by one: the last one grows in place, large ones go to
+ * the heap, others are just forgotten until the tree is deleted.
+ */
+#define ARENA_BLOCK 8192      /* first block size, doubles up to ARENA_MAXBLOCK */
+#define ARENA_MAXBLOCK 65536
+#define ARENA_LARGE 4096      /* bigger allocations go to the heap */
+#define ARENA_ALIGN sizeof(void *)
+#define ARENA_ISLARGE 1       /* flag in the size word */
+
+typedef struct ArenaBlock_
+{
+    struct ArenaBlock_ *next; /* older block */
+    size_t size;
+} ArenaBlock;
+
+typedef struct ArenaLarge_
+{
+    struct ArenaLarge_ *prev, *next;
+} ArenaLarge;
+
+struct Arena_
+{
+    ArenaBlock *blocks; /* newest first */
+    char *top, *end;    /* free space in the newest block */
+    char *last;         /* last small allocation, may grow in place */
+    ArenaLarge head;    /* circular list of large allocations */
+    XMLEle *root;       /* deleting it releases the arena */
+};
+
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_SIZE(p) (((size_t *)(p))[-1])
+
+/* new empty arena, living in its first block */
+static Arena *newArena(void)
+{
+    ArenaBlock *b = (ArenaBlock *)moremem(NULL, ARENA_BLOCK);
+    b->next       = NULL;
+    b->size       = ARENA_BLOCK;
+
+    Arena *a     = (Arena *)(b + 1);
+    a->blocks    = b;
+    a->top       = (char *)b + ARENA_ROUND(sizeof(ArenaBlock) + sizeof(Arena));
+    a->end       = (char *)b + ARENA_BLOCK;
+    a->last      = NULL;
+    a->head.prev = a->head.next = &a->head;
+    a->root      = NULL;
+    return (a);
+}
+
+/* release all memory of arena a, including a itself */
+static void delArena(Arena *a)
+{
+    ArenaLarge *l = a->head.next;
+    while (l != &a->head)
+    {
+        ArenaLarge *next = l->next;
+        (*myfree)(l);
+        l = next;
+    }
+
+    ArenaBlock *b = a->blocks;
+    while (b)
+    {
+        ArenaBlock *next = b->next;
+        (*myfree)(b);
+        b = next;
+    }
+}
+
+/* allocate n bytes in a */
+static void *arenaAlloc(Arena *a, size_t n)
+{
+    n = ARENA_ROUND(n);
+
+    if (n > ARENA_LARGE)
+    {
+        ArenaLarge *l = (ArenaLarge *)moremem(NULL, sizeof(ArenaLarge) + sizeof(size_t) + n);
+        l->prev       = &a->head;
+        l->next       = a->head.next;
+        l->next->prev = l;
+        a->head.next  = l;
+
+        size_t *sz = (size_t *)(l + 1);
+        *sz        = n | ARENA_ISLARGE;
+        return (sz + 1);
+    }
+
+    if (a->top + sizeof(size_t) + n > a->end)
+    {
+        size_t size = a->blocks->size < ARENA_MAXBLOCK ? a->blocks->size * 2 : ARENA_MAXBLOCK;
+        ArenaBlock *b = (ArenaBlock *)moremem(NULL, size);
+        b->next       = a->blocks;
+        b->size       = size;
+        a->blocks     = b;
+        a->top        = (char *)b + ARENA_ROUND(sizeof(ArenaBlock));
+        a->end        = (char *)b + size;
+    }
+
+    size_t *sz = (size_t *)a->top;
+    *sz        = n;
+    a->last    = (char *)(sz + 1);
+    a->top     = a->last + n;
+    return (a->last);
+}
+
+/* like moremem() but in arena a, if any */
+static void *arenamem(Arena *a, void *old, size_t n)
+{
+    if (!a)
+        return (moremem(old, n));
+    if (!old)
+        return (arenaAlloc(a, n));
+
+    size_t oldn = ARENA_SIZE(old);
+    if (oldn & ARENA_ISLARGE)
+    {
+        ArenaLarge *l = (ArenaLarge *)((size_t *)old - 1) - 1;
+        n             = ARENA_ROUND(n);
+        l             = (ArenaLarge *)moremem(l, sizeof(ArenaLarge) + sizeof(size_t) + n);
+        l->prev->next = l;
+        l->next->prev = l;
+
+        size_t *sz = (size_t *)(l + 1);
+        *sz        = n | ARENA_ISLARGE;
+        return (sz + 1);
+    }
+
+    /* last one grows in place while it fits */
+    if (old == a->last && n <= ARENA_LARGE && (char *)old + ARENA_ROUND(n) <= a->end)
+    {
+        n              = ARENA_ROUND(n);
+        ARENA_SIZE(old) = n;
+        a->top         = (char *)old + n;
+        return (old);
+    }
+
+    if (n <= oldn)
+        return (old);
+
+    void *p = arenaAlloc(a, n);
+    memcpy(p, old, oldn);
+    arenafree(a, old);
+    return (p);
+}
+
+/* like free() but in arena a, if any */
+static void arenafree(Arena *a, void *p)
+{
+    if (!a)
+    {
+        if (p)
+            (*myfree)(p);
+        return;
+    }
+    if (!p)
+        return;
+
+    if (ARENA_SIZE(p) & ARENA_ISLARGE)
+    {
+        ArenaLarge *l = (ArenaLarge *)((size_t *)p - 1) - 1;
+        l->prev->next = l->next;
+        l->next->prev = l->prev;
+        (*myfree)(l);
+    }
+    else if (p == a->last)
+    {
+        /* give the space back */
+        a->top  = (char *)p - sizeof(size_t);
+        a->last = NULL;
+    }
+}
+
+/* make room in list for element n, growing it by powers of two */
+static void *growList(Arena *a, void *list, int n, size_t size)
+{
+    if (n == 0)
+        return (arenamem(a, list, 4 * size));
+    if (n >= 4 && (n & (n - 1)) == 0)
+        return (arenamem(a, list, 2 * n * size));
+    return (list);
+}
+
+/* names of the XMLSymbol values, and hash table of them for lookup */
+#define XML_SYMBOL_NAME(s) #s,
+static const char *symbolNames[XMLSYM_COUNT] = { "", XML_SYMBOLS(XML_SYMBOL_NAME) };
+#define SYMBOL_SLOTS 256 /* power of 2, well above XMLSYM_COUNT */
+
+static unsigned int symbolHash(const char *s, int len)
+{
+    unsigned int h = 2166136261u; /* FNV-1a */
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return (h);
+}
+
+static int initSymbolTable(unsigned char *table)
+{
+    memset(table, XMLSYM_UNKNOWN, SYMBOL_SLOTS);
+    for (int id = 1; id < XMLSYM_COUNT; id++)
+    {
+        unsigned int h = symbolHash(symbolNames[id], int(strlen(symbolNames[id])));
+        while (table[h & (SYMBOL_SLOTS - 1)] != XMLSYM_UNKNOWN)
+            h++;
+        table[h & (SYMBOL_SLOTS - 1)] = (unsigned char)id;
+    }
+    return (1);
+}
+
+/* symbol of the len chars at s, XMLSYM_UNKNOWN if none */
+static XMLSymbol lookupSymbol(const char *s, int len)
+{
+    static unsigned char table[SYMBOL_SLOTS];
+    static int ready = initSymbolTable(table);
+    (void)ready;
+
+    for (unsigned int h = symbolHash(s, len);; h++)
+    {
+        int id = table[h & (SYMBOL_SLOTS - 1)];
+        if (id == XMLSYM_UNKNOWN)
+            return (XMLSYM_UNKNOWN);
+        if (!strncmp(symbolNames[id], s, len) && symbolNames[id][len] == '\0')
+            return ((XMLSymbol)id);
+    }
+}
+
+XMLSymbol symbolXML(const char *name)
+{
+    return (lookupSymbol(name, int(strlen(name))));
+}
+
 /* pass back a fresh handle for use with our other functions */
 LilXML *newLilXML()
 {
@@ -155,6 +402,12 @@ LilXML *newLilXML()
     return (lp);
 }
 
+/* build every tree parsed by lp in its own arena, released in one go by delXMLEle() on the root */
+void lilxmlArena(LilXML *lp, int on)
+{
+    lp->arena = on;
+}
+
 /* discard */
 void delLilXML(LilXML *lp)
 {
@@ -172,6 +425,13 @@ void delXMLEle(XMLEle *ep)
     if (!ep)
         return;
 
+    /* the whole tree goes at once with its arena */
+    if (ep->arena && ep->arena->root == ep)
+    {
+        delArena(ep->arena);
+        return;
+    }
+
     /* delete all parts of ep */
     freeString(&ep->tag);
     freeString(&ep->pcdata);
@@ -179,7 +439,7 @@ void delXMLEle(XMLEle *ep)
     {
         for (i = 0; i < ep->nat; i++)
             freeAtt(ep->at[i]);
-        (*myfree)(ep->at);
+        arenafree(ep->arena, ep->at);
     }
     if (ep->el)
     {
@@ -190,7 +450,7 @@ void delXMLEle(XMLEle *ep)
 
             delXMLEle(ep->el[i]);
         }
-        (*myfree)(ep->el);
+        arenafree(ep->arena, ep->el);
     }
 
     /* remove from parent's list if known */
@@ -208,10 +468,9 @@ void delXMLEle(XMLEle *ep)
     }
 
     /* delete ep itself */
-    (*myfree)(ep);
+    arenafree(ep->arena, ep);
 }
 
-//#define WITH_MEMCHR
 XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
 {
     unsigned int nnodes     = 1;
@@ -221,80 +480,20 @@ XMLEle **parseXMLChunk(LilXML *lp, char *buf, int size, char ynot[])
     int s;
     ynot[0] = '\0';
 
-    if (lp->inblob)
-    {
-#ifdef WITH_ENCLEN
-        if (size < lp->ce->pcdata.sm - lp->ce->pcdata.sl)
-        {
-            memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-            lp->ce->pcdata.sl += size;
-            return nodes;
-        }
-        else
-            lp->inblob = 0;
-#endif
-#ifdef WITH_MEMCHR
-        char *ltpos = memchr(buf, '<', size);
-        if (!ltpos)
-        {
-            lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-            lp->ce->pcdata.sm += size;
-            memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-            lp->ce->pcdata.sl += size;
-            return nodes;
-        }
-        else
-            lp->inblob = 0;
-#endif
-    }
-    else
+    while (curr - buf < size)
     {
-        if (lp->ce)
+        /* take whole runs of plain characters at once when the state allows */
+        if (!lp->skipping && lp->lastc != '<')
         {
-            char *ctag = tagXMLEle(lp->ce);
-            if (ctag && !(strcmp(ctag, "oneBLOB")) && (lp->cs == INCON))
+            int n = scanXMLrun(lp, curr, buf + size);
+            if (n > 0)
             {
-#ifdef WITH_ENCLEN
-                XMLAtt *blenatt = findXMLAtt(lp->ce, "enclen");
-                if (blenatt)
-                {
-                    int blen;
-                    sscanf(valuXMLAtt(blenatt), "%d", &blen);
-
-                    // Add room for those '\n' on every 72 character line + extra half-full line.
-                    blen += (blen / 72) + 1;
-
-                    lp->ce->pcdata.s  = (char *)moremem(lp->ce->pcdata.s, blen);
-                    lp->ce->pcdata.sm = blen; // always set sm
-
-                    if (size <= blen - lp->ce->pcdata.sl)
-                    {
-                        memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-                        lp->ce->pcdata.sl += size;
-                        lp->inblob = 1;
-                        return nodes;
-                    }
-                }
-#endif
-#ifdef WITH_MEMCHR
-                char *ltpos = memchr(buf, '<', size);
-                if (!ltpos)
-                {
-                    lp->ce->pcdata.s = (char *)moremem(lp->ce->pcdata.s, lp->ce->pcdata.sm + size);
-                    lp->ce->pcdata.sm += size;
-                    memcpy((void *)(lp->ce->pcdata.s + lp->ce->pcdata.sl), (const void *)buf, size);
-                    lp->ce->pcdata.sl += size;
-                    lp->inblob = 1;
-                    return nodes;
-                }
-                else
-                    lp->inblob = 0;
-#endif
+                lp->lastc = curr[n - 1];
+                curr += n;
+                continue;
             }
         }
-    }
-    while (curr - buf < size)
-    {
+
         char newc = *curr;
         /* EOF? */
         if (newc == 0)
@@ -531,6 +730,34 @@ XMLAtt *findXMLAtt(XMLEle *ep, const char *name)
     return (NULL);
 }
 
+/* search ep for an attribute with given name symbol.
+ * return NULL if not found.
+ */
+XMLAtt *findXMLAttById(XMLEle *ep, XMLSymbol id)
+{
+    if (id == XMLSYM_UNKNOWN)
+        return (NULL);
+
+    for (int i = 0; i < ep->nat; i++)
+        if (ep->at[i]->nameid == id)
+            return (ep->at[i]);
+    return (NULL);
+}
+
+/* search ep for an element with given tag symbol.
+ * return NULL if not found.
+ */
+XMLEle *findXMLEleById(XMLEle *ep, XMLSymbol id)
+{
+    if (id == XMLSYM_UNKNOWN)
+        return (NULL);
+
+    for (int i = 0; i < ep->nel; i++)
+        if (ep->el[i]->tagid == id)
+            return (ep->el[i]);
+    return (NULL);
+}
+
 /* search ep for an element with given tag.
  * return NULL if not found.
  */
@@ -602,6 +829,12 @@ char *tagXMLEle(XMLEle *ep)
     return (ep->tag.s);
 }
 
+/* return the symbol of the tag of the given element */
+XMLSymbol tagIdXMLEle(XMLEle *ep)
+{
+    return (ep->tagid);
+}
+
 /* return the pcdata portion of the given element */
 char *pcdataXMLEle(XMLEle *ep)
 {
@@ -620,6 +853,12 @@ char *nameXMLAtt(XMLAtt *ap)
     return (ap->name.s);
 }
 
+/* return the symbol of the name of the given attribute */
+XMLSymbol nameIdXMLAtt(XMLAtt *ap)
+{
+    return (ap->nameid);
+}
+
 /* return the value of the given attribute */
 char *valuXMLAtt(XMLAtt *ap)
 {
@@ -647,6 +886,13 @@ const char *findXMLAttValu(XMLEle *ep, const char *name)
     return (a ? a->valu.s : "");
 }
 
+/* return the value of the attribute with the given name symbol, or "" */
+const char *findXMLAttValuById(XMLEle *ep, XMLSymbol id)
+{
+    XMLAtt *a = findXMLAttById(ep, id);
+    return (a ? a->valu.s : "");
+}
+
 /* handy wrapper to read one xml file.
  * return root element else NULL with report in ynot[]
  */
@@ -669,8 +915,9 @@ XMLEle *readXMLFile(FILE *fp, LilXML *lp, char ynot[])
  */
 XMLEle *addXMLEle(XMLEle *parent, const char *tag)
 {
-    XMLEle *ep = growEle(parent);
+    XMLEle *ep = growEle(parent, NULL);
     appendString(&ep->tag, tag);
+    ep->tagid = lookupSymbol(ep->tag.s, ep->tag.sl);
     return (ep);
 }
 
@@ -679,7 +926,7 @@ XMLEle *addXMLEle(XMLEle *parent, const char *tag)
  */
 static void appXMLEle(XMLEle *ep, XMLEle *newep)
 {
-    ep->el            = (XMLEle **)moremem(ep->el, (ep->nel + 1) * sizeof(XMLEle *));
+    ep->el            = (XMLEle **)growList(ep->arena, ep->el, ep->nel, sizeof(XMLEle *));
     ep->el[ep->nel++] = newep;
 }
 
@@ -690,6 +937,7 @@ XMLEle *setXMLEleTag(XMLEle *ep, const char * tag)
     freeString(&ep->tag);
     newString(&ep->tag);
     appendString(&ep->tag, tag);
+    ep->tagid = lookupSymbol(ep->tag.s, ep->tag.sl);
     return ep;
 }
 
@@ -708,6 +956,7 @@ XMLAtt *addXMLAtt(XMLEle *ep, const char *name, const char *valu)
     XMLAtt *ap = growAtt(ep);
     appendString(&ap->name, name);
     appendString(&ap->valu, valu);
+    ap->nameid = lookupSymbol(ap->name.s, ap->name.sl);
     return (ap);
 }
 
@@ -1090,8 +1339,12 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
 
         case INTAG: /* reading tag */
             if (isTokenChar(0, c))
+            {
                 growString(&lp->ce->tag, c);
-            else if (c == '>')
+                break;
+            }
+            lp->ce->tagid = lookupSymbol(lp->ce->tag.s, lp->ce->tag.sl);
+            if (c == '>')
                 lp->cs = LOOK4CON;
             else if (c == '/')
                 lp->cs = SAWSLASH;
@@ -1136,7 +1389,11 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
             if (isTokenChar(0, c))
                 growString(&lp->ce->at[lp->ce->nat - 1]->name, c);
             else if (isspace(c) || c == '=')
-                lp->cs = LOOK4ATTRV;
+            {
+                XMLAtt *ap = lp->ce->at[lp->ce->nat - 1];
+                ap->nameid = lookupSymbol(ap->name.s, ap->name.sl);
+                lp->cs     = LOOK4ATTRV;
+            }
             else
             {
                 sprintf(ynot, "Line %d: Bogus attr name char: %c", lp->ln, c);
@@ -1300,15 +1557,144 @@ static int oneXMLchar(LilXML *lp, int c, char ynot[])
     return (0);
 }
 
+/* number of new lines in the n chars at p */
+static int countLines(const char *p, int n)
+{
+    const char *end = p + n;
+    int l = 0;
+    while ((p = (const char *)memchr(p, '\n', end - p)) != NULL)
+    {
+        l++;
+        p++;
+    }
+    return (l);
+}
+
+/* make room at once for the content of a BLOB announced by its enclen attribute,
+ * with fast BLOB support (WITH_ENCLEN). the base64 data is sent by lines of 72 characters.
+ */
+static void reserveBlob(XMLEle *ep)
+{
+#ifndef WITH_ENCLEN
+    (void)ep;
+#else
+    if (ep->tagid != XMLSYM_oneBLOB)
+        return;
+
+    XMLAtt *ap = findXMLAttById(ep, XMLSYM_enclen);
+    if (!ap)
+        return;
+
+    long len = atol(ap->valu.s);
+    if (len <= 0 || len > INT_MAX / 2)
+        return;
+    len += len / 72 + 2;
+
+    if (len > ep->pcdata.sm)
+    {
+        ep->pcdata.s  = (char *)arenamem(ep->pcdata.arena, ep->pcdata.s, len);
+        ep->pcdata.sm = int(len);
+    }
+#endif
+}
+
+/* consume at once the run of chars starting at p that oneXMLchar() would just
+ * collect or skip in the current state. requires no pending '<' nor skipping.
+ * return the number of chars consumed, 0 if the first one needs oneXMLchar().
+ */
+static int scanXMLrun(LilXML *lp, const char *p, const char *end)
+{
+    const char *q = p;
+
+    switch (lp->cs)
+    {
+        case LOOK4START: /* ignored until '<' */
+        {
+            const char *stop = (const char *)memchr(p, '<', end - p);
+            if (!stop)
+                stop = end;
+            const char *nul = (const char *)memchr(p, '\0', stop - p);
+            q = nul ? nul : stop;
+            lp->ln += countLines(p, int(q - p));
+            break;
+        }
+
+        case LOOK4ATTRN: /* leading whitespace is skipped */
+        case LOOK4CON:
+            while (q < end && isspace((unsigned char)*q))
+                q++;
+            lp->ln += countLines(p, int(q - p));
+            break;
+
+        case INTAG: /* tokens */
+            while (q < end && isTokenChar(0, (unsigned char)*q))
+                q++;
+            appendBytes(&lp->ce->tag, p, int(q - p));
+            break;
+
+        case INATTRN:
+            while (q < end && isTokenChar(0, (unsigned char)*q))
+                q++;
+            appendBytes(&lp->ce->at[lp->ce->nat - 1]->name, p, int(q - p));
+            break;
+
+        case INCLOSETAG:
+            while (q < end && isTokenChar(0, (unsigned char)*q))
+                q++;
+            appendBytes(&lp->endtag, p, int(q - p));
+            break;
+
+        case INATTRV: /* up to delimiter, entity or control char */
+            while (q < end && *q != lp->delim && *q != '&' && *q != '<' && *q != '\0' && !iscntrl((unsigned char)*q))
+                q++;
+            appendBytes(&lp->ce->at[lp->ce->nat - 1]->valu, p, int(q - p));
+            break;
+
+        case INCON: /* up to markup or entity, this is where BLOBs go */
+        {
+            const char *stop = (const char *)memchr(p, '<', end - p);
+            if (!stop)
+                stop = end;
+            const char *amp = (const char *)memchr(p, '&', stop - p);
+            if (amp)
+                stop = amp;
+            const char *nul = (const char *)memchr(p, '\0', stop - p);
+            q = nul ? nul : stop;
+            if (q == p)
+                break;
+
+            if (lp->ce->pcdata.sl <= 1)
+                reserveBlob(lp->ce);
+            appendBytes(&lp->ce->pcdata, p, int(q - p));
+            lp->ln += countLines(p, int(q - p));
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return (int(q - p));
+}
+
 /* set up for a fresh start again */
 static void initParser(LilXML *lp)
 {
-    delXMLEle(lp->ce);
-    freeString(&lp->endtag);
+    /* drop the whole tree in progress, not just the current element */
+    XMLEle *root = lp->ce;
+    while (root && root->pe)
+        root = root->pe;
+    delXMLEle(root);
+
+    /* keep endtag memory for the next tree */
+    int arena     = lp->arena;
+    String endtag = lp->endtag;
     memset(lp, 0, sizeof(*lp));
-    newString(&lp->endtag);
-    lp->cs = LOOK4START;
-    lp->ln = 1;
+    lp->endtag = endtag;
+    resetEndTag(lp);
+    lp->cs     = LOOK4START;
+    lp->ln     = 1;
+    lp->arena  = arena;
 }
 
 /* start a new XMLEle.
@@ -1318,7 +1704,14 @@ static void initParser(LilXML *lp)
  */
 static void pushXMLEle(LilXML *lp)
 {
-    lp->ce = growEle(lp->ce);
+    if (!lp->ce && lp->arena)
+    {
+        Arena *a = newArena();
+        lp->ce   = growEle(NULL, a);
+        a->root  = lp->ce;
+    }
+    else
+        lp->ce = growEle(lp->ce, NULL);
     resetEndTag(lp);
 }
 
@@ -1331,19 +1724,27 @@ static void popXMLEle(LilXML *lp)
     resetEndTag(lp);
 }
 
-/* return one new XMLEle, added to the given element if given */
-static XMLEle *growEle(XMLEle *pe)
+/* return one new XMLEle, added to the given element if given.
+ * it lives in the arena of pe, else in a if not NULL, else on the heap.
+ */
+static XMLEle *growEle(XMLEle *pe, Arena *a)
 {
-    XMLEle *newe = (XMLEle *)moremem(NULL, sizeof(XMLEle));
+    if (pe)
+        a = pe->arena;
+
+    XMLEle *newe = (XMLEle *)arenamem(a, NULL, sizeof(XMLEle));
 
     memset(newe, 0, sizeof(XMLEle));
+    newe->arena        = a;
+    newe->tag.arena    = a;
+    newe->pcdata.arena = a;
     newString(&newe->tag);
     newString(&newe->pcdata);
     newe->pe = pe;
 
     if (pe)
     {
-        pe->el            = (XMLEle **)moremem(pe->el, (pe->nel + 1) * sizeof(XMLEle *));
+        pe->el            = (XMLEle **)growList(a, pe->el, pe->nel, sizeof(XMLEle *));
         pe->el[pe->nel++] = newe;
     }
 
@@ -1353,14 +1754,16 @@ static XMLEle *growEle(XMLEle *pe)
 /* add room for and return one new XMLAtt to the given element */
 static XMLAtt *growAtt(XMLEle *ep)
 {
-    XMLAtt *newa = (XMLAtt *)moremem(NULL, sizeof * newa);
+    XMLAtt *newa = (XMLAtt *)arenamem(ep->arena, NULL, sizeof * newa);
 
     memset(newa, 0, sizeof(*newa));
+    newa->name.arena = ep->arena;
+    newa->valu.arena = ep->arena;
     newString(&newa->name);
     newString(&newa->valu);
     newa->ce = ep;
 
-    ep->at            = (XMLAtt **)moremem(ep->at, (ep->nat + 1) * sizeof(XMLAtt *));
+    ep->at            = (XMLAtt **)growList(ep->arena, ep->at, ep->nat, sizeof(XMLAtt *));
     ep->at[ep->nat++] = newa;
 
     return (newa);
@@ -1373,14 +1776,16 @@ static void freeAtt(XMLAtt *a)
         return;
     freeString(&a->name);
     freeString(&a->valu);
-    (*myfree)(a);
+    arenafree(a->ce->arena, a);
 }
 
-/* reset endtag */
+/* reset endtag, keeping its memory */
 static void resetEndTag(LilXML *lp)
 {
-    freeString(&lp->endtag);
-    newString(&lp->endtag);
+    if (!lp->endtag.s)
+        newString(&lp->endtag);
+    lp->endtag.sl   = 0;
+    lp->endtag.s[0] = '\0';
 }
 
 /* 1 if c is a valid token character, else 0.
@@ -1402,7 +1807,7 @@ static void growString(String *sp, int c)
             newString(sp);
         else
         {
-            sp->s = (char *)moremem(sp->s, sp->sm *= 2);
+            sp->s = (char *)arenamem(sp->arena, sp->s, sp->sm *= 2);
         }
     }
     sp->s[--l] = '\0';
@@ -1425,7 +1830,7 @@ static void appendString(String *sp, const char *str)
             newString(sp);
         if (l > sp->sm)
         {
-            sp->s = (char *)moremem(sp->s, (sp->sm = l));
+            sp->s = (char *)arenamem(sp->arena, sp->s, (sp->sm = l));
         }
     }
     if (sp->s)
@@ -1435,23 +1840,48 @@ static void appendString(String *sp, const char *str)
     }
 }
 
+/* append the n chars at str to the String storage at *sp */
+static void appendBytes(String *sp, const char *str, int n)
+{
+    if (n <= 0)
+        return;
+
+    int l = sp->sl + n + 1; /* need room for '\0' */
+
+    if (l > sp->sm)
+    {
+        if (!sp->s)
+            newString(sp);
+        if (l > sp->sm)
+        {
+            /* keep growing geometrically, runs may come in small pieces */
+            int sm = sp->sm;
+            while (sm < l)
+                sm = (sm > INT_MAX / 2) ? l : sm * 2;
+            sp->s = (char *)arenamem(sp->arena, sp->s, (sp->sm = sm));
+        }
+    }
+    memcpy(&sp->s[sp->sl], str, n);
+    sp->sl += n;
+    sp->s[sp->sl] = '\0';
+}
+
 /* init a String with a malloced string containing just \0 */
 static void newString(String *sp)
 {
     if (!sp)
         return;
 
-    sp->s  = (char *)moremem(NULL, MINMEM);
+    sp->s  = (char *)arenamem(sp->arena, NULL, MINMEM);
     sp->sm = MINMEM;
     *sp->s = '\0';
     sp->sl = 0;
 }
 
-/* free memory used by the given String */
+/* free memory used by the given String, it stays in the same arena */
 static void freeString(String *sp)
 {
-    if (sp->s)
-        (*myfree)(sp->s);
+    arenafree(sp->arena, sp->s);
     sp->s  = NULL;
     sp->sl = 0;
     sp->sm = 0;
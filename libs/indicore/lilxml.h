@@ -75,6 +75,27 @@ typedef struct xml_att_ XMLAtt;
 typedef struct xml_ele_ XMLEle;
 typedef struct LilXML_ LilXML;
 
+/* tags and attribute names of the INDI protocol, resolved once when parsed */
+#define XML_SYMBOLS(X) \
+    X(device) X(name) X(label) X(group) X(state) X(perm) X(rule) X(timeout) X(timestamp) \
+    X(message) X(format) X(size) X(len) X(enclen) X(attached) X(min) X(max) X(step) X(version) X(uid) \
+    X(getProperties) X(delProperty) X(enableBLOB) X(pingRequest) X(pingReply) \
+    X(defTextVector) X(defNumberVector) X(defSwitchVector) X(defLightVector) X(defBLOBVector) \
+    X(defText) X(defNumber) X(defSwitch) X(defLight) X(defBLOB) \
+    X(setTextVector) X(setNumberVector) X(setSwitchVector) X(setLightVector) X(setBLOBVector) \
+    X(newTextVector) X(newNumberVector) X(newSwitchVector) X(newBLOBVector) \
+    X(oneText) X(oneNumber) X(oneSwitch) X(oneLight) X(oneBLOB)
+
+#define XML_SYMBOL_ENUM(s) XMLSYM_##s,
+
+/** \brief Known tags and attribute names. XMLSYM_UNKNOWN for any other name. */
+typedef enum
+{
+    XMLSYM_UNKNOWN = 0,
+    XML_SYMBOLS(XML_SYMBOL_ENUM)
+    XMLSYM_COUNT
+} XMLSymbol;
+
 /**
  * \defgroup lilxmlFunctions XML Functions: Functions to parse, process, and search XML.
  */
@@ -92,6 +113,20 @@ extern LilXML *newLilXML();
 */
 extern void delLilXML(LilXML *lp);
 
+/** \brief Install the memory allocator used for all lilxml memory.
+    N.B. don't call after first use of any other lilxml function.
+*/
+extern void lilxmlMalloc(void *(*newmalloc)(size_t size), void *(*newrealloc)(void *ptr, size_t size),
+                         void (*newfree)(void *ptr));
+
+/** \brief Build each tree parsed by a lilxml parser in its own arena.
+    The tree then takes a few blocks of memory instead of one allocation per element, attribute and string,
+    and delXMLEle() on its root releases them at once. Elements of such a tree must not be moved to another tree.
+    \param lp a pointer to a lilxml parser.
+    \param on 1 to use an arena for the next trees, 0 to allocate each part on the heap (default).
+*/
+extern void lilxmlArena(LilXML *lp, int on);
+
 /**
  * @brief delXMLEle Delete XML element.
  * @param e Pointer to XML element to delete. If nullptr, no action is taken.
@@ -99,6 +134,7 @@ extern void delLilXML(LilXML *lp);
 extern void delXMLEle(XMLEle *e);
 
 /** \brief Process an XML chunk.
+    Runs of content, tokens and attribute values are scanned and copied at once, so feeding large chunks is much faster than readXMLEle.
     \param lp a pointer to a lilxml parser.
     \param buf buffer to process.
     \param size size of buf
@@ -130,6 +166,20 @@ extern XMLAtt *findXMLAtt(XMLEle *e, const char *name);
 */
 extern XMLEle *findXMLEle(XMLEle *e, const char *tag);
 
+/** \brief Find an XML attribute within an XML element, by its symbol.
+    \param e a pointer to the XML element to search.
+    \param id the symbol of the attribute name to search for.
+    \return A pointer to the XML attribute if found or NULL on failure.
+*/
+extern XMLAtt *findXMLAttById(XMLEle *e, XMLSymbol id);
+
+/** \brief Find an XML element within an XML element, by its symbol.
+    \param e a pointer to the XML element to search.
+    \param id the symbol of the element tag to search for.
+    \return A pointer to the XML element if found or NULL on failure.
+*/
+extern XMLEle *findXMLEleById(XMLEle *e, XMLSymbol id);
+
 /* iteration functions */
 /** \brief Iterate an XML element for a list of nesetd XML elements.
     \param ep a pointer to the XML element to iterate.
@@ -163,6 +213,12 @@ extern XMLEle *parentXMLAtt(XMLAtt *ap);
 */
 extern char *tagXMLEle(XMLEle *ep);
 
+/** \brief Return the symbol of the tag of an XML element.
+    \param ep a pointer to an XML element.
+    \return the tag symbol, XMLSYM_UNKNOWN if it is not a known one.
+*/
+extern XMLSymbol tagIdXMLEle(XMLEle *ep);
+
 /** \brief Return the pcdata of an XML element.
     \param ep a pointer to an XML element.
     \return the pcdata string on success.
@@ -175,6 +231,12 @@ extern char *pcdataXMLEle(XMLEle *ep);
 */
 extern char *nameXMLAtt(XMLAtt *ap);
 
+/** \brief Return the symbol of the name of an XML attribute.
+    \param ap a pointer to an XML attribute.
+    \return the name symbol, XMLSYM_UNKNOWN if it is not a known one.
+*/
+extern XMLSymbol nameIdXMLAtt(XMLAtt *ap);
+
 /** \brief Return the value of an XML attribute.
     \param ap a pointer to an XML attribute.
     \return the value string of the attribute.
@@ -251,6 +313,19 @@ extern char *entityXML(char *str);
 */
 extern const char *findXMLAttValu(XMLEle *ep, const char *name);
 
+/** \brief Find an XML element's attribute value, by its symbol.
+    \param ep a pointer to an XML element.
+    \param id the symbol of the XML attribute to retrieve its value.
+    \return the value string of an XML element on success. An empty string on failure.
+*/
+extern const char *findXMLAttValuById(XMLEle *ep, XMLSymbol id);
+
+/** \brief Return the symbol of a tag or attribute name.
+    \param name the name to resolve.
+    \return its symbol, XMLSYM_UNKNOWN if it is not a known one.
+*/
+extern XMLSymbol symbolXML(const char *name);
+
 /** \brief return a surface copy of a node.
     Don't copy childs or cdata.
     \return a new independent node
@@ -27,6 +27,7 @@
 #endif
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <stdio.h>
 
@@ -38,22 +39,27 @@
 
 #ifdef ENABLE_INDI_SHARED_MEMORY
 #include "shm_open_anon.h"
-static pthread_mutex_t shared_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t shared_buffer_lock = PTHREAD_RWLOCK_INITIALIZER;
 #endif
 
 // A shared buffer will be allocated by chunk of at least 1M (must be ^ 2)
 #define BLOB_SIZE_UNIT 0x100000
+// Reserved address space is aligned for transparent huge pages
+#define BLOB_MAP_ALIGN 0x200000
 
 typedef struct shared_buffer
 {
     void * mapstart;
     size_t size;
     size_t allocated;
+    size_t reserved; // address space reserved at mapstart for growing in place
     int fd;
     int sealed;
-    struct shared_buffer * prev, *next;
+    int external; // mapping and fd owned by the caller of IDSharedBlobRegister
+    struct shared_buffer * next; // in the same hash bucket
 } shared_buffer;
 
+#ifdef ENABLE_INDI_SHARED_MEMORY
 /* Return the buffer size required for storage (rounded to next BLOB_SIZE_UNIT) */
 static size_t allocation(size_t storage)
 {
@@ -64,30 +70,244 @@ static size_t allocation(size_t storage)
     return (storage + BLOB_SIZE_UNIT - 1) & ~(BLOB_SIZE_UNIT - 1);
 }
 
-#ifdef ENABLE_INDI_SHARED_MEMORY
 static void sharedBufferAdd(shared_buffer * sb);
 static shared_buffer * sharedBufferRemove(void * mapstart);
+
+// Address space is plentiful only on 64 bits systems
+#if UINTPTR_MAX > 0xffffffff
+#define DEFAULT_RESERVE_FACTOR 4
+#else
+#define DEFAULT_RESERVE_FACTOR 1
+#endif
+
+static unsigned int reserveFactor = DEFAULT_RESERVE_FACTOR;
+
+/* Return the address space to reserve for a buffer of allocated bytes, at least minimum */
+static size_t reservation(size_t allocated, size_t minimum)
+{
+    size_t reserved = allocated * __atomic_load_n(&reserveFactor, __ATOMIC_RELAXED);
+    if (reserved < minimum)
+    {
+        reserved = allocation(minimum);
+    }
+    return reserved > allocated ? reserved : allocated;
+}
+
+/* Reserve reserved bytes of address space, without backing memory */
+static void * reserveAddressSpace(size_t reserved)
+{
+    size_t length = reserved + BLOB_MAP_ALIGN;
+    char * start = mmap(0, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) return MAP_FAILED;
+
+    // Keep an aligned range, release the rest
+    char * aligned = (char *)(((uintptr_t)start + BLOB_MAP_ALIGN - 1) & ~(uintptr_t)(BLOB_MAP_ALIGN - 1));
+    if (aligned > start)
+    {
+        munmap(start, aligned - start);
+    }
+    munmap(aligned + reserved, start + length - (aligned + reserved));
+    return aligned;
+}
+
+/* Map length bytes of fd from offset at addr, inside an address space reservation */
+static int mapFixed(void * addr, size_t length, int fd, size_t offset)
+{
+    void * ret = mmap(addr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset);
+    if (ret == MAP_FAILED) return -1;
+#ifdef MADV_HUGEPAGE
+    // Best effort: depends on /sys/kernel/mm/transparent_hugepage/shmem_enabled
+    madvise(addr, length, MADV_HUGEPAGE);
+#endif
+    return 0;
+}
+
+/* Pool of unsealed buffers, kept when freed for the next allocations.
+ * Sealed buffers are never pooled: other processes may still map them.
+ * Disabled until IDSharedBlobSetPoolSize() sets its limits.
+ */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static shared_buffer * pool = NULL; // chained by next
+static unsigned int poolCount = 0;
+static size_t poolBytes = 0;
+static unsigned int poolMaxCount = 0;
+static size_t poolMaxBytes = 0;
+static unsigned long poolHits = 0, poolMisses = 0;
+
+static void sharedBufferDestroy(shared_buffer * sb)
+{
+    if (munmap(sb->mapstart, sb->reserved) == -1)
+    {
+        perror("shared buffer munmap");
+        _exit(1);
+    }
+    if (close(sb->fd) == -1)
+    {
+        perror("shared buffer close");
+    }
+    free(sb);
+}
+
+/* Keep sb for reuse, return 0 if the pool is full */
+static int poolPut(shared_buffer * sb)
+{
+    int kept = 0;
+    pthread_mutex_lock(&pool_mutex);
+    if (poolCount < poolMaxCount && sb->allocated <= poolMaxBytes - poolBytes)
+    {
+        sb->next = pool;
+        pool = sb;
+        poolCount++;
+        poolBytes += sb->allocated;
+        kept = 1;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return kept;
+}
+
+/* Return true if a is closer than b to allocated bytes: the smallest buffer
+ * large enough, else the largest one.
+ */
+static int betterFit(const shared_buffer * a, const shared_buffer * b, size_t allocated)
+{
+    int aFits = a->allocated >= allocated;
+    int bFits = b->allocated >= allocated;
+    if (aFits != bFits)
+        return aFits;
+    return aFits ? a->allocated < b->allocated : a->allocated > b->allocated;
+}
+
+/* Take the pooled buffer closest to allocated bytes, among those whose reservation holds both allocated
+ * and reserve bytes. Its content is whatever its last user left.
+ */
+static shared_buffer * poolTake(size_t allocated, size_t reserve)
+{
+    pthread_mutex_lock(&pool_mutex);
+    shared_buffer ** best = NULL;
+    for (shared_buffer ** it = &pool; *it; it = &(*it)->next)
+    {
+        if ((*it)->reserved >= allocated && (*it)->reserved >= reserve
+                && (best == NULL || betterFit(*it, *best, allocated)))
+        {
+            best = it;
+        }
+    }
+
+    shared_buffer * sb = NULL;
+    if (best)
+    {
+        sb = *best;
+        *best = sb->next;
+        poolCount--;
+        poolBytes -= sb->allocated;
+        poolHits++;
+    }
+    else
+    {
+        poolMisses++;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return sb;
+}
 #endif
 static shared_buffer * sharedBufferFind(void * mapstart);
 
-void * IDSharedBlobAlloc(size_t size)
+void IDSharedBlobSetPoolSize(unsigned int count, size_t bytes)
 {
 #ifdef ENABLE_INDI_SHARED_MEMORY
-    shared_buffer * sb = (shared_buffer*)malloc(sizeof(shared_buffer));
+    shared_buffer * released = NULL;
+
+    pthread_mutex_lock(&pool_mutex);
+    poolMaxCount = count;
+    poolMaxBytes = bytes;
+    while (poolCount > poolMaxCount || poolBytes > poolMaxBytes)
+    {
+        shared_buffer * sb = pool;
+        pool = sb->next;
+        poolCount--;
+        poolBytes -= sb->allocated;
+        sb->next = released;
+        released = sb;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    while (released)
+    {
+        shared_buffer * sb = released;
+        released = sb->next;
+        sharedBufferDestroy(sb);
+    }
+#else
+    (void)count;
+    (void)bytes;
+#endif
+}
+
+void IDSharedBlobPoolStats(unsigned long * hits, unsigned long * misses)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    pthread_mutex_lock(&pool_mutex);
+    *hits = poolHits;
+    *misses = poolMisses;
+    pthread_mutex_unlock(&pool_mutex);
+#else
+    *hits = 0;
+    *misses = 0;
+#endif
+}
+
+void IDSharedBlobSetReserveFactor(unsigned int factor)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    __atomic_store_n(&reserveFactor, factor > 0 ? factor : 1, __ATOMIC_RELAXED);
+#else
+    (void)factor;
+#endif
+}
+
+void * IDSharedBlobAllocReserve(size_t size, size_t reserve)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    size_t allocated = allocation(size);
+    shared_buffer * sb = poolTake(allocated, reserve);
+    if (sb != NULL)
+    {
+        // Reuse, growing in place if needed
+        if (sb->allocated >= allocated
+                || (ftruncate(sb->fd, allocated) != -1
+                    && mapFixed((char *)sb->mapstart + sb->allocated, allocated - sb->allocated, sb->fd, sb->allocated) != -1))
+        {
+            if (sb->allocated < allocated)
+                sb->allocated = allocated;
+            sb->size = size;
+            sharedBufferAdd(sb);
+            return sb->mapstart;
+        }
+        sharedBufferDestroy(sb);
+    }
+
+    sb = (shared_buffer*)malloc(sizeof(shared_buffer));
     if (sb == NULL) goto ERROR;
 
     sb->size = size;
-    sb->allocated = allocation(size);
+    sb->allocated = allocated;
     sb->sealed = 0;
+    sb->external = 0;
     sb->fd = shm_open_anon();
     if (sb->fd == -1)  goto ERROR;
 
     int ret = ftruncate(sb->fd, sb->allocated);
     if (ret == -1) goto ERROR;
 
-    // FIXME: try to map far more than sb->allocated, to allow efficient mremap
-    sb->mapstart = mmap(0, sb->allocated, PROT_READ | PROT_WRITE, MAP_SHARED, sb->fd, 0);
+    // Reserve more than allocated, so that realloc can grow in place
+    sb->reserved = reservation(sb->allocated, reserve);
+    sb->mapstart = reserveAddressSpace(sb->reserved);
     if (sb->mapstart == MAP_FAILED) goto ERROR;
+    if (mapFixed(sb->mapstart, sb->allocated, sb->fd, 0) == -1)
+    {
+        munmap(sb->mapstart, sb->reserved);
+        goto ERROR;
+    }
 
     sharedBufferAdd(sb);
 
@@ -102,10 +322,16 @@ ERROR:
     }
     return NULL;
 #else
+    (void)reserve;
     return malloc(size);
 #endif
 }
 
+void * IDSharedBlobAlloc(size_t size)
+{
+    return IDSharedBlobAllocReserve(size, 0);
+}
+
 void * IDSharedBlobAttach(int fd, size_t size)
 {
 #ifdef ENABLE_INDI_SHARED_MEMORY
@@ -114,7 +340,9 @@ void * IDSharedBlobAttach(int fd, size_t size)
     sb->fd = fd;
     sb->size = size;
     sb->allocated = size;
+    sb->reserved = size;
     sb->sealed = 1;
+    sb->external = 0;
 
     sb->mapstart = mmap(0, sb->allocated, PROT_READ, MAP_SHARED, sb->fd, 0);
     if (sb->mapstart == MAP_FAILED) goto ERROR;
@@ -135,6 +363,46 @@ ERROR:
     return NULL;
 }
 
+int IDSharedBlobRegister(void * ptr, size_t size, int fd)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    shared_buffer * sb = (shared_buffer*)malloc(sizeof(shared_buffer));
+    if (sb == NULL) return -1;
+
+    sb->mapstart = ptr;
+    sb->fd = fd;
+    sb->size = size;
+    sb->allocated = size;
+    sb->reserved = size;
+    sb->sealed = 0;
+    sb->external = 1;
+
+    sharedBufferAdd(sb);
+    return 0;
+#else
+    (void)ptr;
+    (void)size;
+    (void)fd;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+void IDSharedBlobUnregister(void * ptr)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    shared_buffer * sb = sharedBufferFind(ptr);
+    if (sb == NULL || !sb->external)
+    {
+        fprintf(stderr, "Unregistering unknown shared buffer %p\n", ptr);
+        return;
+    }
+    sharedBufferRemove(ptr);
+    free(sb);
+#else
+    (void)ptr;
+#endif
+}
 
 void IDSharedBlobFree(void * ptr)
 {
@@ -147,16 +415,17 @@ void IDSharedBlobFree(void * ptr)
         return;
     }
 
-    if (munmap(sb->mapstart, sb->allocated) == -1)
+    if (sb->external)
     {
-        perror("shared buffer munmap");
-        _exit(1);
+        // Owned by the caller, only forget it
+        free(sb);
+        return;
     }
-    if (close(sb->fd) == -1)
+
+    if (sb->sealed || !poolPut(sb))
     {
-        perror("shared buffer close");
+        sharedBufferDestroy(sb);
     }
-    free(sb);
 #else
     free(ptr);
 #endif
@@ -172,7 +441,12 @@ void IDSharedBlobDettach(void * ptr)
         free(ptr);
         return;
     }
-    if (munmap(sb->mapstart, sb->allocated) == -1)
+    if (sb->external)
+    {
+        free(sb);
+        return;
+    }
+    if (munmap(sb->mapstart, sb->reserved) == -1)
     {
         perror("shared buffer munmap");
         _exit(1);
@@ -198,9 +472,16 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
         return realloc(ptr, size);
     }
 
-#if defined(_WIN32)
+#ifndef ENABLE_INDI_SHARED_MEMORY
     return NULL;
 #else
+    if (sb->external)
+    {
+        // Can't resize a mapping owned by the caller
+        errno = EPERM;
+        return NULL;
+    }
+
     if (sb->sealed)
     {
         IDSharedBlobFree(ptr);
@@ -215,8 +496,9 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
         return ptr;
     }
 
+    // Buffers taken from the pool may already be larger than needed
     size_t reallocated = allocation(size);
-    if (reallocated == sb->allocated)
+    if (reallocated <= sb->allocated)
     {
         sb->size = size;
         return ptr;
@@ -225,23 +507,53 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
     int ret = ftruncate(sb->fd, reallocated);
     if (ret == -1) return NULL;
 
-#ifdef HAVE_MREMAP
-    void * remaped = mremap(sb->mapstart, sb->allocated, reallocated, MREMAP_MAYMOVE);
+    if (reallocated <= sb->reserved)
+    {
+        // Map the new part in the reserved range: nothing moves
+        if (mapFixed((char *)sb->mapstart + sb->allocated, reallocated - sb->allocated, sb->fd, sb->allocated) == -1)
+            return NULL;
+
+        sb->size = size;
+        sb->allocated = reallocated;
+        return ptr;
+    }
+
+    // Move to a larger reservation
+    size_t reserved = reservation(reallocated, 0);
+    void * remaped = reserveAddressSpace(reserved);
     if (remaped == MAP_FAILED) return NULL;
 
-#else
-    // compatibility path for MACOS
-    if (munmap(sb->mapstart, sb->allocated) == -1)
+    int mapped = -1;
+#ifdef HAVE_MREMAP
+    // Move the page tables, so the pages already written don't fault again
+    if (mremap(sb->mapstart, sb->allocated, sb->allocated, MREMAP_MAYMOVE | MREMAP_FIXED, remaped) != MAP_FAILED)
+        mapped = mapFixed((char *)remaped + sb->allocated, reallocated - sb->allocated, sb->fd, sb->allocated);
+#endif
+    if (mapped == -1)
+    {
+        // The content is in the file, map it again
+        mapped = mapFixed(remaped, reallocated, sb->fd, 0);
+    }
+    if (mapped == -1)
+    {
+        munmap(remaped, reserved);
+        return NULL;
+    }
+
+    if (munmap(sb->mapstart, sb->reserved) == -1)
     {
         perror("shared buffer munmap");
         _exit(1);
     }
-    void * remaped = mmap(0, reallocated, PROT_READ | PROT_WRITE, MAP_SHARED, sb->fd, 0);
-    if (remaped == MAP_FAILED) return NULL;
-#endif
+
     sb->size = size;
     sb->allocated = reallocated;
+    sb->reserved = reserved;
+
+    // Registered by address: move to the bucket of the new one
+    sharedBufferRemove(sb->mapstart);
     sb->mapstart = remaped;
+    sharedBufferAdd(sb);
 
     return remaped;
 #endif
@@ -250,6 +562,11 @@ void * IDSharedBlobRealloc(void * ptr, size_t size)
 static void seal(shared_buffer * sb)
 {
 #ifdef ENABLE_INDI_SHARED_MEMORY
+    if (sb->external)
+    {
+        // The owner decides when the buffer is modified
+        return;
+    }
     void * ret = mmap(sb->mapstart, sb->allocated, PROT_READ, MAP_SHARED | MAP_FIXED, sb->fd, 0);
     if (ret == MAP_FAILED)
     {
@@ -290,29 +607,85 @@ void IDSharedBlobSeal(void * ptr)
 #endif
 }
 
+int IDSharedBlobIsSealed(void * ptr)
+{
+#ifdef ENABLE_INDI_SHARED_MEMORY
+    shared_buffer * sb;
+    sb = sharedBufferFind(ptr);
+    return sb != NULL && sb->sealed;
+#else
+    (void)ptr;
+    return 0;
+#endif
+}
+
 #ifdef ENABLE_INDI_SHARED_MEMORY
-static shared_buffer * first = NULL, *last = NULL;
+/* Registry of the shared buffers, hashed by mapping address.
+ * Lookups only take the lock for reading, so threads don't serialize on them.
+ */
+#define INITIAL_BUCKETS 64
 
-static void sharedBufferAdd(shared_buffer * sb)
+static shared_buffer * initialBuckets[INITIAL_BUCKETS];
+static shared_buffer ** buckets = initialBuckets;
+static size_t bucketCount = INITIAL_BUCKETS; // always a power of 2
+static size_t bufferCount = 0;
+
+static size_t sharedBufferHash(void * mapstart, size_t count)
+{
+    // Mappings are page aligned: drop the low bits, then Fibonacci hashing
+    uint64_t h = (uint64_t)((uintptr_t)mapstart >> 12) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & (count - 1);
+}
+
+/* Double the bucket count when the average chain would exceed one buffer. Lock must be held for writing */
+static void sharedBufferGrow(void)
 {
-    pthread_mutex_lock(&shared_buffer_mutex);
-    // Chained insert at start
-    sb->prev = NULL;
-    sb->next = first;
-    if (first)
+    size_t newCount = bucketCount * 2;
+    shared_buffer ** newBuckets = (shared_buffer **)calloc(newCount, sizeof(shared_buffer *));
+    if (newBuckets == NULL)
     {
-        first->prev = sb;
+        // Keep the current table, only chains get longer
+        return;
     }
-    else
+
+    for (size_t i = 0; i < bucketCount; ++i)
+    {
+        shared_buffer * sb = buckets[i];
+        while(sb)
+        {
+            shared_buffer * next = sb->next;
+            size_t h = sharedBufferHash(sb->mapstart, newCount);
+            sb->next = newBuckets[h];
+            newBuckets[h] = sb;
+            sb = next;
+        }
+    }
+
+    if (buckets != initialBuckets)
+    {
+        free(buckets);
+    }
+    buckets = newBuckets;
+    bucketCount = newCount;
+}
+
+static void sharedBufferAdd(shared_buffer * sb)
+{
+    pthread_rwlock_wrlock(&shared_buffer_lock);
+    if (bufferCount >= bucketCount)
     {
-        last = sb;
+        sharedBufferGrow();
     }
-    first = sb;
-    pthread_mutex_unlock(&shared_buffer_mutex);
+    size_t h = sharedBufferHash(sb->mapstart, bucketCount);
+    sb->next = buckets[h];
+    buckets[h] = sb;
+    bufferCount++;
+    pthread_rwlock_unlock(&shared_buffer_lock);
 }
+
 static shared_buffer * sharedBufferFindUnlocked(void * mapstart)
 {
-    shared_buffer * sb = first;
+    shared_buffer * sb = buckets[sharedBufferHash(mapstart, bucketCount)];
     while(sb)
     {
         if (sb->mapstart == mapstart)
@@ -326,28 +699,21 @@ static shared_buffer * sharedBufferFindUnlocked(void * mapstart)
 
 static shared_buffer * sharedBufferRemove(void * mapstart)
 {
-    pthread_mutex_lock(&shared_buffer_mutex);
-    shared_buffer * sb  = sharedBufferFindUnlocked(mapstart);
-    if (sb != NULL)
+    pthread_rwlock_wrlock(&shared_buffer_lock);
+    shared_buffer ** prev = &buckets[sharedBufferHash(mapstart, bucketCount)];
+    shared_buffer * sb = *prev;
+    while(sb)
     {
-        if (sb->prev)
-        {
-            sb->prev->next = sb->next;
-        }
-        else
-        {
-            first = sb->next;
-        }
-        if (sb->next)
-        {
-            sb->next->prev = sb->prev;
-        }
-        else
+        if (sb->mapstart == mapstart)
         {
-            last = sb->prev;
+            *prev = sb->next;
+            bufferCount--;
+            break;
         }
+        prev = &sb->next;
+        sb = sb->next;
     }
-    pthread_mutex_unlock(&shared_buffer_mutex);
+    pthread_rwlock_unlock(&shared_buffer_lock);
     return sb;
 }
 #endif
@@ -355,9 +721,9 @@ static shared_buffer * sharedBufferRemove(void * mapstart)
 static shared_buffer * sharedBufferFind(void * mapstart)
 {
 #ifdef ENABLE_INDI_SHARED_MEMORY
-    pthread_mutex_lock(&shared_buffer_mutex);
+    pthread_rwlock_rdlock(&shared_buffer_lock);
     shared_buffer * sb  = sharedBufferFindUnlocked(mapstart);
-    pthread_mutex_unlock(&shared_buffer_mutex);
+    pthread_rwlock_unlock(&shared_buffer_lock);
     return sb;
 #else
     (void)mapstart;
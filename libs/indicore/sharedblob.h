@@ -18,6 +18,39 @@ extern void * IDSharedBlobAlloc(size_t size);
  */
 extern void * IDSharedBlobAttach(int fd, size_t size);
 
+/** \brief Allocate like IDSharedBlobAlloc, reserving at least reserve bytes of address space so that IDSharedBlobRealloc grows the buffer in place up to that size.
+ *  A buffer taken from the pool is only reused when its reservation is at least reserve bytes.
+ *  \param reserve bytes to reserve, for example the size of a full frame
+ */
+extern void * IDSharedBlobAllocReserve(size_t size, size_t reserve);
+
+/** \brief Set the address space reserved for each buffer, relative to its allocation, so that IDSharedBlobRealloc grows it in place.
+ *  Defaults to 4 on 64 bits systems and 1, nothing more than the allocation, elsewhere.
+ */
+extern void IDSharedBlobSetReserveFactor(unsigned int factor);
+
+/** \brief Set how many freed buffers are kept for reuse by IDSharedBlobAlloc, at most count buffers and bytes in total.
+ *  The pool is shared by the whole process and disabled by default: freed buffers stay mapped while pooled.
+ *  Only buffers never shared (not sealed) are kept, since other processes may still map the others.
+ *  Like malloc, a buffer served from the pool is not cleared: it holds the data of its previous use.
+ */
+extern void IDSharedBlobSetPoolSize(unsigned int count, size_t bytes);
+
+/** \brief Return the count of IDSharedBlobAlloc calls served from the pool (hits) or by a new buffer (misses).
+ */
+extern void IDSharedBlobPoolStats(unsigned long * hits, unsigned long * misses);
+
+/** \brief Register a buffer owned by the caller, mapped from offset 0 of fd, so that it is sent without copy over local connections.
+ *  The buffer is neither sealed nor resizable, and IDSharedBlobFree or IDSharedBlobUnregister only forget it:
+ *  the caller keeps the mapping and fd, and must not modify the buffer while receivers may read it.
+ *  \return 0 on success, -1 on failure
+ */
+extern int IDSharedBlobRegister(void * ptr, size_t size, int fd);
+
+/** \brief Forget a buffer registered using IDSharedBlobRegister.
+ */
+extern void IDSharedBlobUnregister(void * ptr);
+
 /** \brief Free a buffer allocated using IDSharedBlobAlloc. Fall back to free for buffer that are not shared blob
  * Must be used for IBLOB.data
  */
@@ -42,6 +75,12 @@ extern int IDSharedBlobGetFd(void * ptr);
  */
 extern void IDSharedBlobSeal(void * ptr);
 
+/** \brief Tell whether a buffer was sealed, by IDSharedBlobSeal or by sending it attached to a BLOB.
+ *  A sealed buffer is readonly: the owner must not write to it anymore.
+ *  \return 1 if sealed, 0 otherwise or if not a shared buffer pointer
+ */
+extern int IDSharedBlobIsSealed(void * ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,7 @@
 #include "indicom.h"
 #include "sharedblob.h"
 #include "indistandardproperty.h"
+#include "blobcompression.h"
 #include "locale_compat.h"
 
 #include "indipropertytext.h"
@@ -40,7 +41,6 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
-#include <zlib.h>
 #include <sys/stat.h>
 #include <thread>
 #include <chrono>
@@ -563,7 +563,7 @@ static void for_property(
 
     for (const auto &element : root.getElements())
     {
-        auto * item = typedProperty.findWidgetByName(element.getAttribute("name"));
+        auto * item = typedProperty.findWidgetByName(element.getAttribute(XMLSYM_name));
         if (item)
             function(element, item);
     }
@@ -578,7 +578,8 @@ int BaseDevice::setValue(const INDI::LilXmlElement &root, char *errmsg)
 {
     D_PTR(BaseDevice);
 
-    if (!root.getAttribute("name").isValid())
+    const auto nameAttribute = root.getAttribute(XMLSYM_name);
+    if (!nameAttribute.isValid())
     {
         snprintf(errmsg, MAXRBUF, "INDI: <%s> unable to find name attribute", root.tagName().c_str());
         return -1;
@@ -588,31 +589,23 @@ int BaseDevice::setValue(const INDI::LilXmlElement &root, char *errmsg)
     checkMessage(root.handle());
 
     // find type of tag
-    static const std::map<INDI_PROPERTY_TYPE, std::string> tagTypeName =
-    {
-        {INDI_NUMBER, "setNumberVector"},
-        {INDI_SWITCH, "setSwitchVector"},
-        {INDI_TEXT,   "setTextVector"},
-        {INDI_LIGHT,  "setLightVector"},
-        {INDI_BLOB,   "setBLOBVector"}
-    };
-
-    const auto rootTagName = root.tagName();
-    const auto rootTagType = std::find_if(tagTypeName.begin(), tagTypeName.end(), [&rootTagName](const auto & it)
-    {
-        return rootTagName == it.second;
-    });
-
-    if (rootTagType == tagTypeName.end())
-    {
-        snprintf(errmsg, MAXRBUF, "INDI: <%s> Unable to process tag", rootTagName.c_str());
-        return -1;
+    INDI_PROPERTY_TYPE rootTagType;
+    switch (root.tagId())
+    {
+        case XMLSYM_setNumberVector: rootTagType = INDI_NUMBER; break;
+        case XMLSYM_setSwitchVector: rootTagType = INDI_SWITCH; break;
+        case XMLSYM_setTextVector:   rootTagType = INDI_TEXT;   break;
+        case XMLSYM_setLightVector:  rootTagType = INDI_LIGHT;  break;
+        case XMLSYM_setBLOBVector:   rootTagType = INDI_BLOB;   break;
+        default:
+            snprintf(errmsg, MAXRBUF, "INDI: <%s> Unable to process tag", root.tagName().c_str());
+            return -1;
     }
 
     // update generic values
-    const char * propertyName = root.getAttribute("name").toCString();
+    const char * propertyName = nameAttribute.toCString();
 
-    INDI::Property property = getProperty(propertyName, rootTagType->first);
+    INDI::Property property = getProperty(propertyName, rootTagType);
 
     if (!property.isValid())
     {
@@ -623,11 +616,12 @@ int BaseDevice::setValue(const INDI::LilXmlElement &root, char *errmsg)
     // 1. set overall property state, if any
     {
         bool ok = false;
-        property.setState(root.getAttribute("state").toIPState(&ok));
+        const auto stateAttribute = root.getAttribute(XMLSYM_state);
+        property.setState(stateAttribute.toIPState(&ok));
 
         if (!ok)
         {
-            snprintf(errmsg, MAXRBUF, "INDI: <%s> bogus state %s for %s", rootTagName.c_str(), root.getAttribute("state").toCString(),
+            snprintf(errmsg, MAXRBUF, "INDI: <%s> bogus state %s for %s", root.tagName().c_str(), stateAttribute.toCString(),
                      propertyName);
             return -1;
         }
@@ -637,14 +631,14 @@ int BaseDevice::setValue(const INDI::LilXmlElement &root, char *errmsg)
     {
         AutoCNumeric locale;
         bool ok = false;
-        auto timeoutValue = root.getAttribute("timeout").toDouble(&ok);
+        auto timeoutValue = root.getAttribute(XMLSYM_timeout).toDouble(&ok);
 
         if (ok)
             property.setTimeout(timeoutValue);
     }
 
     // update specific values
-    switch (rootTagType->first)
+    switch (rootTagType)
     {
         case INDI_NUMBER:
         {
@@ -654,8 +648,8 @@ int BaseDevice::setValue(const INDI::LilXmlElement &root, char *errmsg)
                 item->setValue(element.context());
 
                 // Permit changing of min/max
-                if (auto min = element.getAttribute("min")) item->setMin(min);
-                if (auto max = element.getAttribute("max")) item->setMax(max);
+                if (auto min = element.getAttribute(XMLSYM_min)) item->setMin(min);
+                if (auto max = element.getAttribute(XMLSYM_max)) item->setMax(max);
             });
             locale.Restore();
             break;
@@ -748,11 +742,14 @@ static bool sSharedToBlob(const INDI::LilXmlElement &element, INDI::WidgetViewBl
 */
 int BaseDevicePrivate::setBLOB(INDI::PropertyBlob property, const LilXmlElement &root, char *errmsg)
 {
-    for (const auto &element : root.getElementsByTagName("oneBLOB"))
+    for (const auto &element : root.getElements())
     {
-        auto name   = element.getAttribute("name");
-        auto format = element.getAttribute("format");
-        auto size   = element.getAttribute("size");
+        if (element.tagId() != XMLSYM_oneBLOB)
+            continue;
+
+        auto name   = element.getAttribute(XMLSYM_name);
+        auto format = element.getAttribute(XMLSYM_format);
+        auto size   = element.getAttribute(XMLSYM_size);
 
         auto widget = property.findWidgetByName(name);
 
@@ -781,24 +778,34 @@ int BaseDevicePrivate::setBLOB(INDI::PropertyBlob property, const LilXmlElement
             widget->setBlobLen(blobLen);
         }
 
-        if (format.endsWith(".z"))
+        BlobCompression::Codec codec;
+        size_t elementSize = 1;
+        std::string fileFormat;
+        if (BlobCompression::parseFormat(format.toString(), codec, elementSize, fileFormat))
         {
-            widget->setFormat(format.toString().substr(0, format.lastIndexOf(".z")));
+            widget->setFormat(fileFormat);
+
+            if (!BlobCompression::isAvailable(codec))
+            {
+                snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s format %s is not supported by this client",
+                         property.getDeviceName(), property.getName(), widget->getName(), format.toCString());
+                return -1;
+            }
 
-            uLongf dataSize = widget->getSize() * sizeof(uint8_t);
-            Bytef *dataBuffer = static_cast<Bytef *>(malloc(dataSize));
+            size_t dataSize = widget->getSize() * sizeof(uint8_t);
+            uint8_t *dataBuffer = static_cast<uint8_t *>(malloc(dataSize));
 
             if (dataBuffer == nullptr)
             {
                 strncpy(errmsg, "Unable to allocate memory for data buffer", MAXRBUF);
                 return -1;
             }
-            int r = uncompress(dataBuffer, &dataSize, static_cast<unsigned char *>(widget->getBlob()),
-                               static_cast<uLong>(widget->getBlobLen()));
-            if (r != Z_OK)
+            dataSize = BlobCompression::decompress(codec, elementSize, widget->getBlob(), widget->getBlobLen(), dataBuffer,
+                                                   dataSize);
+            if (dataSize == 0)
             {
-                snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s compression error: %d",
-                         property.getDeviceName(), property.getName(), widget->getName(), r);
+                snprintf(errmsg, MAXRBUF, "INDI: %s.%s.%s decompression error",
+                         property.getDeviceName(), property.getName(), widget->getName());
                 free(dataBuffer);
                 return -1;
             }
@@ -0,0 +1,319 @@
+/*******************************************************************************
+  BLOB Compression
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#include "blobcompression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+namespace INDI
+{
+namespace BlobCompression
+{
+
+#ifdef HAVE_LZ4
+static LZ4F_preferences_t lz4Preferences(int level, size_t size)
+{
+    LZ4F_preferences_t preferences;
+    memset(&preferences, 0, sizeof(preferences));
+    preferences.compressionLevel      = level;
+    preferences.frameInfo.contentSize = size;
+    return preferences;
+}
+#endif
+
+bool isAvailable(Codec codec)
+{
+    switch (codec)
+    {
+        case CODEC_ZLIB:
+            return true;
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD:
+            return true;
+#endif
+#ifdef HAVE_LZ4
+        case CODEC_LZ4:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *suffix(Codec codec)
+{
+    switch (codec)
+    {
+        case CODEC_ZLIB:
+            return ".z";
+        case CODEC_ZSTD:
+            return ".zst";
+        case CODEC_LZ4:
+            return ".lz4";
+        default:
+            return "";
+    }
+}
+
+size_t bound(Codec codec, size_t size)
+{
+    switch (codec)
+    {
+        case CODEC_ZLIB:
+            return compressBound(size);
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD:
+            return ZSTD_compressBound(size);
+#endif
+#ifdef HAVE_LZ4
+        case CODEC_LZ4:
+        {
+            LZ4F_preferences_t preferences = lz4Preferences(0, size);
+            return LZ4F_compressFrameBound(size, &preferences);
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+size_t compress(Codec codec, int level, size_t elementSize, const void *source, size_t size,
+                void *destination, size_t capacity)
+{
+    if (!isAvailable(codec))
+        return 0;
+
+    // zlib is kept as it was, old clients do not know about shuffling
+    if (codec == CODEC_ZLIB)
+    {
+        uLongf compressedBytes = capacity;
+        int r = ::compress2(static_cast<Bytef *>(destination), &compressedBytes, static_cast<const Bytef *>(source), size,
+                            level == 0 ? 9 : std::min(std::max(level, 1), 9));
+        return r == Z_OK ? compressedBytes : 0;
+    }
+
+    std::unique_ptr<uint8_t[]> shuffled;
+    if (elementSize > 1)
+    {
+        shuffled.reset(new (std::nothrow) uint8_t[size]);
+        if (!shuffled)
+            return 0;
+        shuffle(source, shuffled.get(), size, elementSize);
+        source = shuffled.get();
+    }
+
+    switch (codec)
+    {
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD:
+        {
+            size_t r = ZSTD_compress(destination, capacity, source, size,
+                                     level == 0 ? ZSTD_CLEVEL_DEFAULT : std::min(level, ZSTD_maxCLevel()));
+            return ZSTD_isError(r) ? 0 : r;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case CODEC_LZ4:
+        {
+            LZ4F_preferences_t preferences = lz4Preferences(level, size);
+            size_t r = LZ4F_compressFrame(destination, capacity, source, size, &preferences);
+            return LZ4F_isError(r) ? 0 : r;
+        }
+#endif
+        default:
+            return 0;
+    }
+}
+
+size_t decompress(Codec codec, size_t elementSize, const void *source, size_t sourceSize, void *destination,
+                  size_t capacity)
+{
+    if (!isAvailable(codec))
+        return 0;
+
+    if (codec == CODEC_ZLIB)
+    {
+        uLongf dataSize = capacity;
+        int r = ::uncompress(static_cast<Bytef *>(destination), &dataSize, static_cast<const Bytef *>(source), sourceSize);
+        return r == Z_OK ? dataSize : 0;
+    }
+
+    // Decompress next to the destination, then unshuffle into it
+    std::unique_ptr<uint8_t[]> shuffled;
+    void *output = destination;
+    if (elementSize > 1)
+    {
+        shuffled.reset(new (std::nothrow) uint8_t[capacity]);
+        if (!shuffled)
+            return 0;
+        output = shuffled.get();
+    }
+
+    size_t size = 0;
+    switch (codec)
+    {
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD:
+        {
+            size_t r = ZSTD_decompress(output, capacity, source, sourceSize);
+            size = ZSTD_isError(r) ? 0 : r;
+            break;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case CODEC_LZ4:
+        {
+            LZ4F_dctx *context = nullptr;
+            if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION)))
+                return 0;
+
+            auto in  = static_cast<const uint8_t *>(source);
+            auto out = static_cast<uint8_t *>(output);
+            size_t read = 0, r = 1;
+            while (r != 0 && read < sourceSize)
+            {
+                size_t outBytes = capacity - size, inBytes = sourceSize - read;
+                r = LZ4F_decompress(context, out + size, &outBytes, in + read, &inBytes, nullptr);
+                if (LZ4F_isError(r) || (outBytes == 0 && inBytes == 0))
+                    break;
+                size += outBytes;
+                read += inBytes;
+            }
+            LZ4F_freeDecompressionContext(context);
+
+            // The frame must be complete
+            if (r != 0)
+                size = 0;
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+    if (size > 0 && elementSize > 1)
+        unshuffle(output, destination, size, elementSize);
+    return size;
+}
+
+std::string format(const std::string &fileFormat, Codec codec, size_t elementSize)
+{
+    std::string blobFormat = fileFormat;
+    if (codec != CODEC_ZLIB && elementSize > 1)
+        blobFormat += ".sh" + std::to_string(elementSize);
+    return blobFormat + suffix(codec);
+}
+
+bool parseFormat(const std::string &blobFormat, Codec &codec, size_t &elementSize, std::string &fileFormat)
+{
+    auto endsWith = [&](const std::string &text, const char *ending)
+    {
+        size_t length = strlen(ending);
+        return text.size() >= length && text.compare(text.size() - length, length, ending) == 0;
+    };
+
+    int found = CODEC_COUNT;
+    for (int i = 0; i < CODEC_COUNT; i++)
+        if (endsWith(blobFormat, suffix(static_cast<Codec>(i))))
+            found = i;
+    if (found == CODEC_COUNT)
+        return false;
+
+    codec       = static_cast<Codec>(found);
+    fileFormat  = blobFormat.substr(0, blobFormat.size() - strlen(suffix(codec)));
+    elementSize = 1;
+
+    // ".shN" before the codec suffix
+    size_t dot = fileFormat.rfind('.');
+    if (codec != CODEC_ZLIB && dot != std::string::npos && fileFormat.compare(dot, 3, ".sh") == 0)
+    {
+        char *end = nullptr;
+        long size = strtol(fileFormat.c_str() + dot + 3, &end, 10);
+        if (size > 0 && size <= 16 && *end == '\0')
+        {
+            elementSize = size;
+            fileFormat.erase(dot);
+        }
+    }
+    return true;
+}
+
+void shuffle(const void *source, void *destination, size_t size, size_t elementSize)
+{
+    auto in  = static_cast<const uint8_t *>(source);
+    auto out = static_cast<uint8_t *>(destination);
+
+    size_t count = elementSize > 1 ? size / elementSize : 0;
+    if (elementSize == 2)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i]         = in[2 * i];
+            out[count + i] = in[2 * i + 1];
+        }
+    }
+    else
+    {
+        for (size_t k = 0; k < elementSize && count > 0; k++)
+            for (size_t i = 0; i < count; i++)
+                out[k * count + i] = in[i * elementSize + k];
+    }
+
+    memcpy(out + count * elementSize, in + count * elementSize, size - count * elementSize);
+}
+
+void unshuffle(const void *source, void *destination, size_t size, size_t elementSize)
+{
+    auto in  = static_cast<const uint8_t *>(source);
+    auto out = static_cast<uint8_t *>(destination);
+
+    size_t count = elementSize > 1 ? size / elementSize : 0;
+    if (elementSize == 2)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[2 * i]     = in[i];
+            out[2 * i + 1] = in[count + i];
+        }
+    }
+    else
+    {
+        for (size_t k = 0; k < elementSize && count > 0; k++)
+            for (size_t i = 0; i < count; i++)
+                out[i * elementSize + k] = in[k * count + i];
+    }
+
+    memcpy(out + count * elementSize, in + count * elementSize, size - count * elementSize);
+}
+
+}
+}
@@ -0,0 +1,95 @@
+/*******************************************************************************
+  BLOB Compression
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Library General Public
+ License version 2 as published by the Free Software Foundation.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Library General Public License for more details.
+
+ You should have received a copy of the GNU Library General Public License
+ along with this library; see the file COPYING.LIB.  If not, write to
+ the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace INDI
+{
+
+/**
+ * @namespace INDI::BlobCompression
+ * @brief Lossless compression of BLOB payloads, shared by drivers and clients.
+ *
+ * The codec is named by the last suffix of the BLOB format: ".z" for zlib, ".zst" for Zstandard and
+ * ".lz4" for an LZ4 frame. Before ".zst" or ".lz4", a ".shN" suffix tells that the bytes of the N-byte
+ * pixels were shuffled before compression: all first bytes, then all second bytes, and so on. The
+ * high bytes of 16 bit astronomical frames barely change, so shuffling them together compresses better
+ * and faster. For example, a 16 bit native frame is sent as ".bin.sh2.zst".
+ */
+namespace BlobCompression
+{
+
+typedef enum
+{
+    CODEC_ZLIB,
+    CODEC_ZSTD,
+    CODEC_LZ4,
+    CODEC_COUNT
+} Codec;
+
+/** @return True if the library was built with the codec. zlib is always available. */
+bool isAvailable(Codec codec);
+
+/** @return The format suffix of the codec, ".z", ".zst" or ".lz4". */
+const char *suffix(Codec codec);
+
+/** @return The largest compressed size of size bytes. */
+size_t bound(Codec codec, size_t size);
+
+/**
+ * @brief compress Shuffle and compress a buffer.
+ * @param codec Compression library.
+ * @param level Compression level of the codec, 0 for its default: 9 for zlib, 3 for Zstandard and the
+ * fast mode for LZ4. Levels above 2 select LZ4 HC.
+ * @param elementSize Size of a pixel in bytes, 1 to not shuffle. zlib ignores it, for the clients that
+ * only know ".z".
+ * @param destination Receives the compressed data, at least bound(codec, size) bytes.
+ * @return The compressed size, 0 on error.
+ */
+size_t compress(Codec codec, int level, size_t elementSize, const void *source, size_t size,
+                void *destination, size_t capacity);
+
+/**
+ * @brief decompress Decompress and unshuffle a buffer.
+ * @param destination Receives the decompressed data, capacity is the size announced with the BLOB.
+ * @return The decompressed size, 0 if the data is corrupt or does not fit.
+ */
+size_t decompress(Codec codec, size_t elementSize, const void *source, size_t sourceSize, void *destination,
+                  size_t capacity);
+
+/** @return The BLOB format of a file compressed with codec, ".bin" becomes ".bin.sh2.zst" for example. */
+std::string format(const std::string &fileFormat, Codec codec, size_t elementSize);
+
+/**
+ * @brief parseFormat Split a compressed BLOB format.
+ * @param fileFormat Receives the format of the decompressed file, ".bin" for ".bin.sh2.zst".
+ * @return False if the format does not end with a known codec suffix.
+ */
+bool parseFormat(const std::string &blobFormat, Codec &codec, size_t &elementSize, std::string &fileFormat);
+
+/** @brief Gather byte k of every element in the k-th plane. Trailing bytes of a partial element are copied. */
+void shuffle(const void *source, void *destination, size_t size, size_t elementSize);
+
+/** @brief Reverse shuffle(). */
+void unshuffle(const void *source, void *destination, size_t size, size_t elementSize);
+
+}
+}
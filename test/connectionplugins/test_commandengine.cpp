@@ -0,0 +1,347 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "indicom.h"
+#include "connectionplugins/commandengine.h"
+
+using Connection::CommandEngine;
+
+/* An LX200 style mount behind a pseudo terminal.
+ * Commands end with '#'. Each reply is written latency ms after its command
+ * was received, as over a network bridge, and replies keep the command order.
+ * ACK (0x06) gets a single char reply without terminator, :Q# gets no reply,
+ * unknown commands get no reply either.
+ */
+class MountEmulator
+{
+    public:
+        explicit MountEmulator(int latencyMs) : latency(latencyMs)
+        {
+            master = posix_openpt(O_RDWR | O_NOCTTY);
+            if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+                throw std::runtime_error("posix_openpt");
+            slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+            if (slave < 0)
+                throw std::runtime_error("open pty slave");
+
+            struct termios tio;
+            tcgetattr(slave, &tio);
+            cfmakeraw(&tio);
+            tcsetattr(slave, TCSANOW, &tio);
+
+            thread = std::thread([this]()
+            {
+                serve();
+            });
+        }
+
+        ~MountEmulator()
+        {
+            running = false;
+            thread.join();
+            close(slave);
+            close(master);
+        }
+
+        int fd() const
+        {
+            return slave;
+        }
+
+        std::atomic<int> received { 0 };
+
+    private:
+        std::string reply(const std::string &command)
+        {
+            static const std::map<std::string, std::string> replies =
+            {
+                { ":GR#", "12:34:56#" },
+                { ":GD#", "+45*12'34#" },
+                { ":GA#", "+30*00'00#" },
+                { ":GZ#", "180*00'00#" },
+                { ":GS#", "06:00:00#" },
+                { ":GL#", "21:00:00#" },
+                { ":GC#", "10/18/26#" },
+                { ":GG#", "+00#" },
+                { ":MS#", "0" },
+                { "\x06", "P" },
+            };
+            auto it = replies.find(command);
+            return it == replies.end() ? std::string() : it->second;
+        }
+
+        void serve()
+        {
+            std::string input;
+            std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> pending;
+
+            while (running)
+            {
+                int waitMs = pending.empty() ? 10 : std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>
+                             (pending.front().first - std::chrono::steady_clock::now()).count());
+                struct pollfd pfd = { master, POLLIN, 0 };
+                if (poll(&pfd, 1, std::min(waitMs, 10)) > 0)
+                {
+                    char buffer[256];
+                    ssize_t rd = read(master, buffer, sizeof(buffer));
+                    if (rd > 0)
+                        input.append(buffer, rd);
+                }
+
+                // Split commands: ACK alone, others end with '#'
+                for (;;)
+                {
+                    size_t length = 0;
+                    if (!input.empty() && input[0] == '\x06')
+                        length = 1;
+                    else if (input.find('#') != std::string::npos)
+                        length = input.find('#') + 1;
+                    if (length == 0)
+                        break;
+
+                    received++;
+                    std::string answer = reply(input.substr(0, length));
+                    input.erase(0, length);
+                    if (!answer.empty())
+                        pending.push_back({ std::chrono::steady_clock::now() + std::chrono::milliseconds(latency), answer });
+                }
+
+                while (!pending.empty() && pending.front().first <= std::chrono::steady_clock::now())
+                {
+                    if (write(master, pending.front().second.data(), pending.front().second.size()) < 0)
+                        return;
+                    pending.pop_front();
+                }
+            }
+        }
+
+        int latency;
+        int master { -1 };
+        int slave { -1 };
+        std::atomic<bool> running { true };
+        std::thread thread;
+};
+
+static const std::vector<std::string> statusQueries = { ":GR#", ":GD#", ":GA#", ":GZ#", ":GS#", ":GL#", ":GC#", ":GG#" };
+
+static double pollStatus(CommandEngine &engine, std::vector<CommandEngine::Reply> &replies)
+{
+    for (const auto &query : statusQueries)
+        engine.queue({query});
+
+    auto start = std::chrono::steady_clock::now();
+    replies = engine.run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(CommandEngine, Test_pipelined_status)
+{
+    const int latency = 30;
+    MountEmulator mount(latency);
+    CommandEngine engine(mount.fd());
+
+    std::vector<CommandEngine::Reply> replies;
+    double elapsed = pollStatus(engine, replies);
+
+    ASSERT_EQ(statusQueries.size(), replies.size());
+    for (const auto &reply : replies)
+        ASSERT_EQ(TTY_OK, reply.status);
+    ASSERT_EQ("12:34:56#", replies[0].data);
+    ASSERT_EQ("+45*12'34#", replies[1].data);
+    ASSERT_EQ("+00#", replies[7].data);
+
+    // One round trip for all queries, sequential queries would take 8
+    ASSERT_LT(elapsed, 4 * latency);
+
+    const auto &stats = engine.latencyStats();
+    ASSERT_EQ(1u, stats.at(":GR#").count);
+    ASSERT_GE(stats.at(":GR#").minMs, latency - 1);
+
+    // A window of one makes it sequential again
+    engine.setMaxInFlight(1);
+    elapsed = pollStatus(engine, replies);
+    ASSERT_EQ("+00#", replies[7].data);
+    ASSERT_GE(elapsed, statusQueries.size() * latency);
+    ASSERT_EQ(2u, engine.latencyStats().at(":GR#").count);
+}
+
+TEST(CommandEngine, Test_reply_kinds)
+{
+    MountEmulator mount(5);
+    CommandEngine engine(mount.fd());
+
+    // Fixed length replies, commands without reply, and reply callbacks
+    std::string called;
+    CommandEngine::Command ack { "\x06" };
+    ack.expectedLength = 1;
+    ack.onReply = [&called](const CommandEngine::Reply &reply)
+    {
+        called = reply.data;
+    };
+    CommandEngine::Command quit { ":Q#" };
+    quit.expectReply = false;
+
+    engine.queue(ack);
+    engine.queue(quit);
+    engine.queue({":GR#"});
+    auto replies = engine.run();
+
+    ASSERT_EQ(3u, replies.size());
+    ASSERT_EQ("P", replies[0].data);
+    ASSERT_EQ("P", called);
+    ASSERT_EQ(TTY_OK, replies[1].status);
+    ASSERT_EQ("12:34:56#", replies[2].data);
+    ASSERT_EQ(0u, engine.latencyStats().count(":Q#"));
+
+    // A command that is not pipelined is sent once the replies before it were read
+    CommandEngine::Command slew { ":MS#" };
+    slew.expectedLength = 1;
+    slew.pipelined = false;
+    int sentBeforeSlew = -1;
+    engine.queue({":GR#"});
+    engine.queue({":GD#"});
+    slew.onReply = [&](const CommandEngine::Reply &)
+    {
+        sentBeforeSlew = mount.received;
+    };
+    engine.queue(slew);
+    engine.queue({":GR#"});
+    replies = engine.run();
+    ASSERT_EQ("0", replies[2].data);
+    ASSERT_EQ("12:34:56#", replies[3].data);
+    // 3 commands then 2 queries and the slew: the query after it was not sent yet
+    ASSERT_EQ(6, sentBeforeSlew);
+}
+
+TEST(CommandEngine, Test_missing_reply)
+{
+    MountEmulator mount(5);
+    CommandEngine engine(mount.fd());
+    engine.setTimeout(100);
+
+    // The unknown command is never answered: it and the ones after it in flight fail
+    engine.queue({":GR#"});
+    engine.queue({":XX#"});
+    auto replies = engine.run();
+
+    ASSERT_EQ(TTY_OK, replies[0].status);
+    ASSERT_EQ(TTY_TIME_OUT, replies[1].status);
+    ASSERT_EQ(1u, engine.latencyStats().at(":XX#").failures);
+
+    // Sent alone, a command that may not be answered does not hold the others back
+    CommandEngine::Command unknown { ":XX#" };
+    unknown.pipelined = false;
+    engine.queue({":GR#"});
+    engine.queue(unknown);
+    engine.queue({":GD#"});
+    replies = engine.run();
+
+    ASSERT_EQ(TTY_OK, replies[0].status);
+    ASSERT_EQ(TTY_TIME_OUT, replies[1].status);
+    ASSERT_EQ(TTY_OK, replies[2].status);
+    ASSERT_EQ("+45*12'34#", replies[2].data);
+
+    // Late replies were flushed, the next run is in sync again
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto reply = engine.send({":GD#"});
+    ASSERT_EQ(TTY_OK, reply.status);
+    ASSERT_EQ("+45*12'34#", reply.data);
+}
+
+TEST(CommandEngine, Test_socket_resync)
+{
+    // A mount over the network: tcflush() can not drop a late reply from a socket
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+    std::thread mount([&fds]()
+    {
+        const std::string late = "99:99:99#", position = "12:34:56#";
+        char buffer[16];
+        // The first query is answered after the timeout, the second one in time
+        if (read(fds[1], buffer, sizeof(buffer)) <= 0)
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(80));
+        if (write(fds[1], late.data(), late.size()) < 0)
+            return;
+        if (read(fds[1], buffer, sizeof(buffer)) <= 0)
+            return;
+        if (write(fds[1], position.data(), position.size()) < 0)
+            return;
+    });
+
+    CommandEngine engine(fds[0]);
+    engine.setTimeout(40);
+    auto first = engine.send({":GR#"});
+
+    // The late reply is in the socket by now, and must not be taken for the next one
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    engine.setTimeout(1000);
+    auto reply = engine.send({":GR#"});
+
+    mount.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    ASSERT_EQ(TTY_TIME_OUT, first.status);
+    ASSERT_EQ(TTY_OK, reply.status);
+    ASSERT_EQ("12:34:56#", reply.data);
+}
+
+TEST(CommandEngine, Test_write_timeout)
+{
+    // A device that stops reading: the request no longer fits in the socket
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    CommandEngine engine(fds[0]);
+    engine.setTimeout(5000);
+
+    // The command's own timeout bounds the wait for room to write, not the engine default
+    CommandEngine::Command upload { std::string(8 << 20, 'x') };
+    upload.expectReply = false;
+    upload.timeoutMs   = 50;
+
+    auto start   = std::chrono::steady_clock::now();
+    auto reply   = engine.send(upload);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    ASSERT_EQ(TTY_WRITE_ERROR, reply.status);
+    ASSERT_LT(elapsed.count(), 1000);
+}
@@ -21,8 +21,14 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <random>
+#include <string>
+#include <vector>
 
 #include "base64.h"
 
@@ -115,3 +121,149 @@ TEST(CORE_BASE64, Test_from64tobits_fast_with_bug_time)
     }
 }
 
+TEST(CORE_BASE64, Test_simd_round_trip)
+{
+    std::mt19937 rng(1234);
+    const int maxLevel = base64_set_simd_level(-1);
+
+    for (int iteration = 0; iteration < 2000; iteration++)
+    {
+        int len = iteration < 300 ? iteration : rng() % (iteration < 1900 ? 4096 : 1 << 20);
+        std::vector<unsigned char> raw(len);
+        for (auto &c : raw)
+            c = rng();
+
+        size_t b64len = (len + 2) / 3 * 4;
+        std::vector<unsigned char> expected;
+
+        for (int level = 0; level <= maxLevel; level++)
+        {
+            ASSERT_EQ(level, base64_set_simd_level(level));
+
+            // Canaries after the output check for overflows
+            std::vector<unsigned char> b64(b64len + 1 + 64, 0xa5);
+            ASSERT_EQ(b64len, (size_t)to64frombits_s(b64.data(), raw.data(), len, b64len + 1));
+            ASSERT_EQ(0, b64[b64len]);
+            for (size_t i = b64len + 1; i < b64.size(); i++)
+                ASSERT_EQ(0xa5, b64[i]) << "overflow at level " << level;
+
+            if (level == 0)
+                expected = b64;
+            ASSERT_TRUE(expected == b64) << "encoding differs at level " << level << " for " << len << " bytes";
+
+            if (len == 0)
+                continue;
+
+            std::vector<char> back(len + 64, 0x5a);
+            ASSERT_EQ(len, from64tobits_fast(back.data(), reinterpret_cast<const char *>(b64.data()), b64len));
+            ASSERT_EQ(0, memcmp(back.data(), raw.data(), len)) << "decoding differs at level " << level << " for " << len << " bytes";
+            for (size_t i = len; i < back.size(); i++)
+                ASSERT_EQ(0x5a, back[i]) << "overflow at level " << level;
+        }
+    }
+    base64_set_simd_level(-1);
+}
+
+TEST(CORE_BASE64, Test_simd_invalid_chars)
+{
+    // A new line in a block must be left to the scalar code, that skips it
+    const int maxLevel = base64_set_simd_level(-1);
+    std::vector<unsigned char> raw(3000);
+    for (size_t i = 0; i < raw.size(); i++)
+        raw[i] = i * 7;
+
+    std::vector<unsigned char> b64(4 * raw.size() / 3 + 4);
+    int b64len = to64frombits_s(b64.data(), raw.data(), raw.size(), b64.size());
+
+    for (int pos : { 0, 4, 64, 1000, 2400 })
+    {
+        std::string withNewLine(reinterpret_cast<char *>(b64.data()), b64len);
+        withNewLine.insert(pos, "\n");
+
+        std::vector<char> expected;
+        for (int level = 0; level <= maxLevel; level++)
+        {
+            base64_set_simd_level(level);
+            std::vector<char> back(raw.size() + 64, 0);
+            int backlen = from64tobits_fast(back.data(), withNewLine.data(), b64len);
+            if (level == 0)
+                expected = back;
+            ASSERT_EQ((int)raw.size(), backlen);
+            ASSERT_TRUE(expected == back) << "new line at " << pos << " decoded differently at level " << level;
+            ASSERT_EQ(0, memcmp(back.data(), raw.data(), raw.size()));
+        }
+    }
+    base64_set_simd_level(-1);
+}
+
+TEST(CORE_BASE64, Test_to64frombits_lines)
+{
+    std::mt19937 rng(1234);
+
+    for (int len : { 0, 1, 2, 3, 53, 54, 55, 108, 1000, 100000 })
+    {
+        std::vector<unsigned char> raw(len);
+        for (auto &c : raw)
+            c = rng();
+
+        // Reference: whole base64 with a new line every 72 chars and at the end
+        std::vector<unsigned char> b64(4 * len / 3 + 4);
+        int b64len = to64frombits_s(b64.data(), raw.data(), len, b64.size());
+        std::string expected;
+        for (int i = 0; i < b64len; i += 72)
+            expected += std::string(reinterpret_cast<char *>(b64.data()) + i, std::min(72, b64len - i)) + "\n";
+
+        for (int chunk : { 54, 540, 54 * 1024 })
+        {
+            std::vector<unsigned char> out(chunk / 54 * 73 + 1);
+            std::string result;
+            for (int done = 0; done < len; done += chunk)
+            {
+                size_t n = to64frombits_lines(out.data(), raw.data() + done, std::min(chunk, len - done), 72);
+                ASSERT_EQ(n, strlen(reinterpret_cast<char *>(out.data())));
+                result.append(reinterpret_cast<char *>(out.data()), n);
+            }
+            ASSERT_EQ(expected, result) << len << " bytes by chunks of " << chunk;
+        }
+    }
+}
+
+/* Throughput of each implementation from 1 MB to 200 MB.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(CORE_BASE64, DISABLED_Benchmark_simd)
+{
+    const int maxLevel = base64_set_simd_level(-1);
+    std::mt19937 rng(1234);
+
+    for (int mb : { 1, 16, 200 })
+    {
+        int len = mb * 1024 * 1024;
+        std::vector<unsigned char> raw(len);
+        for (auto &c : raw)
+            c = rng();
+        std::vector<unsigned char> b64(4 * (size_t)len / 3 + 4);
+        std::vector<char> back(len);
+
+        for (int level = 0; level <= maxLevel; level++)
+        {
+            base64_set_simd_level(level);
+            int repeat = mb < 100 ? 200 / mb : 1;
+
+            auto start = std::chrono::steady_clock::now();
+            int b64len = 0;
+            for (int i = 0; i < repeat; i++)
+                b64len = to64frombits_s(b64.data(), raw.data(), len, b64.size());
+            double encode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat; i++)
+                ASSERT_EQ(len, from64tobits_fast(back.data(), reinterpret_cast<const char *>(b64.data()), b64len));
+            double decode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            printf("%3d MB level %d: encode %8.1f MB/s, decode %8.1f MB/s\n",
+                   mb, level, mb * repeat / encode, mb * repeat / decode);
+        }
+    }
+    base64_set_simd_level(-1);
+}
@@ -0,0 +1,179 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "blobcompression.h"
+#include "testframes.h"
+
+using namespace INDI;
+
+// 16 bit sky background with noise, little endian like a native frame
+static std::vector<uint8_t> makeFrame(size_t width, size_t height, uint32_t seed)
+{
+    auto sky = testframes::noiseFrame<uint16_t>(width * height, seed, 1200, 30);
+    std::vector<uint8_t> frame(width * height * 2);
+    for (size_t i = 0; i < width * height; i++)
+    {
+        auto value = static_cast<uint16_t>(sky[i] + (i % width) / 20);
+        frame[2 * i]     = value & 0xff;
+        frame[2 * i + 1] = value >> 8;
+    }
+    return frame;
+}
+
+TEST(BlobCompression, Test_shuffle)
+{
+    for (size_t elementSize : {1, 2, 3, 4, 8})
+        for (size_t size : {0, 1, 7, 64, 1001})
+        {
+            std::vector<uint8_t> data(size), shuffled(size), restored(size);
+            for (size_t i = 0; i < size; i++)
+                data[i] = static_cast<uint8_t>(i * 37 + 11);
+
+            BlobCompression::shuffle(data.data(), shuffled.data(), size, elementSize);
+            BlobCompression::unshuffle(shuffled.data(), restored.data(), size, elementSize);
+            EXPECT_EQ(restored, data) << elementSize << " bytes, " << size;
+
+            if (elementSize == 2 && size >= 4)
+            {
+                EXPECT_EQ(shuffled[0], data[0]);
+                EXPECT_EQ(shuffled[1], data[2]);
+                EXPECT_EQ(shuffled[size / 2], data[1]);
+            }
+        }
+}
+
+TEST(BlobCompression, Test_format)
+{
+    BlobCompression::Codec codec;
+    size_t elementSize = 0;
+    std::string fileFormat;
+
+    EXPECT_EQ(BlobCompression::format(".bin", BlobCompression::CODEC_ZSTD, 2), ".bin.sh2.zst");
+    EXPECT_EQ(BlobCompression::format(".bin", BlobCompression::CODEC_LZ4, 1), ".bin.lz4");
+    EXPECT_EQ(BlobCompression::format(".bin", BlobCompression::CODEC_ZLIB, 2), ".bin.z");
+
+    ASSERT_TRUE(BlobCompression::parseFormat(".bin.sh2.zst", codec, elementSize, fileFormat));
+    EXPECT_EQ(codec, BlobCompression::CODEC_ZSTD);
+    EXPECT_EQ(elementSize, 2u);
+    EXPECT_EQ(fileFormat, ".bin");
+
+    ASSERT_TRUE(BlobCompression::parseFormat(".fits.z", codec, elementSize, fileFormat));
+    EXPECT_EQ(codec, BlobCompression::CODEC_ZLIB);
+    EXPECT_EQ(elementSize, 1u);
+    EXPECT_EQ(fileFormat, ".fits");
+
+    ASSERT_TRUE(BlobCompression::parseFormat(".shape.lz4", codec, elementSize, fileFormat));
+    EXPECT_EQ(codec, BlobCompression::CODEC_LZ4);
+    EXPECT_EQ(elementSize, 1u);
+    EXPECT_EQ(fileFormat, ".shape");
+
+    EXPECT_FALSE(BlobCompression::parseFormat(".fits.fz", codec, elementSize, fileFormat));
+    EXPECT_FALSE(BlobCompression::parseFormat(".fits", codec, elementSize, fileFormat));
+}
+
+TEST(BlobCompression, Test_roundtrip)
+{
+    auto frame = makeFrame(311, 207, 1);
+
+    for (int i = 0; i < BlobCompression::CODEC_COUNT; i++)
+    {
+        auto codec = static_cast<BlobCompression::Codec>(i);
+        if (!BlobCompression::isAvailable(codec))
+            continue;
+
+        for (size_t elementSize : {1, 2})
+            for (int level : {0, 1, 5})
+            {
+                std::vector<uint8_t> compressed(BlobCompression::bound(codec, frame.size()));
+                size_t size = BlobCompression::compress(codec, level, elementSize, frame.data(), frame.size(),
+                                                        compressed.data(), compressed.size());
+                ASSERT_GT(size, 0u) << BlobCompression::suffix(codec);
+                EXPECT_LT(size, frame.size());
+
+                std::vector<uint8_t> restored(frame.size());
+                EXPECT_EQ(BlobCompression::decompress(codec, elementSize, compressed.data(), size, restored.data(),
+                                                      restored.size()), frame.size());
+                EXPECT_EQ(restored, frame) << BlobCompression::suffix(codec) << ", level " << level;
+
+                // Truncated data must not decode
+                EXPECT_EQ(BlobCompression::decompress(codec, elementSize, compressed.data(), size / 2, restored.data(),
+                                                      restored.size()), 0u) << BlobCompression::suffix(codec);
+            }
+    }
+}
+
+TEST(BlobCompression, Test_large_frame)
+{
+    // Many LZ4 blocks and several zstd blocks
+    auto frame = makeFrame(1920, 1080, 2);
+
+    for (int i = 0; i < BlobCompression::CODEC_COUNT; i++)
+    {
+        auto codec = static_cast<BlobCompression::Codec>(i);
+        if (!BlobCompression::isAvailable(codec))
+            continue;
+
+        std::vector<uint8_t> compressed(BlobCompression::bound(codec, frame.size()));
+        size_t size = BlobCompression::compress(codec, 1, 2, frame.data(), frame.size(), compressed.data(),
+                                                compressed.size());
+        ASSERT_GT(size, 0u) << BlobCompression::suffix(codec);
+
+        std::vector<uint8_t> restored(frame.size());
+        EXPECT_EQ(BlobCompression::decompress(codec, 2, compressed.data(), size, restored.data(), restored.size()),
+                  frame.size());
+        EXPECT_EQ(restored, frame) << BlobCompression::suffix(codec);
+
+        // A destination too small must not decode
+        EXPECT_EQ(BlobCompression::decompress(codec, 2, compressed.data(), size, restored.data(), restored.size() / 2), 0u)
+                << BlobCompression::suffix(codec);
+    }
+}
+
+// Ratio and speed of each codec on a 26 Mpx 16 bit frame.
+TEST(BlobCompression, DISABLED_Benchmark)
+{
+    auto frame = makeFrame(6248, 4176, 1);
+    std::vector<uint8_t> compressed, restored(frame.size());
+
+    for (int i = 0; i < BlobCompression::CODEC_COUNT; i++)
+    {
+        auto codec = static_cast<BlobCompression::Codec>(i);
+        if (!BlobCompression::isAvailable(codec))
+            continue;
+
+        compressed.resize(BlobCompression::bound(codec, frame.size()));
+        for (int level : {0, 1, 9})
+        {
+            size_t elementSize = codec == BlobCompression::CODEC_ZLIB ? 1 : 2;
+            auto start = std::chrono::steady_clock::now();
+            size_t size = BlobCompression::compress(codec, level, elementSize, frame.data(), frame.size(), compressed.data(),
+                                                    compressed.size());
+            auto middle = std::chrono::steady_clock::now();
+            BlobCompression::decompress(codec, elementSize, compressed.data(), size, restored.data(), restored.size());
+            auto end = std::chrono::steady_clock::now();
+
+            double mb = frame.size() / 1e6;
+            printf("%-4s level %d: ratio %.2f, compress %.0f MB/s, decompress %.0f MB/s\n", BlobCompression::suffix(codec),
+                   level, double(frame.size()) / size, mb / std::chrono::duration<double>(middle - start).count(),
+                   mb / std::chrono::duration<double>(end - middle).count());
+        }
+    }
+}
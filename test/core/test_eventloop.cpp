@@ -0,0 +1,232 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "eventloop.h"
+
+// Timer user data: records the order in which timers ran
+struct Recorder
+{
+    std::vector<std::string> order;
+    int done = 0;
+};
+
+struct Named
+{
+    Recorder *recorder;
+    std::string name;
+    bool last;
+};
+
+static void recordTimer(void *p)
+{
+    auto named = static_cast<Named *>(p);
+    named->recorder->order.push_back(named->name);
+    if (named->last)
+        named->recorder->done = 1;
+}
+
+TEST(CORE_EVENTLOOP, Test_timer_order)
+{
+    Recorder recorder;
+    Named a{&recorder, "a", false}, b{&recorder, "b", false}, c{&recorder, "c", false}, d{&recorder, "d", true};
+
+    addTimer(30, recordTimer, &d);
+    addTimer(10, recordTimer, &a);
+    addTimer(20, recordTimer, &c);
+    addTimer(10, recordTimer, &b);
+
+    ASSERT_EQ(0, deferLoop(1000, &recorder.done));
+    ASSERT_EQ((std::vector<std::string> { "a", "b", "c", "d" }), recorder.order);
+}
+
+// Immediate works run once per loop iteration, after timers and callbacks
+static int iterations;
+
+static void countIteration(void *)
+{
+    iterations++;
+}
+
+static void drainedTimer(void *p)
+{
+    auto seen = static_cast<std::vector<int> *>(p);
+    if (seen->empty())
+        addImmediateWork(countIteration, nullptr);
+    seen->push_back(iterations);
+}
+
+TEST(CORE_EVENTLOOP, Test_expired_drained)
+{
+    std::vector<int> seen;
+    iterations = 0;
+
+    for (int i = 0; i < 5; i++)
+        addTimer(1, drainedTimer, &seen);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    int flag = 0;
+    deferLoop(20, &flag);
+
+    // All expired timers ran in the same iteration
+    ASSERT_EQ((std::vector<int> { 0, 0, 0, 0, 0 }), seen);
+    ASSERT_GE(iterations, 1);
+}
+
+struct Periodic
+{
+    int tid;
+    int count;
+    int done;
+};
+
+static void periodicTimer(void *p)
+{
+    auto periodic = static_cast<Periodic *>(p);
+    if (++periodic->count == 3)
+    {
+        rmTimer(periodic->tid);
+        periodic->done = 1;
+    }
+}
+
+TEST(CORE_EVENTLOOP, Test_periodic)
+{
+    Periodic periodic{0, 0, 0};
+    periodic.tid = addPeriodicTimer(5, periodicTimer, &periodic);
+
+    ASSERT_GT(remainingTimer(periodic.tid), 0);
+    ASSERT_EQ(0, deferLoop(1000, &periodic.done));
+    ASSERT_EQ(-1, remainingTimer(periodic.tid));
+
+    // Removed from within its own callback: never runs again
+    int flag = 0;
+    deferLoop(30, &flag);
+    ASSERT_EQ(3, periodic.count);
+}
+
+static void readCallback(int fd, void *p)
+{
+    char c;
+    if (read(fd, &c, 1) == 1)
+        (*static_cast<int *>(p))++;
+}
+
+static void countCallback(int, void *p)
+{
+    (*static_cast<int *>(p))++;
+}
+
+TEST(CORE_EVENTLOOP, Test_callbacks)
+{
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+
+    int reads = 0, calls = 0;
+    int rcid = addCallback(fds[0], readCallback, &reads);
+
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+    ASSERT_EQ(0, deferLoop(1000, &reads));
+
+    // Two callbacks on one fd
+    int ccid = addCallback(fds[0], countCallback, &calls);
+    ASSERT_EQ(1, write(fds[1], "y", 1));
+    reads = 0;
+    ASSERT_EQ(0, deferLoop(1000, &reads));
+    ASSERT_GE(calls, 1);
+
+    // The fd is still watched after one of its callbacks is removed
+    rmCallback(ccid);
+    ASSERT_EQ(1, write(fds[1], "z", 1));
+    reads = 0;
+    ASSERT_EQ(0, deferLoop(1000, &reads));
+    rmCallback(rcid);
+
+    // Regular files can not be polled, they are always ready
+    FILE *file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    calls = 0;
+    int fcid = addCallback(fileno(file), countCallback, &calls);
+    ASSERT_EQ(0, deferLoop(1000, &calls));
+    rmCallback(fcid);
+    fclose(file);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+struct Jitter
+{
+    std::chrono::steady_clock::time_point expected;
+    std::chrono::milliseconds period;
+    std::vector<double> *lateness;
+};
+
+static void jitterTimer(void *p)
+{
+    auto jitter = static_cast<Jitter *>(p);
+    auto now = std::chrono::steady_clock::now();
+
+    jitter->lateness->push_back(std::chrono::duration<double, std::milli>(now - jitter->expected).count());
+    jitter->expected += jitter->period;
+    while (jitter->expected <= now)
+        jitter->expected += jitter->period;
+}
+
+/* Lateness of periodic timers, as drivers polling several devices use them.
+ * Runs 16 staggered periodic timers per period, and reports p50/p99 lateness.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(CORE_EVENTLOOP, DISABLED_Benchmark_jitter)
+{
+    const int timerCount = 16;
+
+    for (int ms : { 1, 10, 100, 1000 })
+    {
+        std::vector<double> lateness;
+        std::vector<Jitter> jitters(timerCount);
+        std::vector<int> tids;
+
+        for (int i = 0; i < timerCount; i++)
+        {
+            jitters[i].period   = std::chrono::milliseconds(ms);
+            jitters[i].lateness = &lateness;
+            jitters[i].expected = std::chrono::steady_clock::now() + jitters[i].period;
+            tids.push_back(addPeriodicTimer(ms, jitterTimer, &jitters[i]));
+        }
+
+        int flag = 0;
+        deferLoop(std::max(2000, 5 * ms), &flag);
+
+        for (int tid : tids)
+            rmTimer(tid);
+
+        ASSERT_FALSE(lateness.empty());
+        std::sort(lateness.begin(), lateness.end());
+        printf("%5d ms period: %6zu runs, lateness p50 %8.3f ms, p99 %8.3f ms, max %8.3f ms\n", ms, lateness.size(),
+               lateness[lateness.size() / 2], lateness[lateness.size() * 99 / 100], lateness.back());
+    }
+}
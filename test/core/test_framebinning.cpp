@@ -0,0 +1,164 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <vector>
+#include "framebinning.h"
+#include "testframes.h"
+
+using testframes::averageMs;
+using testframes::uniformFrame;
+
+template <typename T>
+static std::vector<T> referenceBin(const std::vector<T> &src, uint32_t width, uint32_t height, uint32_t binX,
+                                   uint32_t binY, INDI::BinningMode mode)
+{
+    const uint32_t outW = width / binX, outH = height / binY;
+    const uint64_t n = static_cast<uint64_t>(binX) * binY;
+    std::vector<T> dst(static_cast<size_t>(outW) * outH);
+    for (uint32_t r = 0; r < outH; r++)
+        for (uint32_t c = 0; c < outW; c++)
+        {
+            uint64_t sum = 0;
+            for (uint32_t k = 0; k < binY; k++)
+                for (uint32_t l = 0; l < binX; l++)
+                    sum += src[static_cast<size_t>(r * binY + k) * width + c * binX + l];
+
+            if (mode == INDI::BINNING_MEAN)
+                sum /= n;
+            else if (mode == INDI::BINNING_DEFAULT && sizeof(T) == 1)
+                sum /= std::max<uint64_t>(1, n / 2);
+            dst[static_cast<size_t>(r) * outW + c] = static_cast<T>(std::min<uint64_t>(sum, std::numeric_limits<T>::max()));
+        }
+    return dst;
+}
+
+template <typename T>
+static void checkBinning(uint32_t width, uint32_t height, int threads)
+{
+    const int bpp = sizeof(T) * 8;
+    auto src = uniformFrame<T>(static_cast<size_t>(width) * height, width * 31 + height);
+
+    for (int level : {0, -1})
+    {
+        INDI::setFrameBinningSimdLevel(level);
+        for (uint32_t binX : {1, 2, 3, 4})
+            for (uint32_t binY : {1, 2, 3, 4})
+                for (auto mode : {INDI::BINNING_DEFAULT, INDI::BINNING_SUM, INDI::BINNING_MEAN})
+                {
+                    auto expected = referenceBin(src, width, height, binX, binY, mode);
+                    std::vector<T> dst(expected.size() + 1, 0x5a);
+                    ASSERT_TRUE(INDI::binFrameBuffer(src.data(), dst.data(), width, height, bpp, binX, binY, mode, threads));
+                    EXPECT_EQ(dst.back(), 0x5a) << "written past the binned frame";
+                    dst.pop_back();
+                    ASSERT_EQ(dst, expected) << bpp << " bits, " << binX << "x" << binY << ", mode " << mode
+                                             << ", simd " << level;
+                }
+    }
+    INDI::setFrameBinningSimdLevel(-1);
+}
+
+TEST(FrameBinning, Test_8bit)
+{
+    checkBinning<uint8_t>(101, 37, 1);
+    checkBinning<uint8_t>(64, 64, 3);
+}
+
+TEST(FrameBinning, Test_16bit)
+{
+    checkBinning<uint16_t>(97, 41, 1);
+    checkBinning<uint16_t>(128, 48, 4);
+}
+
+TEST(FrameBinning, Test_32bit)
+{
+    checkBinning<uint32_t>(83, 29, 1);
+    checkBinning<uint32_t>(40, 40, 2);
+}
+
+TEST(FrameBinning, Test_unsupported)
+{
+    uint16_t pixels[4] = {0};
+    EXPECT_FALSE(INDI::binFrameBuffer(pixels, pixels + 2, 2, 2, 12, 2, 2));
+    EXPECT_FALSE(INDI::binFrameBuffer(pixels, pixels + 2, 2, 2, 16, 0, 2));
+}
+
+// 16 bit frames of 26 and 61 Mpx, binned 1x1 to 4x4 with the old loop, scalar, SIMD and threads.
+TEST(FrameBinning, DISABLED_Benchmark)
+{
+    struct Size
+    {
+        uint32_t width, height;
+    };
+
+    for (auto size : {Size{6248, 4176}, Size{9576, 6388}})
+    {
+        auto src = uniformFrame<uint16_t>(static_cast<size_t>(size.width) * size.height, 1);
+        std::vector<uint16_t> dst(src.size());
+
+        auto time = [](const std::function<void()> &fn)
+        {
+            return averageMs(3, fn);
+        };
+
+        for (uint32_t bin = 1; bin <= 4; bin++)
+        {
+            // The loop CCDChip::binFrame used before
+            double loop = time([&]()
+            {
+                std::fill(dst.begin(), dst.end(), 0);
+                uint16_t *bin_buf = dst.data();
+                for (uint32_t i = 0; i + bin <= size.height; i += bin)
+                    for (uint32_t j = 0; j + bin <= size.width; j += bin)
+                    {
+                        for (uint32_t k = 0; k < bin; k++)
+                            for (uint32_t l = 0; l < bin; l++)
+                            {
+                                uint16_t val = src[j + (i + k) * size.width + l];
+                                if (val + *bin_buf > UINT16_MAX)
+                                    *bin_buf = UINT16_MAX;
+                                else
+                                    *bin_buf += val;
+                            }
+                        bin_buf++;
+                    }
+            });
+
+            INDI::setFrameBinningSimdLevel(0);
+            double scalar = time([&]()
+            {
+                INDI::binFrameBuffer(src.data(), dst.data(), size.width, size.height, 16, bin, bin, INDI::BINNING_SUM, 1);
+            });
+            INDI::setFrameBinningSimdLevel(-1);
+            double simd = time([&]()
+            {
+                INDI::binFrameBuffer(src.data(), dst.data(), size.width, size.height, 16, bin, bin, INDI::BINNING_SUM, 1);
+            });
+            double threaded = time([&]()
+            {
+                INDI::binFrameBuffer(src.data(), dst.data(), size.width, size.height, 16, bin, bin, INDI::BINNING_SUM, 0);
+            });
+
+            printf("%ux%u %ux%u: loop %.1f ms, scalar %.1f ms, simd %.1f ms, simd + threads %.1f ms\n",
+                   size.width, size.height, bin, bin, loop, scalar, simd, threaded);
+        }
+    }
+}
@@ -0,0 +1,184 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include "framestatistics.h"
+#include "testframes.h"
+
+using testframes::averageMs;
+using testframes::noiseFrame;
+
+template <typename T>
+static void checkAgainstReference(const std::vector<T> &frame, uint32_t width, uint32_t height, int threads)
+{
+    const int bpp = sizeof(T) * 8;
+    INDI::FrameStatistics stats;
+    ASSERT_TRUE(INDI::frameStatistics(frame.data(), width, height, bpp, stats, 64, threads));
+
+    std::vector<T> sorted(frame);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (auto v : frame)
+        sum += v;
+    double mean = sum / frame.size();
+    double squares = 0;
+    for (auto v : frame)
+        squares += (v - mean) * (v - mean);
+
+    EXPECT_EQ(stats.count, frame.size());
+    EXPECT_EQ(stats.min, sorted.front());
+    EXPECT_EQ(stats.max, sorted.back());
+    EXPECT_NEAR(stats.mean, mean, 1e-6 * std::max(1.0, mean));
+    EXPECT_NEAR(stats.stddev, std::sqrt(squares / frame.size()), 1e-6 * std::max(1.0, mean));
+
+    double median = (frame.size() % 2) ? sorted[frame.size() / 2] :
+                    (static_cast<double>(sorted[frame.size() / 2 - 1]) + sorted[frame.size() / 2]) / 2;
+    if (bpp == 32)
+        EXPECT_EQ(stats.median, static_cast<double>(sorted[(frame.size() - 1) / 2] & 0xffff0000));
+    else
+        EXPECT_EQ(stats.median, median);
+
+    ASSERT_EQ(stats.histogram.size(), 64u);
+    uint64_t total = 0;
+    for (auto count : stats.histogram)
+        total += count;
+    EXPECT_EQ(total, frame.size());
+    uint64_t shift = bpp - 6;
+    EXPECT_EQ(stats.histogram[sorted.front() >> shift] > 0, true);
+    EXPECT_EQ(stats.histogram[sorted.back() >> shift] > 0, true);
+}
+
+TEST(FrameStatistics, Test_8bit)
+{
+    auto frame = noiseFrame<uint8_t>(641 * 479, 1, 100, 30);
+    checkAgainstReference(frame, 641, 479, 1);
+    checkAgainstReference(frame, 641, 479, 3);
+}
+
+TEST(FrameStatistics, Test_16bit)
+{
+    auto frame = noiseFrame<uint16_t>(1001 * 333, 2, 1200, 150);
+    frame[12345] = 65535;
+    checkAgainstReference(frame, 1001, 333, 1);
+    checkAgainstReference(frame, 1001, 333, 4);
+}
+
+TEST(FrameStatistics, Test_32bit)
+{
+    auto frame = noiseFrame<uint32_t>(517 * 211, 3, 3e9, 1e6);
+    checkAgainstReference(frame, 517, 211, 1);
+    checkAgainstReference(frame, 517, 211, 5);
+}
+
+TEST(FrameStatistics, Test_flat)
+{
+    std::vector<uint16_t> frame(100 * 10, 4242);
+    INDI::FrameStatistics stats;
+    ASSERT_TRUE(INDI::frameStatistics(frame.data(), 100, 10, 16, stats));
+    EXPECT_EQ(stats.min, 4242);
+    EXPECT_EQ(stats.max, 4242);
+    EXPECT_EQ(stats.mean, 4242);
+    EXPECT_EQ(stats.stddev, 0);
+    EXPECT_EQ(stats.median, 4242);
+    EXPECT_EQ(stats.histogram.size(), 256u);
+}
+
+TEST(FrameStatistics, Test_unsupported)
+{
+    uint8_t pixel = 0;
+    INDI::FrameStatistics stats;
+    EXPECT_FALSE(INDI::frameStatistics(&pixel, 1, 1, 12, stats));
+}
+
+TEST(FrameStatistics, Test_minmax_simd)
+{
+    // Extremes in the vector body and in the scalar tail
+    for (int level : {0, -1})
+    {
+        INDI::setFrameStatisticsSimdLevel(level);
+        for (size_t pixels : {1, 7, 33, 1000, 1003})
+        {
+            std::vector<uint8_t> frame8(pixels, 50);
+            std::vector<uint16_t> frame16(pixels, 5000);
+            std::vector<uint32_t> frame32(pixels, 500000);
+            frame8[pixels / 2] = 3;
+            frame8.back() = 250;
+            frame16[pixels / 3] = 60000;
+            frame16.back() = 7;
+            frame32.front() = 4000000000u;
+            frame32[pixels - 1 - pixels / 4] = 1;
+
+            double min, max;
+            INDI::frameMinMax(frame8.data(), pixels, 8, &min, &max);
+            EXPECT_EQ(min, pixels == 1 ? 250 : 3);
+            EXPECT_EQ(max, 250);
+            INDI::frameMinMax(frame16.data(), pixels, 16, &min, &max);
+            EXPECT_EQ(min, 7);
+            EXPECT_EQ(max, pixels == 1 ? 7 : 60000);
+            INDI::frameMinMax(frame32.data(), pixels, 32, &min, &max);
+            EXPECT_EQ(min, 1);
+            EXPECT_EQ(max, pixels == 1 ? 1 : 4000000000u);
+        }
+    }
+    INDI::setFrameStatisticsSimdLevel(-1);
+}
+
+// Scalar, SIMD and threaded kernels on a 6248x4176 16 bit frame, against the old per pixel loop.
+TEST(FrameStatistics, DISABLED_Benchmark)
+{
+    const uint32_t width = 6248, height = 4176;
+    auto frame = noiseFrame<uint16_t>(static_cast<size_t>(width) * height, 4, 1500, 200);
+
+    auto time = [](const std::function<void()> &fn)
+    {
+        return averageMs(5, fn);
+    };
+
+    double min = 0, max = 0;
+    double loop = time([&]()
+    {
+        double lmin = frame[0], lmax = frame[0];
+        for (uint32_t i = 0; i < height; i++)
+            for (uint32_t j = 0; j < width; j++)
+            {
+                int ind = i * width + j;
+                if (frame[ind] < lmin)
+                    lmin = frame[ind];
+                else if (frame[ind] > lmax)
+                    lmax = frame[ind];
+            }
+        min = lmin;
+        max = lmax;
+    });
+
+    INDI::setFrameStatisticsSimdLevel(0);
+    double scalar = time([&]() { INDI::frameMinMax(frame.data(), frame.size(), 16, &min, &max); });
+    INDI::setFrameStatisticsSimdLevel(-1);
+    double simd = time([&]() { INDI::frameMinMax(frame.data(), frame.size(), 16, &min, &max); });
+
+    INDI::FrameStatistics stats;
+    double stats1 = time([&]() { INDI::frameStatistics(frame.data(), width, height, 16, stats, 256, 1); });
+    double statsN = time([&]() { INDI::frameStatistics(frame.data(), width, height, 16, stats, 256, 0); });
+
+    printf("min/max: per pixel loop %.2f ms, scalar + threads %.2f ms, simd + threads %.2f ms\n", loop, scalar, simd);
+    printf("statistics: 1 thread %.2f ms, auto %.2f ms\n", stats1, statsN);
+}
@@ -0,0 +1,185 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "stream/gammalut16.h"
+#include "testframes.h"
+
+// The curve of the default GammaLut16, for every 16 bit value
+static std::vector<uint8_t> exactCurve()
+{
+    std::vector<uint8_t> curve(65536);
+    for (uint32_t i = 0; i < curve.size(); i++)
+    {
+        double I = i / 65535.0;
+        double p = I <= 0.00304 ? 12.92 * I : 1.055 * powf(I, 1.0 / 2.4) - 0.055;
+        curve[i] = round(255.0 * p);
+    }
+    return curve;
+}
+
+TEST(GammaLut16, Test_curve)
+{
+    GammaLut16 gamma;
+    auto curve = exactCurve();
+
+    std::vector<uint16_t> all(65536);
+    for (uint32_t i = 0; i < all.size(); i++)
+        all[i] = i;
+
+    for (int level : {0, -1})
+    {
+        int used = GammaLut16::setSimdLevel(level);
+
+        // Exact for existing callers, whatever the instruction set
+        std::vector<uint8_t> out(all.size());
+        gamma.apply(all.data(), all.size(), out.data());
+        EXPECT_EQ(out, curve) << "level " << used;
+
+        // The compact table of the AVX2 code
+        gamma.applyRegion(all.data(), all.size(), all.size(), 1, out.data(), 1);
+        if (used == 0)
+        {
+            EXPECT_EQ(out, curve);
+            continue;
+        }
+
+        size_t differences = 0;
+        for (uint32_t i = 0; i < all.size(); i++)
+        {
+            ASSERT_LE(std::abs(out[i] - curve[i]), 1) << "value " << i;
+            differences += out[i] != curve[i];
+
+            // Exact where the curve is steep
+            if (i < 4096)
+            {
+                ASSERT_EQ(out[i], curve[i]) << "value " << i;
+            }
+        }
+        EXPECT_LT(differences, all.size() / 50);
+        EXPECT_EQ(out[0], 0);
+        EXPECT_EQ(out[65535], 255);
+    }
+    GammaLut16::setSimdLevel(-1);
+}
+
+TEST(GammaLut16, Test_region)
+{
+    GammaLut16 gamma;
+    const size_t width = 1001, height = 67;
+
+    for (size_t components : {1, 3})
+    {
+        auto frame = testframes::uniformFrame<uint16_t>(width * height * components, components);
+
+        // Region at an odd position, so that rows are not aligned
+        const size_t x = 13, y = 5, w = 517, h = 41;
+        const size_t stride = width * components, samples = w * components;
+        std::vector<uint8_t> expected(samples * h);
+        for (size_t row = 0; row < h; row++)
+            gamma.apply(frame.data() + (y + row) * stride + x * components, samples, expected.data() + row * samples);
+
+        for (int level : {0, -1})
+            for (int threads : {1, 2, 3, 0})
+            {
+                int used = GammaLut16::setSimdLevel(level);
+                std::vector<uint8_t> out(samples * h + 1, 0x5a);
+                gamma.applyRegion(frame.data() + y * stride + x * components, stride, samples, h, out.data(), threads);
+                EXPECT_EQ(out.back(), 0x5a);
+                out.pop_back();
+
+                if (used == 0)
+                {
+                    EXPECT_EQ(out, expected) << components << " components, " << threads << " threads";
+                    continue;
+                }
+
+                // Within one level of the exact curve
+                for (size_t i = 0; i < out.size(); i++)
+                    ASSERT_LE(std::abs(out[i] - expected[i]), 1) << components << " components, " << threads
+                            << " threads, sample " << i;
+            }
+    }
+    GammaLut16::setSimdLevel(-1);
+}
+
+// Half of a 4K and a 9K wide 16 bit frame, mono and RGB: subframe copy then 64K table, as before, against the
+// fused pass, scalar, SIMD and threaded.
+TEST(GammaLut16, DISABLED_Benchmark)
+{
+    struct Size
+    {
+        size_t width, height;
+    };
+
+    GammaLut16 gamma;
+    auto curve = exactCurve();
+
+    for (auto size : {Size{3840, 2160}, Size{9576, 6388}})
+        for (size_t components : {1, 3})
+        {
+            const size_t stride = size.width * components;
+            const size_t samples = stride / 2, rows = size.height / 2;
+            const uint16_t *region = nullptr;
+
+            // Sky background
+            auto noise = testframes::noiseFrame<uint16_t>(65536, 1, 3000, 200);
+
+            std::vector<uint16_t> frame(stride * size.height);
+            for (size_t i = 0; i < frame.size(); i++)
+                frame[i] = noise[(i * 7919) & 65535];
+            region = frame.data() + (size.height / 4) * stride + (size.width / 4) * components;
+
+            std::vector<uint16_t> subframe(samples * rows);
+            std::vector<uint8_t> out(samples * rows);
+
+            auto time = [](auto &&function)
+            {
+                return testframes::averageMs(10, function);
+            };
+
+            double before = time([&]()
+            {
+                for (size_t row = 0; row < rows; row++)
+                    memcpy(subframe.data() + row * samples, region + row * stride, samples * 2);
+                for (size_t i = 0; i < subframe.size(); i++)
+                    out[i] = curve[subframe[i]];
+            });
+
+            GammaLut16::setSimdLevel(0);
+            double scalar = time([&]()
+            {
+                gamma.applyRegion(region, stride, samples, rows, out.data(), 1);
+            });
+            GammaLut16::setSimdLevel(-1);
+            double simd = time([&]()
+            {
+                gamma.applyRegion(region, stride, samples, rows, out.data(), 1);
+            });
+            double threaded = time([&]()
+            {
+                gamma.applyRegion(region, stride, samples, rows, out.data(), 0);
+            });
+
+            printf("%zux%zu %s region: copy + 64K table %.2f ms, fused scalar %.2f ms, fused SIMD %.2f ms, threaded %.2f ms\n",
+                   size.width, size.height, components == 1 ? "mono" : "RGB", before, scalar, simd, threaded);
+        }
+}
@@ -0,0 +1,220 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "indicom.h"
+
+// A pseudo terminal: the driver reads and writes the slave, the test plays the device on the master
+class Pty
+{
+    public:
+        Pty()
+        {
+            master = posix_openpt(O_RDWR | O_NOCTTY);
+            if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+                throw std::runtime_error("posix_openpt");
+            slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+            if (slave < 0)
+                throw std::runtime_error("open pty slave");
+
+            struct termios tio;
+            tcgetattr(slave, &tio);
+            cfmakeraw(&tio);
+            tcsetattr(slave, TCSANOW, &tio);
+        }
+
+        ~Pty()
+        {
+            close(slave);
+            close(master);
+        }
+
+        void device(const std::string &data)
+        {
+            ASSERT_EQ(ssize_t(data.size()), write(master, data.data(), data.size()));
+            // Let the line discipline pass it on
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        int master;
+        int slave;
+};
+
+TEST(CORE_INDICOM, Test_read_section)
+{
+    Pty pty;
+    char buf[64];
+    int nbytes = 0;
+
+    tty_set_buffered_read(1);
+
+    // Replies that arrive together are returned one section at a time
+    pty.device("abc#def#ghij");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("abc#", std::string(buf, nbytes));
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("def#", std::string(buf, nbytes));
+
+    // Kept bytes are returned first by the other reads
+    ASSERT_EQ(TTY_OVERFLOW, tty_nread_section(pty.slave, buf, 2, '#', 1, &nbytes));
+    ASSERT_EQ("gh", std::string(buf, nbytes));
+    pty.device("kl");
+    ASSERT_EQ(TTY_OK, tty_read(pty.slave, buf, 4, 1, &nbytes));
+    ASSERT_EQ("ijkl", std::string(buf, nbytes));
+
+    // A section spread over several reads
+    pty.device("mn");
+    std::thread later([&pty]()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        pty.device("op#");
+    });
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    later.join();
+    ASSERT_EQ("mnop#", std::string(buf, nbytes));
+
+    // Several commands, then their replies
+    ASSERT_EQ(TTY_OK, tty_write_string(pty.slave, ":GR#", &nbytes));
+    ASSERT_EQ(TTY_OK, tty_write_string(pty.slave, ":GD#", &nbytes));
+    pty.device("ra#de#");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("ra#", std::string(buf, nbytes));
+    ASSERT_EQ(TTY_OK, tty_write_string(pty.slave, ":GR#", &nbytes));
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("de#", std::string(buf, nbytes));
+
+    // Flushing drops what is left of previous replies
+    pty.device("stale#");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, 's', 1, &nbytes));
+    ASSERT_EQ(TTY_OK, tty_flush_input(pty.slave));
+    pty.device("new#");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("new#", std::string(buf, nbytes));
+
+    // Nothing left: time out
+    ASSERT_EQ(TTY_TIME_OUT, tty_read_section_expanded(pty.slave, buf, '#', 0, 20000, &nbytes));
+
+    tty_set_buffered_read(0);
+}
+
+TEST(CORE_INDICOM, Test_unbuffered_flush)
+{
+    Pty pty;
+    char buf[64];
+    int nbytes = 0;
+
+    // By default nothing is read past the stop char, so tcflush() drops stale replies
+    pty.device("abc#stale#");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("abc#", std::string(buf, nbytes));
+    tcflush(pty.slave, TCIFLUSH);
+    pty.device("new#");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+    ASSERT_EQ("new#", std::string(buf, nbytes));
+}
+
+TEST(CORE_INDICOM, Test_clear_trailing_lf)
+{
+    Pty pty;
+    char buf[64];
+    int nbytes = 0;
+
+    tty_clr_trailing_read_lf(1);
+    pty.device("one\r\ntwo\r\n");
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '\r', 1, &nbytes));
+    ASSERT_EQ("one\r", std::string(buf, nbytes));
+    ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '\r', 1, &nbytes));
+    ASSERT_EQ("two\r", std::string(buf, nbytes));
+    tty_clr_trailing_read_lf(0);
+}
+
+static double threadCpuSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Command round trips as a mount driver polls its position:
+ * a 4 byte command and a 30 byte reply ending with '#'.
+ * Reports commands per second and driver CPU time per command.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(CORE_INDICOM, DISABLED_Benchmark_commands)
+{
+    const int commands = 20000;
+    const std::string reply = "+12:34:56.7 -45*12'34.5 Ok...#";
+
+    for (int buffered : { 0, 1 })
+    {
+        Pty pty;
+        std::atomic<bool> running(true);
+
+        // The device answers each command with one write
+        std::thread device([&pty, &reply, &running]()
+        {
+            char cmd[64];
+            while (running)
+            {
+                ssize_t rd = read(pty.master, cmd, sizeof(cmd));
+                if (rd <= 0)
+                    break;
+                for (ssize_t i = 0; i < rd; i++)
+                    if (cmd[i] == '#' && write(pty.master, reply.data(), reply.size()) < 0)
+                        return;
+            }
+        });
+
+        tty_set_buffered_read(buffered);
+
+        char buf[64];
+        int nbytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        double cpuStart = threadCpuSeconds();
+
+        for (int i = 0; i < commands; i++)
+        {
+            ASSERT_EQ(TTY_OK, tty_write_string(pty.slave, ":GR#", &nbytes));
+            ASSERT_EQ(TTY_OK, tty_read_section(pty.slave, buf, '#', 1, &nbytes));
+            ASSERT_EQ(int(reply.size()), nbytes);
+        }
+
+        double cpu = threadCpuSeconds() - cpuStart;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        running = false;
+        tty_write_string(pty.slave, ":Q#", &nbytes);
+        device.join();
+
+        printf("%s: %8.0f commands/s, %6.2f us CPU per command\n", buffered ? "buffered  " : "unbuffered",
+               commands / elapsed, cpu / commands * 1e6);
+    }
+    tty_set_buffered_read(0);
+}
@@ -0,0 +1,330 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "lilxml.h"
+
+// Count allocations through the lilxml allocator hooks
+static unsigned long allocations = 0;
+
+static void *countingMalloc(size_t size)
+{
+    allocations++;
+    return malloc(size);
+}
+
+static void *countingRealloc(void *ptr, size_t size)
+{
+    allocations++;
+    return realloc(ptr, size);
+}
+
+static void countAllocations()
+{
+    lilxmlMalloc(countingMalloc, countingRealloc, free);
+}
+
+// Traffic as a CCD driver sends it: definitions, updates, messages and BLOBs
+static std::string indiTraffic(int blobSize)
+{
+    std::string traffic = "<?xml version='1.0'?>\n<!-- driver traffic -->\n";
+
+    traffic += "<defNumberVector device='CCD Simulator' name='CCD_EXPOSURE' label='Expose' group='Main Control' "
+               "state='Idle' perm='rw' timeout='60' timestamp='2023-01-01T00:00:00'>\n"
+               "    <defNumber name='CCD_EXPOSURE_VALUE' label='Duration (s)' format='%5.2f' min='0.01' max='3600' step='1'>\n"
+               "1\n"
+               "    </defNumber>\n"
+               "</defNumberVector>\n";
+    traffic += "<defSwitchVector device='CCD Simulator' name='CONNECTION' label='Connection' group='Main Control' "
+               "state='Idle' perm='rw' rule='OneOfMany' timeout='60' timestamp='2023-01-01T00:00:00'>\n"
+               "    <defSwitch name='CONNECT' label='Connect'>\nOff\n    </defSwitch>\n"
+               "    <defSwitch name='DISCONNECT' label='Disconnect'>\nOn\n    </defSwitch>\n"
+               "</defSwitchVector>\n";
+    traffic += "<message device='CCD Simulator' timestamp='2023-01-01T00:00:01' "
+               "message='[INFO] Can&apos;t &lt;connect&gt; &amp; retry &#34;now&#34;'/>\n";
+
+    for (int i = 0; i < 50; i++)
+    {
+        traffic += "<setNumberVector device='CCD Simulator' name='CCD_EXPOSURE' state='Busy' timeout='60' "
+                   "timestamp='2023-01-01T00:00:02'>\n"
+                   "    <oneNumber name='CCD_EXPOSURE_VALUE'>\n" + std::to_string(50 - i) + ".5\n    </oneNumber>\n"
+                   "</setNumberVector>\n";
+    }
+
+    std::string base64;
+    int enclen = (blobSize + 2) / 3 * 4;
+    for (int i = 0; i < enclen; i++)
+    {
+        base64 += "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(i * 7) % 64];
+        if (i % 72 == 71)
+            base64 += '\n';
+    }
+    traffic += "<setBLOBVector device='CCD Simulator' name='CCD1' state='Ok' timeout='60' timestamp='2023-01-01T00:00:03'>\n"
+               "  <oneBLOB\n    name='CCD1'\n    size='" + std::to_string(blobSize) + "'\n"
+               "    enclen='" + std::to_string(enclen) + "'\n    format='.fits'>\n" + base64 + "\n  </oneBLOB>\n"
+               "</setBLOBVector>\n";
+
+    return traffic;
+}
+
+static std::string print(XMLEle *root)
+{
+    std::string out(sprlXMLEle(root, 0) + 1, '\0');
+    out.resize(sprXMLEle(&out[0], root, 0));
+    return out;
+}
+
+// Reference: one char at a time. Elements are printed for comparison, or only counted.
+static std::vector<std::string> parseByChar(const std::string &traffic, bool printed = true)
+{
+    std::vector<std::string> result;
+    LilXML *lp = newLilXML();
+    char ynot[1024];
+
+    for (char c : traffic)
+    {
+        XMLEle *root = readXMLEle(lp, c, ynot);
+        if (root)
+        {
+            result.push_back(printed ? print(root) : std::string());
+            delXMLEle(root);
+        }
+        else if (ynot[0])
+            result.push_back(ynot);
+    }
+    delLilXML(lp);
+    return result;
+}
+
+static std::vector<std::string> parseByChunk(std::string traffic, size_t chunk, bool printed = true, bool arena = false)
+{
+    std::vector<std::string> result;
+    LilXML *lp = newLilXML();
+    lilxmlArena(lp, arena);
+    char ynot[1024];
+
+    for (size_t done = 0; done < traffic.size(); done += chunk)
+    {
+        int size = int(std::min(chunk, traffic.size() - done));
+        XMLEle **nodes = parseXMLChunk(lp, &traffic[done], size, ynot);
+        for (XMLEle **node = nodes; *node; node++)
+        {
+            result.push_back(printed ? print(*node) : std::string());
+            delXMLEle(*node);
+        }
+        free(nodes);
+        if (ynot[0])
+            result.push_back(ynot);
+    }
+    delLilXML(lp);
+    return result;
+}
+
+TEST(CORE_LILXML, Test_chunks)
+{
+    std::string traffic = indiTraffic(3000);
+    auto expected = parseByChar(traffic);
+    ASSERT_EQ(54u, expected.size());
+
+    for (size_t chunk : { 1, 2, 3, 7, 64, 1000, 4096, 1 << 20 })
+        ASSERT_EQ(expected, parseByChunk(traffic, chunk)) << "chunk " << chunk;
+}
+
+TEST(CORE_LILXML, Test_content)
+{
+    std::string xml = "<a  b = 'x&amp;y&lt;z'  c=\"1\t2\">\n  text &gt; more\n<b/>tail  </a>";
+    char ynot[1024];
+    LilXML *lp = newLilXML();
+    XMLEle **nodes = parseXMLChunk(lp, &xml[0], int(xml.size()), ynot);
+
+    ASSERT_STREQ("", ynot);
+    ASSERT_NE(nullptr, nodes[0]);
+    ASSERT_EQ(nullptr, nodes[1]);
+    ASSERT_STREQ("a", tagXMLEle(nodes[0]));
+    ASSERT_STREQ("x&y<z", findXMLAttValu(nodes[0], "b"));
+    // Control chars are dropped from attribute values
+    ASSERT_STREQ("12", findXMLAttValu(nodes[0], "c"));
+    // Leading and trailing whitespace chomped, child elements removed
+    ASSERT_STREQ("text > moretail", pcdataXMLEle(nodes[0]));
+    ASSERT_EQ(1, nXMLEle(nodes[0]));
+
+    delXMLEle(nodes[0]);
+    free(nodes);
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_errors)
+{
+    std::string xml = "<a>\n\n<b>\n</c>";
+    auto expected = parseByChar(xml);
+    ASSERT_EQ(1u, expected.size());
+    ASSERT_EQ("Line 4: closing tag c does not match b", expected[0]);
+    ASSERT_EQ(expected, parseByChunk(xml, xml.size()));
+}
+
+TEST(CORE_LILXML, Test_arena)
+{
+    std::string traffic = indiTraffic(3000);
+    auto expected = parseByChunk(traffic, traffic.size());
+
+    for (size_t chunk : { 1, 7, 4096, 1 << 20 })
+        ASSERT_EQ(expected, parseByChunk(traffic, chunk, true, true)) << "chunk " << chunk;
+
+    // Trees in an arena can still be edited
+    std::string xml = "<a x='1' y='2'><b>text</b><c/></a>";
+    char ynot[1024];
+    LilXML *lp = newLilXML();
+    lilxmlArena(lp, 1);
+    XMLEle **nodes = parseXMLChunk(lp, &xml[0], int(xml.size()), ynot);
+    XMLEle *root = nodes[0];
+    free(nodes);
+    ASSERT_NE(nullptr, root);
+
+    rmXMLAtt(root, "x");
+    editXMLAtt(findXMLAtt(root, "y"), std::string(10000, 'y').c_str());
+    for (int i = 0; i < 100; i++)
+        addXMLAtt(addXMLEle(root, "d"), "n", std::to_string(i).c_str());
+    editXMLEle(findXMLEle(root, "b"), std::string(100000, 'b').c_str());
+    delXMLEle(findXMLEle(root, "c"));
+
+    ASSERT_EQ(nullptr, findXMLAtt(root, "x"));
+    ASSERT_EQ(10000u, strlen(findXMLAttValu(root, "y")));
+    ASSERT_EQ(101, nXMLEle(root));
+    ASSERT_EQ(100000, pcdatalenXMLEle(findXMLEle(root, "b")));
+    ASSERT_EQ(nullptr, findXMLEle(root, "c"));
+
+    delXMLEle(root);
+    delLilXML(lp);
+}
+
+TEST(CORE_LILXML, Test_arena_allocations)
+{
+    countAllocations();
+
+    std::string xml = "<setNumberVector device='CCD Simulator' name='CCD_INFO' state='Ok' timeout='60' timestamp='2023-01-01T00:00:00'>\n";
+    for (int i = 0; i < 10; i++)
+        xml += "  <oneNumber name='VALUE_" + std::to_string(i) + "'>\n" + std::to_string(i * 1.5) + "\n  </oneNumber>\n";
+    xml += "</setNumberVector>\n";
+
+    for (int arena : { 0, 1 })
+    {
+        char ynot[1024];
+        LilXML *lp = newLilXML();
+        lilxmlArena(lp, arena);
+
+        unsigned long before = allocations;
+        XMLEle **nodes = parseXMLChunk(lp, &xml[0], int(xml.size()), ynot);
+        unsigned long count = allocations - before;
+
+        ASSERT_NE(nullptr, nodes[0]);
+        ASSERT_EQ(10, nXMLEle(nodes[0]));
+        if (arena)
+            ASSERT_GE(2u, count);
+        else
+            ASSERT_LE(50u, count);
+
+        delXMLEle(nodes[0]);
+        free(nodes);
+        delLilXML(lp);
+    }
+}
+
+TEST(CORE_LILXML, Test_symbols)
+{
+    std::string xml = "<setNumberVector device='CCD Simulator' name='CCD_EXPOSURE' custom='1'>"
+                      "<oneNumber name='CCD_EXPOSURE_VALUE'>1</oneNumber><unknownTag/></setNumberVector>";
+    char ynot[1024];
+    LilXML *lp = newLilXML();
+    XMLEle **nodes = parseXMLChunk(lp, &xml[0], int(xml.size()), ynot);
+    XMLEle *root = nodes[0];
+    free(nodes);
+    ASSERT_NE(nullptr, root);
+
+    ASSERT_EQ(XMLSYM_setNumberVector, tagIdXMLEle(root));
+    ASSERT_STREQ("CCD Simulator", findXMLAttValuById(root, XMLSYM_device));
+    ASSERT_EQ(findXMLAtt(root, "name"), findXMLAttById(root, XMLSYM_name));
+    ASSERT_EQ(XMLSYM_UNKNOWN, nameIdXMLAtt(findXMLAtt(root, "custom")));
+    ASSERT_EQ(nullptr, findXMLAttById(root, XMLSYM_state));
+    ASSERT_STREQ("", findXMLAttValuById(root, XMLSYM_state));
+    ASSERT_EQ(findXMLEle(root, "oneNumber"), findXMLEleById(root, XMLSYM_oneNumber));
+    ASSERT_EQ(XMLSYM_UNKNOWN, tagIdXMLEle(findXMLEle(root, "unknownTag")));
+
+    // Trees built or edited by hand are interned too
+    XMLEle *ep = addXMLEle(root, "oneBLOB");
+    addXMLAtt(ep, "enclen", "4");
+    ASSERT_EQ(ep, findXMLEleById(root, XMLSYM_oneBLOB));
+    ASSERT_STREQ("4", findXMLAttValuById(ep, XMLSYM_enclen));
+    setXMLEleTag(root, "setBLOBVector");
+    ASSERT_EQ(XMLSYM_setBLOBVector, tagIdXMLEle(root));
+
+    delXMLEle(root);
+    delLilXML(lp);
+
+    // Every symbol maps back to itself, prefixes and longer names do not
+    for (const char *name : { "device", "getProperties", "oneBLOB", "defLightVector", "uid" })
+    {
+        XMLSymbol id = symbolXML(name);
+        ASSERT_NE(XMLSYM_UNKNOWN, id) << name;
+        ASSERT_EQ(XMLSYM_UNKNOWN, symbolXML((std::string(name) + "x").c_str())) << name;
+        ASSERT_EQ(XMLSYM_UNKNOWN, symbolXML(std::string(name, strlen(name) - 1).c_str())) << name;
+    }
+    ASSERT_EQ(XMLSYM_UNKNOWN, symbolXML(""));
+}
+
+/* Parser throughput over typical driver traffic, by chunks as indiserver reads them,
+ * and one char at a time as the parser used to handle every byte.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(CORE_LILXML, DISABLED_Benchmark_parse)
+{
+    countAllocations();
+
+    for (int blobSize : { 0, 1 << 20, 16 << 20 })
+    {
+        std::string traffic = indiTraffic(blobSize);
+        while (traffic.size() < (16u << 20))
+            traffic += traffic;
+        double mb = traffic.size() / (1024.0 * 1024.0);
+
+        auto start = std::chrono::steady_clock::now();
+        auto byChar = parseByChar(traffic, false);
+        double charTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%6.1f MB: by char %8.1f MB/s", mb, mb / charTime);
+
+        for (bool arena : { false, true })
+        {
+            unsigned long before = allocations;
+            start = std::chrono::steady_clock::now();
+            auto byChunk = parseByChunk(traffic, 49152, false, arena);
+            double chunkTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            ASSERT_EQ(byChar.size(), byChunk.size());
+
+            printf(", by chunk%s %8.1f MB/s %6.1f allocs/msg", arena ? " in arena" : "", mb / chunkTime,
+                   double(allocations - before) / byChunk.size());
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,259 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <jpeglib.h>
+#include "stream/encoder/mjpegencoder.h"
+#include "testframes.h"
+
+using namespace INDI;
+
+struct Image
+{
+    int width = 0, height = 0, components = 0;
+    std::vector<uint8_t> data;
+};
+
+static Image decode(const WidgetViewBlob &blob)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, static_cast<unsigned char *>(const_cast<void *>(blob.getBlob())), blob.getBlobLen());
+    jpeg_read_header(&cinfo, TRUE);
+    jpeg_start_decompress(&cinfo);
+
+    Image image;
+    image.width = cinfo.output_width;
+    image.height = cinfo.output_height;
+    image.components = cinfo.output_components;
+    image.data.resize(image.width * image.height * image.components);
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = image.data.data() + cinfo.output_scanline * image.width * image.components;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return image;
+}
+
+// Smooth gradients, what survives both scaling and compression
+static std::vector<uint8_t> makeFrame(int width, int height, int components)
+{
+    std::vector<uint8_t> frame(width * height * components);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            for (int c = 0; c < components; c++)
+                frame[(y * width + x) * components + c] = static_cast<uint8_t>((x * 255 / width + y * 255 / height) / 3 + c * 20);
+    return frame;
+}
+
+TEST(MJPEGEncoder, Test_scaled_gray)
+{
+    MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_MONO, 8);
+    encoder.setSize(1280, 720);
+    encoder.setScaleWidth(640);
+    auto frame = makeFrame(1280, 720, 1);
+
+    WidgetViewBlob blob;
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+    EXPECT_STREQ(blob.getFormat(), ".stream_jpg");
+    EXPECT_EQ(encoder.currentScale(), 2);
+
+    auto image = decode(blob);
+    ASSERT_EQ(image.width, 640);
+    ASSERT_EQ(image.height, 360);
+    ASSERT_EQ(image.components, 1);
+    for (int y = 1; y < image.height; y += 37)
+        for (int x = 1; x < image.width; x += 41)
+            EXPECT_NEAR(image.data[y * image.width + x], frame[(2 * y) * 1280 + 2 * x], 4) << x << "," << y;
+}
+
+TEST(MJPEGEncoder, Test_full_rgb)
+{
+    MJPEGEncoder encoder;
+    // Full resolution by default
+    encoder.setPixelFormat(INDI_RGB, 8);
+    encoder.setSize(320, 200);
+    auto frame = makeFrame(320, 200, 3);
+
+    // Without init(), errors are logged under the encoder name
+    WidgetViewBlob blob;
+    EXPECT_FALSE(encoder.upload(&blob, frame.data(), 100));
+
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+
+    auto image = decode(blob);
+    ASSERT_EQ(image.width, 320);
+    ASSERT_EQ(image.height, 200);
+    ASSERT_EQ(image.components, 3);
+    for (size_t i = 0; i < image.data.size(); i += 97)
+        EXPECT_NEAR(image.data[i], frame[i], 6) << i;
+
+    // Too small for the frame size
+    EXPECT_FALSE(encoder.upload(&blob, frame.data(), frame.size() - 1));
+}
+
+TEST(MJPEGEncoder, Test_buffer_reused)
+{
+    MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_MONO, 8);
+    encoder.setSize(640, 480);
+    auto frame = makeFrame(640, 480, 1);
+
+    WidgetViewBlob blob;
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+    void *first = blob.getBlob();
+    int size = blob.getBlobLen();
+
+    for (int quality : {50, 85})
+    {
+        encoder.setQuality(quality);
+        ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+        EXPECT_EQ(blob.getBlob(), first);
+        EXPECT_EQ(encoder.currentQuality(), quality);
+    }
+    EXPECT_EQ(blob.getBlobLen(), size);
+}
+
+TEST(MJPEGEncoder, Test_bandwidth)
+{
+    MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_MONO, 8);
+    encoder.setSize(640, 480);
+    encoder.setScaleWidth(0);
+
+    // Noise, large at any quality
+    std::vector<uint8_t> frame(640 * 480);
+    for (auto &v : frame)
+        v = rand() & 0xff;
+
+    WidgetViewBlob blob;
+    auto run = [&](int frames)
+    {
+        for (int i = 0; i < frames; i++)
+        {
+            ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+            encoder.frameSent(blob.getBlobLen(), 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    };
+
+    // Less than 50 KB per frame: the quality goes down first, then the resolution
+    encoder.setTargetBandwidth(50 * 1024 * 40);
+    run(20);
+    EXPECT_LT(encoder.currentQuality(), 85);
+    EXPECT_GT(encoder.currentScale(), 1);
+    int scale = encoder.currentScale();
+
+    // Clients falling behind
+    encoder.frameSent(blob.getBlobLen(), 0.1);
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_TRUE(encoder.upload(&blob, frame.data(), frame.size()));
+    EXPECT_GE(encoder.currentScale(), scale);
+
+    // Plenty of room, back to the set quality and scale
+    encoder.setTargetBandwidth(1024 * 1024 * 1024);
+    run(40);
+    EXPECT_EQ(encoder.currentQuality(), 85);
+    EXPECT_EQ(encoder.currentScale(), 1);
+
+    // Back to fixed quality
+    encoder.setTargetBandwidth(0);
+    encoder.setQuality(60);
+    run(1);
+    EXPECT_EQ(encoder.currentQuality(), 60);
+}
+
+// A new compressor and output buffer for every frame, as before, against the encoder.
+static size_t compressOnce(const uint8_t *src, int width, int height, std::vector<uint8_t> &dest)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    dest.assign(width * height, 0);
+    unsigned char *out = dest.data();
+    unsigned long size = dest.size();
+    jpeg_mem_dest(&cinfo, &out, &size);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 1;
+    cinfo.in_color_space = JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = const_cast<JSAMPROW>(src + cinfo.next_scanline * width);
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    if (out != dest.data())
+        free(out);
+    return size;
+}
+
+TEST(MJPEGEncoder, DISABLED_Benchmark)
+{
+    const int width = 1920, height = 1080, frames = 100;
+    auto frame = makeFrame(width, height, 1);
+
+    auto time = [&](auto &&function)
+    {
+        return testframes::averageMs(frames, function);
+    };
+
+    std::vector<uint8_t> dest;
+    double before = time([&]()
+    {
+        compressOnce(frame.data(), width, height, dest);
+    });
+
+    MJPEGEncoder encoder;
+    encoder.setPixelFormat(INDI_MONO, 8);
+    encoder.setSize(width, height);
+    WidgetViewBlob blob;
+
+    encoder.setScaleWidth(0);
+    double full = time([&]()
+    {
+        encoder.upload(&blob, frame.data(), frame.size());
+    });
+    int fullBytes = blob.getBlobLen();
+
+    encoder.setScaleWidth(640);
+    double scaled = time([&]()
+    {
+        encoder.upload(&blob, frame.data(), frame.size());
+    });
+
+    printf("%dx%d gray: new compressor per frame %.2f ms, reused %.2f ms (%d bytes), scaled by %d %.2f ms (%d bytes)\n",
+           width, height, before, full, fullBytes, encoder.currentScale(), scaled, blob.getBlobLen());
+}
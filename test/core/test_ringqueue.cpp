@@ -0,0 +1,219 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "stream/ringqueue.h"
+#include "stream/uniquequeue.h"
+
+TEST(RingQueue, Test_bounded)
+{
+    SPSCQueue<int> queue(3);
+    EXPECT_EQ(queue.capacity(), 4u);
+
+    for (int i = 0; i < 4; i++)
+        EXPECT_TRUE(queue.push(int(i)));
+    EXPECT_FALSE(queue.push(4));
+    EXPECT_FALSE(queue.push(5));
+    EXPECT_EQ(queue.dropped(), 2u);
+    EXPECT_EQ(queue.size(), 4u);
+
+    int value = -1;
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE(queue.pop(value, 0));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_EQ(queue.peakSize(), 4u);
+    EXPECT_FALSE(queue.pop(value, 10));
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+TEST(RingQueue, Test_rejected_data_kept)
+{
+    MPMCQueue<std::unique_ptr<int>> queue(2);
+    EXPECT_TRUE(queue.push(std::make_unique<int>(1)));
+    EXPECT_TRUE(queue.push(std::make_unique<int>(2)));
+
+    EXPECT_EQ(queue.peakSize(), 2u);
+
+    auto data = std::make_unique<int>(3);
+    EXPECT_FALSE(queue.push(std::move(data)));
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(*data, 3);
+}
+
+TEST(RingQueue, Test_pop_releases_cell)
+{
+    auto shared = std::make_shared<int>(1);
+    SPSCQueue<std::shared_ptr<int>> queue(4);
+    queue.push(std::shared_ptr<int>(shared));
+
+    std::shared_ptr<int> value;
+    ASSERT_TRUE(queue.pop(value));
+    value.reset();
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+TEST(RingQueue, Test_blocking)
+{
+    SPSCQueue<int> queue(16);
+    std::thread consumer([&queue]()
+    {
+        int value;
+        for (int i = 0; i < 100; i++)
+        {
+            ASSERT_TRUE(queue.pop(value));
+            EXPECT_EQ(value, i);
+            if (i % 10 == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    for (int i = 0; i < 100; i++)
+    {
+        while (!queue.push(int(i)))
+            std::this_thread::yield();
+        if (i % 25 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    queue.waitForEmpty();
+    EXPECT_EQ(queue.size(), 0u);
+    consumer.join();
+}
+
+TEST(RingQueue, Test_abort)
+{
+    SPSCQueue<int> queue;
+    std::atomic<bool> returned {false};
+    std::thread consumer([&]()
+    {
+        int value;
+        EXPECT_FALSE(queue.pop(value));
+        returned = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(returned);
+    queue.abort();
+    consumer.join();
+    EXPECT_TRUE(returned);
+
+    // Usable again after abort
+    queue.push(7);
+    int value = 0;
+    EXPECT_TRUE(queue.pop(value, 100));
+    EXPECT_EQ(value, 7);
+}
+
+TEST(RingQueue, Test_mpmc)
+{
+    const int producers = 4, consumers = 3, count = 20000;
+    MPMCQueue<int> queue(64);
+    std::atomic<long long> sum {0};
+    std::atomic<int> popped {0};
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++)
+        threads.emplace_back([&]()
+        {
+            int value;
+            while (queue.pop(value))
+            {
+                sum += value;
+                ++popped;
+            }
+        });
+
+    std::vector<std::thread> pushers;
+    for (int p = 0; p < producers; p++)
+        pushers.emplace_back([&queue, p]()
+        {
+            for (int i = 1; i <= count; i++)
+                while (!queue.push(int(i * producers + p)))
+                    std::this_thread::yield();
+        });
+    for (auto &thread : pushers)
+        thread.join();
+
+    queue.waitForEmpty();
+    while (popped != producers * count)
+        std::this_thread::yield();
+    queue.abort();
+    for (auto &thread : threads)
+        thread.join();
+
+    long long expected = 0;
+    for (int p = 0; p < producers; p++)
+        for (int i = 1; i <= count; i++)
+            expected += i * producers + p;
+    EXPECT_EQ(sum, expected);
+}
+
+template <typename T, typename Ring>
+static bool pushed(RingQueue<T, Ring> &queue, T &&data)
+{
+    return queue.push(std::move(data));
+}
+
+template <typename T>
+static bool pushed(UniqueQueue<T> &queue, T &&data)
+{
+    queue.push(std::move(data));
+    return true;
+}
+
+// Items handed from a producer to a consumer thread, like frames to the stream thread.
+template <typename Queue>
+static double handOff(Queue &queue, int count)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&queue, count]()
+    {
+        std::shared_ptr<int> value;
+        for (int i = 0; i < count; i++)
+            queue.pop(value);
+    });
+
+    auto item = std::make_shared<int>(1);
+    for (int i = 0; i < count; i++)
+    {
+        std::shared_ptr<int> copy = item;
+        while (!pushed(queue, std::move(copy)))
+            std::this_thread::yield();
+    }
+    consumer.join();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(RingQueue, DISABLED_Benchmark)
+{
+    const int count = 1000000;
+    UniqueQueue<std::shared_ptr<int>> unique;
+    SPSCQueue<std::shared_ptr<int>> spsc(1024);
+    MPMCQueue<std::shared_ptr<int>> mpmc(1024);
+
+    double uniqueMs = handOff(unique, count);
+    double spscMs = handOff(spsc, count);
+    double mpmcMs = handOff(mpmc, count);
+    printf("%d items: UniqueQueue %.0f ms, SPSCQueue %.0f ms, MPMCQueue %.0f ms\n", count, uniqueMs, spscMs, mpmcMs);
+}
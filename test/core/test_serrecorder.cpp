@@ -0,0 +1,192 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include "stream/recorder/batchwriter.h"
+#include "stream/recorder/serrecorder.h"
+
+using namespace INDI;
+
+static std::vector<uint8_t> readFile(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static uint64_t readLE(const uint8_t *data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+TEST(BatchWriter, Test_content)
+{
+    const std::string filename = testing::TempDir() + "test_batchwriter.bin";
+
+    for (bool direct : {true, false})
+    {
+        BatchWriter writer;
+        ASSERT_TRUE(writer.open(filename.c_str(), 8192, 3, direct));
+
+        // Sizes that do not line up with the batches
+        std::vector<uint8_t> expected;
+        for (size_t size = 1; expected.size() < 200000; size = size * 3 % 10007)
+        {
+            std::vector<uint8_t> data(size);
+            for (auto &v : data)
+                v = static_cast<uint8_t>(expected.size() + (&v - data.data()) * 7);
+
+            while (!writer.append(data.data(), data.size()))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            expected.insert(expected.end(), data.begin(), data.end());
+        }
+        EXPECT_EQ(writer.size(), expected.size());
+
+        EXPECT_TRUE(writer.close());
+        EXPECT_EQ(writer.writtenSize(), expected.size());
+        EXPECT_EQ(readFile(filename), expected) << (direct ? "direct" : "buffered");
+    }
+    remove(filename.c_str());
+}
+
+TEST(BatchWriter, Test_no_room)
+{
+    const std::string filename = testing::TempDir() + "test_batchwriter.bin";
+    BatchWriter writer;
+    ASSERT_TRUE(writer.open(filename.c_str(), 4096, 2));
+    EXPECT_EQ(writer.available(), 8192u);
+
+    // Never waits for the disk, refused as a whole
+    std::vector<uint8_t> data(8193, 1);
+    EXPECT_FALSE(writer.append(data.data(), data.size()));
+    EXPECT_EQ(writer.size(), 0u);
+
+    EXPECT_TRUE(writer.append(data.data(), 100));
+    EXPECT_TRUE(writer.close());
+    EXPECT_EQ(readFile(filename).size(), 100u);
+    EXPECT_EQ(writer.available(), 0u);
+    remove(filename.c_str());
+}
+
+TEST(SER_Recorder, Test_file)
+{
+    const std::string filename = testing::TempDir() + "test_serrecorder.ser";
+    const uint32_t width = 64, height = 48, frames = 10;
+    char errmsg[1024];
+
+    SER_Recorder recorder;
+    ASSERT_TRUE(recorder.setPixelFormat(INDI_MONO, 16));
+    ASSERT_TRUE(recorder.setSize(width, height));
+    ASSERT_TRUE(recorder.open(filename.c_str(), errmsg)) << errmsg;
+
+    std::vector<uint8_t> frame(width * height * 2);
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        std::fill(frame.begin(), frame.end(), i);
+        ASSERT_TRUE(recorder.writeFrame(frame.data(), frame.size(), 1000 + i));
+    }
+    ASSERT_TRUE(recorder.close());
+    EXPECT_EQ(recorder.getDroppedFrames(), 0u);
+
+    auto data = readFile(filename);
+    const size_t header = 178;
+    ASSERT_EQ(data.size(), header + frames * frame.size() + frames * 8);
+
+    EXPECT_EQ(std::string(reinterpret_cast<const char *>(data.data()), 13), "INDI-RECORDER");
+    EXPECT_EQ(readLE(&data[26], 4), width);
+    EXPECT_EQ(readLE(&data[30], 4), height);
+    EXPECT_EQ(readLE(&data[34], 4), 16u);
+    EXPECT_EQ(readLE(&data[38], 4), frames);
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        EXPECT_EQ(data[header + i * frame.size()], i);
+        EXPECT_EQ(data[header + (i + 1) * frame.size() - 1], i);
+        EXPECT_EQ(readLE(&data[header + frames * frame.size() + i * 8], 8), (1000 + i) * 10);
+    }
+
+    // The timestamps side file is gone
+    EXPECT_FALSE(std::ifstream(filename + ".stamps").good());
+    remove(filename.c_str());
+}
+
+// 640x480 16 bit frames at 300 fps: written one by one with fwrite on the stream thread, as before, or queued
+// to the writer thread. Frames that keep the stream thread longer than the frame period are late.
+TEST(SER_Recorder, DISABLED_Benchmark)
+{
+    const std::string filename = testing::TempDir() + "test_serrecorder.ser";
+    const uint32_t width = 640, height = 480, frames = 1500;
+    const auto period = std::chrono::microseconds(1000000 / 300);
+    std::vector<uint8_t> frame(width * height * 2, 0x55);
+    const double megabytes = static_cast<double>(frames) * frame.size() / (1024 * 1024);
+
+    auto run = [&](const char *name, const std::function<void(uint32_t)> &write, const std::function<void()> &close)
+    {
+        int late = 0;
+        double slowest = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            std::this_thread::sleep_until(start + i * period);
+            auto frameStart = std::chrono::steady_clock::now();
+            write(i);
+            auto frameTime = std::chrono::steady_clock::now() - frameStart;
+            late += frameTime > period;
+            slowest = std::max(slowest, std::chrono::duration<double, std::milli>(frameTime).count());
+        }
+        close();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %.0f MB in %.2f s, slowest frame %.1f ms, %d late", name, megabytes, seconds, slowest, late);
+    };
+
+    FILE *f = fopen(filename.c_str(), "w");
+    run("fwrite", [&](uint32_t)
+    {
+        fwrite(frame.data(), 1, frame.size(), f);
+    }, [&]()
+    {
+        fclose(f);
+    });
+    printf("\n");
+
+    char errmsg[1024];
+    SER_Recorder recorder;
+    recorder.setPixelFormat(INDI_MONO, 16);
+    recorder.setSize(width, height);
+    recorder.setFPS(300);
+    ASSERT_TRUE(recorder.open(filename.c_str(), errmsg));
+    run("batched", [&](uint32_t i)
+    {
+        recorder.writeFrame(frame.data(), frame.size(), i + 1);
+    }, [&]()
+    {
+        recorder.close();
+    });
+    printf(", %llu dropped, writer %.0f MB/s\n", static_cast<unsigned long long>(recorder.getDroppedFrames()),
+           recorder.getWriteRate() / (1024 * 1024));
+    remove(filename.c_str());
+}
@@ -0,0 +1,329 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "sharedblob.h"
+
+#ifdef ENABLE_INDI_SHARED_MEMORY
+
+TEST(CORE_SHAREDBLOB, Test_registry)
+{
+    std::vector<void *> buffers;
+    for (int i = 0; i < 1000; i++)
+    {
+        void * ptr = IDSharedBlobAlloc(1000);
+        ASSERT_NE(nullptr, ptr);
+        buffers.push_back(ptr);
+    }
+
+    // Growing moves some buffers: they must still be found at their new address
+    for (size_t i = 0; i < buffers.size(); i += 10)
+    {
+        buffers[i] = IDSharedBlobRealloc(buffers[i], 3 * 1024 * 1024);
+        ASSERT_NE(nullptr, buffers[i]);
+    }
+
+    for (size_t i = 0; i < buffers.size(); i += 2)
+        IDSharedBlobFree(buffers[i]);
+
+    for (size_t i = 1; i < buffers.size(); i += 2)
+        ASSERT_NE(-1, IDSharedBlobGetFd(buffers[i])) << "buffer " << i;
+
+    void * notShared = malloc(16);
+    ASSERT_EQ(-1, IDSharedBlobGetFd(notShared));
+    free(notShared);
+
+    for (size_t i = 1; i < buffers.size(); i += 2)
+        IDSharedBlobFree(buffers[i]);
+}
+
+TEST(CORE_SHAREDBLOB, Test_pool)
+{
+    unsigned long hits, misses, hitsBefore, missesBefore;
+
+    IDSharedBlobSetPoolSize(0, 0);
+    IDSharedBlobSetPoolSize(2, SIZE_MAX);
+    IDSharedBlobPoolStats(&hitsBefore, &missesBefore);
+
+    void * first = IDSharedBlobAlloc(1000);
+    ASSERT_NE(nullptr, first);
+    IDSharedBlobFree(first);
+
+    // Same allocation unit: recycled
+    void * second = IDSharedBlobAlloc(500);
+    ASSERT_EQ(first, second);
+    ASSERT_NE(-1, IDSharedBlobGetFd(second));
+
+    // Sealed buffers are not recycled
+    IDSharedBlobFree(second);
+    void * third = IDSharedBlobAlloc(1000);
+    ASSERT_NE(nullptr, third);
+    ASSERT_NE(-1, IDSharedBlobGetFd(third));
+    IDSharedBlobFree(third);
+
+    IDSharedBlobPoolStats(&hits, &misses);
+    ASSERT_EQ(1u, hits - hitsBefore);
+    ASSERT_EQ(2u, misses - missesBefore);
+
+    IDSharedBlobSetPoolSize(0, 0);
+}
+
+TEST(CORE_SHAREDBLOB, Test_pool_limits)
+{
+    const size_t unit = 1024 * 1024;
+
+    // Disabled by default
+    void * first = IDSharedBlobAlloc(1000);
+    IDSharedBlobFree(first);
+    void * second = IDSharedBlobAlloc(1000);
+    IDSharedBlobFree(second);
+    unsigned long hits, misses, hitsBefore, missesBefore;
+    IDSharedBlobPoolStats(&hitsBefore, &missesBefore);
+
+    // 3 MB at most: the 4 MB buffer is not kept
+    IDSharedBlobSetPoolSize(8, 3 * unit);
+    first = IDSharedBlobAlloc(4 * unit);
+    IDSharedBlobFree(first);
+    second = IDSharedBlobAlloc(4 * unit);
+    IDSharedBlobPoolStats(&hits, &misses);
+    ASSERT_EQ(0u, hits - hitsBefore);
+    IDSharedBlobFree(second);
+
+    // A pooled buffer larger than asked for still grows with realloc
+    first = IDSharedBlobAlloc(2 * unit);
+    IDSharedBlobFree(first);
+    char * small = static_cast<char *>(IDSharedBlobAlloc(1000));
+    ASSERT_EQ(first, small);
+    char * grown = static_cast<char *>(IDSharedBlobRealloc(small, unit / 2));
+    ASSERT_EQ(small, grown);
+    grown = static_cast<char *>(IDSharedBlobRealloc(grown, 3 * unit));
+    ASSERT_NE(nullptr, grown);
+    memset(grown, 0x5a, 3 * unit);
+    IDSharedBlobFree(grown);
+
+    IDSharedBlobSetPoolSize(0, 0);
+}
+
+TEST(CORE_SHAREDBLOB, Test_register)
+{
+    const size_t size = 4096;
+    FILE * file = tmpfile();
+    ASSERT_NE(nullptr, file);
+    int fd = fileno(file);
+    ASSERT_EQ(0, ftruncate(fd, size));
+
+    char * mapping = (char*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(MAP_FAILED, mapping);
+
+    ASSERT_EQ(0, IDSharedBlobRegister(mapping, size, fd));
+    ASSERT_EQ(fd, IDSharedBlobGetFd(mapping));
+
+    // Not sealed nor resizable: the caller owns the mapping
+    mapping[0] = 'x';
+    ASSERT_EQ(nullptr, IDSharedBlobRealloc(mapping, 2 * size));
+
+    IDSharedBlobUnregister(mapping);
+    ASSERT_EQ(-1, IDSharedBlobGetFd(mapping));
+    mapping[1] = 'y';
+    ASSERT_EQ('x', mapping[0]);
+
+    // Free forgets it as well, without unmapping
+    ASSERT_EQ(0, IDSharedBlobRegister(mapping, size, fd));
+    IDSharedBlobFree(mapping);
+    ASSERT_EQ(-1, IDSharedBlobGetFd(mapping));
+    ASSERT_EQ('y', mapping[1]);
+
+    munmap(mapping, size);
+    fclose(file);
+}
+
+TEST(CORE_SHAREDBLOB, Test_grow_in_place)
+{
+    IDSharedBlobSetReserveFactor(4);
+    IDSharedBlobSetPoolSize(0, 0);
+
+    // 1 MB allocated, 4 MB reserved
+    char * ptr = static_cast<char *>(IDSharedBlobAlloc(1000));
+    ASSERT_NE(nullptr, ptr);
+    memset(ptr, 0x5a, 1000);
+
+    char * grown = static_cast<char *>(IDSharedBlobRealloc(ptr, 3 * 1024 * 1024));
+    ASSERT_EQ(ptr, grown);
+    memset(grown + 1000, 0xa5, 3 * 1024 * 1024 - 1000);
+
+    // Beyond the reservation: may move, content is kept
+    grown = static_cast<char *>(IDSharedBlobRealloc(grown, 10 * 1024 * 1024));
+    ASSERT_NE(nullptr, grown);
+    ASSERT_EQ(0x5a, grown[999]);
+    ASSERT_EQ((char)0xa5, grown[1000]);
+    ASSERT_EQ((char)0xa5, grown[3 * 1024 * 1024 - 1]);
+    memset(grown, 0, 10 * 1024 * 1024);
+    ASSERT_NE(-1, IDSharedBlobGetFd(grown));
+
+    IDSharedBlobFree(grown);
+}
+
+TEST(CORE_SHAREDBLOB, Test_alloc_reserve)
+{
+    IDSharedBlobSetReserveFactor(1);
+
+    // Nothing reserved beyond the allocation, except what is asked for this buffer
+    char * ptr = static_cast<char *>(IDSharedBlobAllocReserve(1000, 8 * 1024 * 1024));
+    ASSERT_NE(nullptr, ptr);
+    ptr[0] = 0x5a;
+    char * grown = static_cast<char *>(IDSharedBlobRealloc(ptr, 8 * 1024 * 1024));
+    ASSERT_EQ(ptr, grown);
+    ASSERT_EQ(0x5a, grown[0]);
+    memset(grown, 0, 8 * 1024 * 1024);
+    IDSharedBlobFree(grown);
+
+    IDSharedBlobSetReserveFactor(4);
+}
+
+TEST(CORE_SHAREDBLOB, Test_pool_reserve)
+{
+    IDSharedBlobSetReserveFactor(1);
+    IDSharedBlobSetPoolSize(0, 0);
+    IDSharedBlobSetPoolSize(2, SIZE_MAX);
+
+    // A pooled buffer without the reservation asked for is not reused: it could not grow in place
+    IDSharedBlobFree(IDSharedBlobAlloc(1000));
+    unsigned long hits, misses, hitsBefore, missesBefore;
+    IDSharedBlobPoolStats(&hitsBefore, &missesBefore);
+
+    char * ptr = static_cast<char *>(IDSharedBlobAllocReserve(1000, 8 * 1024 * 1024));
+    ASSERT_NE(nullptr, ptr);
+    IDSharedBlobPoolStats(&hits, &misses);
+    ASSERT_EQ(hitsBefore, hits);
+    ASSERT_EQ(missesBefore + 1, misses);
+
+    char * grown = static_cast<char *>(IDSharedBlobRealloc(ptr, 8 * 1024 * 1024));
+    ASSERT_EQ(ptr, grown);
+    IDSharedBlobFree(grown);
+
+    // One that has it is
+    ptr = static_cast<char *>(IDSharedBlobAllocReserve(1000, 8 * 1024 * 1024));
+    ASSERT_EQ(grown, ptr);
+    IDSharedBlobPoolStats(&hits, &misses);
+    ASSERT_EQ(hitsBefore + 1, hits);
+    IDSharedBlobFree(ptr);
+
+    IDSharedBlobSetPoolSize(0, 0);
+    IDSharedBlobSetReserveFactor(4);
+}
+
+/* FITS file of a 60 MP 16 bits frame written in a growing memory file, the way
+ * cfitsio does it (realloc by 2880 bytes records), for several reservations.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(CORE_SHAREDBLOB, DISABLED_Benchmark_growth)
+{
+    const size_t frameSize = 60000000 * 2;
+    const size_t writeSize = 2880 * 10;
+    std::vector<char> data(writeSize, 0x42);
+
+    struct Setting
+    {
+        const char * name;
+        size_t minimum;
+        unsigned int factor;
+    };
+
+    for (auto setting : { Setting{"no reservation", 0, 1}, Setting{"4 x allocation", 0, 4}, Setting{"full frame", frameSize + 2880 * 3, 1} })
+    {
+        IDSharedBlobSetReserveFactor(setting.factor);
+
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        auto start = std::chrono::steady_clock::now();
+
+        size_t allocated = 2880;
+        char * ptr = static_cast<char *>(IDSharedBlobAllocReserve(allocated, setting.minimum));
+        int moves = 0;
+        for (size_t pos = 0; pos < frameSize; pos += writeSize)
+        {
+            if (pos + writeSize > allocated)
+            {
+                allocated = pos + writeSize;
+                char * grown = static_cast<char *>(IDSharedBlobRealloc(ptr, allocated));
+                ASSERT_NE(nullptr, grown);
+                moves += grown != ptr;
+                ptr = grown;
+            }
+            memcpy(ptr + pos, data.data(), writeSize);
+        }
+
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        getrusage(RUSAGE_SELF, &after);
+        IDSharedBlobFree(ptr);
+
+        printf("%-15s: %7.1f ms, %2d moves, %6ld minor faults\n",
+               setting.name, elapsed, moves, after.ru_minflt - before.ru_minflt);
+    }
+    IDSharedBlobSetReserveFactor(4);
+}
+
+/* Lookup cost with 1k live buffers, from 1 to 8 threads.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(CORE_SHAREDBLOB, DISABLED_Benchmark_lookup)
+{
+    const int bufferCount = 1000;
+    const int lookups = 1000000;
+
+    std::vector<void *> buffers;
+    for (int i = 0; i < bufferCount; i++)
+        buffers.push_back(IDSharedBlobAlloc(1000));
+
+    for (int threadCount : { 1, 2, 4, 8 })
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back([&buffers, t]()
+            {
+                // Not growing: only looks the buffer up
+                for (int i = 0; i < lookups; i++)
+                    IDSharedBlobRealloc(buffers[(i * 7 + t) % bufferCount], 1000);
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%d threads: %6.1f ns/lookup, %6.1f M lookups/s\n",
+               threadCount, elapsed / lookups, 1000.0 * threadCount * lookups / elapsed);
+    }
+
+    for (auto ptr : buffers)
+        IDSharedBlobFree(ptr);
+}
+
+#endif
@@ -0,0 +1,155 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "indistagedpipeline.h"
+
+using namespace std::chrono_literals;
+
+TEST(StagedPipeline, Test_order)
+{
+    INDI::StagedPipeline<std::unique_ptr<int>> pipeline;
+    std::vector<int> done;
+
+    pipeline.addStage("double", [](std::unique_ptr<int> &item)
+    {
+        *item *= 2;
+        return true;
+    });
+    pipeline.addStage("increment", [](std::unique_ptr<int> &item)
+    {
+        *item += 1;
+        return true;
+    });
+    pipeline.setDone([&](std::unique_ptr<int> &item, bool ok, const std::vector<double> &stageMs)
+    {
+        EXPECT_TRUE(ok);
+        EXPECT_EQ(stageMs.size(), 2u);
+        done.push_back(*item);
+    });
+    pipeline.setDepth(3);
+
+    for (int i = 0; i < 100; i++)
+        pipeline.push(std::unique_ptr<int>(new int(i)));
+    pipeline.waitForIdle();
+
+    ASSERT_EQ(done.size(), 100u);
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(done[i], 2 * i + 1);
+}
+
+TEST(StagedPipeline, Test_skip)
+{
+    INDI::StagedPipeline<int> pipeline;
+    std::atomic<int> secondStage {0};
+    std::vector<bool> results;
+
+    pipeline.addStage("filter", [](int &item)
+    {
+        return item % 2 == 0;
+    });
+    pipeline.addStage("count", [&](int &)
+    {
+        secondStage++;
+        return true;
+    });
+    pipeline.setDone([&](int &, bool ok, const std::vector<double> &)
+    {
+        results.push_back(ok);
+    });
+
+    for (int i = 0; i < 10; i++)
+        pipeline.push(i);
+    pipeline.stop();
+
+    EXPECT_EQ(secondStage, 5);
+    ASSERT_EQ(results.size(), 10u);
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(results[i], i % 2 == 0);
+}
+
+TEST(StagedPipeline, Test_backpressure)
+{
+    INDI::StagedPipeline<int> pipeline;
+    std::atomic<size_t> maxInFlight {0};
+
+    pipeline.addStage("slow", [&](int &)
+    {
+        maxInFlight = std::max(maxInFlight.load(), pipeline.inFlight());
+        std::this_thread::sleep_for(10ms);
+        return true;
+    });
+    pipeline.setDepth(2);
+
+    double waited = 0;
+    for (int i = 0; i < 6; i++)
+        waited += pipeline.push(i);
+    pipeline.waitForIdle();
+
+    // Room for two, the producer waited for the other four
+    EXPECT_LE(maxInFlight, 2u);
+    EXPECT_GT(waited, 25);
+    EXPECT_EQ(pipeline.inFlight(), 0u);
+}
+
+TEST(StagedPipeline, Test_overlap)
+{
+    // Three stages of 20 ms each: in a pipeline, 10 items take about 12 x 20 ms instead of 30 x 20 ms
+    INDI::StagedPipeline<int> pipeline;
+    for (auto name : {"encode", "compress", "send"})
+    {
+        pipeline.addStage(name, [](int &)
+        {
+            std::this_thread::sleep_for(20ms);
+            return true;
+        });
+    }
+    pipeline.setDepth(3);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; i++)
+        pipeline.push(i);
+    pipeline.waitForIdle();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("10 items through 3 stages of 20 ms: %.0f ms\n", elapsed);
+    EXPECT_LT(elapsed, 450);
+}
+
+TEST(StagedPipeline, Test_restart)
+{
+    INDI::StagedPipeline<int> pipeline;
+    std::atomic<int> count {0};
+    pipeline.addStage("count", [&](int &)
+    {
+        count++;
+        return true;
+    });
+
+    pipeline.push(1);
+    pipeline.stop();
+    pipeline.push(2);
+    pipeline.stop();
+    pipeline.stop();
+
+    EXPECT_EQ(count, 2);
+}
@@ -0,0 +1,68 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+// Synthetic frames and timing shared by the frame processing tests and their benchmarks
+namespace testframes
+{
+
+// Samples spread over the whole range of T
+template <typename T>
+std::vector<T> uniformFrame(size_t samples, uint32_t seed)
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<uint64_t> value(0, std::numeric_limits<T>::max());
+    std::vector<T> frame(samples);
+    for (auto &v : frame)
+        v = static_cast<T>(value(gen));
+    return frame;
+}
+
+// Sky background: gaussian noise around mean, within the range of T
+template <typename T>
+std::vector<T> noiseFrame(size_t samples, uint32_t seed, double mean, double sigma)
+{
+    std::mt19937 gen(seed);
+    std::normal_distribution<double> noise(mean, sigma);
+    std::vector<T> frame(samples);
+    double top = static_cast<double>(std::numeric_limits<T>::max());
+    for (auto &v : frame)
+        v = static_cast<T>(std::min(top, std::max(0.0, std::round(noise(gen)))));
+    return frame;
+}
+
+// Average time of a call to function in ms, over runs calls after a first one to warm up
+template <typename Function>
+double averageMs(int runs, Function &&function)
+{
+    function();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+        function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+
+}
@@ -0,0 +1,232 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "indiccd.h"
+#include "indilogger.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fitsio.h>
+#include <unistd.h>
+
+// Exposures of a CCD without hardware, uploaded through the pipeline to files
+class PipelineCCD : public INDI::CCD
+{
+    public:
+        static const int WIDTH  = 320;
+        static const int HEIGHT = 240;
+        static const int NATIVE = FORMAT_NATIVE;
+        static const int FITS   = FORMAT_FITS;
+
+        PipelineCCD(int depth, int format, const std::string &directory)
+        {
+            initProperties();
+            SetCCDParams(WIDTH, HEIGHT, 16, 5.2, 5.2);
+            PrimaryCCD.setFrameBufferSize(WIDTH * HEIGHT * 2);
+
+            IUResetSwitch(&UploadSP);
+            UploadS[UPLOAD_LOCAL].s = ISS_ON;
+            IUSaveText(&UploadSettingsT[UPLOAD_DIR], directory.c_str());
+            EncodeFormatSP.reset();
+            EncodeFormatSP[format].setState(ISS_ON);
+
+            setConnected(true);
+            updateProperties();
+
+            double values[] = { static_cast<double>(depth) };
+            char name[] = "DEPTH";
+            char *names[] = { name };
+            ISNewNumber(getDeviceName(), "CCD_UPLOAD_PIPELINE", values, names, 1);
+        }
+
+        ~PipelineCCD() override
+        {
+            disconnect();
+        }
+
+        // Fill the frame with value, as a camera would, then complete the exposure
+        void expose(uint16_t value)
+        {
+            {
+                std::unique_lock<std::mutex> guard(ccdBufferLock);
+                auto frame = reinterpret_cast<uint16_t *>(PrimaryCCD.getFrameBuffer());
+                for (int i = 0; i < WIDTH * HEIGHT; i++)
+                    frame[i] = value;
+            }
+            ExposureComplete(&PrimaryCCD);
+        }
+
+        bool waitForUploads(size_t count)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            return uploaded.wait_for(lock, std::chrono::seconds(10), [&]()
+            {
+                return uploadThreads.size() >= count;
+            });
+        }
+
+        size_t uploads()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return uploadThreads.size();
+        }
+
+        std::vector<std::thread::id> threads()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return uploadThreads;
+        }
+
+        void disconnect()
+        {
+            if (isConnected())
+            {
+                setConnected(false, IPS_IDLE);
+                updateProperties();
+            }
+        }
+
+    protected:
+        const char *getDefaultName() override
+        {
+            return "Pipeline CCD";
+        }
+
+        void UploadComplete(INDI::CCDChip *) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uploadThreads.push_back(std::this_thread::get_id());
+            uploaded.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable uploaded;
+        std::vector<std::thread::id> uploadThreads;
+};
+
+static std::string makeDirectory()
+{
+    std::string pattern = testing::TempDir() + "test_ccd_upload_XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    EXPECT_NE(mkdtemp(path.data()), nullptr);
+    return path.data();
+}
+
+static std::string fileName(const std::string &directory, int index, const char *extension)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/IMAGE_%03d.%s", index, extension);
+    return directory + name;
+}
+
+TEST(CCDUpload, Test_pipelined_native)
+{
+    const std::string directory = makeDirectory();
+    const int exposures = 5;
+    {
+        PipelineCCD ccd(2, PipelineCCD::NATIVE, directory);
+        for (int i = 0; i < exposures; i++)
+        {
+            // The camera fills the buffer again once the pipeline holds a copy, wait for it here
+            ccd.expose(1000 + i);
+            ASSERT_TRUE(ccd.waitForUploads(i + 1)) << "exposure " << i;
+        }
+
+        // Completed from the pipeline, not from the thread that exposed
+        for (auto id : ccd.threads())
+            EXPECT_NE(id, std::this_thread::get_id());
+    }
+
+    for (int i = 0; i < exposures; i++)
+    {
+        std::string name = fileName(directory, i + 1, "bin");
+        FILE *file = fopen(name.c_str(), "rb");
+        ASSERT_NE(file, nullptr) << name;
+        std::vector<uint16_t> frame(PipelineCCD::WIDTH * PipelineCCD::HEIGHT + 1);
+        EXPECT_EQ(fread(frame.data(), 2, frame.size(), file), frame.size() - 1) << name;
+        fclose(file);
+        remove(name.c_str());
+
+        frame.pop_back();
+        EXPECT_EQ(frame, std::vector<uint16_t>(frame.size(), 1000 + i)) << name;
+    }
+    rmdir(directory.c_str());
+}
+
+TEST(CCDUpload, Test_disconnect_drains_fits)
+{
+    const std::string directory = makeDirectory();
+    const int exposures = 6;
+    {
+        PipelineCCD ccd(2, PipelineCCD::FITS, directory);
+
+        // Back to back exposures, uploads overlap the next ones
+        for (int i = 0; i < exposures; i++)
+        {
+            ccd.expose(2000);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        // Every frame in flight is out before the driver is torn down
+        ccd.disconnect();
+        EXPECT_EQ(ccd.uploads(), static_cast<size_t>(exposures));
+    }
+
+    for (int i = 0; i < exposures; i++)
+    {
+        std::string name = fileName(directory, i + 1, "fits");
+        fitsfile *fptr = nullptr;
+        int status = 0, naxis = 0;
+        long naxes[2] = {0, 0};
+        fits_open_file(&fptr, name.c_str(), READONLY, &status);
+        ASSERT_EQ(status, 0) << name;
+        fits_get_img_dim(fptr, &naxis, &status);
+        fits_get_img_size(fptr, 2, naxes, &status);
+        EXPECT_EQ(naxis, 2);
+        EXPECT_EQ(naxes[0], PipelineCCD::WIDTH);
+        EXPECT_EQ(naxes[1], PipelineCCD::HEIGHT);
+
+        std::vector<uint16_t> frame(PipelineCCD::WIDTH * PipelineCCD::HEIGHT);
+        int anynul = 0;
+        fits_read_img(fptr, TUSHORT, 1, frame.size(), nullptr, frame.data(), &anynul, &status);
+        fits_close_file(fptr, &status);
+        EXPECT_EQ(status, 0) << name;
+        EXPECT_EQ(frame, std::vector<uint16_t>(frame.size(), 2000)) << name;
+        remove(name.c_str());
+    }
+    rmdir(directory.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    INDI::Logger::getInstance().configure("", INDI::Logger::file_off,
+                                          INDI::Logger::DBG_ERROR, INDI::Logger::DBG_ERROR);
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,171 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "indiserver/routingindex.h"
+
+struct Record
+{
+    std::string dev;
+    std::string name;
+    Record(const std::string &dev, const std::string &name): dev(dev), name(name) {}
+};
+
+TEST(INDISERVER_ROUTINGINDEX, Test_find)
+{
+    RoutingIndex<Record> index;
+    Record whole("Mount", ""), exact("Mount", "EQUATORIAL_EOD_COORD"), other("CCD", "CCD1");
+
+    index.add(whole.dev, whole.name, 1, &whole);
+    index.add(exact.dev, exact.name, 1, &exact);
+    index.add(other.dev, other.name, 2, &other);
+
+    // Property record has precedence on whole device record
+    ASSERT_EQ(&exact, index.find("Mount", "EQUATORIAL_EOD_COORD", 1));
+    ASSERT_EQ(&whole, index.find("Mount", "TARGET_EOD_COORD", 1));
+    ASSERT_EQ(&whole, index.find("Mount", "", 1));
+    ASSERT_EQ(nullptr, index.find("Mount", "EQUATORIAL_EOD_COORD", 2));
+    ASSERT_EQ(&other, index.find("CCD", "CCD1", 2));
+    ASSERT_EQ(nullptr, index.find("CCD", "CCD2", 2));
+
+    auto entries = index.find("Mount", "EQUATORIAL_EOD_COORD");
+    ASSERT_NE(nullptr, entries);
+    ASSERT_EQ(1u, entries->size());
+    ASSERT_EQ(nullptr, index.find("Focuser", ""));
+}
+
+TEST(INDISERVER_ROUTINGINDEX, Test_match)
+{
+    RoutingIndex<Record> index;
+    Record whole1("Mount", ""), exact1("Mount", "EQUATORIAL_EOD_COORD"), exact2("Mount", "EQUATORIAL_EOD_COORD"),
+           whole3("Mount", "");
+
+    index.add(whole1.dev, whole1.name, 1, &whole1);
+    index.add(exact1.dev, exact1.name, 1, &exact1);
+    index.add(exact2.dev, exact2.name, 2, &exact2);
+    index.add(whole3.dev, whole3.name, 3, &whole3);
+
+    RoutingIndex<Record>::Entries result;
+    index.match("Mount", "EQUATORIAL_EOD_COORD", result);
+    ASSERT_EQ(3u, result.size());
+    ASSERT_EQ(&exact1, result[1]);
+    ASSERT_EQ(&exact2, result[2]);
+    ASSERT_EQ(&whole3, result[3]);
+
+    index.match("Mount", "TELESCOPE_PARK", result);
+    ASSERT_EQ(2u, result.size());
+    ASSERT_EQ(&whole1, result[1]);
+    ASSERT_EQ(&whole3, result[3]);
+
+    index.match("CCD", "CCD1", result);
+    ASSERT_TRUE(result.empty());
+}
+
+TEST(INDISERVER_ROUTINGINDEX, Test_remove)
+{
+    RoutingIndex<Record> index;
+    Record exact1("Mount", "EQUATORIAL_EOD_COORD"), exact2("Mount", "EQUATORIAL_EOD_COORD");
+
+    index.add(exact1.dev, exact1.name, 1, &exact1);
+    index.add(exact2.dev, exact2.name, 2, &exact2);
+
+    index.remove("Mount", "EQUATORIAL_EOD_COORD", 1);
+    ASSERT_EQ(nullptr, index.find("Mount", "EQUATORIAL_EOD_COORD", 1));
+    ASSERT_EQ(&exact2, index.find("Mount", "EQUATORIAL_EOD_COORD", 2));
+
+    index.remove("Mount", "EQUATORIAL_EOD_COORD", 2);
+    ASSERT_EQ(nullptr, index.find("Mount", "EQUATORIAL_EOD_COORD"));
+
+    // Unknown entries are ignored
+    index.remove("Mount", "EQUATORIAL_EOD_COORD", 2);
+    index.remove("CCD", "", 1);
+}
+
+/* Routing cost versus connection count: every connection snoops a few
+ * properties of the devices, then each message is routed either by scanning
+ * every connection's list (as indiserver used to) or through the index.
+ * Run with --gtest_also_run_disabled_tests.
+ */
+TEST(INDISERVER_ROUTINGINDEX, DISABLED_Benchmark_routing)
+{
+    const int devCount = 30;
+    const int propsPerConnection = 16;
+    const int messages = 20000;
+
+    for (int connections : { 4, 16, 64, 256, 1024 })
+    {
+        std::vector<std::list<Record*>> lists(connections);
+        std::list<Record> records;
+        RoutingIndex<Record> index;
+
+        for (int c = 0; c < connections; c++)
+        {
+            for (int p = 0; p < propsPerConnection; p++)
+            {
+                int d = (c * 7 + p) % devCount;
+                records.emplace_back("Device" + std::to_string(d), p == 0 ? "" : "PROP_" + std::to_string(p));
+                lists[c].push_back(&records.back());
+                index.add(records.back().dev, records.back().name, c + 1, &records.back());
+            }
+        }
+
+        std::vector<std::pair<std::string, std::string>> traffic;
+        for (int m = 0; m < 256; m++)
+            traffic.emplace_back("Device" + std::to_string(m % devCount), "PROP_" + std::to_string(m % propsPerConnection));
+
+        size_t linearHits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int m = 0; m < messages; m++)
+        {
+            const auto &msg = traffic[m % traffic.size()];
+            for (auto &list : lists)
+            {
+                for (auto r : list)
+                {
+                    if (r->dev == msg.first && (r->name.empty() || r->name == msg.second))
+                    {
+                        linearHits++;
+                        break;
+                    }
+                }
+            }
+        }
+        auto linear = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        size_t indexHits = 0;
+        RoutingIndex<Record>::Entries result;
+        start = std::chrono::steady_clock::now();
+        for (int m = 0; m < messages; m++)
+        {
+            const auto &msg = traffic[m % traffic.size()];
+            index.match(msg.first, msg.second, result);
+            indexHits += result.size();
+        }
+        auto indexed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        ASSERT_EQ(linearHits, indexHits);
+
+        printf("%5d connections: linear %9.1f ns/msg, indexed %9.1f ns/msg, %.1f receivers/msg\n",
+               connections, linear / messages, indexed / messages, (double)indexHits / messages);
+    }
+}